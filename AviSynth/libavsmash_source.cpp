@@ -134,6 +134,9 @@ LSMASHVideoSource::LSMASHVideoSource
     int                 threads,
     int                 seek_mode,
     uint32_t            forward_seek_threshold,
+    size_t              frame_cache_size,
+    int                 read_ahead,
+    int                 decoder_pool,
     int                 direct_rendering,
     int                 fps_num,
     int                 fps_den,
@@ -149,6 +152,9 @@ LSMASHVideoSource::LSMASHVideoSource
     set_preferred_decoder_names( preferred_decoder_names );
     libavsmash_video_set_seek_mode              ( vdhp, seek_mode );
     libavsmash_video_set_forward_seek_threshold ( vdhp, forward_seek_threshold );
+    libavsmash_video_set_frame_cache_size       ( vdhp, frame_cache_size );
+    libavsmash_video_set_read_ahead             ( vdhp, direct_rendering ? 0 : read_ahead );
+    libavsmash_video_set_decoder_pool           ( vdhp, decoder_pool );
     libavsmash_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names() );
     vohp->vfr2cfr = (fps_num > 0 && fps_den > 0);
     vohp->cfr_num = (uint32_t)fps_num;
@@ -395,19 +401,24 @@ AVSValue __cdecl CreateLSMASHVideoSource( AVSValue args, void *user_data, IScrip
     uint32_t    track_number            = args[1].AsInt( 0 );
     int         threads                 = args[2].AsInt( 0 );
     int         seek_mode               = args[3].AsInt( 0 );
-    uint32_t    forward_seek_threshold  = args[4].AsInt( 10 );
+    int         forward_seek_threshold  = args[4].AsInt( 10 );
     int         direct_rendering        = args[5].AsBool( false ) ? 1 : 0;
     int         fps_num                 = args[6].AsInt( 0 );
     int         fps_den                 = args[7].AsInt( 1 );
     int         stacked_format          = args[8].AsBool( false ) ? 1 : 0;
     enum AVPixelFormat pixel_format     = get_av_output_pixel_format( args[9].AsString( nullptr ) );
     const char *preferred_decoder_names = args[10].AsString( nullptr );
+    int         frame_cache             = args[11].AsInt( 0 );
+    int         read_ahead              = args[12].AsInt( 0 );
+    int         decoder_pool            = args[13].AsBool( false ) ? 1 : 0;
     threads                = threads >= 0 ? threads : 0;
     seek_mode              = CLIP_VALUE( seek_mode, 0, 2 );
-    forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 1, 999 );
+    forward_seek_threshold = forward_seek_threshold < 0 ? 0 : CLIP_VALUE( forward_seek_threshold, 1, 999 );  /* 0: by the measured costs */
     direct_rendering      &= (pixel_format == AV_PIX_FMT_NONE);
-    return new LSMASHVideoSource( source, track_number, threads, seek_mode, forward_seek_threshold,
-                                  direct_rendering, fps_num, fps_den, stacked_format, pixel_format, preferred_decoder_names, env );
+    size_t      frame_cache_size        = (size_t)MAX( frame_cache, 0 ) << 20;
+    read_ahead             = CLIP_VALUE( read_ahead, 0, 32 );
+    return new LSMASHVideoSource( source, track_number, threads, seek_mode, forward_seek_threshold, frame_cache_size, read_ahead,
+                                  decoder_pool, direct_rendering, fps_num, fps_den, stacked_format, pixel_format, preferred_decoder_names, env );
 }
 
 AVSValue __cdecl CreateLSMASHAudioSource( AVSValue args, void *user_data, IScriptEnvironment *env )
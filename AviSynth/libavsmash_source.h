@@ -67,6 +67,9 @@ public:
         int                 threads,
         int                 seek_mode,
         uint32_t            forward_seek_threshold,
+        size_t              frame_cache_size,
+        int                 read_ahead,
+        int                 decoder_pool,
         int                 direct_rendering,
         int                 fps_num,
         int                 fps_den,
@@ -47,7 +47,7 @@ extern "C" __declspec(dllexport) const char * __stdcall AvisynthPluginInit2( ISc
     env->AddFunction
     (
         "LSMASHVideoSource",
-        "[source]s[track]i[threads]i[seek_mode]i[seek_threshold]i[dr]b[fpsnum]i[fpsden]i[stacked]b[format]s[decoder]s",
+        "[source]s[track]i[threads]i[seek_mode]i[seek_threshold]i[dr]b[fpsnum]i[fpsden]i[stacked]b[format]s[decoder]s[frame_cache]i[read_ahead]i[decoder_pool]b",
         CreateLSMASHVideoSource,
         0
     );
@@ -63,7 +63,7 @@ extern "C" __declspec(dllexport) const char * __stdcall AvisynthPluginInit2( ISc
     env->AddFunction
     (
         "LWLibavVideoSource",
-        "[source]s[stream_index]i[threads]i[cache]b[seek_mode]i[seek_threshold]i[dr]b[fpsnum]i[fpsden]i[repeat]b[dominance]i[stacked]b[format]s[decoder]s",
+        "[source]s[stream_index]i[threads]i[cache]b[seek_mode]i[seek_threshold]i[dr]b[fpsnum]i[fpsden]i[repeat]b[dominance]i[stacked]b[format]s[decoder]s[binary_index]b[cache_dir]s[cache_size]i[sparse_index]b[trust_container_index]b[frame_cache]i[read_ahead]i[pipeline_index]b[ranged_index]b[decoder_pool]b",
         CreateLWLibavVideoSource,
         0
     );
@@ -71,7 +71,7 @@ extern "C" __declspec(dllexport) const char * __stdcall AvisynthPluginInit2( ISc
     env->AddFunction
     (
         "LWLibavAudioSource",
-        "[source]s[stream_index]i[cache]b[av_sync]b[layout]s[rate]i[decoder]s",
+        "[source]s[stream_index]i[cache]b[av_sync]b[layout]s[rate]i[decoder]s[binary_index]b[cache_dir]s[cache_size]i[pipeline_index]b[ranged_index]b",
         CreateLWLibavAudioSource,
         0
     );
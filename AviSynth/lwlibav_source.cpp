@@ -76,6 +76,9 @@ LWLibavVideoSource::LWLibavVideoSource
     lwlibav_option_t   *opt,
     int                 seek_mode,
     uint32_t            forward_seek_threshold,
+    size_t              frame_cache_size,
+    int                 read_ahead,
+    int                 decoder_pool,
     int                 direct_rendering,
     int                 stacked_format,
     enum AVPixelFormat  pixel_format,
@@ -90,6 +93,9 @@ LWLibavVideoSource::LWLibavVideoSource
     set_preferred_decoder_names( preferred_decoder_names );
     lwlibav_video_set_seek_mode              ( vdhp, seek_mode );
     lwlibav_video_set_forward_seek_threshold ( vdhp, forward_seek_threshold );
+    lwlibav_video_set_frame_cache_size       ( vdhp, frame_cache_size );
+    lwlibav_video_set_read_ahead             ( vdhp, direct_rendering ? 0 : read_ahead );
+    lwlibav_video_set_decoder_pool           ( vdhp, decoder_pool );
     lwlibav_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names() );
     as_video_output_handler_t *as_vohp = (as_video_output_handler_t *)lw_malloc_zero( sizeof(as_video_output_handler_t) );
     if( !as_vohp )
@@ -272,7 +278,7 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     int         threads                 = args[2].AsInt( 0 );
     int         no_create_index         = args[3].AsBool( true ) ? 0 : 1;
     int         seek_mode               = args[4].AsInt( 0 );
-    uint32_t    forward_seek_threshold  = args[5].AsInt( 10 );
+    int         forward_seek_threshold  = args[5].AsInt( 10 );
     int         direct_rendering        = args[6].AsBool( false ) ? 1 : 0;
     int         fps_num                 = args[7].AsInt( 0 );
     int         fps_den                 = args[8].AsInt( 1 );
@@ -281,6 +287,16 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     int         stacked_format          = args[11].AsBool( false ) ? 1 : 0;
     enum AVPixelFormat pixel_format     = get_av_output_pixel_format( args[12].AsString( NULL ) );
     const char *preferred_decoder_names = args[13].AsString( NULL );
+    int         binary_index            = args[14].AsBool( false ) ? 1 : 0;
+    const char *cache_dir               = args[15].AsString( NULL );
+    int         cache_size              = args[16].AsInt( 1024 );
+    int         sparse_index            = args[17].AsBool( false ) ? 1 : 0;
+    int         trust_container_index   = args[18].AsBool( false ) ? 1 : 0;
+    int         frame_cache             = args[19].AsInt( 0 );
+    int         read_ahead              = args[20].AsInt( 0 );
+    int         pipeline_index          = args[21].AsBool( false ) ? 1 : 0;
+    int         ranged_index            = args[22].AsBool( false ) ? 1 : 0;
+    int         decoder_pool            = args[23].AsBool( false ) ? 1 : 0;
     /* Set LW-Libav options. */
     lwlibav_option_t opt;
     opt.file_path         = source;
@@ -293,13 +309,23 @@ AVSValue __cdecl CreateLWLibavVideoSource( AVSValue args, void *user_data, IScri
     opt.force_audio_index = -1;
     opt.apply_repeat_flag = apply_repeat_flag;
     opt.field_dominance   = CLIP_VALUE( field_dominance, 0, 2 );    /* 0: Obey source flags, 1: TFF, 2: BFF */
+    opt.binary_index      = binary_index;
+    opt.cache_dir         = cache_dir;
+    opt.cache_size        = cache_size >= 0 ? cache_size : 0;
+    opt.sparse_index      = sparse_index;
+    opt.trust_container_index = trust_container_index;
+    opt.pipeline_index    = pipeline_index;
+    opt.ranged_index      = ranged_index;
+    opt.checkpoint_interval = 0;
     opt.vfr2cfr.active    = fps_num > 0 && fps_den > 0 ? 1 : 0;
     opt.vfr2cfr.fps_num   = fps_num;
     opt.vfr2cfr.fps_den   = fps_den;
     seek_mode              = CLIP_VALUE( seek_mode, 0, 2 );
-    forward_seek_threshold = CLIP_VALUE( forward_seek_threshold, 1, 999 );
+    forward_seek_threshold = forward_seek_threshold < 0 ? 0 : CLIP_VALUE( forward_seek_threshold, 1, 999 );  /* 0: by the measured costs */
     direct_rendering      &= (pixel_format == AV_PIX_FMT_NONE);
-    return new LWLibavVideoSource( &opt, seek_mode, forward_seek_threshold,
+    size_t      frame_cache_size        = (size_t)MAX( frame_cache, 0 ) << 20;
+    read_ahead             = CLIP_VALUE( read_ahead, 0, 32 );
+    return new LWLibavVideoSource( &opt, seek_mode, forward_seek_threshold, frame_cache_size, read_ahead, decoder_pool,
                                    direct_rendering, stacked_format, pixel_format, preferred_decoder_names, env );
 }
 
@@ -315,6 +341,11 @@ AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScri
     const char *layout_string           = args[4].AsString( NULL );
     uint32_t    sample_rate             = args[5].AsInt( 0 );
     const char *preferred_decoder_names = args[6].AsString( NULL );
+    int         binary_index            = args[7].AsBool( false ) ? 1 : 0;
+    const char *cache_dir               = args[8].AsString( NULL );
+    int         cache_size              = args[9].AsInt( 1024 );
+    int         pipeline_index          = args[10].AsBool( false ) ? 1 : 0;
+    int         ranged_index            = args[11].AsBool( false ) ? 1 : 0;
     /* Set LW-Libav options. */
     lwlibav_option_t opt;
     opt.file_path         = source;
@@ -327,6 +358,14 @@ AVSValue __cdecl CreateLWLibavAudioSource( AVSValue args, void *user_data, IScri
     opt.force_audio_index = stream_index >= 0 ? stream_index : -1;
     opt.apply_repeat_flag = 0;
     opt.field_dominance   = 0;
+    opt.binary_index      = binary_index;
+    opt.cache_dir         = cache_dir;
+    opt.cache_size        = cache_size >= 0 ? cache_size : 0;
+    opt.sparse_index      = 0;
+    opt.trust_container_index = 0;
+    opt.pipeline_index    = pipeline_index;
+    opt.ranged_index      = ranged_index;
+    opt.checkpoint_interval = 0;
     opt.vfr2cfr.active    = 0;
     opt.vfr2cfr.fps_num   = 0;
     opt.vfr2cfr.fps_den   = 0;
@@ -61,6 +61,9 @@ public:
         lwlibav_option_t   *opt,
         int                 seek_mode,
         uint32_t            forward_seek_threshold,
+        size_t              frame_cache_size,
+        int                 read_ahead,
+        int                 decoder_pool,
         int                 direct_rendering,
         int                 stacked_format,
         enum AVPixelFormat  pixel_format,
@@ -156,6 +156,15 @@ static inline void set_preferred_decoder_names_on_buf
     reader_opt.preferred_decoder_names = lw_tokenize_string( reader_opt.preferred_decoder_names_buf, ',', NULL );
 }
 
+/* The forward threshold is from 1 to 999, or -1 to decide by the measured costs. */
+static inline int clip_forward_seek_threshold
+(
+    int forward_seek_threshold
+)
+{
+    return forward_seek_threshold < 0 ? -1 : CLIP_VALUE( forward_seek_threshold, 1, 999 );
+}
+
 static void get_settings( void )
 {
     FILE *ini = open_settings();
@@ -199,7 +208,7 @@ static void get_settings( void )
         if( !fgets( buf, sizeof(buf), ini ) || sscanf( buf, "forward_threshold=%d", &video_opt->forward_seek_threshold ) != 1 )
             video_opt->forward_seek_threshold = 10;
         else
-            video_opt->forward_seek_threshold = CLIP_VALUE( video_opt->forward_seek_threshold, 1, 999 );
+            video_opt->forward_seek_threshold = clip_forward_seek_threshold( video_opt->forward_seek_threshold );
         /* scaler */
         if( !fgets( buf, sizeof(buf), ini ) || sscanf( buf, "scaler=%d", &video_opt->scaler ) != 1 )
             video_opt->scaler = 0;
@@ -812,8 +821,14 @@ static BOOL CALLBACK dialog_proc
                 {
                     video_opt->forward_seek_threshold = get_int_from_dlg( hwnd, IDC_EDIT_FORWARD_THRESHOLD );
                     if( lpnmud->iDelta )
-                        video_opt->forward_seek_threshold += lpnmud->iDelta > 0 ? -1 : 1;
-                    video_opt->forward_seek_threshold = CLIP_VALUE( video_opt->forward_seek_threshold, 1, 999 );
+                    {
+                        int step = lpnmud->iDelta > 0 ? -1 : 1;
+                        video_opt->forward_seek_threshold += step;
+                        /* Step over 0 between 1 and -1. */
+                        if( video_opt->forward_seek_threshold == 0 )
+                            video_opt->forward_seek_threshold = step;
+                    }
+                    video_opt->forward_seek_threshold = clip_forward_seek_threshold( video_opt->forward_seek_threshold );
                     set_int_to_dlg( hwnd, IDC_EDIT_FORWARD_THRESHOLD, video_opt->forward_seek_threshold );
                 }
             }
@@ -867,7 +882,7 @@ static BOOL CALLBACK dialog_proc
                     fprintf( ini, "seek_mode=%d\n", video_opt->seek_mode );
                     /* forward_seek_threshold */
                     video_opt->forward_seek_threshold = get_int_from_dlg( hwnd, IDC_EDIT_FORWARD_THRESHOLD );
-                    video_opt->forward_seek_threshold = CLIP_VALUE( video_opt->forward_seek_threshold, 1, 999 );
+                    video_opt->forward_seek_threshold = clip_forward_seek_threshold( video_opt->forward_seek_threshold );
                     fprintf( ini, "forward_threshold=%d\n", video_opt->forward_seek_threshold );
                     /* scaler */
                     video_opt->scaler = SendMessage( GetDlgItem( hwnd, IDC_COMBOBOX_SCALER ), CB_GETCURSEL, 0, 0 );
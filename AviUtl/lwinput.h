@@ -76,7 +76,7 @@ typedef enum
 typedef struct
 {
     int seek_mode;
-    int forward_seek_threshold;
+    int forward_seek_threshold;     /* -1 means that the decision is done by the measured costs */
     int scaler;
     int apply_repeat_flag;
     int field_dominance;
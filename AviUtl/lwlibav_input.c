@@ -119,7 +119,7 @@ static int prepare_video_decoding( lsmash_handler_t *h, video_option_t *opt )
     if( !ctx )
         return 0;
     lwlibav_video_set_seek_mode             ( vdhp, opt->seek_mode );
-    lwlibav_video_set_forward_seek_threshold( vdhp, opt->forward_seek_threshold );
+    lwlibav_video_set_forward_seek_threshold( vdhp, opt->forward_seek_threshold < 0 ? 0 : opt->forward_seek_threshold );
     lwlibav_video_output_handler_t *vohp = hp->vohp;
     /* Import AVIndexEntrys. */
     if( lwlibav_import_av_index_entry( (lwlibav_decode_handler_t *)vdhp ) < 0 )
@@ -209,6 +209,14 @@ static void *open_file( char *file_path, reader_option_t *opt )
     lwlibav_opt.force_audio_index = opt->force_audio_index;
     lwlibav_opt.apply_repeat_flag = opt->video_opt.apply_repeat_flag;
     lwlibav_opt.field_dominance   = opt->video_opt.field_dominance;
+    lwlibav_opt.binary_index      = 0;
+    lwlibav_opt.cache_dir         = NULL;   /* LWINDEX_CACHE_DIR environment variable */
+    lwlibav_opt.cache_size        = 1024;
+    lwlibav_opt.sparse_index      = 0;
+    lwlibav_opt.trust_container_index = 0;
+    lwlibav_opt.pipeline_index    = 0;
+    lwlibav_opt.ranged_index      = 0;
+    lwlibav_opt.checkpoint_interval = 0;
     lwlibav_opt.vfr2cfr.active    = opt->video_opt.vfr2cfr.active;
     lwlibav_opt.vfr2cfr.fps_num   = opt->video_opt.vfr2cfr.framerate_num;
     lwlibav_opt.vfr2cfr.fps_den   = opt->video_opt.vfr2cfr.framerate_den;
@@ -0,0 +1,475 @@
+/*****************************************************************************
+ * lwindexer.c
+ *****************************************************************************
+ * Copyright (C) 2013-2015 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license.
+ * However, when distributing its binary file, it will be under LGPL or GPL. */
+
+/* The standalone indexer
+ * This creates the index files of the input files, which are the same ones as the LW-Libav source filters create,
+ * by a pool of jobs each of which indexes a file at a time. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* Libav (LGPL or GPL) */
+#include <libavformat/avformat.h>       /* Demuxer */
+#include <libavcodec/avcodec.h>         /* Decoder */
+
+/* Dummy definitions.
+ * Audio resampler/buffer is NOT used at all in this indexer. */
+typedef void AVAudioResampleContext;
+typedef void audio_samples_t;
+int flush_resampler_buffers( AVAudioResampleContext *avr ){ return 0; }
+int update_resampler_configuration( AVAudioResampleContext *avr,
+                                    uint64_t out_channel_layout, int out_sample_rate, enum AVSampleFormat out_sample_fmt,
+                                    uint64_t  in_channel_layout, int  in_sample_rate, enum AVSampleFormat  in_sample_fmt,
+                                    int *input_planes, int *input_block_align ){ return 0; }
+int resample_audio( AVAudioResampleContext *avr, audio_samples_t *out, audio_samples_t *in ){ return 0; }
+#include "../common/audio_output.h"
+uint64_t output_pcm_samples_from_buffer
+(
+    lw_audio_output_handler_t *aohp,
+    AVFrame                   *frame_buffer,
+    uint8_t                  **output_buffer,
+    enum audio_output_flag    *output_flags
+)
+{
+    return 0;
+}
+
+uint64_t output_pcm_samples_from_packet
+(
+    lw_audio_output_handler_t *aohp,
+    AVCodecContext            *ctx,
+    AVPacket                  *pkt,
+    AVFrame                   *frame_buffer,
+    uint8_t                  **output_buffer,
+    enum audio_output_flag    *output_flags
+)
+{
+    return 0;
+}
+
+void lw_cleanup_audio_output_handler( lw_audio_output_handler_t *aohp ){ }
+
+#include "../common/utils.h"
+#include "../common/osdep.h"
+#include "../common/progress.h"
+#include "../common/video_output.h"
+#include "../common/lwlibav_dec.h"
+#include "../common/lwlibav_video.h"
+#include "../common/lwlibav_audio.h"
+#include "../common/lwindex.h"
+
+#include "config.h"
+
+/* The progress is used only to abort indexing for testing the resumption from checkpoints. */
+struct progress_handler_tag
+{
+    int stop_percent;
+};
+
+typedef struct
+{
+    char    *file_path;
+    int64_t  file_size;
+    int      ret;
+} indexer_job_t;
+
+typedef struct
+{
+    indexer_job_t *jobs;
+    int            number_of_jobs;
+    int            next_job;
+    lw_mutex_t    *mutex;
+    /* options */
+    int            threads;
+    int            binary_index;
+    int            pipeline_index;
+    int            ranged_index;
+    int            checkpoint_interval;
+    int            stop_percent;
+    const char    *cache_dir;
+    int            cache_size;
+    const char    *extension;
+    int            quiet;
+} indexer_t;
+
+static void show_help( void )
+{
+    fprintf( stderr,
+             "L-SMASH Works Indexer r" LSMASHWORKS_REV " " LSMASHWORKS_GIT_HASH "\n"
+             "Usage: lwindexer [options] <input file or directory>...\n"
+             "Options:\n"
+             "  -h, --help               print help (this)\n"
+             "  -j, --jobs <integer>     the number of files indexed at a time [the number of processors]\n"
+             "  -t, --threads <integer>  the number of threads of each decoder, 0 means auto [0]\n"
+             "  -b, --binary-index       create binary index files instead of text ones\n"
+             "  -p, --pipeline           demux, parse and write each file in a pipeline of threads\n"
+             "  -r, --ranged             index byte ranges of each MPEG-TS/PS file in parallel\n"
+             "                           without checkpoints\n"
+             "  -k, --checkpoint <MiB>   the interval of checkpoints while indexing each MPEG-TS/PS file [256]\n"
+             "  -x, --stop <percent>     abort indexing each file at the percent, to test resuming it\n"
+             "                           from the last checkpoint\n"
+             "  -c, --cache-dir <dir>    store index files in the directory instead of next to the input files\n"
+             "  -s, --cache-size <MiB>   the maximum total size of index files in the cache directory,\n"
+             "                           0 means unlimited [1024]\n"
+             "  -e, --ext <suffix>       index only files whose names end with the suffix, e.g. .ts,\n"
+             "                           in the input directories\n"
+             "  -l, --list <file>        read input files, one per line, from the file, or stdin if '-'\n"
+             "  -q, --quiet              print only errors and the summary\n"
+             "The input directories are not searched recursively.\n" );
+}
+
+static void show_log
+(
+    lw_log_handler_t *lhp,
+    lw_log_level      level,
+    const char       *message
+)
+{
+    indexer_t *indexer = (indexer_t *)lhp->priv;
+    lw_mutex_lock( indexer->mutex );
+    fprintf( stderr, "%s\n", message );
+    lw_mutex_unlock( indexer->mutex );
+}
+
+static int add_job
+(
+    indexer_t  *indexer,
+    const char *file_path,
+    int64_t     file_size
+)
+{
+    if( (indexer->number_of_jobs & 255) == 0 )
+    {
+        indexer_job_t *temp = (indexer_job_t *)realloc( indexer->jobs, (indexer->number_of_jobs + 256) * sizeof(indexer_job_t) );
+        if( !temp )
+            return -1;
+        indexer->jobs = temp;
+    }
+    size_t length = strlen( file_path );
+    char *path = (char *)lw_memdup( (void *)file_path, length + 1 );
+    if( !path )
+        return -1;
+    indexer_job_t *job = &indexer->jobs[ indexer->number_of_jobs++ ];
+    job->file_path = path;
+    job->file_size = file_size;
+    job->ret       = -1;
+    return 0;
+}
+
+static void add_directory_entry( void *arg, const char *path, int64_t size, int64_t mtime )
+{
+    /* Skip the index files and the checkpoints of indexing. */
+    if( lw_check_file_extension( path, "lwi" ) == 0 || lw_check_file_extension( path, "ckpt" ) == 0 )
+        return;
+    add_job( (indexer_t *)arg, path, size );
+}
+
+/* Add an input file, or every file in an input directory. */
+static int add_input
+(
+    indexer_t  *indexer,
+    const char *path
+)
+{
+    if( lw_enumerate_files( path, indexer->extension, add_directory_entry, indexer ) == 0 )
+        return 0;
+    /* Not a directory. The size is examined when indexed. */
+    return add_job( indexer, path, -1 );
+}
+
+static int add_input_list
+(
+    indexer_t  *indexer,
+    const char *list_path
+)
+{
+    FILE *list = strcmp( list_path, "-" ) ? lw_fopen( list_path, "r" ) : stdin;
+    if( !list )
+    {
+        fprintf( stderr, "lwindexer: failed to open %s.\n", list_path );
+        return -1;
+    }
+    char line[4096];
+    int  ret = 0;
+    while( ret == 0 && fgets( line, sizeof(line), list ) )
+    {
+        size_t length = strlen( line );
+        while( length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r') )
+            line[ --length ] = '\0';
+        if( length > 0 )
+            ret = add_input( indexer, line );
+    }
+    if( list != stdin )
+        fclose( list );
+    return ret;
+}
+
+static int stop_indexing
+(
+    progress_handler_t *php,
+    const char         *message,
+    int                 percent
+)
+{
+    return percent >= php->stop_percent;
+}
+
+static int index_file
+(
+    indexer_t     *indexer,
+    indexer_job_t *job
+)
+{
+    if( job->file_size < 0 )
+    {
+        FILE *fp = lw_fopen( job->file_path, "rb" );
+        if( fp )
+        {
+            job->file_size = lw_get_file_size( fp );
+            fclose( fp );
+        }
+    }
+    lwlibav_file_handler_t          lwh  = { 0 };
+    lwlibav_video_decode_handler_t *vdhp = lwlibav_video_alloc_decode_handler();
+    lwlibav_video_output_handler_t *vohp = lwlibav_video_alloc_output_handler();
+    lwlibav_audio_decode_handler_t *adhp = lwlibav_audio_alloc_decode_handler();
+    lwlibav_audio_output_handler_t *aohp = lwlibav_audio_alloc_output_handler();
+    int ret = -1;
+    if( vdhp && vohp && adhp && aohp )
+    {
+        lw_log_handler_t lh = { 0 };
+        lh.name     = job->file_path;
+        lh.level    = LW_LOG_FATAL;
+        lh.priv     = indexer;
+        lh.show_log = show_log;
+        lwlibav_option_t opt = { 0 };
+        opt.file_path         = job->file_path;
+        opt.threads           = indexer->threads;
+        opt.av_sync           = 0;
+        opt.no_create_index   = 0;
+        opt.force_video       = 0;
+        opt.force_video_index = -1;
+        opt.force_audio       = 0;
+        opt.force_audio_index = -1;
+        opt.apply_repeat_flag = 0;
+        opt.field_dominance   = 0;
+        opt.binary_index      = indexer->binary_index;
+        opt.cache_dir         = indexer->cache_dir;
+        opt.cache_size        = indexer->cache_size;
+        opt.sparse_index      = 0;
+        opt.trust_container_index = 0;
+        opt.pipeline_index    = indexer->pipeline_index;
+        opt.ranged_index      = indexer->ranged_index;
+        opt.checkpoint_interval = indexer->checkpoint_interval;
+        opt.vfr2cfr.active    = 0;
+        opt.vfr2cfr.fps_num   = 0;
+        opt.vfr2cfr.fps_den   = 1;
+        progress_handler_t   progress = { indexer->stop_percent };
+        progress_indicator_t indicator;
+        indicator.open   = NULL;
+        indicator.update = indexer->stop_percent > 0 ? stop_indexing : NULL;
+        indicator.close  = NULL;
+        ret = lwlibav_construct_index( &lwh, vdhp, vohp, adhp, aohp, &lh, &opt, &indicator, &progress );
+    }
+    lwlibav_video_free_decode_handler( vdhp );
+    lwlibav_video_free_output_handler( vohp );
+    lwlibav_audio_free_decode_handler( adhp );
+    lwlibav_audio_free_output_handler( aohp );
+    lw_free( lwh.file_path );
+    return ret;
+}
+
+static void *indexer_thread( void *arg )
+{
+    indexer_t *indexer = (indexer_t *)arg;
+    while( 1 )
+    {
+        lw_mutex_lock( indexer->mutex );
+        indexer_job_t *job = indexer->next_job < indexer->number_of_jobs ? &indexer->jobs[ indexer->next_job++ ] : NULL;
+        lw_mutex_unlock( indexer->mutex );
+        if( !job )
+            break;
+        int64_t start = lw_get_wall_clock();
+        job->ret = index_file( indexer, job );
+        double elapsed = (lw_get_wall_clock() - start) / 1000000.0;
+        double size    = job->file_size > 0 ? job->file_size / (1024.0 * 1024.0) : 0.0;
+        lw_mutex_lock( indexer->mutex );
+        if( job->ret < 0 )
+            fprintf( stderr, "%s: failed to index.\n", job->file_path );
+        else if( !indexer->quiet )
+            fprintf( stderr, "%s: %.1f MiB in %.3f s, %.1f MiB/s\n",
+                     job->file_path, size, elapsed, elapsed > 0.0 ? size / elapsed : 0.0 );
+        lw_mutex_unlock( indexer->mutex );
+    }
+    return NULL;
+}
+
+static const char *get_option_value
+(
+    int    argc,
+    char **argv,
+    int   *i
+)
+{
+    if( *i + 1 >= argc )
+    {
+        fprintf( stderr, "lwindexer: %s requires a value.\n", argv[*i] );
+        return NULL;
+    }
+    return argv[ ++(*i) ];
+}
+
+int main( int argc, char **argv )
+{
+    indexer_t indexer = { 0 };
+    indexer.cache_size = 1024;
+    indexer.extension  = "";
+    int number_of_threads = lw_get_cpu_count();
+    int ret = 1;
+    if( argc < 2 )
+    {
+        show_help();
+        return 1;
+    }
+    indexer.mutex = lw_mutex_create();
+    if( !indexer.mutex )
+        return 1;
+    for( int i = 1; i < argc; i++ )
+    {
+        const char *arg   = argv[i];
+        const char *value = NULL;
+        if( !strcmp( arg, "-h" ) || !strcmp( arg, "--help" ) )
+        {
+            show_help();
+            ret = 0;
+            goto end;
+        }
+        else if( !strcmp( arg, "-b" ) || !strcmp( arg, "--binary-index" ) )
+            indexer.binary_index = 1;
+        else if( !strcmp( arg, "-p" ) || !strcmp( arg, "--pipeline" ) )
+            indexer.pipeline_index = 1;
+        else if( !strcmp( arg, "-r" ) || !strcmp( arg, "--ranged" ) )
+            indexer.ranged_index = 1;
+        else if( !strcmp( arg, "-q" ) || !strcmp( arg, "--quiet" ) )
+            indexer.quiet = 1;
+        else if( !strcmp( arg, "-j" ) || !strcmp( arg, "--jobs" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            number_of_threads = atoi( value );
+        }
+        else if( !strcmp( arg, "-t" ) || !strcmp( arg, "--threads" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            indexer.threads = MAX( atoi( value ), 0 );
+        }
+        else if( !strcmp( arg, "-k" ) || !strcmp( arg, "--checkpoint" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            indexer.checkpoint_interval = MAX( atoi( value ), 0 );
+        }
+        else if( !strcmp( arg, "-x" ) || !strcmp( arg, "--stop" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            indexer.stop_percent = CLIP_VALUE( atoi( value ), 0, 100 );
+        }
+        else if( !strcmp( arg, "-c" ) || !strcmp( arg, "--cache-dir" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            indexer.cache_dir = value;
+        }
+        else if( !strcmp( arg, "-s" ) || !strcmp( arg, "--cache-size" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            indexer.cache_size = MAX( atoi( value ), 0 );
+        }
+        else if( !strcmp( arg, "-e" ) || !strcmp( arg, "--ext" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                goto end;
+            indexer.extension = value;
+        }
+        else if( !strcmp( arg, "-l" ) || !strcmp( arg, "--list" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) || add_input_list( &indexer, value ) < 0 )
+                goto end;
+        }
+        else if( arg[0] == '-' && arg[1] != '\0' )
+        {
+            fprintf( stderr, "lwindexer: unknown option %s.\n", arg );
+            goto end;
+        }
+        else if( add_input( &indexer, arg ) < 0 )
+        {
+            fprintf( stderr, "lwindexer: failed to add %s.\n", arg );
+            goto end;
+        }
+    }
+    if( indexer.number_of_jobs == 0 )
+    {
+        fprintf( stderr, "lwindexer: no input file.\n" );
+        goto end;
+    }
+    /* Register the demuxers and the decoders here since registering them is not thread-safe. */
+    av_register_all();
+    avcodec_register_all();
+    number_of_threads = MAX( MIN( number_of_threads, indexer.number_of_jobs ), 1 );
+    lw_thread_t **threads = (lw_thread_t **)lw_malloc_zero( number_of_threads * sizeof(lw_thread_t *) );
+    if( !threads )
+        goto end;
+    int64_t start = lw_get_wall_clock();
+    for( int i = 0; i < number_of_threads; i++ )
+        threads[i] = lw_thread_create( indexer_thread, &indexer );
+    /* Index on this thread too if no thread is available. */
+    if( !threads[0] )
+        indexer_thread( &indexer );
+    for( int i = 0; i < number_of_threads; i++ )
+        lw_thread_join( threads[i] );
+    lw_free( threads );
+    double  elapsed    = (lw_get_wall_clock() - start) / 1000000.0;
+    int64_t total_size = 0;
+    int     failed     = 0;
+    for( int i = 0; i < indexer.number_of_jobs; i++ )
+        if( indexer.jobs[i].ret < 0 )
+            ++failed;
+        else if( indexer.jobs[i].file_size > 0 )
+            total_size += indexer.jobs[i].file_size;
+    fprintf( stderr, "%d files indexed, %d failed, %.1f MiB in %.3f s, %.1f MiB/s with %d jobs\n",
+             indexer.number_of_jobs - failed, failed, total_size / (1024.0 * 1024.0), elapsed,
+             elapsed > 0.0 ? total_size / (1024.0 * 1024.0) / elapsed : 0.0, number_of_threads );
+    int64_t peak_memory = lw_get_peak_memory_usage();
+    if( peak_memory >= 0 )
+        fprintf( stderr, "peak memory %.1f MiB\n", peak_memory / (1024.0 * 1024.0) );
+    ret = failed ? 2 : 0;
+end:
+    for( int i = 0; i < indexer.number_of_jobs; i++ )
+        lw_free( indexer.jobs[i].file_path );
+    lw_free( indexer.jobs );
+    lw_mutex_destroy( indexer.mutex );
+    return ret;
+}
@@ -0,0 +1,40 @@
+#!/bin/bash
+
+#----------------------------------------------------------------------------------------------
+#  Benchmarks of the LW-Libav source
+#
+#  Usage: bench.sh <lwbench> [<mode>...]
+#    Run all modes of lwbench if no mode is given.
+#    The samples are generated by ffmpeg in a temporary directory, 60 seconds long by default.
+#    Set LWBENCH_SECONDS to change the duration of the samples.
+#    Set LWTEST_SAMPLES to a directory to add the MPEG-TS/PS files in it to the samples.
+#    Set LWBENCH_OPTIONS to pass options to lwbench, e.g. "-n 20".
+#----------------------------------------------------------------------------------------------
+
+LWBENCH="$1"
+shift
+if [ -z "$LWBENCH" ] || [ ! -x "$LWBENCH" ]; then
+    echo "usage: $0 <lwbench> [<mode>...]"
+    exit 1
+fi
+FFMPEG="${FFMPEG:-ffmpeg}"
+command -v "$FFMPEG" > /dev/null || { echo "error: ffmpeg is required to generate the samples."; exit 1; }
+
+WORKDIR="$(mktemp -d "${TMPDIR:-/tmp}/lwbench.XXXXXX")" || exit 1
+trap 'rm -rf "$WORKDIR"' EXIT
+SAMPLES="$WORKDIR/samples"
+mkdir -p "$SAMPLES"
+
+. "$(dirname "$0")/samples.sh"
+
+ALL_MODES="open sort seek trace read scan"
+MODES="${*:-$ALL_MODES}"
+
+SAMPLE_SECONDS="${LWBENCH_SECONDS:-60}" generate_samples || { echo "error: failed to generate the samples."; exit 1; }
+
+ret=0
+for mode in $MODES; do
+    echo "-- $mode"
+    "$LWBENCH" $mode $LWBENCH_OPTIONS -w "$WORKDIR/$mode" "$SAMPLES"/* || ret=1
+done
+exit $ret
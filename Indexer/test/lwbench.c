@@ -0,0 +1,1235 @@
+/*****************************************************************************
+ * lwbench.c
+ *****************************************************************************
+ * Copyright (C) 2013-2015 L-SMASH Works project
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *****************************************************************************/
+
+/* This file is available under an ISC license.
+ * However, when distributing its binary file, it will be under LGPL or GPL. */
+
+/* The benchmark of the LW-Libav source
+ * This measures the stages of the LW-Libav source, which the source filters go through, on the input files
+ * and prints the elapsed times. */
+
+#define NO_PROGRESS_HANDLER
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+/* Libav (LGPL or GPL) */
+#include <libavformat/avformat.h>       /* Demuxer */
+#include <libavcodec/avcodec.h>         /* Decoder */
+#include <libswscale/swscale.h>         /* Colorspace converter */
+#include <libavutil/pixdesc.h>
+#include <libavutil/imgutils.h>
+
+/* Dummy definitions.
+ * Audio resampler/buffer is NOT used at all in this benchmark. */
+typedef void AVAudioResampleContext;
+typedef void audio_samples_t;
+int flush_resampler_buffers( AVAudioResampleContext *avr ){ return 0; }
+int update_resampler_configuration( AVAudioResampleContext *avr,
+                                    uint64_t out_channel_layout, int out_sample_rate, enum AVSampleFormat out_sample_fmt,
+                                    uint64_t  in_channel_layout, int  in_sample_rate, enum AVSampleFormat  in_sample_fmt,
+                                    int *input_planes, int *input_block_align ){ return 0; }
+int resample_audio( AVAudioResampleContext *avr, audio_samples_t *out, audio_samples_t *in ){ return 0; }
+#include "../../common/audio_output.h"
+uint64_t output_pcm_samples_from_buffer
+(
+    lw_audio_output_handler_t *aohp,
+    AVFrame                   *frame_buffer,
+    uint8_t                  **output_buffer,
+    enum audio_output_flag    *output_flags
+)
+{
+    return 0;
+}
+
+uint64_t output_pcm_samples_from_packet
+(
+    lw_audio_output_handler_t *aohp,
+    AVCodecContext            *ctx,
+    AVPacket                  *pkt,
+    AVFrame                   *frame_buffer,
+    uint8_t                  **output_buffer,
+    enum audio_output_flag    *output_flags
+)
+{
+    return 0;
+}
+
+void lw_cleanup_audio_output_handler( lw_audio_output_handler_t *aohp ){ }
+
+#include "../../common/utils.h"
+#include "../../common/osdep.h"
+#include "../../common/progress.h"
+#include "../../common/video_output.h"
+#include "../../common/decode.h"
+#include "../../common/lwlibav_dec.h"
+#include "../../common/lwlibav_video.h"
+#include "../../common/lwlibav_audio.h"
+#include "../../common/lwindex.h"
+#include "../../common/lwlibav_video_internal.h"
+
+typedef struct
+{
+    int         repeat;
+    int         threads;
+    int         read_ahead;
+    int         decoders;
+    const char *work_dir;
+} bench_option_t;
+
+typedef struct
+{
+    lwlibav_file_handler_t          lwh;
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    lwlibav_audio_decode_handler_t *adhp;
+    lwlibav_audio_output_handler_t *aohp;
+    lw_log_handler_t                lh;
+} bench_source_t;
+
+typedef struct
+{
+    const char *name;
+    const char *description;
+    int         needs_input;
+    int (*run)( bench_option_t *, const char * );
+} bench_mode_t;
+
+static void show_log
+(
+    lw_log_handler_t *lhp,
+    lw_log_level      level,
+    const char       *message
+)
+{
+    fprintf( stderr, "%s: %s\n", lhp->name, message );
+}
+
+static double get_elapsed_ms
+(
+    int64_t start
+)
+{
+    return (lw_get_wall_clock() - start) / 1000.0;
+}
+
+static int compare_time
+(
+    const void *a,
+    const void *b
+)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/* Print the minimum, the median and the mean of the times in milliseconds. */
+static void print_times
+(
+    const char *name,
+    const char *label,
+    double     *times,
+    int         count
+)
+{
+    double sum = 0.0;
+    for( int i = 0; i < count; i++ )
+        sum += times[i];
+    qsort( times, count, sizeof(double), compare_time );
+    printf( "%s: %-24s min %10.3f ms, median %10.3f ms, mean %10.3f ms (%d runs)\n",
+            name, label, times[0], times[count / 2], sum / count, count );
+}
+
+static void close_source
+(
+    bench_source_t *source
+)
+{
+    lwlibav_video_free_decode_handler_ptr( &source->vdhp );
+    lwlibav_video_free_output_handler_ptr( &source->vohp );
+    lwlibav_audio_free_decode_handler_ptr( &source->adhp );
+    lwlibav_audio_free_output_handler_ptr( &source->aohp );
+    lw_freep( &source->lwh.file_path );
+}
+
+/* Construct the index of the input file in the cache directory, that is, create the index file
+ * or load the one created before. */
+static int open_source
+(
+    bench_source_t *source,
+    bench_option_t *option,
+    const char     *file_path,
+    const char     *cache_dir,
+    int             binary_index
+)
+{
+    memset( source, 0, sizeof(bench_source_t) );
+    source->vdhp = lwlibav_video_alloc_decode_handler();
+    source->vohp = lwlibav_video_alloc_output_handler();
+    source->adhp = lwlibav_audio_alloc_decode_handler();
+    source->aohp = lwlibav_audio_alloc_output_handler();
+    if( !source->vdhp || !source->vohp || !source->adhp || !source->aohp )
+        goto fail;
+    source->lh.name     = file_path;
+    source->lh.level    = LW_LOG_FATAL;
+    source->lh.priv     = source;
+    source->lh.show_log = show_log;
+    lwlibav_option_t opt = { 0 };
+    opt.file_path         = file_path;
+    opt.threads           = option->threads;
+    opt.av_sync           = 0;
+    opt.no_create_index   = 0;
+    opt.force_video       = 0;
+    opt.force_video_index = -1;
+    opt.force_audio       = 0;
+    opt.force_audio_index = -1;
+    opt.apply_repeat_flag = 0;
+    opt.field_dominance   = 0;
+    opt.binary_index      = binary_index;
+    opt.cache_dir         = cache_dir;
+    opt.cache_size        = 0;
+    opt.sparse_index      = 0;
+    opt.trust_container_index = 0;
+    opt.pipeline_index    = 0;
+    opt.ranged_index      = 0;
+    opt.checkpoint_interval = 0;
+    opt.vfr2cfr.active    = 0;
+    opt.vfr2cfr.fps_num   = 0;
+    opt.vfr2cfr.fps_den   = 1;
+    progress_indicator_t indicator;
+    indicator.open   = NULL;
+    indicator.update = NULL;
+    indicator.close  = NULL;
+    if( lwlibav_construct_index( &source->lwh, source->vdhp, source->vohp, source->adhp, source->aohp,
+                                 &source->lh, &opt, &indicator, NULL ) < 0 )
+        goto fail;
+    return 0;
+fail:
+    close_source( source );
+    return -1;
+}
+
+static char *get_work_path
+(
+    bench_option_t *option,
+    const char     *name
+)
+{
+    size_t length = strlen( option->work_dir ) + strlen( name ) + 2;
+    char *path = (char *)lw_malloc_zero( length );
+    if( path )
+        snprintf( path, length, "%s/%s", option->work_dir, name );
+    return path;
+}
+
+static void add_index_file_size
+(
+    void       *arg,
+    const char *path,
+    int64_t     size,
+    int64_t     mtime
+)
+{
+    *(int64_t *)arg += size;
+}
+
+/* The size of the index file and the latency to open the input file with it, for the text index file, the binary one
+ * of the fixed-size frame records written before packing them and the binary one of the packed frame records.
+ * The index files are created by the first run, which is not counted. */
+static int bench_open
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    static const char *index_names [3] = { "text", "binary-fixed", "binary" };
+    static const int   binary_index[3] = { 0, 2, 1 };
+    double *times = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    if( !times )
+        return -1;
+    int ret = 0;
+    for( int k = 0; k < 3 && ret == 0; k++ )
+    {
+        char *cache_dir = get_work_path( option, index_names[k] );
+        if( !cache_dir )
+        {
+            ret = -1;
+            break;
+        }
+        bench_source_t source;
+        for( int i = -1; i < option->repeat; i++ )
+        {
+            int64_t start = lw_get_wall_clock();
+            if( open_source( &source, option, file_path, cache_dir, binary_index[k] ) < 0 )
+            {
+                ret = -1;
+                break;
+            }
+            if( i >= 0 )
+                times[i] = get_elapsed_ms( start );
+            close_source( &source );
+        }
+        if( ret == 0 )
+        {
+            char label[64];
+            snprintf( label, sizeof(label), "open (%s index)", index_names[k] );
+            print_times( file_path, label, times, option->repeat );
+            int64_t size = 0;
+            lw_enumerate_files( cache_dir, ".lwi", add_index_file_size, &size );
+            snprintf( label, sizeof(label), "size (%s index)", index_names[k] );
+            printf( "%s: %-24s %10" PRId64 " bytes\n", file_path, label, size );
+        }
+        lw_free( cache_dir );
+    }
+    lw_free( times );
+    return ret;
+}
+
+#define SEEK_THRESHOLD      10
+#define SEEK_REQUEST_COUNT  10     /* per run */
+
+/* Select the video stream and open its decoder as the source filters do.
+ * If use_pool is 0, the decoder pool is discarded so that the decoder is opened and closed in place at every seek.
+ * If forward_seek_threshold is 0, whether to seek or not is decided by the measured costs. */
+static int select_video_track
+(
+    bench_source_t *source,
+    bench_option_t *option,
+    int             use_pool,
+    uint32_t        forward_seek_threshold
+)
+{
+    lwlibav_video_decode_handler_t *vdhp = source->vdhp;
+    lwlibav_video_set_decoder_pool          ( vdhp, use_pool );
+    lwlibav_video_set_seek_mode             ( vdhp, 0 );
+    lwlibav_video_set_forward_seek_threshold( vdhp, forward_seek_threshold );
+    return lwlibav_video_get_desired_track( source->lwh.file_path, vdhp, option->threads );
+}
+
+/* Hand over the index to the demuxer and find the first valid frame, after which frames can be requested. */
+static int start_video_decoding
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp
+)
+{
+    if( lwlibav_import_av_index_entry( (lwlibav_decode_handler_t *)vdhp ) < 0 )
+        return -1;
+    lwlibav_video_set_initial_input_format( vdhp );
+    AVCodecContext *ctx = lwlibav_video_get_codec_context( vdhp );
+    vohp->scaler.scaler_flags        = SWS_FAST_BILINEAR;
+    vohp->scaler.output_pixel_format = ctx->pix_fmt;
+    if( lwlibav_video_find_first_valid_frame( vdhp ) < 0 )
+        return -1;
+    lwlibav_video_force_seek( vdhp );
+    return 0;
+}
+
+/* Set up decoding of the video stream as the source filters do. */
+static int prepare_video_decoding
+(
+    bench_source_t *source,
+    bench_option_t *option,
+    int             use_pool,
+    uint32_t        forward_seek_threshold
+)
+{
+    if( select_video_track( source, option, use_pool, forward_seek_threshold ) < 0 )
+        return -1;
+    return start_video_decoding( source->vdhp, source->vohp );
+}
+
+/* The latency of the requests for random frames, each of which needs a seek unless the input file is too short,
+ * with the decoder pool and without it. The requests are the same for both. */
+static int bench_seek
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    static const char *pool_names[2] = { "seek (no decoder pool)", "seek (decoder pool)" };
+    int     count = option->repeat * SEEK_REQUEST_COUNT;
+    double *times = (double *)lw_malloc_zero( count * sizeof(double) );
+    char   *cache_dir = get_work_path( option, "seek" );
+    int     ret = -1;
+    if( !times || !cache_dir )
+        goto end;
+    for( int use_pool = 0; use_pool < 2; use_pool++ )
+    {
+        bench_source_t source;
+        if( open_source( &source, option, file_path, cache_dir, 1 ) < 0 )
+            goto end;
+        if( source.vdhp->stream_index < 0 || source.vohp->frame_count < 2 || prepare_video_decoding( &source, option, use_pool, SEEK_THRESHOLD ) < 0 )
+        {
+            close_source( &source );
+            goto end;
+        }
+        uint32_t frame_count = source.vohp->frame_count;
+        uint32_t last        = 1;
+        uint64_t seed        = UINT64_C(0x9e3779b97f4a7c15);
+        /* Decode the first frame so that the decoder is set up before the measurement as the first request does. */
+        lwlibav_video_get_frame( source.vdhp, source.vohp, 1 );
+        for( int i = 0; i < count; i++ )
+        {
+            /* Skip the frames reached by decoding forward from the last one without a seek. */
+            uint32_t frame_number;
+            do
+            {
+                seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+                frame_number = 1 + (uint32_t)((seed >> 33) % frame_count);
+            } while( frame_count > 4 * SEEK_THRESHOLD && frame_number >= last && frame_number <= last + SEEK_THRESHOLD );
+            last = frame_number;
+            int64_t start = lw_get_wall_clock();
+            if( lwlibav_video_get_frame( source.vdhp, source.vohp, frame_number ) < 0 )
+            {
+                close_source( &source );
+                goto end;
+            }
+            times[i] = get_elapsed_ms( start );
+        }
+        close_source( &source );
+        print_times( file_path, pool_names[use_pool], times, count );
+    }
+    ret = 0;
+end:
+    lw_free( times );
+    lw_free( cache_dir );
+    return ret;
+}
+
+#define TRACE_REQUEST_COUNT 300    /* per run */
+
+static uint32_t get_random_number
+(
+    uint64_t *seed,
+    uint32_t  range
+)
+{
+    *seed = *seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+    return (uint32_t)((*seed >> 33) % range);
+}
+
+/* Get the next frame of the trace of requests.
+ *   sequential : every frame in order, as encoding
+ *   random     : random frames, as sampling thumbnails
+ *   mixed      : mostly in order, with forward jumps of various lengths, random jumps and steps back, as editing */
+static uint32_t get_trace_frame
+(
+    int       trace,
+    uint32_t  last,
+    uint32_t  frame_count,
+    uint64_t *seed
+)
+{
+    int64_t next;
+    if( trace == 0 )
+        next = last + 1;
+    else if( trace == 1 )
+        next = 1 + get_random_number( seed, frame_count );
+    else
+    {
+        uint32_t r = get_random_number( seed, 100 );
+        if( r < 70 )
+            next = last + 1;
+        else if( r < 85 )
+            next = last + 2 + get_random_number( seed, 60 );
+        else if( r < 95 )
+            next = 1 + get_random_number( seed, frame_count );
+        else
+            next = (int64_t)last - 1 - get_random_number( seed, 30 );
+    }
+    if( next < 1 || next > frame_count )
+        next = 1 + (next > frame_count ? (uint32_t)(next - 1) % frame_count : 0);
+    return (uint32_t)next;
+}
+
+/* The time to serve the traces of requests with the fixed seek threshold and with the decision by the measured costs.
+ * The source is opened again for each run so that the costs are measured from scratch. */
+static int bench_trace
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    static const char *trace_names[3]     = { "sequential", "random", "mixed" };
+    static const char *threshold_names[2] = { "fixed threshold 10", "measured costs" };
+    double *times     = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    char   *cache_dir = get_work_path( option, "trace" );
+    int     ret       = -1;
+    if( !times || !cache_dir )
+        goto end;
+    for( int trace = 0; trace < 3; trace++ )
+        for( int adaptive = 0; adaptive < 2; adaptive++ )
+        {
+            for( int run = 0; run < option->repeat; run++ )
+            {
+                bench_source_t source;
+                if( open_source( &source, option, file_path, cache_dir, 1 ) < 0 )
+                    goto end;
+                if( source.vdhp->stream_index < 0 || source.vohp->frame_count < 2
+                 || prepare_video_decoding( &source, option, 1, adaptive ? 0 : SEEK_THRESHOLD ) < 0 )
+                {
+                    close_source( &source );
+                    goto end;
+                }
+                uint32_t frame_count = source.vohp->frame_count;
+                uint32_t frame_number = 1;
+                uint64_t seed         = UINT64_C(0x9e3779b97f4a7c15) + run;
+                int64_t  start        = lw_get_wall_clock();
+                for( int i = 0; i < TRACE_REQUEST_COUNT; i++ )
+                {
+                    if( lwlibav_video_get_frame( source.vdhp, source.vohp, frame_number ) < 0 )
+                    {
+                        close_source( &source );
+                        goto end;
+                    }
+                    frame_number = get_trace_frame( trace, frame_number, frame_count, &seed );
+                }
+                times[run] = get_elapsed_ms( start );
+                close_source( &source );
+            }
+            char label[64];
+            snprintf( label, sizeof(label), "%s (%s)", trace_names[trace], threshold_names[adaptive] );
+            print_times( file_path, label, times, option->repeat );
+        }
+    ret = 0;
+end:
+    lw_free( times );
+    lw_free( cache_dir );
+    return ret;
+}
+
+static int compare_info_pts
+(
+    const video_frame_info_t *a,
+    const video_frame_info_t *b
+)
+{
+    int64_t diff = (int64_t)(a->pts - b->pts);
+    return diff > 0 ? 1 : (diff == 0 ? 0 : -1);
+}
+
+/* Set the frame records in decoding order with the presentation timestamps of the pattern.
+ *   reordered : an anchor frame followed by two B-frames displayed before it, as the usual MPEG-2 and H.264 streams
+ *   shuffled  : randomly shuffled timestamps, as broken streams */
+static void set_sort_records
+(
+    video_frame_info_t *info,
+    uint32_t            count,
+    int                 shuffled
+)
+{
+    memset( info, 0, count * sizeof(video_frame_info_t) );
+    for( uint32_t i = 0; i < count; i++ )
+    {
+        uint32_t order = i;
+        if( !shuffled && i > 0 )
+        {
+            /* Decoding order: I0 P3 B1 B2 P6 B4 B5 ... */
+            uint32_t phase = (i - 1) % 3;
+            order = phase == 0 ? MIN( i + 2, count - 1 ) : i - 1;
+        }
+        info[i].pts           = (int64_t)order * 1001;
+        info[i].dts           = (int64_t)i * 1001;
+        info[i].sample_number = i + 1;
+    }
+    if( shuffled )
+    {
+        uint64_t seed = UINT64_C(0x9e3779b97f4a7c15);
+        for( uint32_t i = count - 1; i > 0; i-- )
+        {
+            seed = seed * UINT64_C(6364136223846793005) + UINT64_C(1442695040888963407);
+            uint32_t j = (uint32_t)((seed >> 33) % (i + 1));
+            int64_t pts = info[i].pts;
+            info[i].pts = info[j].pts;
+            info[j].pts = pts;
+        }
+    }
+}
+
+/* Sorting the frame records into presentation order by the sort of the indexer and by qsort(). */
+static int bench_sort
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    static const uint32_t counts[3]  = { 10000, 100000, 1000000 };
+    static const char    *pattern[2] = { "reordered", "shuffled" };
+    double *times[2] = { NULL };
+    video_frame_info_t *source = (video_frame_info_t *)malloc( counts[2] * sizeof(video_frame_info_t) );
+    video_frame_info_t *sorted = (video_frame_info_t *)malloc( counts[2] * sizeof(video_frame_info_t) );
+    video_frame_info_t *info   = (video_frame_info_t *)malloc( counts[2] * sizeof(video_frame_info_t) );
+    times[0] = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    times[1] = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    int ret = -1;
+    if( !source || !sorted || !info || !times[0] || !times[1] )
+        goto end;
+    for( int shuffled = 0; shuffled < 2; shuffled++ )
+        for( int c = 0; c < 3; c++ )
+        {
+            uint32_t count = counts[c];
+            size_t   size  = count * sizeof(video_frame_info_t);
+            set_sort_records( source, count, shuffled );
+            memcpy( sorted, source, size );
+            qsort( sorted, count, sizeof(video_frame_info_t), (int(*)( const void *, const void * ))compare_info_pts );
+            for( int i = 0; i < option->repeat; i++ )
+            {
+                memcpy( info, source, size );
+                int64_t start = lw_get_wall_clock();
+                if( lw_sort_records( info, count, sizeof(video_frame_info_t), offsetof( video_frame_info_t, pts ) ) < 0 )
+                    goto end;
+                times[0][i] = get_elapsed_ms( start );
+                if( memcmp( info, sorted, size ) )
+                {
+                    fprintf( stderr, "lwbench: the sort of the indexer disagrees with qsort.\n" );
+                    goto end;
+                }
+                memcpy( info, source, size );
+                start = lw_get_wall_clock();
+                qsort( info, count, sizeof(video_frame_info_t), (int(*)( const void *, const void * ))compare_info_pts );
+                times[1][i] = get_elapsed_ms( start );
+            }
+            char name[64];
+            snprintf( name, sizeof(name), "%s %7" PRIu32 " frames", pattern[shuffled], count );
+            print_times( name, "sort (indexer)", times[0], option->repeat );
+            print_times( name, "sort (qsort)", times[1], option->repeat );
+        }
+    ret = 0;
+end:
+    free( source );
+    free( sorted );
+    free( info );
+    lw_free( times[0] );
+    lw_free( times[1] );
+    return ret;
+}
+
+/* The time to read every frame in order with the read-ahead disabled and enabled.
+ * Each frame is converted into BGRA after the request as the source filters do, which the read-ahead overlaps. */
+static int bench_read
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    double  *times     = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    char    *cache_dir = get_work_path( option, "read" );
+    uint8_t *data[4]   = { NULL };
+    int      linesize[4];
+    int      ret       = -1;
+    if( !times || !cache_dir )
+        goto end;
+    int depths[2] = { 0, option->read_ahead };
+    for( int d = 0; d < 2; d++ )
+    {
+        uint32_t frame_count = 0;
+        for( int run = 0; run < option->repeat; run++ )
+        {
+            bench_source_t source;
+            if( open_source( &source, option, file_path, cache_dir, 1 ) < 0 )
+                goto end;
+            if( source.vdhp->stream_index < 0 || prepare_video_decoding( &source, option, 1, SEEK_THRESHOLD ) < 0 )
+            {
+                close_source( &source );
+                goto end;
+            }
+            lwlibav_video_set_read_ahead( source.vdhp, depths[d] );
+            source.vohp->scaler.output_pixel_format = AV_PIX_FMT_BGRA;
+            AVFrame *frame = lwlibav_video_get_frame_buffer( source.vdhp );
+            frame_count = source.vohp->frame_count;
+            int64_t start = lw_get_wall_clock();
+            for( uint32_t i = 1; i <= frame_count; i++ )
+            {
+                if( lwlibav_video_get_frame( source.vdhp, source.vohp, i ) < 0 )
+                {
+                    close_source( &source );
+                    goto end;
+                }
+                if( !data[0] && av_image_alloc( data, linesize, frame->width, frame->height, AV_PIX_FMT_BGRA, 32 ) < 0 )
+                {
+                    close_source( &source );
+                    goto end;
+                }
+                sws_scale( source.vohp->scaler.sws_ctx, (const uint8_t * const *)frame->data, frame->linesize,
+                           0, frame->height, data, linesize );
+            }
+            times[run] = get_elapsed_ms( start );
+            close_source( &source );
+            av_freep( &data[0] );
+        }
+        char label[64];
+        snprintf( label, sizeof(label), "read %" PRIu32 " frames (read-ahead %d)", frame_count, depths[d] );
+        print_times( file_path, label, times, option->repeat );
+    }
+    ret = 0;
+end:
+    av_freep( &data[0] );
+    lw_free( times );
+    lw_free( cache_dir );
+    return ret;
+}
+
+/* FNV-1a hash of the visible bytes of the planes of the frame */
+static uint64_t hash_frame
+(
+    const AVFrame *frame
+)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get( (enum AVPixelFormat)frame->format );
+    if( !desc )
+        return 0;
+    for( int plane = 0; plane < 4 && frame->data[plane]; plane++ )
+    {
+        int width  = av_image_get_linesize( (enum AVPixelFormat)frame->format, frame->width, plane );
+        int height = (plane == 1 || plane == 2) ? -((-frame->height) >> desc->log2_chroma_h) : frame->height;
+        for( int y = 0; y < height; y++ )
+        {
+            const uint8_t *p = frame->data[plane] + y * frame->linesize[plane];
+            for( int x = 0; x < width; x++ )
+                hash = (hash ^ p[x]) * UINT64_C(0x100000001b3);
+        }
+    }
+    return hash;
+}
+
+/* Make the requests of the frames mode: every frame in order up to 90, steps back, forward jumps, a repeated request
+ * and the last frames. Return the number of the requests. */
+static int get_frame_requests
+(
+    uint32_t *requests,
+    uint32_t  frame_count
+)
+{
+    /* { the first frame, the number of the frames in order } */
+    const uint32_t runs[][2] =
+    {
+        { 1, 90 },
+        { 20, 30 },
+        { frame_count / 2, 30 },
+        { 10, 5 },
+        { 14, 1 },
+        { frame_count / 3, 1 },
+        { frame_count / 3 + 40, 20 },
+        { frame_count > 20 ? frame_count - 20 : 1, 20 }
+    };
+    int count = 0;
+    for( size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++ )
+        for( uint32_t j = 0; j < runs[i][1]; j++ )
+            requests[count++] = CLIP_VALUE( runs[i][0] + j, 1, frame_count );
+    return count;
+}
+
+#define FRAME_REQUEST_MAX_COUNT 256
+#define MAX_DECODER_COUNT       16      /* the same as LWLibavSource of VapourSynth */
+
+typedef struct
+{
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    uint32_t                        position;   /* the last frame requested to this decoder */
+    int                             busy;
+} frame_decoder_t;
+
+typedef struct
+{
+    int      width;
+    int      height;
+    int      format;
+    uint64_t hash;
+} frame_result_t;
+
+/* The requests of the frames mode served by one or more decoders on as many threads */
+typedef struct
+{
+    frame_decoder_t decoders[MAX_DECODER_COUNT];
+    int             decoder_count;
+    uint32_t        requests[FRAME_REQUEST_MAX_COUNT];
+    frame_result_t  results [FRAME_REQUEST_MAX_COUNT];
+    int             request_count;
+    int             next_request;
+    int             failed_request;             /* the earliest failed request, or -1 */
+    lw_mutex_t     *mutex;                      /* NULL if served on the caller thread by a single decoder */
+    lw_cond_t      *cond;
+} frame_requester_t;
+
+/* Pick up the idle decoder which reaches the requested frame the earliest, as LWLibavSource of VapourSynth does:
+ * a decoder positioned before the frame only has to decode forward, while the others have to seek.
+ * Wait until any decoder becomes idle if all are busy. The mutex must be locked. */
+static frame_decoder_t *acquire_frame_decoder
+(
+    frame_requester_t *requester,
+    uint32_t           frame_number
+)
+{
+    while( 1 )
+    {
+        frame_decoder_t *decoder  = NULL;
+        uint64_t         min_cost = UINT64_MAX;
+        for( int i = 0; i < requester->decoder_count; i++ )
+        {
+            frame_decoder_t *candidate = &requester->decoders[i];
+            if( candidate->busy )
+                continue;
+            uint64_t cost = candidate->position <= frame_number
+                          ? frame_number - candidate->position
+                          : ((uint64_t)1 << 32) + candidate->position - frame_number;
+            if( cost < min_cost )
+            {
+                decoder  = candidate;
+                min_cost = cost;
+            }
+        }
+        if( decoder )
+        {
+            decoder->busy = 1;
+            return decoder;
+        }
+        lw_cond_wait( requester->cond, requester->mutex );
+    }
+}
+
+/* Serve the requests in order of their arrival until all are served or any fails.
+ * With multiple threads, the requests are completed out of order, so the results are stored by the request. */
+static void *serve_frame_requests
+(
+    void *arg
+)
+{
+    frame_requester_t *requester = (frame_requester_t *)arg;
+    lw_mutex_t        *mutex     = requester->mutex;
+    while( 1 )
+    {
+        if( mutex )
+            lw_mutex_lock( mutex );
+        if( requester->next_request >= requester->request_count || requester->failed_request >= 0 )
+        {
+            if( mutex )
+                lw_mutex_unlock( mutex );
+            break;
+        }
+        int              i            = requester->next_request++;
+        uint32_t         frame_number = requester->requests[i];
+        frame_decoder_t *decoder      = mutex ? acquire_frame_decoder( requester, frame_number ) : &requester->decoders[0];
+        if( mutex )
+            lw_mutex_unlock( mutex );
+        int ret = lwlibav_video_get_frame( decoder->vdhp, decoder->vohp, frame_number );
+        if( ret >= 0 )
+        {
+            AVFrame *frame = lwlibav_video_get_frame_buffer( decoder->vdhp );
+            requester->results[i].width  = frame->width;
+            requester->results[i].height = frame->height;
+            requester->results[i].format = frame->format;
+            requester->results[i].hash   = hash_frame( frame );
+        }
+        if( mutex )
+            lw_mutex_lock( mutex );
+        decoder->position = frame_number;
+        decoder->busy     = 0;
+        if( ret < 0 && (requester->failed_request < 0 || i < requester->failed_request) )
+            requester->failed_request = i;
+        if( mutex )
+        {
+            lw_cond_broadcast( requester->cond );
+            lw_mutex_unlock( mutex );
+        }
+        else if( ret < 0 )
+            break;
+    }
+    return NULL;
+}
+
+/* Set up a decoder which decodes the stream of the source independently of it.
+ * This must be called after the video track is selected and before the decoding of the source is started. */
+static int duplicate_frame_decoder
+(
+    bench_source_t  *source,
+    bench_option_t  *option,
+    frame_decoder_t *decoder
+)
+{
+    lwlibav_video_output_handler_t *vohp = source->vohp;
+    decoder->vohp = lwlibav_video_alloc_output_handler();
+    if( !decoder->vohp )
+        return -1;
+    decoder->vohp->vfr2cfr              = vohp->vfr2cfr;
+    decoder->vohp->cfr_num              = vohp->cfr_num;
+    decoder->vohp->cfr_den              = vohp->cfr_den;
+    decoder->vohp->repeat_control       = vohp->repeat_control;
+    decoder->vohp->repeat_correction_ts = vohp->repeat_correction_ts;
+    decoder->vohp->frame_count          = vohp->frame_count;
+    decoder->vohp->frame_order_count    = vohp->frame_order_count;
+    if( vohp->frame_order_list )
+    {
+        /* The list may be terminated by a zeroed entry beyond the last frame. */
+        lw_video_frame_order_t *order_list = (lw_video_frame_order_t *)lw_malloc_zero( (vohp->frame_order_count + 2) * sizeof(lw_video_frame_order_t) );
+        if( !order_list )
+            return -1;
+        memcpy( order_list, vohp->frame_order_list, (vohp->frame_order_count + 1) * sizeof(lw_video_frame_order_t) );
+        decoder->vohp->frame_order_list = order_list;
+    }
+    decoder->vdhp = lwlibav_video_duplicate_decode_handler( source->vdhp, source->lwh.file_path, option->threads );
+    return decoder->vdhp ? 0 : -1;
+}
+
+/* Print the hash of the frame for each of the requests in order, steps back and jumps forward.
+ * With -d, the requests are served in parallel by as many independent decoders as threads, each request
+ * by the decoder closest before the frame, and the hashes are printed in order of the requests.
+ * This is not a benchmark but a check: the outputs of the same input file must be the same for any setting. */
+static int bench_frames
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    char *cache_dir = get_work_path( option, "frames" );
+    if( !cache_dir )
+        return -1;
+    frame_requester_t *requester = (frame_requester_t *)lw_malloc_zero( sizeof(frame_requester_t) );
+    if( !requester )
+    {
+        lw_free( cache_dir );
+        return -1;
+    }
+    bench_source_t source;
+    int ret = open_source( &source, option, file_path, cache_dir, 1 );
+    lw_free( cache_dir );
+    if( ret < 0 )
+    {
+        lw_free( requester );
+        return -1;
+    }
+    ret = -1;
+    lw_thread_t *threads[MAX_DECODER_COUNT] = { NULL };
+    if( source.vdhp->stream_index < 0 || select_video_track( &source, option, 1, SEEK_THRESHOLD ) < 0 )
+        goto end;
+    /* Duplicate the decoders before the index of the source is handed over to the demuxer. */
+    requester->decoders[0].vdhp = source.vdhp;
+    requester->decoders[0].vohp = source.vohp;
+    requester->decoder_count    = 1;
+    for( int i = 1; i < option->decoders; i++ )
+    {
+        /* Count it before setting up so that whatever is allocated is freed on failure. */
+        ++ requester->decoder_count;
+        if( duplicate_frame_decoder( &source, option, &requester->decoders[i] ) < 0 )
+            goto end;
+    }
+    for( int i = 0; i < requester->decoder_count; i++ )
+    {
+        frame_decoder_t *decoder = &requester->decoders[i];
+        if( start_video_decoding( decoder->vdhp, decoder->vohp ) < 0 )
+            goto end;
+        lwlibav_video_set_read_ahead( decoder->vdhp, option->read_ahead );
+    }
+    requester->request_count  = get_frame_requests( requester->requests, source.vohp->frame_count );
+    requester->failed_request = -1;
+    if( requester->decoder_count > 1 )
+    {
+        requester->mutex = lw_mutex_create();
+        requester->cond  = lw_cond_create();
+        if( !requester->mutex || !requester->cond )
+            goto end;
+        /* The caller thread serves too. Even if some threads are not created, the others serve all the requests. */
+        for( int i = 1; i < requester->decoder_count; i++ )
+            if( !(threads[i] = lw_thread_create( serve_frame_requests, requester )) )
+                break;
+    }
+    serve_frame_requests( requester );
+    for( int i = 1; i < requester->decoder_count; i++ )
+        if( threads[i] )
+            lw_thread_join( threads[i] );
+    int served = requester->failed_request < 0 ? requester->request_count : requester->failed_request;
+    for( int i = 0; i < served; i++ )
+    {
+        frame_result_t *result = &requester->results[i];
+        printf( "%s: frame %6" PRIu32 " %dx%d %s %016" PRIx64 "\n", file_path, requester->requests[i],
+                result->width, result->height, av_get_pix_fmt_name( (enum AVPixelFormat)result->format ), result->hash );
+    }
+    if( served < requester->request_count )
+    {
+        fprintf( stderr, "%s: failed to get the frame %" PRIu32 ".\n", file_path, requester->requests[served] );
+        goto end;
+    }
+    ret = 0;
+end:
+    /* The duplicated decoders borrow the index of the source, so free them first. */
+    for( int i = 1; i < requester->decoder_count; i++ )
+    {
+        lwlibav_video_free_decode_handler( requester->decoders[i].vdhp );
+        lwlibav_video_free_output_handler( requester->decoders[i].vohp );
+    }
+    close_source( &source );
+    lw_cond_destroy( requester->cond );
+    lw_mutex_destroy( requester->mutex );
+    lw_free( requester );
+    return ret;
+}
+
+#define SCAN_FRAME_COUNT    4000000
+#define SCAN_GOP_LENGTH     15
+#define SCAN_REQUEST_COUNT  1000000     /* per run */
+
+/* The layout of the frame records which seeking scans, that is, video_frame_info_t without the fields
+ * read only for the frames fed to the decoder or output. */
+typedef struct
+{
+    int64_t  pts;
+    int64_t  dts;
+    int64_t  file_offset;
+    uint32_t sample_number;
+    uint8_t  flags;
+} scan_seek_record_t;
+
+/* Walk from the random accessible point to the requested frame by DTS and file offset as correct_current_frame_number()
+ * does after a seek, and return the number of the visited records. */
+static uint64_t scan_frame_records
+(
+    const video_frame_info_t *info,
+    uint64_t                 *seed
+)
+{
+    uint64_t visited = 0;
+    for( int i = 0; i < SCAN_REQUEST_COUNT; i++ )
+    {
+        uint32_t goal = 1 + get_random_number( seed, SCAN_FRAME_COUNT );
+        uint32_t rap  = goal - (goal - 1) % SCAN_GOP_LENGTH;
+        uint32_t j    = rap;
+        while( !(info[j].flags & LW_VFRAME_FLAG_KEY) )
+            --j;
+        while( info[j].dts != info[goal].dts && info[j].file_offset != info[goal].file_offset )
+            ++j;
+        visited += j - rap + 1;
+    }
+    return visited;
+}
+
+static uint64_t scan_seek_records
+(
+    const scan_seek_record_t *info,
+    uint64_t                 *seed
+)
+{
+    uint64_t visited = 0;
+    for( int i = 0; i < SCAN_REQUEST_COUNT; i++ )
+    {
+        uint32_t goal = 1 + get_random_number( seed, SCAN_FRAME_COUNT );
+        uint32_t rap  = goal - (goal - 1) % SCAN_GOP_LENGTH;
+        uint32_t j    = rap;
+        while( !(info[j].flags & LW_VFRAME_FLAG_KEY) )
+            --j;
+        while( info[j].dts != info[goal].dts && info[j].file_offset != info[goal].file_offset )
+            ++j;
+        visited += j - rap + 1;
+    }
+    return visited;
+}
+
+/* Scanning the frame records after seeks in the layout of the decode handler, video_frame_info_t, and in the layout
+ * of the records which seeking scans only, without input. This tells whether splitting the frame list pays off. */
+static int bench_scan
+(
+    bench_option_t *option,
+    const char     *file_path
+)
+{
+    size_t count = (size_t)SCAN_FRAME_COUNT + 1;
+    video_frame_info_t *frame_info  = (video_frame_info_t *)lw_malloc_zero( count * sizeof(video_frame_info_t) );
+    scan_seek_record_t *seek_record = (scan_seek_record_t *)lw_malloc_zero( count * sizeof(scan_seek_record_t) );
+    double *times[2] = { NULL };
+    times[0] = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    times[1] = (double *)lw_malloc_zero( option->repeat * sizeof(double) );
+    int ret = -1;
+    if( !frame_info || !seek_record || !times[0] || !times[1] )
+        goto end;
+    for( uint32_t i = 1; i < count; i++ )
+    {
+        frame_info[i].pts           = (int64_t)i * 1001;
+        frame_info[i].dts           = (int64_t)i * 1001 - 2002;
+        frame_info[i].file_offset   = (int64_t)i * 18800;
+        frame_info[i].sample_number = i;
+        frame_info[i].flags         = (i - 1) % SCAN_GOP_LENGTH ? 0 : LW_VFRAME_FLAG_KEY;
+        seek_record[i].pts           = frame_info[i].pts;
+        seek_record[i].dts           = frame_info[i].dts;
+        seek_record[i].file_offset   = frame_info[i].file_offset;
+        seek_record[i].sample_number = frame_info[i].sample_number;
+        seek_record[i].flags         = frame_info[i].flags;
+    }
+    for( int i = 0; i < option->repeat; i++ )
+    {
+        uint64_t seed[2] = { UINT64_C(0x9e3779b97f4a7c15) + i, UINT64_C(0x9e3779b97f4a7c15) + i };
+        int64_t start = lw_get_wall_clock();
+        uint64_t visited = scan_frame_records( frame_info, &seed[0] );
+        times[0][i] = get_elapsed_ms( start );
+        start = lw_get_wall_clock();
+        if( scan_seek_records( seek_record, &seed[1] ) != visited )
+        {
+            fprintf( stderr, "lwbench: the scans of the two layouts disagree.\n" );
+            goto end;
+        }
+        times[1][i] = get_elapsed_ms( start );
+    }
+    char name[64];
+    snprintf( name, sizeof(name), "%d frames, %d requests", SCAN_FRAME_COUNT, SCAN_REQUEST_COUNT );
+    print_times( name, "scan (frame records)", times[0], option->repeat );
+    print_times( name, "scan (seek records)", times[1], option->repeat );
+    ret = 0;
+end:
+    lw_free( frame_info );
+    lw_free( seek_record );
+    lw_free( times[0] );
+    lw_free( times[1] );
+    return ret;
+}
+
+static const bench_mode_t modes[] =
+{
+    { "open", "the size of the text, the fixed and the packed binary index file and the latency to open with it", 1, bench_open },
+    { "sort", "sorting frame records into presentation order by the indexer and qsort, no input", 0, bench_sort },
+    { "seek", "the latency of random frame requests with and without the decoder pool", 1, bench_seek },
+    { "trace", "the time to serve traces of frame requests with the fixed and the adaptive seek threshold", 1, bench_trace },
+    { "read", "the time to read every frame in order without and with the read-ahead", 1, bench_read },
+    { "frames", "the hashes of the frames requested in order, back and forward, as a check, not a benchmark", 1, bench_frames },
+    { "scan", "scanning frame records after seeks in the layout of the decoder and of the seek fields, no input", 0, bench_scan },
+    { NULL, NULL, 0, NULL }
+};
+
+static void show_help( void )
+{
+    fprintf( stderr,
+             "Usage: lwbench <mode> [options] <input file>...\n"
+             "Options:\n"
+             "  -n, --repeat <integer>      the number of runs of each measurement [10]\n"
+             "  -t, --threads <integer>     the number of threads of each decoder, 0 means auto [0]\n"
+             "  -a, --read-ahead <integer>  the depth of the read-ahead of the read and frames modes [8]\n"
+             "  -d, --decoders <integer>    the number of decoders serving the requests in parallel in the frames mode [1]\n"
+             "  -w, --work-dir <dir>        the directory to store the index files [lwbench.tmp]\n"
+             "Modes:\n" );
+    for( int i = 0; modes[i].name; i++ )
+        fprintf( stderr, "  %-8s %s\n", modes[i].name, modes[i].description );
+}
+
+static const char *get_option_value
+(
+    int    argc,
+    char **argv,
+    int   *i
+)
+{
+    if( *i + 1 >= argc )
+    {
+        fprintf( stderr, "lwbench: %s requires a value.\n", argv[*i] );
+        return NULL;
+    }
+    return argv[ ++(*i) ];
+}
+
+int main( int argc, char **argv )
+{
+    bench_option_t option = { 0 };
+    option.repeat     = 10;
+    option.read_ahead = 8;
+    option.decoders   = 1;
+    option.work_dir   = "lwbench.tmp";
+    if( argc < 2 )
+    {
+        show_help();
+        return 1;
+    }
+    const bench_mode_t *mode = NULL;
+    for( int i = 0; modes[i].name && !mode; i++ )
+        if( !strcmp( argv[1], modes[i].name ) )
+            mode = &modes[i];
+    if( !mode )
+    {
+        fprintf( stderr, "lwbench: unknown mode %s.\n", argv[1] );
+        show_help();
+        return 1;
+    }
+    int first_input = argc;
+    for( int i = 2; i < argc; i++ )
+    {
+        const char *arg   = argv[i];
+        const char *value = NULL;
+        if( !strcmp( arg, "-n" ) || !strcmp( arg, "--repeat" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                return 1;
+            option.repeat = MAX( atoi( value ), 1 );
+        }
+        else if( !strcmp( arg, "-t" ) || !strcmp( arg, "--threads" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                return 1;
+            option.threads = MAX( atoi( value ), 0 );
+        }
+        else if( !strcmp( arg, "-a" ) || !strcmp( arg, "--read-ahead" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                return 1;
+            option.read_ahead = CLIP_VALUE( atoi( value ), 0, 32 );
+        }
+        else if( !strcmp( arg, "-d" ) || !strcmp( arg, "--decoders" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                return 1;
+            option.decoders = CLIP_VALUE( atoi( value ), 1, MAX_DECODER_COUNT );
+        }
+        else if( !strcmp( arg, "-w" ) || !strcmp( arg, "--work-dir" ) )
+        {
+            if( !(value = get_option_value( argc, argv, &i )) )
+                return 1;
+            option.work_dir = value;
+        }
+        else if( arg[0] == '-' && arg[1] != '\0' )
+        {
+            fprintf( stderr, "lwbench: unknown option %s.\n", arg );
+            return 1;
+        }
+        else
+        {
+            first_input = i;
+            break;
+        }
+    }
+    if( !mode->needs_input )
+        return mode->run( &option, NULL ) < 0 ? 2 : 0;
+    if( first_input == argc )
+    {
+        fprintf( stderr, "lwbench: no input file.\n" );
+        return 1;
+    }
+    if( lw_make_directory( option.work_dir ) < 0 )
+    {
+        fprintf( stderr, "lwbench: failed to create %s.\n", option.work_dir );
+        return 1;
+    }
+    av_register_all();
+    avcodec_register_all();
+    int failed = 0;
+    for( int i = first_input; i < argc; i++ )
+        if( mode->run( &option, argv[i] ) < 0 )
+        {
+            fprintf( stderr, "%s: failed to measure.\n", argv[i] );
+            ++failed;
+        }
+    return failed ? 2 : 0;
+}
@@ -0,0 +1,334 @@
+#!/bin/bash
+
+#----------------------------------------------------------------------------------------------
+#  Tests of the standalone indexer
+#
+#  Usage: run.sh <lwindexer> [<test>...]
+#    Run all tests if no test is given.
+#    The samples are generated by ffmpeg in a temporary directory.
+#    Set LWTEST_SAMPLES to a directory to add the MPEG-TS/PS files in it (*.ts, *.m2ts, *.mts,
+#    *.mpg, *.vob), e.g. real broadcast captures, to the samples.
+#    Set LWTEST_KEEP=1 to keep the temporary directory.
+#    The tests of decoding use lwbench, which is looked for next to lwindexer unless LWBENCH is set.
+#----------------------------------------------------------------------------------------------
+
+LWINDEXER="$1"
+shift
+if [ -z "$LWINDEXER" ] || [ ! -x "$LWINDEXER" ]; then
+    echo "usage: $0 <lwindexer> [<test>...]"
+    exit 1
+fi
+LWINDEXER="$(cd "$(dirname "$LWINDEXER")"; pwd)/$(basename "$LWINDEXER")"
+LWBENCH="${LWBENCH:-$(dirname "$LWINDEXER")/lwbench}"
+test -x "$LWBENCH" && LWBENCH="$(cd "$(dirname "$LWBENCH")"; pwd)/$(basename "$LWBENCH")"
+FFMPEG="${FFMPEG:-ffmpeg}"
+command -v "$FFMPEG" > /dev/null || { echo "error: ffmpeg is required to generate the samples."; exit 1; }
+
+WORKDIR="$(mktemp -d "${TMPDIR:-/tmp}/lwtest.XXXXXX")" || exit 1
+test -n "$LWTEST_KEEP" || trap 'rm -rf "$WORKDIR"' EXIT
+SAMPLES="$WORKDIR/samples"
+mkdir -p "$SAMPLES"
+
+. "$(dirname "$0")/samples.sh"
+
+FAILED=0
+
+#-- func --------------------------------------------------------------------------------------
+pass()
+{
+    echo "PASS: $1"
+}
+
+fail()
+{
+    echo "FAIL: $1"
+    FAILED=$((FAILED + 1))
+}
+
+# The index file without the lines depending on the path and the modification time of the input file.
+lwi_body()
+{
+    grep -av -e '^<InputFilePath>' -e '^<InputFileStatus>' "$1"
+}
+
+# Compare two index files and show the first differences if any.
+same_index()
+{
+    if cmp -s <(lwi_body "$1") <(lwi_body "$2"); then
+        return 0
+    fi
+    diff <(lwi_body "$1") <(lwi_body "$2") | head -n 10
+    return 1
+}
+
+# Index files in a directory of its own so that an existing index file is not reused.
+# Usage: index <dir> <input file> [<lwindexer options>...]
+index()
+{
+    local dir="$1" src="$2"
+    shift 2
+    rm -rf "$dir"
+    mkdir -p "$dir"
+    cp "$src" "$dir/"
+    "$LWINDEXER" -q "$@" "$dir/$(basename "$src")" || return 1
+    test -f "$dir/$(basename "$src").lwi"
+}
+
+# Print the hashes of the frames requested in order, back and forward by lwbench.
+# Usage: frame_hashes <work dir> <input file> [<lwbench options>...]
+frame_hashes()
+{
+    local dir="$1" src="$2"
+    shift 2
+    "$LWBENCH" frames -w "$dir" "$@" "$src"
+}
+
+#-- tests -------------------------------------------------------------------------------------
+# The index file extended after growth of the input file in two steps must be the same as
+# the index file created from the whole input file.
+test_growing()
+{
+    for sample in "$SAMPLES"/*; do
+        local name="growing: $(basename "$sample")"
+        local size=$(stat -L -c %s "$sample")
+        local unit=$(cut_unit "$sample")
+        local first=$(( size / 3 / unit * unit ))
+        local second=$(( size * 2 / 3 / unit * unit ))
+        local grow="$WORKDIR/growing/grow/$(basename "$sample")"
+        rm -rf "$WORKDIR/growing"
+        mkdir -p "$WORKDIR/growing/grow"
+        head -c $first "$sample" > "$grow"
+        if ! "$LWINDEXER" -q "$grow"; then
+            fail "$name (indexing the first part)"
+            continue
+        fi
+        head -c $second "$sample" | tail -c +$(( first + 1 )) >> "$grow"
+        "$LWINDEXER" -q "$grow" || { fail "$name (extending to the second part)"; continue; }
+        tail -c +$(( second + 1 )) "$sample" >> "$grow"
+        local start=$(now)
+        "$LWINDEXER" -q "$grow" || { fail "$name (extending to the whole)"; continue; }
+        local extend_time=$(elapsed $start $(now))
+        start=$(now)
+        index "$WORKDIR/growing/whole" "$sample" || { fail "$name (indexing the whole)"; continue; }
+        local whole_time=$(elapsed $start $(now))
+        if same_index "$grow.lwi" "$WORKDIR/growing/whole/$(basename "$sample").lwi"; then
+            pass "$name (extended in ${extend_time}s, indexed from scratch in ${whole_time}s)"
+        else
+            fail "$name"
+        fi
+    done
+}
+
+# The index file created by the pipeline must be the same as the one created on a single thread.
+# The pipeline runs with at least one worker whatever the number of processors, so this is always compared.
+test_pipeline()
+{
+    for sample in "$SAMPLES"/*; do
+        local name="pipeline: $(basename "$sample")"
+        index "$WORKDIR/pipeline/single" "$sample"    || { fail "$name (indexing on a single thread)"; continue; }
+        index "$WORKDIR/pipeline/multi"  "$sample" -p || { fail "$name (indexing by the pipeline)"; continue; }
+        if same_index "$WORKDIR/pipeline/single/$(basename "$sample").lwi" "$WORKDIR/pipeline/multi/$(basename "$sample").lwi"; then
+            pass "$name"
+        else
+            fail "$name"
+        fi
+    done
+}
+
+# The index file created by indexing byte ranges in parallel must be the same as the one created sequentially.
+# The generated samples are too small to be split, so larger ones are generated.
+test_ranged()
+{
+    local large="$WORKDIR/large"
+    test -d "$large" || generate_large_samples "$large" || { fail "ranged (generating the large samples)"; return; }
+    test $(nproc 2> /dev/null || echo 1) -ge 2 || echo "note: byte ranges are not indexed in parallel on this machine with a single processor."
+    for sample in "$large"/*; do
+        local name="ranged: $(basename "$sample")"
+        test $(stat -L -c %s "$sample") -ge $(( 128 * 1024 * 1024 )) || name="$name (not split, smaller than 128 MiB)"
+        local start=$(now)
+        index "$WORKDIR/ranged/sequential" "$sample"    || { fail "$name (indexing sequentially)"; continue; }
+        local sequential_time=$(elapsed $start $(now))
+        start=$(now)
+        index "$WORKDIR/ranged/parallel"   "$sample" -r || { fail "$name (indexing byte ranges)"; continue; }
+        local ranged_time=$(elapsed $start $(now))
+        if same_index "$WORKDIR/ranged/sequential/$(basename "$sample").lwi" "$WORKDIR/ranged/parallel/$(basename "$sample").lwi"; then
+            pass "$name (sequentially in ${sequential_time}s, by byte ranges in ${ranged_time}s)"
+        else
+            fail "$name"
+        fi
+    done
+    rm -rf "$WORKDIR/ranged"
+}
+
+# The index file created by resuming indexing aborted halfway must be the same as the one created at once.
+test_resume()
+{
+    for sample in "$SAMPLES"/*; do
+        local name="resume: $(basename "$sample")"
+        local dir="$WORKDIR/resume/aborted"
+        local src="$dir/$(basename "$sample")"
+        index "$dir" "$sample" -k 1 -x 50 && { fail "$name (indexing was not aborted)"; continue; }
+        test -f "$src.ckpt" || { fail "$name (no checkpoint is left)"; continue; }
+        local start=$(now)
+        "$LWINDEXER" -q -k 1 "$src" || { fail "$name (resuming indexing)"; continue; }
+        local resume_time=$(elapsed $start $(now))
+        test ! -f "$src.ckpt" || { fail "$name (the checkpoint is left after resuming)"; continue; }
+        index "$WORKDIR/resume/whole" "$sample" || { fail "$name (indexing at once)"; continue; }
+        if same_index "$src.lwi" "$WORKDIR/resume/whole/$(basename "$sample").lwi"; then
+            pass "$name (resumed in ${resume_time}s)"
+        else
+            fail "$name"
+        fi
+    done
+    rm -rf "$WORKDIR/resume"
+}
+
+# The index file must be reused while the sample is unchanged, even if only its modification time is updated,
+# and be re-created once the sample is modified.
+test_stale()
+{
+    for sample in "$SAMPLES"/*; do
+        local name="stale: $(basename "$sample")"
+        local dir="$WORKDIR/stale/reused"
+        local src="$dir/$(basename "$sample")"
+        index "$dir" "$sample" || { fail "$name (indexing)"; continue; }
+        local stamp=$(stat -c %y "$src.lwi")
+        sleep 1
+        "$LWINDEXER" -q "$src" || { fail "$name (indexing the unchanged sample)"; continue; }
+        test "$(stat -c %y "$src.lwi")" = "$stamp" || { fail "$name (re-indexed although unchanged)"; continue; }
+        touch "$src"
+        "$LWINDEXER" -q "$src" || { fail "$name (indexing the touched sample)"; continue; }
+        test "$(stat -c %y "$src.lwi")" = "$stamp" || { fail "$name (re-indexed although only touched)"; continue; }
+        # Overwrite the last packet, which the sampled fingerprint covers, keeping the size.
+        local size=$(stat -c %s "$src")
+        local unit=$(cut_unit "$src")
+        dd if=/dev/zero of="$src" bs=$unit seek=$(( size / unit - 1 )) count=1 conv=notrunc 2> /dev/null
+        "$LWINDEXER" -q "$src" || { fail "$name (indexing the modified sample)"; continue; }
+        test "$(stat -c %y "$src.lwi")" != "$stamp" || { fail "$name (not re-indexed although modified)"; continue; }
+        index "$WORKDIR/stale/fresh" "$src" || { fail "$name (indexing the modified sample from scratch)"; continue; }
+        if same_index "$src.lwi" "$WORKDIR/stale/fresh/$(basename "$sample").lwi"; then
+            pass "$name"
+        else
+            fail "$name (the re-created index file differs from the one indexed from scratch)"
+        fi
+    done
+    rm -rf "$WORKDIR/stale"
+}
+
+# When the total size of the index files in the cache directory exceeds the cap, the least recently used ones
+# must be evicted. The copies of a sample get different modification times, so that each has an index file of its own.
+test_cache()
+{
+    local sample="$SAMPLES/mpeg2.ts"
+    local dir="$WORKDIR/cache"
+    local cache="$dir/cache"
+    local base=$(( $(date +%s) - 1000 ))
+    rm -rf "$dir"
+    mkdir -p "$cache"
+    # Usage: index_copy <number>
+    index_copy()
+    {
+        cp "$sample" "$dir/copy$1.ts"
+        touch -d "@$(( base + $1 ))" "$dir/copy$1.ts"
+        "$LWINDEXER" -q -c "$cache" -s 1 "$dir/copy$1.ts"
+    }
+    # Usage: cached <number>
+    cached()
+    {
+        grep -alFx "<InputFilePath>$dir/copy$1.ts</InputFilePath>" "$cache"/*.lwi > /dev/null 2>&1
+    }
+    index_copy 1 && cached 1 || { fail "cache (indexing the first copy)"; return; }
+    # The number of the index files within the cap of 1 MiB, with a margin for the lengths of the paths
+    local size=$(stat -c %s "$cache"/*.lwi)
+    local fit=$(( (1024 * 1024 - 1024) / (size + 16) ))
+    test $fit -ge 2 || { fail "cache (the index file of $size bytes is too large for the cap of 1 MiB)"; return; }
+    # The modification time of the index files is the time of their last use, in seconds.
+    for i in $(seq 2 $fit); do
+        sleep 1
+        index_copy $i || { fail "cache (indexing copy $i)"; return; }
+    done
+    for i in $(seq 1 $fit); do
+        cached $i || { fail "cache (copy $i is evicted within the cap)"; return; }
+    done
+    # Use the first one again, and then the next copy exceeds the cap. The second one is the least recently used.
+    sleep 1
+    "$LWINDEXER" -q -c "$cache" -s 1 "$dir/copy1.ts" || { fail "cache (reusing copy 1)"; return; }
+    sleep 1
+    index_copy $(( fit + 1 )) || { fail "cache (indexing copy $(( fit + 1 )))"; return; }
+    if cached 2; then
+        fail "cache (the least recently used copy 2 is not evicted)"
+    elif ! cached 1; then
+        fail "cache (the recently used copy 1 is evicted)"
+    elif [ $(ls "$cache"/*.lwi | wc -l) -ne $fit ]; then
+        fail "cache ($(ls "$cache"/*.lwi | wc -l) index files are left instead of $fit)"
+    else
+        pass "cache ($fit index files of $size bytes within 1 MiB, the least recently used one evicted)"
+    fi
+    rm -rf "$dir"
+}
+
+# The frames decoded with the read-ahead must be the same as the ones decoded on demand.
+# The requests go in order, then back and forward, so that the read-ahead is stopped and started again.
+test_read_ahead()
+{
+    test -x "$LWBENCH" || { fail "read_ahead (lwbench is not found, set LWBENCH)"; return; }
+    for sample in "$SAMPLES"/*; do
+        local name="read_ahead: $(basename "$sample")"
+        local out="$WORKDIR/read_ahead"
+        rm -rf "$out"
+        mkdir -p "$out"
+        frame_hashes "$out" "$sample" -a 0 > "$out/on_demand.txt" || { fail "$name (decoding on demand)"; continue; }
+        frame_hashes "$out" "$sample" -a 8 > "$out/read_ahead.txt" || { fail "$name (decoding with the read-ahead)"; continue; }
+        if cmp -s "$out/on_demand.txt" "$out/read_ahead.txt"; then
+            pass "$name ($(wc -l < "$out/on_demand.txt") requests)"
+        else
+            diff "$out/on_demand.txt" "$out/read_ahead.txt" | head -n 10
+            fail "$name"
+        fi
+    done
+    rm -rf "$WORKDIR/read_ahead"
+}
+
+# The frames served in parallel by independent decoders must be the same as the ones served by a single decoder.
+# Each request goes to the idle decoder closest before the frame, so the decoders seek and decode forward
+# from various positions while the others are decoding.
+test_decoders()
+{
+    test -x "$LWBENCH" || { fail "decoders (lwbench is not found, set LWBENCH)"; return; }
+    for sample in "$SAMPLES"/*; do
+        local name="decoders: $(basename "$sample")"
+        local out="$WORKDIR/decoders"
+        rm -rf "$out"
+        mkdir -p "$out"
+        frame_hashes "$out" "$sample" -d 1 > "$out/single.txt"   || { fail "$name (decoding by a single decoder)"; continue; }
+        frame_hashes "$out" "$sample" -d 4 > "$out/parallel.txt" || { fail "$name (decoding by 4 decoders)"; continue; }
+        if cmp -s "$out/single.txt" "$out/parallel.txt"; then
+            pass "$name ($(wc -l < "$out/single.txt") requests)"
+        else
+            diff "$out/single.txt" "$out/parallel.txt" | head -n 10
+            fail "$name"
+        fi
+    done
+    rm -rf "$WORKDIR/decoders"
+}
+
+#-- main --------------------------------------------------------------------------------------
+ALL_TESTS="growing pipeline ranged resume stale cache read_ahead decoders"
+TESTS="${*:-$ALL_TESTS}"
+
+generate_samples || { echo "error: failed to generate the samples."; exit 1; }
+
+for t in $TESTS; do
+    if ! declare -F "test_$t" > /dev/null; then
+        echo "error: unknown test $t"
+        exit 1
+    fi
+    "test_$t"
+done
+
+if [ $FAILED -ne 0 ]; then
+    echo "$FAILED test(s) failed."
+    exit 1
+fi
+echo "All tests passed."
+exit 0
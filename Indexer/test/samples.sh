@@ -0,0 +1,68 @@
+#----------------------------------------------------------------------------------------------
+#  Generation of the samples of the tests and the benchmarks
+#  This is sourced by run.sh and bench.sh, which set FFMPEG and SAMPLES.
+#----------------------------------------------------------------------------------------------
+
+now()
+{
+    date +%s.%N
+}
+
+elapsed()
+{
+    echo "$1 $2" | awk '{ printf "%.3f", $2 - $1 }'
+}
+
+# Usage: generate <output> <seconds> <video encoder options> <format>
+generate()
+{
+    "$FFMPEG" -v error -y -f lavfi -i "testsrc2=size=640x360:rate=30000/1001" \
+              -f lavfi -i "sine=frequency=1000:sample_rate=48000" -t "$2" \
+              $3 -c:a mp2 -b:a 192k -f "$4" "$1" < /dev/null
+}
+
+# The duration of the samples in seconds is SAMPLE_SECONDS, 20 by default.
+generate_samples()
+{
+    local seconds="${SAMPLE_SECONDS:-20}"
+    local mpeg2="-c:v mpeg2video -b:v 4M -g 15 -bf 2"
+    generate "$SAMPLES/mpeg2.ts"  $seconds "$mpeg2" mpegts || return 1
+    generate "$SAMPLES/mpeg2.mpg" $seconds "$mpeg2" vob    || return 1
+    if "$FFMPEG" -v error -hide_banner -encoders 2> /dev/null | grep -q libx264; then
+        generate "$SAMPLES/h264.ts" $seconds "-c:v libx264 -preset veryfast -g 60 -bf 3" mpegts || return 1
+    fi
+    if [ -n "$LWTEST_SAMPLES" ]; then
+        for f in "$LWTEST_SAMPLES"/*.ts "$LWTEST_SAMPLES"/*.m2ts "$LWTEST_SAMPLES"/*.mts \
+                 "$LWTEST_SAMPLES"/*.mpg "$LWTEST_SAMPLES"/*.vob; do
+            test -f "$f" && ln -s "$(cd "$(dirname "$f")"; pwd)/$(basename "$f")" "$SAMPLES/"
+        done
+    fi
+    return 0
+}
+
+# Generate MPEG-TS/PS samples of constant bitrate large enough to be split into byte ranges by ranged indexing
+# into the directory, and link the ones of LWTEST_SAMPLES there too.
+# The duration of the samples in seconds is LWTEST_LARGE_SECONDS, 60 by default, which makes them about 170 MiB.
+# Usage: generate_large_samples <directory>
+generate_large_samples()
+{
+    local seconds="${LWTEST_LARGE_SECONDS:-60}"
+    local cbr="-s 1280x720 -c:v mpeg2video -b:v 24M -minrate 24M -maxrate 24M -bufsize 8M -g 15 -bf 2"
+    mkdir -p "$1"
+    generate "$1/mpeg2-cbr.ts"  $seconds "$cbr" mpegts || return 1
+    generate "$1/mpeg2-cbr.mpg" $seconds "$cbr" vob    || return 1
+    for f in "$SAMPLES"/*; do
+        test -L "$f" && ln -s "$(readlink "$f")" "$1/"
+    done
+    return 0
+}
+
+# The unit to cut a file without breaking packets: 188 or 192 bytes for MPEG-TS, 2048 bytes for MPEG-PS.
+cut_unit()
+{
+    case "$1" in
+        *.m2ts|*.mts) echo 192 ;;
+        *.ts)         echo 188 ;;
+        *)            echo 2048 ;;
+    esac
+}
@@ -327,6 +327,9 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     int64_t direct_rendering;
     int64_t fps_num;
     int64_t fps_den;
+    int64_t frame_cache;
+    int64_t read_ahead;
+    int64_t decoder_pool;
     const char *format;
     const char *preferred_decoder_names;
     set_option_int64 ( &track_number,            0,    "track",          in, vsapi );
@@ -337,17 +340,23 @@ void VS_CC vs_libavsmashsource_create( const VSMap *in, VSMap *out, void *user_d
     set_option_int64 ( &direct_rendering,        0,    "dr",             in, vsapi );
     set_option_int64 ( &fps_num,                 0,    "fpsnum",         in, vsapi );
     set_option_int64 ( &fps_den,                 1,    "fpsden",         in, vsapi );
+    set_option_int64 ( &frame_cache,             0,    "frame_cache",    in, vsapi );
+    set_option_int64 ( &read_ahead,              0,    "read_ahead",     in, vsapi );
+    set_option_int64 ( &decoder_pool,            0,    "decoder_pool",   in, vsapi );
     set_option_string( &format,                  NULL, "format",         in, vsapi );
     set_option_string( &preferred_decoder_names, NULL, "decoder",        in, vsapi );
     set_preferred_decoder_names_on_buf( hp->preferred_decoder_names_buf, preferred_decoder_names );
     libavsmash_video_set_seek_mode              ( vdhp, CLIP_VALUE( seek_mode,      0, 2 ) );
-    libavsmash_video_set_forward_seek_threshold ( vdhp, CLIP_VALUE( seek_threshold, 1, 999 ) );
+    libavsmash_video_set_forward_seek_threshold ( vdhp, seek_threshold < 0 ? 0 : CLIP_VALUE( seek_threshold, 1, 999 ) );
+    libavsmash_video_set_frame_cache_size       ( vdhp, (size_t)CLIP_VALUE( frame_cache, 0, (int64_t)(SIZE_MAX >> 20) ) << 20 );
     libavsmash_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names( hp->preferred_decoder_names_buf ) );
     vohp->vfr2cfr = (fps_num > 0 && fps_den > 0);
     vohp->cfr_num = (uint32_t)fps_num;
     vohp->cfr_den = (uint32_t)fps_den;
     vs_vohp->variable_info               = CLIP_VALUE( variable_info,  0, 1 );
     vs_vohp->direct_rendering            = CLIP_VALUE( direct_rendering,  0, 1 ) && !format;
+    libavsmash_video_set_read_ahead( vdhp, vs_vohp->direct_rendering ? 0 : (int)CLIP_VALUE( read_ahead, 0, 32 ) );
+    libavsmash_video_set_decoder_pool( vdhp, (int)CLIP_VALUE( decoder_pool, 0, 1 ) );
     vs_vohp->vs_output_pixel_format = vs_vohp->variable_info ? pfNone : get_vs_output_pixel_format( format );
     if( track_number && track_number > number_of_tracks )
     {
@@ -73,7 +73,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit( VSConfigPlugin config_func, VSRegis
         1,
         plugin
     );
-#define COMMON_OPTS "threads:int:opt;seek_mode:int:opt;seek_threshold:int:opt;dr:int:opt;fpsnum:int:opt;fpsden:int:opt;variable:int:opt;format:data:opt;decoder:data:opt;"
+#define COMMON_OPTS "threads:int:opt;seek_mode:int:opt;seek_threshold:int:opt;dr:int:opt;fpsnum:int:opt;fpsden:int:opt;variable:int:opt;format:data:opt;decoder:data:opt;frame_cache:int:opt;read_ahead:int:opt;decoder_pool:int:opt;"
     register_func
     (
         "LibavSMASHSource",
@@ -85,7 +85,7 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit( VSConfigPlugin config_func, VSRegis
     register_func
     (
         "LWLibavSource",
-        "source:data;stream_index:int:opt;cache:int:opt;" COMMON_OPTS "repeat:int:opt;dominance:int:opt;",
+        "source:data;stream_index:int:opt;cache:int:opt;" COMMON_OPTS "repeat:int:opt;dominance:int:opt;binary_index:int:opt;cache_dir:data:opt;cache_size:int:opt;sparse_index:int:opt;trust_container_index:int:opt;decoders:int:opt;pipeline_index:int:opt;ranged_index:int:opt;",
         vs_lwlibavsource_create,
         NULL,
         plugin
@@ -70,11 +70,22 @@ void lw_cleanup_audio_output_handler( lw_audio_output_handler_t *aohp ){ }
 #include "video_output.h"
 
 #include "../common/progress.h"
+#include "../common/osdep.h"
 #include "../common/lwlibav_dec.h"
 #include "../common/lwlibav_video.h"
 #include "../common/lwlibav_audio.h"
 #include "../common/lwindex.h"
 
+#define MAX_DECODER_COUNT 16
+
+typedef struct
+{
+    lwlibav_video_decode_handler_t *vdhp;
+    lwlibav_video_output_handler_t *vohp;
+    uint32_t                        position;   /* the number of the last frame output by this decoder */
+    int                             busy;
+} lwlibav_decoder_t;
+
 typedef struct
 {
     VSVideoInfo                     vi;
@@ -84,6 +95,12 @@ typedef struct
     lwlibav_audio_decode_handler_t *adhp;
     lwlibav_audio_output_handler_t *aohp;
     char preferred_decoder_names_buf[PREFERRED_DECODER_NAMES_BUFSIZE];
+    /* Independent decoders for parallel frame requests
+     * decoders[0] refers to vdhp and vohp, and the others share the index of vdhp. */
+    int                             decoder_count;
+    lwlibav_decoder_t               decoders[MAX_DECODER_COUNT];
+    lw_mutex_t                     *decoder_mutex;
+    lw_cond_t                      *decoder_cond;
 } lwlibav_handler_t;
 
 /* Deallocate the handler of this plugin. */
@@ -95,6 +112,16 @@ static void free_handler
     if( !hpp || !*hpp )
         return;
     lwlibav_handler_t *hp = *hpp;
+    /* The duplicated decoders borrow the index of vdhp, so free them first. */
+    for( int i = 1; i < hp->decoder_count; i++ )
+    {
+        lwlibav_video_free_decode_handler( hp->decoders[i].vdhp );
+        lwlibav_video_free_output_handler( hp->decoders[i].vohp );
+    }
+    if( hp->decoder_cond )
+        lw_cond_destroy( hp->decoder_cond );
+    if( hp->decoder_mutex )
+        lw_mutex_destroy( hp->decoder_mutex );
     lw_free( lwlibav_video_get_preferred_decoder_names( hp->vdhp ) );
     lwlibav_video_free_decode_handler( hp->vdhp );
     lwlibav_video_free_output_handler( hp->vohp );
@@ -146,15 +173,14 @@ static void set_frame_properties
 
 static int prepare_video_decoding
 (
-    lwlibav_handler_t *hp,
-    VSMap             *out,
-    VSCore            *core,
-    const VSAPI       *vsapi
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    VSVideoInfo                    *vi,
+    VSMap                          *out,
+    VSCore                         *core,
+    const VSAPI                    *vsapi
 )
 {
-    lwlibav_video_decode_handler_t *vdhp = hp->vdhp;
-    lwlibav_video_output_handler_t *vohp = hp->vohp;
-    VSVideoInfo                    *vi   = &hp->vi;
     /* Import AVIndexEntrys. */
     if( lwlibav_import_av_index_entry( (lwlibav_decode_handler_t *)vdhp ) < 0 )
         return -1;
@@ -181,15 +207,17 @@ static int prepare_video_decoding
     return 0;
 }
 
-static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
+static VSFrameRef *get_frame
+(
+    lwlibav_handler_t              *hp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    uint32_t                        frame_number,
+    VSFrameContext                 *frame_ctx,
+    VSCore                         *core,
+    const VSAPI                    *vsapi
+)
 {
-    if( activation_reason != arInitial )
-        return NULL;
-    lwlibav_handler_t *hp = (lwlibav_handler_t *)*instance_data;
-    VSVideoInfo       *vi = &hp->vi;
-    uint32_t frame_number = MIN( n + 1, vi->numFrames );    /* frame_number is 1-origin. */
-    lwlibav_video_decode_handler_t *vdhp = hp->vdhp;
-    lwlibav_video_output_handler_t *vohp = hp->vohp;
     if( lwlibav_video_get_error( vdhp ) )
     {
         vsapi->setFilterError( "lsmas: failed to output a video frame.", frame_ctx );
@@ -221,10 +249,123 @@ static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason
         vsapi->setFilterError( "lsmas: failed to output a video frame.", frame_ctx );
         return NULL;
     }
-    set_frame_properties( vi, av_frame, vs_frame, vsapi );
+    set_frame_properties( &hp->vi, av_frame, vs_frame, vsapi );
+    return vs_frame;
+}
+
+/* Pick up the idle decoder which reaches the requested frame the earliest.
+ * A decoder positioned before the requested frame only has to decode forward,
+ * while the others have to seek, so they are chosen only if no decoder is positioned before it.
+ * Wait until any decoder becomes idle if all are busy. */
+static lwlibav_decoder_t *acquire_decoder
+(
+    lwlibav_handler_t *hp,
+    uint32_t           frame_number
+)
+{
+    lw_mutex_lock( hp->decoder_mutex );
+    lwlibav_decoder_t *decoder;
+    while( 1 )
+    {
+        decoder = NULL;
+        uint64_t min_cost = UINT64_MAX;
+        for( int i = 0; i < hp->decoder_count; i++ )
+        {
+            lwlibav_decoder_t *candidate = &hp->decoders[i];
+            if( candidate->busy )
+                continue;
+            uint64_t cost = candidate->position <= frame_number
+                          ? frame_number - candidate->position
+                          : ((uint64_t)1 << 32) + candidate->position - frame_number;
+            if( cost < min_cost )
+            {
+                decoder  = candidate;
+                min_cost = cost;
+            }
+        }
+        if( decoder )
+            break;
+        lw_cond_wait( hp->decoder_cond, hp->decoder_mutex );
+    }
+    decoder->busy = 1;
+    lw_mutex_unlock( hp->decoder_mutex );
+    return decoder;
+}
+
+static void release_decoder
+(
+    lwlibav_handler_t *hp,
+    lwlibav_decoder_t *decoder,
+    uint32_t           frame_number
+)
+{
+    lw_mutex_lock( hp->decoder_mutex );
+    decoder->position = frame_number;
+    decoder->busy     = 0;
+    lw_cond_signal( hp->decoder_cond );
+    lw_mutex_unlock( hp->decoder_mutex );
+}
+
+static const VSFrameRef *VS_CC vs_filter_get_frame( int n, int activation_reason, void **instance_data, void **frame_data, VSFrameContext *frame_ctx, VSCore *core, const VSAPI *vsapi )
+{
+    if( activation_reason != arInitial )
+        return NULL;
+    lwlibav_handler_t *hp = (lwlibav_handler_t *)*instance_data;
+    uint32_t frame_number = MIN( n + 1, hp->vi.numFrames );    /* frame_number is 1-origin. */
+    if( hp->decoder_count <= 1 )
+        return get_frame( hp, hp->vdhp, hp->vohp, frame_number, frame_ctx, core, vsapi );
+    lwlibav_decoder_t *decoder  = acquire_decoder( hp, frame_number );
+    VSFrameRef        *vs_frame = get_frame( hp, decoder->vdhp, decoder->vohp, frame_number, frame_ctx, core, vsapi );
+    release_decoder( hp, decoder, frame_number );
     return vs_frame;
 }
 
+/* Set up a decoder which decodes the stream independently of the others.
+ * Its output handler takes over the settings of the original one. */
+static int duplicate_decoder
+(
+    lwlibav_handler_t *hp,
+    lwlibav_decoder_t *decoder,
+    VSMap             *out,
+    const VSAPI       *vsapi
+)
+{
+    lwlibav_video_output_handler_t *vohp = hp->vohp;
+    decoder->vohp = lwlibav_video_alloc_output_handler();
+    if( !decoder->vohp )
+        goto fail;
+    vs_video_output_handler_t *vs_vohp = vs_allocate_video_output_handler( decoder->vohp );
+    if( !vs_vohp )
+        goto fail;
+    vs_video_output_handler_t *src_vs_vohp = (vs_video_output_handler_t *)vohp->private_handler;
+    vs_vohp->variable_info          = src_vs_vohp->variable_info;
+    vs_vohp->direct_rendering       = src_vs_vohp->direct_rendering;
+    vs_vohp->vs_output_pixel_format = src_vs_vohp->vs_output_pixel_format;
+    decoder->vohp->vfr2cfr              = vohp->vfr2cfr;
+    decoder->vohp->cfr_num              = vohp->cfr_num;
+    decoder->vohp->cfr_den              = vohp->cfr_den;
+    decoder->vohp->repeat_control       = vohp->repeat_control;
+    decoder->vohp->repeat_correction_ts = vohp->repeat_correction_ts;
+    decoder->vohp->frame_count          = vohp->frame_count;
+    decoder->vohp->frame_order_count    = vohp->frame_order_count;
+    if( vohp->frame_order_list )
+    {
+        /* The list may be terminated by a zeroed entry beyond the last frame. */
+        lw_video_frame_order_t *order_list = (lw_video_frame_order_t *)lw_malloc_zero( (vohp->frame_order_count + 2) * sizeof(lw_video_frame_order_t) );
+        if( !order_list )
+            goto fail;
+        memcpy( order_list, vohp->frame_order_list, (vohp->frame_order_count + 1) * sizeof(lw_video_frame_order_t) );
+        decoder->vohp->frame_order_list = order_list;
+    }
+    decoder->vdhp = lwlibav_video_duplicate_decode_handler( hp->vdhp, hp->lwh.file_path, hp->lwh.threads );
+    if( !decoder->vdhp )
+        goto fail;
+    return 0;
+fail:
+    set_error_on_init( out, vsapi, "lsmas: failed to allocate a duplicated decoder." );
+    return -1;
+}
+
 static void VS_CC vs_filter_free( void *instance_data, VSCore *core, const VSAPI *vsapi )
 {
     free_handler( (lwlibav_handler_t **)&instance_data );
@@ -270,10 +411,21 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     int64_t direct_rendering;
     int64_t fps_num;
     int64_t fps_den;
+    int64_t frame_cache;
+    int64_t read_ahead;
+    int64_t decoder_pool;
     int64_t apply_repeat_flag;
     int64_t field_dominance;
+    int64_t binary_index;
+    int64_t cache_size;
+    int64_t sparse_index;
+    int64_t trust_container_index;
+    int64_t decoders;
+    int64_t pipeline_index;
+    int64_t ranged_index;
     const char *format;
     const char *preferred_decoder_names;
+    const char *cache_dir;
     set_option_int64 ( &stream_index,           -1,    "stream_index",   in, vsapi );
     set_option_int64 ( &threads,                 0,    "threads",        in, vsapi );
     set_option_int64 ( &cache_index,             1,    "cache",          in, vsapi );
@@ -283,10 +435,21 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     set_option_int64 ( &direct_rendering,        0,    "dr",             in, vsapi );
     set_option_int64 ( &fps_num,                 0,    "fpsnum",         in, vsapi );
     set_option_int64 ( &fps_den,                 1,    "fpsden",         in, vsapi );
+    set_option_int64 ( &frame_cache,             0,    "frame_cache",    in, vsapi );
+    set_option_int64 ( &read_ahead,              0,    "read_ahead",     in, vsapi );
+    set_option_int64 ( &decoder_pool,            0,    "decoder_pool",   in, vsapi );
     set_option_int64 ( &apply_repeat_flag,       0,    "repeat",         in, vsapi );
     set_option_int64 ( &field_dominance,         0,    "dominance",      in, vsapi );
+    set_option_int64 ( &binary_index,            0,    "binary_index",   in, vsapi );
+    set_option_int64 ( &cache_size,              1024, "cache_size",     in, vsapi );
+    set_option_int64 ( &sparse_index,            0,    "sparse_index",   in, vsapi );
+    set_option_int64 ( &trust_container_index,   0,    "trust_container_index", in, vsapi );
+    set_option_int64 ( &decoders,                1,    "decoders",       in, vsapi );
+    set_option_int64 ( &pipeline_index,          0,    "pipeline_index", in, vsapi );
+    set_option_int64 ( &ranged_index,            0,    "ranged_index",   in, vsapi );
     set_option_string( &format,                  NULL, "format",         in, vsapi );
     set_option_string( &preferred_decoder_names, NULL, "decoder",        in, vsapi );
+    set_option_string( &cache_dir,               NULL, "cache_dir",      in, vsapi );
     set_preferred_decoder_names_on_buf( hp->preferred_decoder_names_buf, preferred_decoder_names );
     /* Set options. */
     lwlibav_option_t opt;
@@ -300,14 +463,25 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     opt.force_audio_index = -1;
     opt.apply_repeat_flag = apply_repeat_flag;
     opt.field_dominance   = CLIP_VALUE( field_dominance, 0, 2 );    /* 0: Obey source flags, 1: TFF, 2: BFF */
+    opt.binary_index      = CLIP_VALUE( binary_index, 0, 1 );
+    opt.cache_dir         = cache_dir;
+    opt.cache_size        = CLIP_VALUE( cache_size, 0, INT32_MAX );
+    opt.sparse_index      = CLIP_VALUE( sparse_index, 0, 1 );
+    opt.trust_container_index = CLIP_VALUE( trust_container_index, 0, 1 );
+    opt.pipeline_index    = CLIP_VALUE( pipeline_index, 0, 1 );
+    opt.ranged_index      = CLIP_VALUE( ranged_index, 0, 1 );
+    opt.checkpoint_interval = 0;
     opt.vfr2cfr.active    = fps_num > 0 && fps_den > 0 ? 1 : 0;
     opt.vfr2cfr.fps_num   = fps_num;
     opt.vfr2cfr.fps_den   = fps_den;
     lwlibav_video_set_seek_mode              ( vdhp, CLIP_VALUE( seek_mode,      0, 2 ) );
-    lwlibav_video_set_forward_seek_threshold ( vdhp, CLIP_VALUE( seek_threshold, 1, 999 ) );
+    lwlibav_video_set_forward_seek_threshold ( vdhp, seek_threshold < 0 ? 0 : CLIP_VALUE( seek_threshold, 1, 999 ) );
+    lwlibav_video_set_frame_cache_size       ( vdhp, (size_t)CLIP_VALUE( frame_cache, 0, (int64_t)(SIZE_MAX >> 20) ) << 20 );
     lwlibav_video_set_preferred_decoder_names( vdhp, tokenize_preferred_decoder_names( hp->preferred_decoder_names_buf ) );
     vs_vohp->variable_info          = CLIP_VALUE( variable_info,     0, 1 );
     vs_vohp->direct_rendering       = CLIP_VALUE( direct_rendering,  0, 1 ) && !format;
+    lwlibav_video_set_read_ahead( vdhp, vs_vohp->direct_rendering ? 0 : (int)CLIP_VALUE( read_ahead, 0, 32 ) );
+    lwlibav_video_set_decoder_pool( vdhp, (int)CLIP_VALUE( decoder_pool, 0, 1 ) );
     vs_vohp->vs_output_pixel_format = vs_vohp->variable_info ? pfNone : get_vs_output_pixel_format( format );
     /* Set up progress indicator. */
     progress_indicator_t indicator;
@@ -336,12 +510,45 @@ void VS_CC vs_lwlibavsource_create( const VSMap *in, VSMap *out, void *user_data
     hp->vi.fpsNum    = 25;
     hp->vi.fpsDen    = 1;
     lwlibav_video_setup_timestamp_info( lwhp, vdhp, vohp, &hp->vi.fpsNum, &hp->vi.fpsDen );
+    /* Duplicate the decoder before the index of vdhp is handed over to the demuxer. */
+    hp->decoders[0].vdhp = vdhp;
+    hp->decoders[0].vohp = vohp;
+    hp->decoder_count    = 1;
+    if( decoders > 1 )
+    {
+        hp->decoder_mutex = lw_mutex_create();
+        hp->decoder_cond  = lw_cond_create();
+        if( !hp->decoder_mutex || !hp->decoder_cond )
+        {
+            vs_filter_free( hp, core, vsapi );
+            set_error_on_init( out, vsapi, "lsmas: failed to allocate the decoder lock." );
+            return;
+        }
+        for( int i = 1; i < CLIP_VALUE( decoders, 1, MAX_DECODER_COUNT ); i++ )
+        {
+            /* Count it before setting up so that whatever is allocated is freed on failure. */
+            ++ hp->decoder_count;
+            if( duplicate_decoder( hp, &hp->decoders[i], out, vsapi ) < 0 )
+            {
+                vs_filter_free( hp, core, vsapi );
+                return;
+            }
+        }
+    }
     /* Set up decoders for this stream. */
-    if( prepare_video_decoding( hp, out, core, vsapi ) < 0 )
+    for( int i = 0; i < hp->decoder_count; i++ )
     {
-        vs_filter_free( hp, core, vsapi );
-        return;
+        /* The video info is filled by the first decoder, and the others give the same. */
+        VSVideoInfo vi = hp->vi;
+        if( prepare_video_decoding( hp->decoders[i].vdhp, hp->decoders[i].vohp, i == 0 ? &hp->vi : &vi, out, core, vsapi ) < 0 )
+        {
+            vs_filter_free( hp, core, vsapi );
+            return;
+        }
     }
-    vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, fmUnordered, nfMakeLinear, hp, core );
+    if( hp->decoder_count > 1 )
+        vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, fmParallel, 0, hp, core );
+    else
+        vsapi->createFilter( in, out, "LWLibavSource", vs_filter_init, vs_filter_get_frame, vs_filter_free, fmUnordered, nfMakeLinear, hp, core );
     return;
 }
@@ -29,6 +29,10 @@ extern "C"
 }
 #endif  /* __cplusplus */
 
+#include <string.h>
+
+#include "utils.h"
+#include "osdep.h"
 #include "decode.h"
 #include "qsv.h"
 
@@ -102,6 +106,391 @@ int find_and_open_decoder
     return open_decoder( ctx, codecpar, codec, thread_count, refcounted_frames );
 }
 
+/* The number of configurations the pool prepares a decoder for.
+ * Every decoder opened in advance holds the threads for frame threading until it is used,
+ * so only the one for the most recently used configuration is kept. */
+#define DECODER_POOL_SLOT_COUNT 1
+
+typedef struct
+{
+    AVCodecParameters *codecpar;            /* NULL if this slot is unused */
+    const AVCodec     *codec;
+    int                thread_count;
+    int                refcounted_frames;
+    AVCodecContext    *idle;                /* the decoder opened in advance, never fed */
+    int                request;             /* Set to non-zero if the worker is requested to open the idle decoder. */
+    uint32_t           generation;          /* incremented whenever this slot is assigned to another configuration */
+    uint64_t           last_use;
+} decoder_pool_slot_t;
+
+struct decoder_pool_tag
+{
+    lw_mutex_t          *mutex;
+    lw_cond_t           *cond;
+    lw_thread_t         *worker;
+    int                  worker_failed;
+    int                  quit;
+    uint64_t             use_count;
+    decoder_pool_slot_t  slots[DECODER_POOL_SLOT_COUNT];
+    AVCodecContext     **retired;           /* the decoders waiting to be closed by the worker */
+    int                  retired_count;
+    int                  retired_capacity;
+};
+
+static void *decoder_pool_worker
+(
+    void *arg
+)
+{
+    decoder_pool_t *pool = (decoder_pool_t *)arg;
+    lw_mutex_lock( pool->mutex );
+    while( 1 )
+    {
+        /* Close the retired decoders first, even if quitting. */
+        if( pool->retired_count > 0 )
+        {
+            AVCodecContext *ctx = pool->retired[ --pool->retired_count ];
+            lw_mutex_unlock( pool->mutex );
+            avcodec_free_context( &ctx );
+            lw_mutex_lock( pool->mutex );
+            continue;
+        }
+        if( pool->quit )
+            break;
+        decoder_pool_slot_t *slot = NULL;
+        for( int i = 0; i < DECODER_POOL_SLOT_COUNT; i++ )
+            if( pool->slots[i].codecpar && pool->slots[i].request && !pool->slots[i].idle )
+            {
+                slot = &pool->slots[i];
+                break;
+            }
+        if( !slot )
+        {
+            lw_cond_wait( pool->cond, pool->mutex );
+            continue;
+        }
+        /* Open a decoder for the requested configuration in advance.
+         * The slot could be reassigned while opening, so open it with a copy of the configuration. */
+        const AVCodec     *codec             = slot->codec;
+        const int          thread_count      = slot->thread_count;
+        const int          refcounted_frames = slot->refcounted_frames;
+        const uint32_t     generation        = slot->generation;
+        AVCodecParameters *codecpar          = avcodec_parameters_alloc();
+        if( codecpar && avcodec_parameters_copy( codecpar, slot->codecpar ) < 0 )
+            avcodec_parameters_free( &codecpar );
+        slot->request = 0;
+        lw_mutex_unlock( pool->mutex );
+        AVCodecContext *ctx = NULL;
+        if( codecpar )
+            open_decoder( &ctx, codecpar, codec, thread_count, refcounted_frames );
+        avcodec_parameters_free( &codecpar );
+        lw_mutex_lock( pool->mutex );
+        if( !ctx )
+            continue;
+        if( slot->generation == generation && !slot->idle )
+            slot->idle = ctx;
+        else
+        {
+            lw_mutex_unlock( pool->mutex );
+            avcodec_free_context( &ctx );
+            lw_mutex_lock( pool->mutex );
+        }
+    }
+    lw_mutex_unlock( pool->mutex );
+    return NULL;
+}
+
+/* The followings must be called with the lock of the pool held. */
+static void start_decoder_pool_worker
+(
+    decoder_pool_t *pool
+)
+{
+    if( pool->worker || pool->worker_failed )
+        return;
+    pool->worker = lw_thread_create( decoder_pool_worker, pool );
+    if( !pool->worker )
+        pool->worker_failed = 1;
+}
+
+static void retire_decoder
+(
+    decoder_pool_t *pool,
+    AVCodecContext *ctx
+)
+{
+    start_decoder_pool_worker( pool );
+    if( pool->worker && pool->retired_count == pool->retired_capacity )
+    {
+        int capacity = pool->retired_capacity ? 2 * pool->retired_capacity : 4;
+        AVCodecContext **temp = (AVCodecContext **)realloc( pool->retired, capacity * sizeof(AVCodecContext *) );
+        if( temp )
+        {
+            pool->retired          = temp;
+            pool->retired_capacity = capacity;
+        }
+    }
+    if( pool->worker && pool->retired_count < pool->retired_capacity )
+    {
+        pool->retired[ pool->retired_count++ ] = ctx;
+        lw_cond_signal( pool->cond );
+    }
+    else
+        /* No way to hand over to the worker. */
+        avcodec_free_context( &ctx );
+}
+
+static int is_same_decoder_configuration
+(
+    const decoder_pool_slot_t *slot,
+    const AVCodecParameters   *codecpar,
+    const AVCodec             *codec,
+    const int                  thread_count,
+    const int                  refcounted_frames
+)
+{
+    const AVCodecParameters *par = slot->codecpar;
+    return slot->codec                   == codec
+        && slot->thread_count            == thread_count
+        && slot->refcounted_frames       == refcounted_frames
+        && par->codec_type               == codecpar->codec_type
+        && par->codec_id                 == codecpar->codec_id
+        && par->codec_tag                == codecpar->codec_tag
+        && par->format                   == codecpar->format
+        && par->bits_per_coded_sample    == codecpar->bits_per_coded_sample
+        && par->bits_per_raw_sample      == codecpar->bits_per_raw_sample
+        && par->profile                  == codecpar->profile
+        && par->level                    == codecpar->level
+        && par->width                    == codecpar->width
+        && par->height                   == codecpar->height
+        && par->sample_aspect_ratio.num  == codecpar->sample_aspect_ratio.num
+        && par->sample_aspect_ratio.den  == codecpar->sample_aspect_ratio.den
+        && par->field_order              == codecpar->field_order
+        && par->color_range              == codecpar->color_range
+        && par->color_space              == codecpar->color_space
+        && par->color_primaries          == codecpar->color_primaries
+        && par->color_trc                == codecpar->color_trc
+        && par->chroma_location          == codecpar->chroma_location
+        && par->channel_layout           == codecpar->channel_layout
+        && par->channels                 == codecpar->channels
+        && par->sample_rate              == codecpar->sample_rate
+        && par->block_align              == codecpar->block_align
+        && par->frame_size               == codecpar->frame_size
+        && par->extradata_size           == codecpar->extradata_size
+        && (par->extradata_size == 0 || !memcmp( par->extradata, codecpar->extradata, par->extradata_size ));
+}
+
+/* Return the slot for the configuration. If none, assign the least recently used slot to it.
+ * Return NULL on failure. */
+static decoder_pool_slot_t *get_decoder_pool_slot
+(
+    decoder_pool_t          *pool,
+    const AVCodecParameters *codecpar,
+    const AVCodec           *codec,
+    const int                thread_count,
+    const int                refcounted_frames
+)
+{
+    decoder_pool_slot_t *victim = &pool->slots[0];
+    for( int i = 0; i < DECODER_POOL_SLOT_COUNT; i++ )
+    {
+        decoder_pool_slot_t *slot = &pool->slots[i];
+        if( !slot->codecpar )
+        {
+            if( victim->codecpar )
+                victim = slot;
+            continue;
+        }
+        if( is_same_decoder_configuration( slot, codecpar, codec, thread_count, refcounted_frames ) )
+            return slot;
+        if( victim->codecpar && slot->last_use < victim->last_use )
+            victim = slot;
+    }
+    /* The decoder being opened by the worker for the previous configuration is discarded by the generation change. */
+    if( victim->idle )
+        retire_decoder( pool, victim->idle );
+    victim->idle    = NULL;
+    victim->request = 0;
+    ++victim->generation;
+    if( !victim->codecpar && !(victim->codecpar = avcodec_parameters_alloc()) )
+        return NULL;
+    if( avcodec_parameters_copy( victim->codecpar, codecpar ) < 0 )
+    {
+        avcodec_parameters_free( &victim->codecpar );
+        return NULL;
+    }
+    victim->codec             = codec;
+    victim->thread_count      = thread_count;
+    victim->refcounted_frames = refcounted_frames;
+    return victim;
+}
+
+/* Hardware decoders hold the device and its surfaces until closed, and some of them must be opened and closed
+ * on the same thread, so they are never pooled. */
+static int is_pooled_decoder
+(
+    const AVCodec *codec
+)
+{
+    if( !codec || is_qsv_decoder( codec ) )
+        return 0;
+#ifdef AV_CODEC_CAP_HARDWARE
+    if( codec->capabilities & AV_CODEC_CAP_HARDWARE )
+        return 0;
+#endif
+    return 1;
+}
+
+decoder_pool_t *decoder_pool_create
+(
+    void
+)
+{
+    decoder_pool_t *pool = (decoder_pool_t *)lw_malloc_zero( sizeof(decoder_pool_t) );
+    if( !pool )
+        return NULL;
+    pool->mutex = lw_mutex_create();
+    pool->cond  = lw_cond_create();
+    if( !pool->mutex || !pool->cond )
+    {
+        decoder_pool_destroy( pool );
+        return NULL;
+    }
+    return pool;
+}
+
+void decoder_pool_destroy
+(
+    decoder_pool_t *pool
+)
+{
+    if( !pool )
+        return;
+    if( pool->worker )
+    {
+        lw_mutex_lock( pool->mutex );
+        pool->quit = 1;
+        lw_cond_signal( pool->cond );
+        lw_mutex_unlock( pool->mutex );
+        lw_thread_join( pool->worker );
+    }
+    for( int i = 0; i < pool->retired_count; i++ )
+        avcodec_free_context( &pool->retired[i] );
+    for( int i = 0; i < DECODER_POOL_SLOT_COUNT; i++ )
+    {
+        avcodec_free_context( &pool->slots[i].idle );
+        avcodec_parameters_free( &pool->slots[i].codecpar );
+    }
+    lw_free( pool->retired );
+    lw_cond_destroy( pool->cond );
+    lw_mutex_destroy( pool->mutex );
+    lw_free( pool );
+}
+
+int decoder_pool_open_decoder
+(
+    decoder_pool_t          *pool,
+    AVCodecContext         **ctx,
+    const AVCodecParameters *codecpar,
+    const AVCodec           *codec,
+    const int                thread_count,
+    const int                refcounted_frames
+)
+{
+    if( !pool || !is_pooled_decoder( codec ) )
+        return open_decoder( ctx, codecpar, codec, thread_count, refcounted_frames );
+    AVCodecContext *idle = NULL;
+    lw_mutex_lock( pool->mutex );
+    decoder_pool_slot_t *slot = get_decoder_pool_slot( pool, codecpar, codec, thread_count, refcounted_frames );
+    if( slot )
+    {
+        idle           = slot->idle;
+        slot->idle     = NULL;
+        slot->request  = 1;
+        slot->last_use = ++pool->use_count;
+        start_decoder_pool_worker( pool );
+        lw_cond_signal( pool->cond );
+    }
+    lw_mutex_unlock( pool->mutex );
+    if( idle )
+    {
+        *ctx = idle;
+        return 0;
+    }
+    /* Nothing is prepared yet for this configuration. */
+    return open_decoder( ctx, codecpar, codec, thread_count, refcounted_frames );
+}
+
+void decoder_pool_close_decoder
+(
+    decoder_pool_t  *pool,
+    AVCodecContext **ctx
+)
+{
+    if( !pool || !*ctx || !is_pooled_decoder( (*ctx)->codec ) )
+    {
+        avcodec_free_context( ctx );
+        return;
+    }
+    lw_mutex_lock( pool->mutex );
+    retire_decoder( pool, *ctx );
+    lw_mutex_unlock( pool->mutex );
+    *ctx = NULL;
+}
+
+void seek_cost_model_start
+(
+    seek_cost_model_t *model
+)
+{
+    model->start = lw_get_wall_clock();
+}
+
+/* Each measurement is weighted by 1/8 so that the average follows the changes of the stream
+ * such as resolution while the noise of a single request is smoothed. */
+static inline int64_t update_cost_average
+(
+    int64_t average,
+    int64_t cost
+)
+{
+    return average ? average + (cost - average) / 8 : cost;
+}
+
+void seek_cost_model_update
+(
+    seek_cost_model_t *model,
+    uint32_t           fed_count,
+    int                seeked
+)
+{
+    int64_t start = model->start;
+    model->start = -1;
+    if( start < 0 || fed_count == 0 )
+        return;
+    int64_t elapsed = lw_get_wall_clock() - start;
+    if( elapsed < 0 )
+        return;
+    if( !seeked )
+        model->picture_cost = update_cost_average( model->picture_cost, MAX( elapsed / fed_count, 1 ) );
+    else if( model->picture_cost )
+        /* The seek cost is what remains after the decoding cost estimated so far is subtracted. */
+        model->seek_cost = update_cost_average( model->seek_cost, MAX( elapsed - fed_count * model->picture_cost, 1 ) );
+}
+
+int seek_cost_model_prefer_forward
+(
+    seek_cost_model_t *model,
+    uint32_t           forward_count,
+    uint32_t           seek_count
+)
+{
+    if( model->picture_cost == 0 || model->seek_cost == 0 )
+        /* Regard seeking as free until measured. Then, seeking is done at least once when it decodes fewer pictures. */
+        return forward_count <= seek_count;
+    return forward_count * model->picture_cost <= model->seek_cost + seek_count * model->picture_cost;
+}
+
 /* An incomplete simulator of the old libavcodec video decoder API
  * Unlike the old, this function does not return consumed bytes of input packet on success. */
 int decode_video_packet
@@ -52,6 +52,81 @@ int find_and_open_decoder
     const int                refcounted_frames
 );
 
+/* A pool of decoders keeps the decoder which is opened in advance for the most recently used configuration and
+ * the decoders retired by the user, so that a decoder can be replaced with a brand-new one without waiting for
+ * its opening and closing, which spawn and join the whole threads of frame threading.
+ * Both are done by a worker thread of the pool, which is started on demand.
+ * Only software decoders are pooled. The others are opened and closed in place as without the pool.
+ * The source filters use a pool only for the video decoder, and only if enabled by their option decoder_pool. */
+typedef struct decoder_pool_tag decoder_pool_t;
+
+/* Return NULL on failure. */
+decoder_pool_t *decoder_pool_create
+(
+    void
+);
+
+/* Close all decoders kept in the pool and then free the pool. */
+void decoder_pool_destroy
+(
+    decoder_pool_t *pool
+);
+
+/* Same as open_decoder() except for taking the decoder opened in advance from the pool if available.
+ * The pool prepares the next decoder for the same configuration after this call.
+ * If pool is NULL, this is just open_decoder(). */
+int decoder_pool_open_decoder
+(
+    decoder_pool_t          *pool,
+    AVCodecContext         **ctx,
+    const AVCodecParameters *codecpar,
+    const AVCodec           *codec,
+    const int                thread_count,
+    const int                refcounted_frames
+);
+
+/* Hand over the decoder to the pool, which closes it later, and set *ctx to NULL.
+ * If pool is NULL, the decoder is closed here. */
+void decoder_pool_close_decoder
+(
+    decoder_pool_t  *pool,
+    AVCodecContext **ctx
+);
+
+/* The cost model to decide whether the requested picture is reached by decoding forward from the current position
+ * or by seeking to the random accessible point preceding it.
+ * The costs are measured in wall clock time while getting the requested pictures since they depend on the codec,
+ * the resolution, the threading of the decoder, the replacement of the decoder at seek and so on. */
+typedef struct
+{
+    int64_t picture_cost;   /* the average time in microseconds to decode a picture, or 0 if not measured yet */
+    int64_t seek_cost;      /* the average time in microseconds spent for a seek besides decoding, or 0 if not measured yet */
+    int64_t start;          /* the time when the measurement of the current request started, or -1 if unavailable */
+} seek_cost_model_t;
+
+/* Start the measurement of a request. */
+void seek_cost_model_start
+(
+    seek_cost_model_t *model
+);
+
+/* Finish the measurement of a request, where fed_count pictures were decoded after seeking if seeked is non-zero. */
+void seek_cost_model_update
+(
+    seek_cost_model_t *model,
+    uint32_t           fed_count,
+    int                seeked
+);
+
+/* Return non-zero if decoding forward_count pictures from the current position is expected to be cheaper than
+ * seeking and then decoding seek_count pictures. */
+int seek_cost_model_prefer_forward
+(
+    seek_cost_model_t *model,
+    uint32_t           forward_count,
+    uint32_t           seek_count
+);
+
 int decode_video_packet
 (
     AVCodecContext *ctx,
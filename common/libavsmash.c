@@ -795,6 +795,7 @@ int get_sample
 
 /* Close and open the new decoder to flush buffers in the decoder even if the decoder implements avcodec_flush_buffers().
  * It seems this brings about more stable composition when seeking.
+ * The new decoder is taken from the pool if opened in advance, and the old one is closed by the pool in the background.
  * Note that this function could reallocate AVCodecContext. */
 void libavsmash_flush_buffers
 (
@@ -807,7 +808,7 @@ void libavsmash_flush_buffers
     AVCodecParameters *codecpar     = avcodec_parameters_alloc();
     if( !codecpar
      || avcodec_parameters_from_context( codecpar, config->ctx ) < 0
-     || open_decoder( &ctx, codecpar, codec, config->ctx->thread_count, config->ctx->refcounted_frames ) < 0 )
+     || decoder_pool_open_decoder( config->decoder_pool, &ctx, codecpar, codec, config->ctx->thread_count, config->ctx->refcounted_frames ) < 0 )
     {
         avcodec_flush_buffers( config->ctx );
         config->error = 1;
@@ -819,7 +820,7 @@ void libavsmash_flush_buffers
     else
     {
         config->ctx->opaque = NULL;
-        avcodec_free_context( &config->ctx );
+        decoder_pool_close_decoder( config->decoder_pool, &config->ctx );
         config->ctx = ctx;
         config->ctx->opaque = app_specific;
     }
@@ -866,7 +867,7 @@ void update_configuration
     }
     /* Close the decoder here. */
     config->ctx->opaque = NULL;
-    avcodec_free_context( &config->ctx );
+    decoder_pool_close_decoder( config->decoder_pool, &config->ctx );
     /* Find an appropriate decoder. */
     const AVCodec *codec = find_decoder( config->queue.codec_id, config->preferred_decoder_names );
     if( !codec )
@@ -914,7 +915,7 @@ void update_configuration
     /* Open an appropriate decoder.
      * Here, we force single threaded decoding since some decoder doesn't do its proper initialization with multi-threaded decoding. */
     AVCodecContext *ctx = NULL;
-    if( open_decoder( &ctx, codecpar, codec, 1, refcounted_frames ) < 0 )
+    if( decoder_pool_open_decoder( config->decoder_pool, &ctx, codecpar, codec, 1, refcounted_frames ) < 0 )
     {
         strcpy( error_string, "Failed to open decoder.\n" );
         goto fail;
@@ -1138,4 +1139,6 @@ void cleanup_configuration
     av_freep( &config->queue.extradata );
     av_freep( &config->input_buffer );
     avcodec_free_context( &config->ctx );
+    decoder_pool_destroy( config->decoder_pool );
+    config->decoder_pool = NULL;
 }
@@ -51,6 +51,7 @@ typedef struct
     libavsmash_summary_t *entries;
     extended_summary_t    prefer;
     lw_log_handler_t      lh;
+    struct decoder_pool_tag *decoder_pool;
     int  (*get_buffer)( struct AVCodecContext *, AVFrame *, int );
     struct
     {
@@ -38,10 +38,10 @@ extern "C"
 
 #include "utils.h"
 #include "video_output.h"
+#include "decode.h"
 #include "libavsmash.h"
 #include "libavsmash_video.h"
 #include "libavsmash_video_internal.h"
-#include "decode.h"
 
 /*****************************************************************************
  * Allocators / Deallocators
@@ -78,10 +78,13 @@ void libavsmash_video_free_decode_handler
 {
     if( !vdhp )
         return;
+    /* The worker of the read-ahead might be decoding. */
+    lw_video_read_ahead_destroy( vdhp->read_ahead );
     lw_freep( &vdhp->keyframe_list );
     lw_freep( &vdhp->order_converter );
     av_frame_free( &vdhp->frame_buffer );
     av_frame_free( &vdhp->first_valid_frame );
+    lw_video_frame_cache_cleanup( &vdhp->frame_cache );
     cleanup_configuration( &vdhp->config );
     lw_free( vdhp );
 }
@@ -158,6 +161,41 @@ void libavsmash_video_set_seek_mode
     vdhp->seek_mode = seek_mode;
 }
 
+void libavsmash_video_set_frame_cache_size
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    size_t                             frame_cache_size
+)
+{
+    vdhp->frame_cache.budget = frame_cache_size;
+}
+
+void libavsmash_video_set_read_ahead
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    int                                read_ahead_depth
+)
+{
+    vdhp->read_ahead_depth = read_ahead_depth;
+}
+
+void libavsmash_video_set_decoder_pool
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    int                                decoder_pool
+)
+{
+    codec_configuration_t *config = &vdhp->config;
+    if( decoder_pool && !config->decoder_pool )
+        /* Without the pool, decoders are just opened and closed on demand. */
+        config->decoder_pool = decoder_pool_create();
+    else if( !decoder_pool )
+    {
+        decoder_pool_destroy( config->decoder_pool );
+        config->decoder_pool = NULL;
+    }
+}
+
 void libavsmash_video_set_preferred_decoder_names
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -173,7 +211,10 @@ void libavsmash_video_set_log_handler
     lw_log_handler_t                  *lh
 )
 {
-    vdhp->config.lh = *lh;
+    if( vdhp->read_ahead )
+        *lw_video_read_ahead_get_log_handler( vdhp->read_ahead ) = *lh;
+    else
+        vdhp->config.lh = *lh;
 }
 
 void libavsmash_video_set_get_buffer_func
@@ -240,7 +281,9 @@ lw_log_handler_t *libavsmash_video_get_log_handler
     libavsmash_video_decode_handler_t *vdhp
 )
 {
-    return vdhp ? &vdhp->config.lh : NULL;
+    if( !vdhp )
+        return NULL;
+    return vdhp->read_ahead ? lw_video_read_ahead_get_log_handler( vdhp->read_ahead ) : &vdhp->config.lh;
 }
 
 AVCodecContext *libavsmash_video_get_codec_context
@@ -451,7 +494,13 @@ int libavsmash_video_get_cts
     uint64_t                          *cts
 )
 {
-    return lsmash_get_cts_from_media_timeline( vdhp->root, vdhp->track_id, coded_sample_number, cts );
+    /* The timeline of L-SMASH remembers the last access, so the worker of the read-ahead must not access it at the same time. */
+    if( vdhp->read_ahead )
+        lw_video_read_ahead_lock_decoder( vdhp->read_ahead );
+    int ret = lsmash_get_cts_from_media_timeline( vdhp->root, vdhp->track_id, coded_sample_number, cts );
+    if( vdhp->read_ahead )
+        lw_video_read_ahead_unlock_decoder( vdhp->read_ahead );
+    return ret;
 }
 
 int libavsmash_video_get_sample_duration
@@ -461,7 +510,12 @@ int libavsmash_video_get_sample_duration
     uint32_t                          *sample_duration
 )
 {
-    return lsmash_get_sample_delta_from_media_timeline( vdhp->root, vdhp->track_id, coded_sample_number, sample_duration );
+    if( vdhp->read_ahead )
+        lw_video_read_ahead_lock_decoder( vdhp->read_ahead );
+    int ret = lsmash_get_sample_delta_from_media_timeline( vdhp->root, vdhp->track_id, coded_sample_number, sample_duration );
+    if( vdhp->read_ahead )
+        lw_video_read_ahead_unlock_decoder( vdhp->read_ahead );
+    return ret;
 }
 
 void libavsmash_video_clear_error
@@ -806,6 +860,37 @@ static int get_picture
     return got_picture ? 0 : -1;
 }
 
+/* Return the number of samples decoded after seeking to the random accessible sample rap_number,
+ * which is in decoding order, to get the sample sample_number in composition order. */
+static inline uint32_t get_seek_sample_count
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    uint32_t                           sample_number,
+    uint32_t                           rap_number
+)
+{
+    uint32_t decoding_sample_number = get_decoding_sample_number( vdhp->order_converter, sample_number );
+    return decoding_sample_number >= rap_number ? decoding_sample_number - rap_number + 1 : 1;
+}
+
+/* Decide whether the requested sample after the last one is reached by decoding forward by the measured costs
+ * instead of the fixed threshold. */
+static int prefer_decoding_forward
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    uint32_t                           sample_number
+)
+{
+    uint32_t rap_number;
+    find_random_accessible_point( vdhp, sample_number, 0, &rap_number );
+    if( rap_number == vdhp->last_rap_number )
+        /* Seeking doesn't skip any sample. */
+        return 1;
+    return seek_cost_model_prefer_forward( &vdhp->seek_cost,
+                                           sample_number - vdhp->last_sample_number,
+                                           get_seek_sample_count( vdhp, sample_number, rap_number ) );
+}
+
 static int get_requested_picture
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -816,6 +901,18 @@ static int get_requested_picture
 #define MAX_ERROR_COUNT 3       /* arbitrary */
     codec_configuration_t *config = &vdhp->config;
     uint32_t config_index;
+    AVFrame *cached_frame = picture == vdhp->frame_buffer
+                          ? lw_video_frame_cache_get( &vdhp->frame_cache, sample_number )
+                          : NULL;
+    if( cached_frame )
+    {
+        /* The decoder state is left as it is. */
+        if( lw_video_frame_cache_output( &vdhp->frame_cache, picture, cached_frame ) < 0 )
+            goto video_fail;
+        return 0;
+    }
+    /* The decoder state might refer to the content of the frame buffer before the cached frame was output. */
+    lw_video_frame_cache_restore( &vdhp->frame_cache, vdhp->frame_buffer );
     if( sample_number < vdhp->first_valid_frame_number || vdhp->sample_count == 1 )
     {
         /* Get the index of the decoder configuration. */
@@ -836,11 +933,18 @@ static int get_requested_picture
     uint32_t rap_number;    /* number of sample, for seeking, where decoding starts excluding decoding delay */
     int seek_mode = vdhp->seek_mode;
     int roll_recovery = 0;
+    int adaptive_seek = vdhp->forward_seek_threshold == 0;
+    int seeked        = 0;
+    uint32_t fed_count; /* number of samples expected to be decoded for the cost model */
+    if( adaptive_seek )
+        seek_cost_model_start( &vdhp->seek_cost );
     if( sample_number > vdhp->last_sample_number
-     && sample_number <= vdhp->last_sample_number + vdhp->forward_seek_threshold )
+     && (adaptive_seek ? prefer_decoding_forward( vdhp, sample_number )
+                       : sample_number <= vdhp->last_sample_number + vdhp->forward_seek_threshold) )
     {
         start_number = vdhp->last_sample_number + 1 + config->delay_count;
         rap_number   = vdhp->last_rap_number;
+        fed_count    = sample_number - vdhp->last_sample_number;
     }
     else
     {
@@ -849,9 +953,12 @@ static int get_requested_picture
         {
             roll_recovery = 0;
             start_number  = vdhp->last_sample_number + 1 + config->delay_count;
+            fed_count     = sample_number - vdhp->last_sample_number;
         }
         else
         {
+            fed_count = get_seek_sample_count( vdhp, sample_number, rap_number );
+            seeked    = 1;
             /* Require starting to decode from random accessible sample. */
             vdhp->last_rap_number = rap_number;
             start_number = seek_video( vdhp, picture, sample_number, rap_number, roll_recovery || seek_mode != SEEK_MODE_NORMAL );
@@ -890,7 +997,11 @@ static int get_requested_picture
             }
         }
         start_number = seek_video( vdhp, picture, sample_number, rap_number, roll_recovery || seek_mode != SEEK_MODE_NORMAL );
+        /* Retries are not measured since they are not what the decision expects. */
+        fed_count = 0;
     }
+    if( adaptive_seek )
+        seek_cost_model_update( &vdhp->seek_cost, fed_count, seeked );
     vdhp->last_sample_number = sample_number;
     config_index = config->index;
 return_frame:;
@@ -900,6 +1011,7 @@ return_frame:;
         config->ctx->width = extended->width;
     if( config->ctx->height > extended->height )
         config->ctx->height = extended->height;
+    lw_video_frame_cache_put( &vdhp->frame_cache, sample_number, picture, picture->pts );
     return 0;
 video_fail:
     /* fatal error of decoding */
@@ -989,6 +1101,34 @@ static uint32_t libavsmash_vfr2cfr
 /* Return 0 if successful.
  * Return 1 if the same frame was requested at the last call.
  * Return a negative value otherwise. */
+static int read_ahead_decode
+(
+    void     *handler,
+    AVFrame  *frame,
+    uint32_t  sample_number
+)
+{
+    return get_requested_picture( (libavsmash_video_decode_handler_t *)handler, frame, sample_number );
+}
+
+/* The decoder outputs only to the frame buffer of the read-ahead from now on,
+ * so the decoded frame cache, which works on the frame buffer of the handler, is discarded. */
+static void start_read_ahead
+(
+    libavsmash_video_decode_handler_t *vdhp
+)
+{
+    lw_video_frame_cache_cleanup( &vdhp->frame_cache );
+    vdhp->frame_cache.budget = 0;
+    vdhp->read_ahead = lw_video_read_ahead_create( vdhp->read_ahead_depth, vdhp->sample_count,
+                                                   read_ahead_decode, vdhp, &vdhp->config.lh );
+    if( !vdhp->read_ahead )
+    {
+        lw_log_show( &vdhp->config.lh, LW_LOG_WARNING, "Failed to start the read-ahead. Frames are decoded on demand." );
+        vdhp->read_ahead_depth = 0;
+    }
+}
+
 int libavsmash_video_get_frame
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -996,17 +1136,32 @@ int libavsmash_video_get_frame
     uint32_t                           sample_number
 )
 {
+    if( vdhp->read_ahead_depth > 0 && !vdhp->read_ahead )
+        start_read_ahead( vdhp );
     if( vohp->vfr2cfr )
     {
+        if( vdhp->read_ahead )
+            lw_video_read_ahead_lock_decoder( vdhp->read_ahead );
         sample_number = libavsmash_vfr2cfr( vdhp, vohp, sample_number );
+        if( vdhp->read_ahead )
+            lw_video_read_ahead_unlock_decoder( vdhp->read_ahead );
         if( sample_number == 0 )
             return -1;
     }
-    if( sample_number == vdhp->last_sample_number )
-        return 1;
     int ret;
-    if( (ret = get_requested_picture( vdhp, vdhp->frame_buffer, sample_number )) < 0
-     || (ret = update_scaler_configuration_if_needed( &vohp->scaler, &vdhp->config.lh, vdhp->frame_buffer )) < 0 )
+    if( vdhp->read_ahead )
+    {
+        if( (ret = lw_video_read_ahead_get_frame( vdhp->read_ahead, vdhp->frame_buffer, sample_number )) != 0 )
+            return ret;
+    }
+    else
+    {
+        if( sample_number == vdhp->last_sample_number && !vdhp->frame_cache.stashed )
+            return 1;
+        if( (ret = get_requested_picture( vdhp, vdhp->frame_buffer, sample_number )) < 0 )
+            return ret;
+    }
+    if( (ret = update_scaler_configuration_if_needed( &vohp->scaler, libavsmash_video_get_log_handler( vdhp ), vdhp->frame_buffer )) < 0 )
         return ret;
     return 0;
 }
@@ -1071,6 +1226,12 @@ int libavsmash_video_is_keyframe
 )
 {
     if( vohp->vfr2cfr )
+    {
+        if( vdhp->read_ahead )
+            lw_video_read_ahead_lock_decoder( vdhp->read_ahead );
         sample_number = libavsmash_vfr2cfr( vdhp, vohp, sample_number );
+        if( vdhp->read_ahead )
+            lw_video_read_ahead_unlock_decoder( vdhp->read_ahead );
+    }
     return vdhp->keyframe_list[sample_number];
 }
@@ -76,6 +76,7 @@ void libavsmash_video_set_track_id
     uint32_t                           track_id
 );
 
+/* If forward_seek_threshold is 0, whether to seek or not is decided by the costs measured while decoding. */
 void libavsmash_video_set_forward_seek_threshold
 (
     libavsmash_video_decode_handler_t *vdhp,
@@ -88,6 +89,29 @@ void libavsmash_video_set_seek_mode
     int                                seek_mode
 );
 
+/* Set the byte budget of the decoded frame cache. 0 disables the cache. */
+void libavsmash_video_set_frame_cache_size
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    size_t                             frame_cache_size
+);
+
+/* Set the maximum number of frames decoded in advance by a worker thread under sequential access.
+ * 0 disables it. The decoded frame cache is not used if enabled. */
+void libavsmash_video_set_read_ahead
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    int                                read_ahead_depth
+);
+
+/* Set to 1 to replace the decoder at every seek with the one opened in advance by a pool of decoders,
+ * which closes the old one in the background. 0 disables it, and then decoders are opened and closed in place. */
+void libavsmash_video_set_decoder_pool
+(
+    libavsmash_video_decode_handler_t *vdhp,
+    int                                decoder_pool
+);
+
 void libavsmash_video_set_preferred_decoder_names
 (
     libavsmash_video_decode_handler_t *vdhp,
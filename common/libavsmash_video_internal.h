@@ -35,7 +35,8 @@ struct libavsmash_video_decode_handler_tag
     uint32_t              track_id;
     codec_configuration_t config;
     AVFrame              *frame_buffer;
-    uint32_t              forward_seek_threshold;
+    uint32_t              forward_seek_threshold;   /* 0 means that the decision is done by seek_cost */
+    seek_cost_model_t     seek_cost;
     int                   seek_mode;
     order_converter_t    *order_converter;
     uint8_t              *keyframe_list;
@@ -47,4 +48,7 @@ struct libavsmash_video_decode_handler_tag
     uint32_t              media_timescale;
     uint64_t              media_duration;
     uint64_t              min_cts;
+    lw_video_frame_cache_t frame_cache;     /* decoded frames keyed by composition sample number */
+    int                   read_ahead_depth; /* the maximum number of frames read ahead, 0 if disabled */
+    lw_video_read_ahead_t *read_ahead;      /* started at the first request if enabled */
 };
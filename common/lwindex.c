@@ -39,6 +39,7 @@ extern "C"
 #include "utils.h"
 #include "video_output.h"
 #include "audio_output.h"
+#include "decode.h"
 #include "lwlibav_dec.h"
 #include "lwlibav_video.h"
 #include "lwlibav_video_internal.h"
@@ -46,15 +47,97 @@ extern "C"
 #include "lwlibav_audio_internal.h"
 #include "progress.h"
 #include "lwindex.h"
-#include "decode.h"
+
+/* Opt-in instrumentation of indexing, enabled by the environment variable LWINDEX_STATS.
+ * The time spent in each stage and the amount of demuxed packets are accumulated per stream,
+ * and reported through the log handler, and appended to the file LWINDEX_STATS names unless it is "1". */
+enum
+{
+    LWINDEX_STAGE_DEMUX = 0,    /* read_av_frame() */
+    LWINDEX_STAGE_BSF,          /* bitstream filtering */
+    LWINDEX_STAGE_PARSE,        /* av_parser_parse2() */
+    LWINDEX_STAGE_DECODE,       /* decoding to get picture types or audio frame lengths */
+    LWINDEX_STAGE_PIX_FMT,      /* decoding to get the pixel format */
+    LWINDEX_STAGE_WRITE,        /* writing the index file */
+    LWINDEX_STAGE_COUNT
+};
+
+typedef struct
+{
+    int64_t wall;               /* in microseconds */
+    int64_t cpu;                /* in microseconds */
+} lwindex_stage_time_t;
+
+typedef struct
+{
+    uint64_t             packets;
+    uint64_t             bytes;
+    uint64_t             allocations;   /* heap allocations for packets and extradata made per packet by the indexer */
+    lwindex_stage_time_t stage[LWINDEX_STAGE_COUNT];
+} lwindex_stats_t;
+
+static inline void count_index_allocation
+(
+    lwindex_stats_t *stats
+)
+{
+    if( stats )
+        ++ stats->allocations;
+}
+
+static inline void start_index_stage
+(
+    lwindex_stats_t      *stats,
+    lwindex_stage_time_t *start
+)
+{
+    if( !stats )
+        return;
+    start->wall = lw_get_wall_clock();
+    start->cpu  = lw_get_thread_cpu_time();
+}
+
+/* Add the time elapsed since start to the stage, and then set it to start. */
+static inline void end_index_stage
+(
+    lwindex_stats_t      *stats,
+    int                   stage,
+    lwindex_stage_time_t *start
+)
+{
+    if( !stats )
+        return;
+    start->wall = lw_get_wall_clock()      - start->wall;
+    start->cpu  = lw_get_thread_cpu_time() - start->cpu;
+    stats->stage[stage].wall += start->wall;
+    stats->stage[stage].cpu  += start->cpu;
+}
+
+/* The hash table to look up the extradata list of an index helper by the content of extradata
+ * Broadcast streams repeat the same parameter sets at every random accessible point,
+ * so the lookup is done per keyframe and shall not depend on the number of extradata entries. */
+typedef struct
+{
+    uint64_t hash;
+    int      index;     /* the index of the extradata entry, or -1 if the slot is empty */
+} lwindex_extradata_slot_t;
+
+typedef struct
+{
+    lwindex_extradata_slot_t *slots;
+    int                       size;         /* the number of slots, a power of 2 */
+    int                       entry_count;  /* the number of extradata entries registered in the table */
+} lwindex_extradata_table_t;
 
 typedef struct
 {
     lwlibav_extradata_handler_t exh;
+    lwindex_extradata_table_t   extradata_table;    /* kept along with exh */
     AVCodecContext             *codec_ctx;
     AVCodecParserContext       *parser_ctx;
     const AVBitStreamFilter    *bsf;
     AVBSFContext               *bsf_ctx;
+    AVPacket                   *bsf_pkt;        /* reused to send packets to the bitstream filter */
     AVFrame                    *picture;
     AVPacket                    pkt;
     uint32_t                    delay_count;
@@ -65,9 +148,47 @@ typedef struct
                                                  * 1: either VC-1 or WMV3
                                                  * 2: either VC-1 or WMV3 encapsulated in ASF */
     int                         already_decoded;
+    uint64_t                    audio_duration; /* the total frame length, counted only for the active audio stream */
+    lwindex_stats_t            *stats;          /* NULL unless the instrumentation is enabled */
     int (*decode)(AVCodecContext *, AVFrame *, int *, AVPacket * );
 } lwindex_helper_t;
 
+/* The status of the input file recorded in the index file.
+ * The fingerprint is the hash of sampled bytes and is examined only if the size or the modification time differs. */
+#define LWINDEX_FINGERPRINT_EDGE_SIZE   (64 * 1024)
+#define LWINDEX_FINGERPRINT_BLOCK_SIZE  (4 * 1024)
+#define LWINDEX_FINGERPRINT_BLOCK_COUNT 32
+
+typedef struct
+{
+    int64_t  size;
+    int64_t  mtime;
+    uint64_t fingerprint;
+} lwindex_file_status_t;
+
+/* The state to extend the index file of a growing input file, or to resume indexing from a checkpoint.
+ * The records from index_pos of the index file are rewritten by demuxing from seek_pos of the input file. */
+typedef struct
+{
+    int64_t                      seek_pos;              /* the file offset where demuxing resumes */
+    int64_t                      index_pos;             /* the offset of the first rewritten record in the index file */
+    int32_t                      resume_point_pos;      /* the offset of <ResumePoint> in the index file */
+    int                          active_video_index;
+    int                          active_audio_index;
+    int                          number_of_streams;
+    int64_t                     *last_pos;              /* the file offset of the last kept packet per stream */
+    lwlibav_extradata_handler_t *exh;                   /* the extradata lists per stream */
+    int                          resumed;               /* 1: the index file has been extended */
+} lwindex_resume_t;
+
+/* While creating the text index file of an MPEG-TS/PS file, a checkpoint is written into the file
+ * whose name is the index file name followed by this extension, every time demuxing proceeds by the interval,
+ * which opt->checkpoint_interval overrides.
+ * If indexing is aborted, the next indexing is resumed from the last checkpoint.
+ * No checkpoint is taken while byte ranges are indexed in parallel, so ranged indexing aborted is not resumed. */
+#define LWINDEX_CHECKPOINT_EXTENSION    ".ckpt"
+#define LWINDEX_CHECKPOINT_INTERVAL     (INT64_C(256) * 1024 * 1024)
+
 typedef struct
 {
     int                number_of_helpers;
@@ -76,8 +197,101 @@ typedef struct
     const char       **preferred_audio_decoder_names;
     int                thread_count;
     char              *format_name;
+    lwindex_resume_t  *resume;
+    lwindex_stats_t   *stats;       /* the total over all streams, or NULL unless the instrumentation is enabled */
 } lwindex_indexer_t;
 
+/* A demuxed packet and the results of the stream specific parsing of it. */
+typedef struct
+{
+    AVPacket            pkt;
+    AVStream           *stream;
+    lwindex_helper_t   *helper;
+    int                 worker;             /* the parse worker in charge of this packet */
+    int                 active_audio;       /* 1: the packet belongs to the active audio stream */
+    int                 done;
+    int                 error;
+    int                 extradata_index;
+    enum AVMediaType    codec_type;
+    enum AVCodecID      codec_id;
+    /* video */
+    int                 pre_width;          /* resolution and color space prior to picture type investigation */
+    int                 pre_height;
+    enum AVColorSpace   pre_colorspace;
+    int                 pict_type;
+    int                 poc;
+    int                 repeat_pict;
+    lw_field_info_t     field_info;
+    int                 invisible;
+    int                 width;
+    int                 height;
+    enum AVPixelFormat  pix_fmt;
+    enum AVColorSpace   colorspace;
+    /* audio */
+    int                 bits_per_sample;
+    int                 frame_length;
+    uint32_t            delay_count;
+    int                 channels;
+    uint64_t            channel_layout;
+    int                 sample_rate;
+    enum AVSampleFormat sample_fmt;
+} lwindex_packet_t;
+
+typedef struct lwindex_text_chunk_tag lwindex_text_chunk_t;
+struct lwindex_text_chunk_tag
+{
+    lwindex_text_chunk_t *next;
+    int32_t               pos;              /* -1: append, otherwise: overwrite at this position */
+    size_t                size;
+    size_t                capacity;
+    char                 *data;
+};
+
+typedef struct lwindex_pipeline_tag lwindex_pipeline_t;
+
+typedef struct
+{
+    lwindex_pipeline_t *pipeline;
+    int                 id;
+    AVFrame            *frame_buffer;
+} lwindex_worker_t;
+
+/* Staged indexing: a demuxer thread, parse workers each of which takes charge of a fixed set of streams
+ * so that the packet order is kept within a stream, and a writer thread for the text index file.
+ * Packets are committed to the frame lists in the demuxed order by the caller of create_index().
+ * If number_of_workers is 0, every stage runs on the caller thread. */
+struct lwindex_pipeline_tag
+{
+    AVFormatContext      *format_ctx;
+    lwindex_indexer_t    *indexer;
+    lwlibav_option_t     *opt;
+    FILE                 *index;
+    AVFrame              *frame_buffer;
+    int                   active_audio_index;
+    int                   number_of_workers;
+    lwindex_worker_t     *workers;
+    lw_thread_t          *demuxer_thread;
+    lw_thread_t         **worker_threads;
+    lw_thread_t          *writer_thread;
+    lw_mutex_t           *mutex;
+    lw_cond_t            *cond;
+    lwindex_packet_t     *packets;
+    uint32_t              queue_size;
+    uint64_t              demuxed;
+    uint64_t              committed;
+    int                   eof;
+    int                   abort;
+    int                   hold;             /* 1: the demuxer stops for a checkpoint */
+    int                   demuxing;         /* 1: the demuxer is reading a packet */
+    /* writer */
+    int64_t               text_pos;         /* the offset where the next appended text is written */
+    lwindex_text_chunk_t *chunk;            /* the chunk being filled by the caller */
+    lwindex_text_chunk_t *chunk_head;       /* the chunks waiting for being written */
+    lwindex_text_chunk_t *chunk_tail;
+    int                   writer_eof;
+    int                   writing;          /* 1: the writer is writing a chunk */
+};
+
 typedef struct
 {
     int64_t pts;
@@ -90,6 +304,336 @@ typedef struct
     video_timestamp_t core;
 } video_timestamp_temp_t;
 
+/*
+    # Structure of Libav reader binary index file
+    All values are stored in the native byte order, and the file is mapped onto memory at loading.
+    The header is written at the last, so an incomplete file is never accepted.
+    [header]                        lwindex_binary_header_t
+    [section]                       aligned to 8 bytes
+        LWINDEX_SECTION_INPUT_FILE_PATH : null terminated string
+        LWINDEX_SECTION_FORMAT_NAME     : null terminated string
+        LWINDEX_SECTION_FRAMES          : lwindex_video_record_t or lwindex_audio_record_t per packet of each stream
+        LWINDEX_SECTION_PACKED_FRAMES   : packed lwindex_video_record_t or lwindex_audio_record_t per packet of each stream
+        LWINDEX_SECTION_INDEX_ENTRIES   : lwindex_index_entry_record_t per AVIndexEntry of each stream
+        LWINDEX_SECTION_EXTRADATA       : lwindex_extradata_record_t followed by extradata aligned to 8 bytes
+    ...
+    [section table]                 lwindex_binary_section_t * section_count
+ */
+#define LWINDEX_BINARY_MAGIC            "LWINDEXB"
+#define LWINDEX_BINARY_MAGIC_SIZE       8
+#define LWINDEX_BINARY_BYTE_ORDER_MARK  0x01020304
+#define LWINDEX_BINARY_ALIGNMENT        8
+
+#define LWINDEX_SECTION_INPUT_FILE_PATH 1
+#define LWINDEX_SECTION_FORMAT_NAME     2
+#define LWINDEX_SECTION_FRAMES          3
+#define LWINDEX_SECTION_INDEX_ENTRIES   4
+#define LWINDEX_SECTION_EXTRADATA       5
+#define LWINDEX_SECTION_PACKED_FRAMES   6
+
+/*
+    # Packed frame records
+    Each record starts with a byte of LWINDEX_PACKED_*s, followed by variable length integers in this order.
+        pos, pts and dts            : the differences from the previous record
+                                      pts and dts are omitted if AV_NOPTS_VALUE, and then not updated as the base
+        pict_type, poc, repeat_pict and field_info  (video only)
+        the rest of the fields      : present only if LWINDEX_PACKED_* indicates the change from the previous record
+    Variable length integers hold 7 bits per byte from the least significant ones, and the most significant bit of each
+    byte indicates whether any byte follows. Signed values are zigzag encoded, i.e. 0, -1, 1, -2, ... map to 0, 1, 2, 3, ...
+    All fields of the first record are present.
+ */
+#define LWINDEX_PACKED_KEY              0x01    /* video */
+#define LWINDEX_PACKED_PTS_NONE         0x02
+#define LWINDEX_PACKED_DTS_NONE         0x04
+#define LWINDEX_PACKED_EXTRADATA        0x08
+#define LWINDEX_PACKED_RESOLUTION       0x10    /* video : width and height */
+#define LWINDEX_PACKED_PIX_FMT          0x20    /* video */
+#define LWINDEX_PACKED_COLORSPACE       0x40    /* video */
+#define LWINDEX_PACKED_CHANNELS         0x10    /* audio : channels and channel_layout */
+#define LWINDEX_PACKED_SAMPLE_RATE      0x20    /* audio */
+#define LWINDEX_PACKED_SAMPLE_FMT       0x40    /* audio : sample_fmt and bits_per_sample */
+#define LWINDEX_PACKED_FRAME_LENGTH     0x80    /* audio */
+#define LWINDEX_PACKED_RECORD_MAX_SIZE  (1 + 14 * 10)
+
+typedef struct
+{
+    uint8_t  magic[LWINDEX_BINARY_MAGIC_SIZE];
+    uint32_t lwindex_version;
+    uint32_t index_file_version;
+    uint32_t byte_order_mark;
+    uint32_t avutil_version;        /* Pixel and sample formats are stored as enumerators of libavutil. */
+    uint32_t format_flags;
+    int32_t  raw_demuxer;
+    int32_t  active_video_index;
+    int32_t  active_audio_index;
+    uint32_t section_count;
+    uint32_t reserved;
+    uint64_t section_table_offset;
+    int64_t  input_file_size;
+    int64_t  input_file_mtime;
+    uint64_t input_file_fingerprint;
+} lwindex_binary_header_t;
+
+typedef struct
+{
+    uint32_t type;
+    int32_t  stream_index;
+    int32_t  codec_type;
+    int32_t  codec_id;
+    int32_t  time_base_num;
+    int32_t  time_base_den;
+    int64_t  stream_duration;
+    uint32_t entry_count;
+    uint32_t entry_size;
+    uint64_t offset;
+    uint64_t size;
+} lwindex_binary_section_t;
+
+typedef struct
+{
+    int64_t pos;
+    int64_t pts;
+    int64_t dts;
+    int32_t extradata_index;
+    int32_t key;
+    int32_t pict_type;
+    int32_t poc;
+    int32_t repeat_pict;
+    int32_t field_info;
+    int32_t width;
+    int32_t height;
+    int32_t pix_fmt;
+    int32_t colorspace;
+} lwindex_video_record_t;
+
+typedef struct
+{
+    int64_t  pos;
+    int64_t  pts;
+    int64_t  dts;
+    uint64_t channel_layout;
+    int32_t  extradata_index;
+    int32_t  channels;
+    int32_t  sample_rate;
+    int32_t  sample_fmt;
+    int32_t  bits_per_sample;
+    int32_t  frame_length;
+} lwindex_audio_record_t;
+
+typedef struct
+{
+    int64_t pos;
+    int64_t timestamp;
+    int32_t flags;
+    int32_t size;
+    int32_t min_distance;
+    int32_t reserved;
+} lwindex_index_entry_record_t;
+
+typedef struct
+{
+    int32_t  extradata_size;
+    int32_t  codec_id;
+    uint32_t codec_tag;
+    int32_t  width;
+    int32_t  height;
+    int32_t  pixel_format;
+    int32_t  video_delay;
+    uint64_t channel_layout;
+    int32_t  sample_format;
+    int32_t  sample_rate;
+    int32_t  bits_per_sample;
+    int32_t  block_align;
+} lwindex_extradata_record_t;
+
+typedef struct
+{
+    int32_t    codec_type;
+    int32_t    codec_id;
+    AVRational time_base;
+    uint32_t   record_count;
+    size_t     size;
+    size_t     capacity;
+    uint8_t   *records;         /* packed records, or fixed-size records if fixed_records */
+    union
+    {
+        lwindex_video_record_t video;
+        lwindex_audio_record_t audio;
+    } last;                     /* the base of the next packed record */
+} lwindex_binary_frames_t;
+
+typedef struct
+{
+    FILE                     *fp;
+    uint64_t                  offset;
+    int                       error;
+    int                       number_of_streams;
+    lwindex_binary_frames_t  *frames;
+    lwindex_binary_section_t *sections;
+    uint32_t                  section_count;
+    int32_t                   active_video_index;
+    int32_t                   active_audio_index;
+    lwindex_file_status_t     file_status;
+    int                       fixed_records;    /* Write LWINDEX_SECTION_FRAMES instead of LWINDEX_SECTION_PACKED_FRAMES. */
+} lwindex_binary_writer_t;
+
+/* Frame lists under construction are stored in fixed size chunks instead of an array grown by realloc,
+ * so that growing them neither copies the stored frames nor leaves the doubled capacity unused.
+ * Once every frame is stored, the chunks are gathered into an array of the exact size. */
+#define LWINDEX_FRAME_CHUNK_SHIFT       16
+#define LWINDEX_FRAME_CHUNK_SIZE        (1 << LWINDEX_FRAME_CHUNK_SHIFT)
+
+typedef struct
+{
+    size_t    entry_size;
+    uint32_t  number_of_chunks;
+    uint32_t  chunk_table_size;
+    uint8_t **chunks;
+} lwindex_frame_store_t;
+
+/* The state of frame lists under reconstruction from an index file. */
+typedef struct
+{
+    lwindex_frame_store_t video_store;
+    lwindex_frame_store_t audio_store;
+    video_frame_info_t   *video_info;       /* gathered from video_store */
+    audio_frame_info_t   *audio_info;       /* gathered from audio_store */
+    uint32_t              video_sample_count;
+    uint32_t              invisible_count;
+    int64_t               last_keyframe_pts;
+    uint32_t              audio_sample_count;
+    int                   audio_sample_rate;
+    int                   constant_frame_length;
+    uint64_t              audio_duration;
+} lwindex_parser_t;
+
+/* Return the entry of number, or NULL if the chunk of it is not allocated. */
+static inline void *get_frame_store_entry
+(
+    lwindex_frame_store_t *store,
+    uint32_t               number
+)
+{
+    uint32_t chunk_number = number >> LWINDEX_FRAME_CHUNK_SHIFT;
+    if( chunk_number >= store->number_of_chunks )
+        return NULL;
+    return store->chunks[chunk_number] + (size_t)(number & (LWINDEX_FRAME_CHUNK_SIZE - 1)) * store->entry_size;
+}
+
+static inline video_frame_info_t *get_video_frame_info
+(
+    lwindex_frame_store_t *store,
+    uint32_t               number
+)
+{
+    return (video_frame_info_t *)get_frame_store_entry( store, number );
+}
+
+static inline audio_frame_info_t *get_audio_frame_info
+(
+    lwindex_frame_store_t *store,
+    uint32_t               number
+)
+{
+    return (audio_frame_info_t *)get_frame_store_entry( store, number );
+}
+
+/* Return the entry of number after allocating zero-filled chunks up to it as needed, or NULL on failure. */
+static void *reserve_frame_store_entry
+(
+    lwindex_frame_store_t *store,
+    uint32_t               number
+)
+{
+    uint32_t chunk_number = number >> LWINDEX_FRAME_CHUNK_SHIFT;
+    while( store->number_of_chunks <= chunk_number )
+    {
+        if( store->number_of_chunks == store->chunk_table_size )
+        {
+            uint32_t chunk_table_size = store->chunk_table_size ? store->chunk_table_size << 1 : 16;
+            uint8_t **temp = (uint8_t **)realloc( store->chunks, chunk_table_size * sizeof(uint8_t *) );
+            if( !temp )
+                return NULL;
+            store->chunks           = temp;
+            store->chunk_table_size = chunk_table_size;
+        }
+        uint8_t *chunk = (uint8_t *)lw_malloc_zero( LWINDEX_FRAME_CHUNK_SIZE * store->entry_size );
+        if( !chunk )
+            return NULL;
+        store->chunks[ store->number_of_chunks ++ ] = chunk;
+    }
+    return get_frame_store_entry( store, number );
+}
+
+static void free_frame_store
+(
+    lwindex_frame_store_t *store
+)
+{
+    for( uint32_t i = 0; i < store->number_of_chunks; i++ )
+        free( store->chunks[i] );
+    lw_freep( &store->chunks );
+    store->number_of_chunks = 0;
+    store->chunk_table_size = 0;
+}
+
+/* Allocate the first chunk, which holds the entries from 0 as the frame lists begin with 1. */
+static int init_frame_store
+(
+    lwindex_frame_store_t *store,
+    size_t                 entry_size
+)
+{
+    memset( store, 0, sizeof(lwindex_frame_store_t) );
+    store->entry_size = entry_size;
+    return reserve_frame_store_entry( store, 0 ) ? 0 : -1;
+}
+
+/* Zero-fill the entries from 0 to count. */
+static void clear_frame_store
+(
+    lwindex_frame_store_t *store,
+    uint32_t               count
+)
+{
+    for( uint32_t i = 0; i < store->number_of_chunks && i <= (count >> LWINDEX_FRAME_CHUNK_SHIFT); i++ )
+        memset( store->chunks[i], 0, LWINDEX_FRAME_CHUNK_SIZE * store->entry_size );
+}
+
+/* Gather the entries from 0 to count into an array followed by a zero-filled entry, and free the chunks.
+ * Each chunk is freed as soon as it is copied, and the array is touched only by copying,
+ * so the memory in use hardly exceeds the size of the frame list in the meantime.
+ * Return the array on success, otherwise NULL. */
+static void *gather_frame_store
+(
+    lwindex_frame_store_t *store,
+    uint32_t               count
+)
+{
+    size_t   size       = ((size_t)count + 2) * store->entry_size;
+    size_t   chunk_size = LWINDEX_FRAME_CHUNK_SIZE * store->entry_size;
+    uint8_t *array      = (uint8_t *)malloc( size );
+    if( !array )
+    {
+        free_frame_store( store );
+        return NULL;
+    }
+    size_t offset = 0;
+    for( uint32_t i = 0; i < store->number_of_chunks; i++ )
+    {
+        if( offset < size )
+        {
+            memcpy( array + offset, store->chunks[i], MIN( chunk_size, size - offset ) );
+            offset += MIN( chunk_size, size - offset );
+        }
+        lw_freep( &store->chunks[i] );
+    }
+    if( offset < size )
+        memset( array + offset, 0, size - offset );
+    free_frame_store( store );
+    return array;
+}
+
 static inline int check_frame_reordering
 (
     video_frame_info_t *info,
@@ -138,7 +682,8 @@ static inline void sort_info_presentation_order
     uint32_t            sample_count
 )
 {
-    qsort( info, sample_count, sizeof(video_frame_info_t), (int(*)( const void *, const void * ))compare_info_pts );
+    if( lw_sort_records( info, sample_count, sizeof(video_frame_info_t), offsetof( video_frame_info_t, pts ) ) < 0 )
+        qsort( info, sample_count, sizeof(video_frame_info_t), (int(*)( const void *, const void * ))compare_info_pts );
 }
 
 static inline void sort_presentation_order
@@ -148,7 +693,8 @@ static inline void sort_presentation_order
     size_t             size
 )
 {
-    qsort( timestamp, sample_count, size, (int(*)( const void *, const void * ))compare_pts );
+    if( lw_sort_records( timestamp, sample_count, size, offsetof( video_timestamp_t, pts ) ) < 0 )
+        qsort( timestamp, sample_count, size, (int(*)( const void *, const void * ))compare_pts );
 }
 
 static inline void sort_decoding_order
@@ -158,7 +704,8 @@ static inline void sort_decoding_order
     size_t             size
 )
 {
-    qsort( timestamp, sample_count, size, (int(*)( const void *, const void * ))compare_dts );
+    if( lw_sort_records( timestamp, sample_count, size, offsetof( video_timestamp_t, dts ) ) < 0 )
+        qsort( timestamp, sample_count, size, (int(*)( const void *, const void * ))compare_dts );
 }
 
 static inline int lineup_seek_base_candidates
@@ -943,11 +1490,11 @@ static void create_video_frame_order_list
     int             enable_repeat   = 0;
     int             complete_frame  = 1;
     int             repeat_field    = 1;
-    lw_field_info_t next_field_info = info[1].field_info;
+    lw_field_info_t next_field_info = (lw_field_info_t)info[1].field_info;
     for( uint32_t i = 1; i <= frame_count; i++, order_count++ )
     {
         int             repeat_pict = info[i].repeat_pict;
-        lw_field_info_t field_info  = info[i].field_info;
+        lw_field_info_t field_info  = (lw_field_info_t)info[i].field_info;
         int             field_shift = !(repeat_pict & 1);
         if( field_info == LW_FIELD_INFO_UNKNOWN )
         {
@@ -1024,7 +1571,7 @@ static void create_video_frame_order_list
     {
         /* Check repeat_pict and field dominance. */
         int             repeat_pict = info[i].repeat_pict;
-        lw_field_info_t field_info  = info[i].field_info;
+        lw_field_info_t field_info  = (lw_field_info_t)info[i].field_info;
         order_list[t_count++].top    = i;
         order_list[b_count++].bottom = i;
         if( opt->apply_repeat_flag )
@@ -1205,6 +1752,7 @@ static lwlibav_extradata_t *alloc_extradata_entries
         entry->width           = 0;
         entry->height          = 0;
         entry->pixel_format    = AV_PIX_FMT_NONE;
+        entry->video_delay     = -1;
         entry->channel_layout  = 0;
         entry->sample_format   = AV_SAMPLE_FMT_NONE;
         entry->sample_rate     = 0;
@@ -1281,23 +1829,39 @@ static inline void av_init_packet_for_safe
     av_init_packet( pkt );
 }
 
+/* Grow the table of the index helpers so that it can hold at least 'number_of_helpers' entries. */
+static int reserve_index_helpers
+(
+    lwindex_indexer_t *indexer,
+    int                number_of_helpers
+)
+{
+    if( indexer->number_of_helpers >= number_of_helpers )
+        return 0;
+    const size_t old_alloc_size = indexer->number_of_helpers * sizeof(lwindex_helper_t *);
+    const size_t new_alloc_size = number_of_helpers          * sizeof(lwindex_helper_t *);
+    lwindex_helper_t **temp = (lwindex_helper_t **)av_realloc( indexer->helpers, new_alloc_size );
+    if( !temp )
+        return -1;
+    memset( (char *)temp + old_alloc_size, 0, new_alloc_size - old_alloc_size );
+    indexer->helpers           = temp;
+    indexer->number_of_helpers = number_of_helpers;
+    return 0;
+}
+
+/* With the indexing pipeline, this is called only from the demuxer thread while the workers are running.
+ * The table is reserved for the streams known at the start of the pipeline, but a stream added midway still
+ * moves it by the reallocation below. That is safe because the workers never look up the table; they only
+ * touch the helper through the pointer the demuxer attached to each packet (ipkt->helper), and the helpers
+ * themselves are never moved. Any other reader of the table runs while the pipeline is held or closed. */
 static lwindex_helper_t *get_index_helper
 (
     lwindex_indexer_t *indexer,
     AVStream          *stream
 )
 {
-    if( indexer->number_of_helpers <= stream->index )
-    {
-        const size_t old_alloc_size = indexer->number_of_helpers * sizeof(lwindex_indexer_t *);
-        const size_t new_alloc_size = (stream->index + 1)        * sizeof(lwindex_indexer_t *);
-        lwindex_helper_t **temp = (lwindex_helper_t **)av_realloc( indexer->helpers, new_alloc_size );
-        if( !temp )
-            return NULL;
-        memset( (char *)temp + old_alloc_size, 0, new_alloc_size - old_alloc_size );
-        indexer->helpers           = temp;
-        indexer->number_of_helpers = stream->index + 1;
-    }
+    if( reserve_index_helpers( indexer, stream->index + 1 ) < 0 )
+        return NULL;
     lwindex_helper_t *helper = indexer->helpers[ stream->index ];
     if( !helper )
     {
@@ -1306,6 +1870,15 @@ static lwindex_helper_t *get_index_helper
         if( !helper )
             return NULL;
         indexer->helpers[ stream->index ] = helper;
+        if( indexer->stats )
+            /* Just give up measuring this stream on failure. */
+            helper->stats = (lwindex_stats_t *)lw_malloc_zero( sizeof(lwindex_stats_t) );
+        if( indexer->resume && stream->index < indexer->resume->number_of_streams )
+        {
+            /* Take over the extradata list from the index file to be extended. */
+            helper->exh = indexer->resume->exh[ stream->index ];
+            memset( &indexer->resume->exh[ stream->index ], 0, sizeof(lwlibav_extradata_handler_t) );
+        }
         /* Set up the decoder. */
         AVCodecParameters *codecpar = stream->codecpar;
         const char **preferred_decoder_names = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
@@ -1389,12 +1962,12 @@ static lwindex_helper_t *get_index_helper
             av_packet_unref( &parsable_pkt );
         }
     }
-    else
-        helper->already_decoded = 0;
     return helper;
 }
 
 /* Apply bistream filter input packet. Allocate or reallocate AVBSFContext if needed.
+ * Apart from the output packet of the filter itself, no heap allocation is made per packet
+ * except for referencing the input packet.
  *
  * Return 0 and set out_pkt to the filtered packet on success.
  * Otherwise return a negative value. */
@@ -1420,12 +1993,21 @@ static int apply_bsf
         helper->bsf_ctx->time_base_in = ctx->time_base;
         if( (ret = av_bsf_init( helper->bsf_ctx )) < 0 )
             return ret;
+        count_index_allocation( helper->stats );
     }
-    /* Clone input packet since av_bsf_send_packet() moves sent packet to the internal packet buffer.
-     * The allocated packet will be reused for draining the remaining packets. */
-    AVPacket *pkt = av_packet_clone( in_pkt );
-    if( !pkt )
-        return -1;
+    /* Reference input packet since av_bsf_send_packet() moves sent packet to the internal packet buffer.
+     * The packet is kept in the index helper and reused for every input packet and for draining the remaining packets,
+     * so only a reference to the packet data is made here. */
+    if( !helper->bsf_pkt )
+    {
+        helper->bsf_pkt = av_packet_alloc();
+        if( !helper->bsf_pkt )
+            return -1;
+    }
+    AVPacket *pkt = helper->bsf_pkt;
+    if( (ret = av_packet_ref( pkt, in_pkt )) < 0 )
+        return ret;
+    count_index_allocation( helper->stats );
     in_pkt = pkt;   /* Don't send the original input packet to the bitstream filter. */
     /* Apply the filter actually here.
      * Note that ffmpeg's av_bsf_send_packet() does not set EOF by sending NULL payload packet while libav's does.
@@ -1442,16 +2024,25 @@ static int apply_bsf
         else if( ret == 0 )
             break;
     }
-    /* Update extradata of AVCodecContext if changed. */
+    /* Update extradata of AVCodecContext if changed.
+     * The current buffer is reused if the new extradata fits in it. */
     if( ctx->extradata_size != helper->bsf_ctx->par_out->extradata_size
      || memcmp( ctx->extradata, helper->bsf_ctx->par_out->extradata, helper->bsf_ctx->par_out->extradata_size ) )
     {
-        av_free( ctx->extradata );
-        ctx->extradata_size = 0;
-        ctx->extradata      = (uint8_t *)av_mallocz( helper->bsf_ctx->par_out->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
-        if( !ctx->extradata )
-            return -1;
+        if( !ctx->extradata || ctx->extradata_size < helper->bsf_ctx->par_out->extradata_size )
+        {
+            av_free( ctx->extradata );
+            ctx->extradata_size = 0;
+            ctx->extradata      = (uint8_t *)av_malloc( helper->bsf_ctx->par_out->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+            if( !ctx->extradata )
+            {
+                ret = -1;
+                goto fail;
+            }
+            count_index_allocation( helper->stats );
+        }
         memcpy( ctx->extradata, helper->bsf_ctx->par_out->extradata, helper->bsf_ctx->par_out->extradata_size );
+        memset( ctx->extradata + helper->bsf_ctx->par_out->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
         ctx->extradata_size = helper->bsf_ctx->par_out->extradata_size;
     }
     /* Drain all the remaining packets. */
@@ -1462,10 +2053,134 @@ static int apply_bsf
     }
     ret = 0;
 fail:
-    av_packet_free( &pkt );
+    av_packet_unref( pkt );
     return ret;
 }
 
+static uint64_t update_fingerprint
+(
+    uint64_t    hash,
+    const void *data,
+    size_t      size
+)
+{
+    /* 64-bit FNV-1a */
+    const uint8_t *p = (const uint8_t *)data;
+    for( size_t i = 0; i < size; i++ )
+        hash = (hash ^ p[i]) * UINT64_C(0x100000001b3);
+    return hash;
+}
+
+static uint64_t get_extradata_hash
+(
+    const uint8_t *extradata,
+    int            extradata_size
+)
+{
+    uint64_t hash = update_fingerprint( UINT64_C(0xcbf29ce484222325), &extradata_size, sizeof(int) );
+    return update_fingerprint( hash, extradata, extradata_size );
+}
+
+static void insert_extradata_slot
+(
+    lwindex_extradata_table_t *table,
+    uint64_t                   hash,
+    int                        index
+)
+{
+    int mask = table->size - 1;
+    int i    = (int)(hash & mask);
+    while( table->slots[i].index >= 0 )
+        i = (i + 1) & mask;
+    table->slots[i].hash  = hash;
+    table->slots[i].index = index;
+}
+
+/* Register the extradata entries appended since the last call into the table.
+ * Entries may be appended from several places such as resuming and merging ranges, so this is done lazily.
+ * Return 0 on success, otherwise -1. */
+static int update_extradata_table
+(
+    lwindex_extradata_table_t   *table,
+    lwlibav_extradata_handler_t *exhp
+)
+{
+    if( table->entry_count == exhp->entry_count )
+        return 0;
+    if( exhp->entry_count * 2 > table->size )
+    {
+        /* Keep the load factor at most 1/2. */
+        int size = table->size ? table->size : 16;
+        while( exhp->entry_count * 2 > size )
+            size <<= 1;
+        lwindex_extradata_slot_t *slots = (lwindex_extradata_slot_t *)lw_malloc_zero( size * sizeof(lwindex_extradata_slot_t) );
+        if( !slots )
+            return -1;
+        for( int i = 0; i < size; i++ )
+            slots[i].index = -1;
+        lw_free( table->slots );
+        table->slots       = slots;
+        table->size        = size;
+        table->entry_count = 0;
+    }
+    for( int i = table->entry_count; i < exhp->entry_count; i++ )
+        insert_extradata_slot( table, get_extradata_hash( exhp->entries[i].extradata, exhp->entries[i].extradata_size ), i );
+    table->entry_count = exhp->entry_count;
+    return 0;
+}
+
+static void free_extradata_table
+(
+    lwindex_extradata_table_t *table
+)
+{
+    lw_freep( &table->slots );
+    table->size        = 0;
+    table->entry_count = 0;
+}
+
+static inline int is_same_extradata
+(
+    const lwlibav_extradata_t *entry,
+    const uint8_t             *extradata,
+    int                        extradata_size,
+    enum AVCodecID             codec_id
+)
+{
+    return entry->extradata_size == extradata_size
+        && (entry->codec_id == AV_CODEC_ID_NONE || codec_id == AV_CODEC_ID_NONE || entry->codec_id == codec_id)
+        && (extradata_size == 0 || !memcmp( entry->extradata, extradata, extradata_size ));
+}
+
+/* Find the extradata entry having the same content for the same CODEC in the list of the index helper.
+ * Return the index of the found entry, otherwise -1. */
+static int find_extradata_entry
+(
+    lwindex_helper_t *helper,
+    const uint8_t    *extradata,
+    int               extradata_size,
+    enum AVCodecID    codec_id
+)
+{
+    lwlibav_extradata_handler_t *exhp  = &helper->exh;
+    lwindex_extradata_table_t   *table = &helper->extradata_table;
+    if( update_extradata_table( table, exhp ) < 0 )
+    {
+        /* Fall back to the linear search. */
+        for( int i = 0; i < exhp->entry_count; i++ )
+            if( is_same_extradata( &exhp->entries[i], extradata, extradata_size, codec_id ) )
+                return i;
+        return -1;
+    }
+    uint64_t hash = get_extradata_hash( extradata, extradata_size );
+    int      mask = table->size - 1;
+    for( int i = (int)(hash & mask); table->slots[i].index >= 0; i = (i + 1) & mask )
+        if( table->slots[i].hash == hash
+         && is_same_extradata( &exhp->entries[ table->slots[i].index ], extradata, extradata_size, codec_id ) )
+            return table->slots[i].index;
+    return -1;
+}
+
 #define IF_START_CODE( ptr ) if( (ptr)[0] == 0x00 && (ptr)[1] == 0x00 && (ptr)[2] == 0x01 )
 static int get_offset_to_h264_parameter_sets
 (
@@ -1543,7 +2258,9 @@ static int append_extradata_if_new
          * Here, we assume non-keyframes reference the latest extradata. */
         return list->current_index;
     /* Anyway, import extradata from AVCodecContext. */
-    lwlibav_extradata_t current = { ctx->extradata, ctx->extradata_size };
+    lwlibav_extradata_t current = { 0 };
+    current.extradata      = ctx->extradata;
+    current.extradata_size = ctx->extradata_size;
     /* Import extradata from a side data in the packet if present. */
     for( int i = 0; i < pkt->side_data_elems; i++ )
         if( pkt->side_data[i].type == AV_PKT_DATA_NEW_EXTRADATA )
@@ -1590,9 +2307,13 @@ static int append_extradata_if_new
                  * filtering is for exporting the extradata only and the filtered packet is not sent to the decoder. */
                 av_bsf_free( &helper->bsf_ctx );
                 AVPacket  filtered_pkt = { 0 };
+                lwindex_stage_time_t start;
+                start_index_stage( helper->stats, &start );
                 (void)apply_bsf( helper, ctx, &filtered_pkt, pkt, "aac_adtstoasc" );
+                end_index_stage( helper->stats, LWINDEX_STAGE_BSF, &start );
                 /* Decode actually to get output channels and sampling rate of AAC frame.
                  * Note that this is a side effect of this function. */
+                start_index_stage( helper->stats, &start );
                 int decode_complete;
                 int ret = helper->decode( ctx, helper->picture, &decode_complete, pkt );
                 if( ret > 0 && !decode_complete )
@@ -1605,6 +2326,7 @@ static int append_extradata_if_new
                     /* Reset the draining state. */
                     avcodec_flush_buffers( ctx );
                 }
+                end_index_stage( helper->stats, LWINDEX_STAGE_DECODE, &start );
                 helper->already_decoded = 1;
                 current.extradata      = ctx->extradata;
                 current.extradata_size = ctx->extradata_size;
@@ -1628,28 +2350,18 @@ static int append_extradata_if_new
             memset( entry->extradata + entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
         }
     }
-    else
+    else if( !is_same_extradata( &list->entries[ list->current_index ], current.extradata, current.extradata_size, ctx->codec_id ) )
     {
-        lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-        if( current.extradata_size != entry->extradata_size
-         || memcmp( current.extradata, entry->extradata, current.extradata_size ) )
+        /* Check if this extradata is a new one. If so, append it to the list.
+         * The same parameter sets seen at different positions in the stream share a single entry,
+         * which also avoids reconfiguring the decoder at decoding time. */
+        int index = find_extradata_entry( helper, current.extradata, current.extradata_size, ctx->codec_id );
+        if( index >= 0 )
+            list->current_index = index;
+        else
         {
-            /* Check if this extradata is a new one. If so, append it to the list. */
-            for( int i = 0; i < list->entry_count; i++ )
-            {
-                if( i == list->current_index )
-                    continue;   /* already compared */
-                entry = &list->entries[i];
-                if( current.extradata_size == entry->extradata_size
-                 && (current.extradata_size == 0 || !memcmp( current.extradata, entry->extradata, current.extradata_size )) )
-                {
-                    /* The same extradata is found. */
-                    list->current_index = i;
-                    return list->current_index;
-                }
-            }
             /* Append a new extradata. */
-            entry = alloc_extradata_entries( list, list->entry_count + 1 );
+            lwlibav_extradata_t *entry = alloc_extradata_entries( list, list->entry_count + 1 );
             if( !entry )
                 return -1;
             if( current.extradata && current.extradata_size > 0 )
@@ -1688,13 +2400,24 @@ static int make_packet_parsable
 {
     av_init_packet_for_safe( out_pkt );
     if( helper->vc1_wmv3 == 2 )
+    {
         /* Make a frame EBDU (0x0000010D). */
+        count_index_allocation( helper->stats );
         return make_vc1_ebdu( helper, in_pkt, out_pkt, 0x0D, ctx->codec_id == AV_CODEC_ID_VC1 || ctx->codec_id == AV_CODEC_ID_VC1IMAGE );
+    }
     if( !helper->bsf )
-        /* Just use input packet since no bitstream filters are defined for this packet. */
-        return av_packet_ref( out_pkt, in_pkt );
+    {
+        /* Just refer to input packet since no bitstream filters are defined for this packet.
+         * The output packet does not own the data, so the caller shall not unreference it. */
+        *out_pkt = *in_pkt;
+        return 1;
+    }
     /* Convert frame data into parsable bitstream format. */
-    return apply_bsf( helper, ctx, out_pkt, in_pkt, NULL );
+    lwindex_stage_time_t start;
+    start_index_stage( helper->stats, &start );
+    int ret = apply_bsf( helper, ctx, out_pkt, in_pkt, NULL );
+    end_index_stage( helper->stats, LWINDEX_STAGE_BSF, &start );
+    return ret;
 }
 
 static int get_picture_type
@@ -1711,11 +2434,15 @@ static int get_picture_type
     int ret = make_packet_parsable( helper, ctx, &filtered_pkt, pkt );
     if( ret < 0 )
         return ret;
+    int owned = (ret == 0);     /* filtered_pkt just refers to pkt unless owned */
     uint8_t *dummy;
     int      dummy_size;
+    lwindex_stage_time_t start;
+    start_index_stage( helper->stats, &start );
     av_parser_parse2( helper->parser_ctx, ctx,
                       &dummy, &dummy_size, filtered_pkt.data, filtered_pkt.size,
                       pkt->pts, pkt->dts, pkt->pos );
+    end_index_stage( helper->stats, LWINDEX_STAGE_PARSE, &start );
     /* One frame decoding.
      * Sometimes, the parser returns a picture type other than I-picture and BI-picture even if the frame is a keyframe.
      * Actual decoding fixes this issue.
@@ -1725,6 +2452,7 @@ static int get_picture_type
      && (filtered_pkt.flags & AV_PKT_FLAG_KEY)
      && (enum AVPictureType)helper->parser_ctx->pict_type != AV_PICTURE_TYPE_I )
     {
+        start_index_stage( helper->stats, &start );
         int decode_complete;
         helper->decode( ctx, helper->picture, &decode_complete, &filtered_pkt );
         if( !decode_complete )
@@ -1735,12 +2463,15 @@ static int get_picture_type
             null_pkt.size = 0;
             helper->decode( ctx, helper->picture, &decode_complete, &null_pkt );
         }
+        end_index_stage( helper->stats, LWINDEX_STAGE_DECODE, &start );
         if( (enum AVPictureType)helper->picture->pict_type != AV_PICTURE_TYPE_I )
             pkt->flags &= ~AV_PKT_FLAG_KEY;
-        av_packet_unref( &filtered_pkt );
+        if( owned )
+            av_packet_unref( &filtered_pkt );
         return helper->picture->pict_type > 0 ? helper->picture->pict_type : 0;
     }
-    av_packet_unref( &filtered_pkt );
+    if( owned )
+        av_packet_unref( &filtered_pkt );
     return helper->parser_ctx->pict_type > 0 ? helper->parser_ctx->pict_type : 0;
 }
 
@@ -1770,14 +2501,17 @@ static int get_audio_frame_length
 )
 {
     int frame_length;
+    lwindex_stage_time_t start;
     if( helper->parser_ctx )
     {
         /* Try to get from the parser. */
         uint8_t *dummy;
         int      dummy_size;
+        start_index_stage( helper->stats, &start );
         av_parser_parse2( helper->parser_ctx, ctx,
                           &dummy, &dummy_size, pkt->data, pkt->size,
                           pkt->pts, pkt->dts, pkt->pos );
+        end_index_stage( helper->stats, LWINDEX_STAGE_PARSE, &start );
         frame_length = helper->parser_ctx->duration;
     }
     else
@@ -1795,6 +2529,7 @@ static int get_audio_frame_length
             int ret          = 0;
             int output_audio = 0;
             int draining     = 0;
+            start_index_stage( helper->stats, &start );
             do
             {
                 if( temp.size == 0 )
@@ -1817,6 +2552,7 @@ static int get_audio_frame_length
             if( draining )
                 /* Reset the draining state. */
                 avcodec_flush_buffers( ctx );
+            end_index_stage( helper->stats, LWINDEX_STAGE_DECODE, &start );
         }
         if( frame_length == 0 )
         {
@@ -1889,33 +2625,236 @@ static inline void print_index
     va_end( args );
 }
 
-static inline void write_av_index_entry
+/* Get the fingerprint of the first 'size' bytes of the file opened as fp.
+ * Only the head, the tail and some blocks evenly spaced between them are read, so this is cheap even for huge files.
+ * Return 0 on success, otherwise -1. */
+static int get_file_fingerprint
 (
-    FILE         *index,
-    AVIndexEntry *ie
+    FILE     *fp,
+    int64_t   size,
+    uint64_t *fingerprint
 )
 {
-    print_index( index, "POS=%" PRId64 ",TS=%" PRId64 ",Flags=%x,Size=%d,Distance=%d\n",
-                 ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance );
+    uint8_t *buf = (uint8_t *)lw_malloc_zero( LWINDEX_FINGERPRINT_EDGE_SIZE );
+    if( !buf )
+        return -1;
+    uint64_t hash = update_fingerprint( UINT64_C(0xcbf29ce484222325), &size, sizeof(int64_t) );
+    for( int i = 0; i <= LWINDEX_FINGERPRINT_BLOCK_COUNT + 1; i++ )
+    {
+        /* The head, the blocks and then the tail. */
+        int64_t offset;
+        int64_t length;
+        if( i == 0 || i == LWINDEX_FINGERPRINT_BLOCK_COUNT + 1 )
+        {
+            length = MIN( size, LWINDEX_FINGERPRINT_EDGE_SIZE );
+            offset = i == 0 ? 0 : size - length;
+        }
+        else
+        {
+            length = MIN( size, LWINDEX_FINGERPRINT_BLOCK_SIZE );
+            offset = (size - length) / (LWINDEX_FINGERPRINT_BLOCK_COUNT + 1) * i;
+        }
+        if( lw_fseek( fp, offset, SEEK_SET ) < 0
+         || fread( buf, 1, (size_t)length, fp ) != (size_t)length )
+        {
+            lw_free( buf );
+            return -1;
+        }
+        hash = update_fingerprint( hash, buf, (size_t)length );
+    }
+    lw_free( buf );
+    *fingerprint = hash;
+    return 0;
 }
 
-static void write_video_extradata
+/* Get the status of the input file to detect its changes since indexing.
+ * If size is negative, the whole file is examined. Return 0 on success, otherwise -1. */
+static int get_input_file_status
 (
-    FILE                *index,
-    lwlibav_extradata_t *entry
+    const char            *file_path,
+    int64_t                size,
+    lwindex_file_status_t *status
 )
 {
-    if( !index )
+    FILE *fp = lw_fopen( file_path, "rb" );
+    if( !fp )
+        return -1;
+    status->size  = size < 0 ? lw_get_file_size( fp ) : size;
+    status->mtime = lw_get_file_mtime( fp );
+    int ret = status->size < 0 || status->mtime < 0 || get_file_fingerprint( fp, status->size, &status->fingerprint ) < 0 ? -1 : 0;
+    fclose( fp );
+    return ret;
+}
+
+/* Return 1 if the first status->size bytes of the input file seem unchanged since the status was recorded,
+ * otherwise return 0. The fingerprint is examined only if the size or the modification time differs. */
+static int is_input_file_unchanged
+(
+    const char                  *file_path,
+    int64_t                      file_size,
+    int64_t                      file_mtime,
+    const lwindex_file_status_t *status
+)
+{
+    if( status->size < 0 || file_size < status->size )
+        return 0;
+    if( file_size == status->size && file_mtime == status->mtime && file_mtime >= 0 )
+        return 1;
+    lwindex_file_status_t current;
+    return get_input_file_status( file_path, status->size, &current ) == 0
+        && current.fingerprint == status->fingerprint;
+}
+
+/* Write the resume point and the status of the input file at the fixed position resume_point_pos.
+ * If status is NULL, the index file is marked as incomplete. */
+static void update_resume_point
+(
+    FILE                        *index,
+    int32_t                      resume_point_pos,
+    const lwindex_file_status_t *status,
+    int64_t                      index_pos
+)
+{
+    static const lwindex_file_status_t invalid_status = { -1, -1, 0 };
+    if( !status )
+        status = &invalid_status;
+    int64_t current_pos = lw_ftell( index );
+    fseek( index, resume_point_pos, SEEK_SET );
+    fprintf( index, "<ResumePoint>%+021" PRId64 ",%+021" PRId64 "</ResumePoint>\n", status->size, index_pos );
+    fprintf( index, "<InputFileStatus>%+021" PRId64 ",0x%016" PRIx64 "</InputFileStatus>\n", status->mtime, status->fingerprint );
+    if( current_pos > resume_point_pos )
+        lw_fseek( index, current_pos, SEEK_SET );
+}
+
+/* Return 1 if the demuxer can resume from any file offset where a packet starts, otherwise return 0. */
+static inline int is_appendable_format
+(
+    const char *format_name
+)
+{
+    return !strcmp( format_name, "mpegts" ) || !strcmp( format_name, "mpeg" );
+}
+
+/* The header line of each section per stream following the records in the text index file ends with the byte size
+ * of the section body, so that the loader can skip the sections of the streams which are not active.
+ * The size is unknown until the body is written, so it is reserved by begin_index_section() and then filled in place
+ * by end_index_section(). */
+#define LWINDEX_SECTION_SIZE_FORMAT ",Size=%+011d>\n"
+#define LWINDEX_SECTION_SIZE_LENGTH 19  /* the length of the string LWINDEX_SECTION_SIZE_FORMAT prints */
+
+/* Return the position of the section body. */
+static int64_t begin_index_section
+(
+    FILE *index
+)
+{
+    if( !index )
+        return -1;
+    fprintf( index, LWINDEX_SECTION_SIZE_FORMAT, 0 );
+    return lw_ftell( index );
+}
+
+static void end_index_section
+(
+    FILE   *index,
+    int64_t body_pos
+)
+{
+    if( !index )
+        return;
+    int64_t end_pos = lw_ftell( index );
+    lw_fseek( index, body_pos - LWINDEX_SECTION_SIZE_LENGTH, SEEK_SET );
+    fprintf( index, LWINDEX_SECTION_SIZE_FORMAT, (int)(end_pos - body_pos) );
+    lw_fseek( index, end_pos, SEEK_SET );
+}
+
+static inline void write_av_index_entry
+(
+    FILE         *index,
+    AVIndexEntry *ie
+)
+{
+    print_index( index, "POS=%" PRId64 ",TS=%" PRId64 ",Flags=%x,Size=%d,Distance=%d\n",
+                 ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance );
+}
+
+static void write_video_extradata
+(
+    FILE                *index,
+    lwlibav_extradata_t *entry
+)
+{
+    if( !index )
         return;
-    fprintf( index, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%s,BPS=%d\n",
+    fprintf( index, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%s,BPS=%d,Delay=%d\n",
              entry->extradata_size, entry->codec_id, entry->codec_tag, entry->width, entry->height,
              av_get_pix_fmt_name( entry->pixel_format ) ? av_get_pix_fmt_name( entry->pixel_format ) : "none",
-             entry->bits_per_sample );
+             entry->bits_per_sample, entry->video_delay );
     if( entry->extradata_size > 0 )
         fwrite( entry->extradata, 1, entry->extradata_size, index );
     fprintf( index, "\n" );
 }
 
+static void write_video_stream_parameters
+(
+    FILE     *index,
+    int       stream_index,
+    AVStream *stream
+)
+{
+    AVCodecParameters *codecpar = stream->codecpar;
+    const char        *pix_fmt  = av_get_pix_fmt_name( (enum AVPixelFormat)codecpar->format );
+    fprintf( index, "<StreamParameters=%d>ID=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%s,SAR=%d:%d,"
+             "FieldOrder=%d,Range=%d,Primaries=%d,Transfer=%d,Matrix=%d,ChromaLoc=%d,Profile=%d,Level=%d,"
+             "Delay=%d,BPS=%d,RawBPS=%d,StreamSAR=%d:%d,AvgFrameRate=%d/%d,RealFrameRate=%d/%d</StreamParameters>\n",
+             stream_index, stream->id, codecpar->codec_id, codecpar->codec_tag, codecpar->width, codecpar->height,
+             pix_fmt ? pix_fmt : "none", codecpar->sample_aspect_ratio.num, codecpar->sample_aspect_ratio.den,
+             codecpar->field_order, codecpar->color_range, codecpar->color_primaries, codecpar->color_trc,
+             codecpar->color_space, codecpar->chroma_location, codecpar->profile, codecpar->level,
+             codecpar->video_delay, codecpar->bits_per_coded_sample, codecpar->bits_per_raw_sample,
+             stream->sample_aspect_ratio.num, stream->sample_aspect_ratio.den,
+             stream->avg_frame_rate.num, stream->avg_frame_rate.den, stream->r_frame_rate.num, stream->r_frame_rate.den );
+}
+
+static int read_video_stream_parameters
+(
+    const char                        *buf,
+    int                               *stream_index,
+    lwlibav_video_stream_parameters_t *params
+)
+{
+    char pix_fmt[64];
+    int  codec_id;
+    int  field_order;
+    int  color_range;
+    int  color_primaries;
+    int  color_trc;
+    int  color_space;
+    int  chroma_location;
+    if( sscanf( buf, "<StreamParameters=%d>ID=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%63[^,],SAR=%d:%d,"
+                "FieldOrder=%d,Range=%d,Primaries=%d,Transfer=%d,Matrix=%d,ChromaLoc=%d,Profile=%d,Level=%d,"
+                "Delay=%d,BPS=%d,RawBPS=%d,StreamSAR=%d:%d,AvgFrameRate=%d/%d,RealFrameRate=%d/%d",
+                stream_index, &params->id, &codec_id, &params->codec_tag, &params->width, &params->height,
+                pix_fmt, &params->sample_aspect_ratio.num, &params->sample_aspect_ratio.den,
+                &field_order, &color_range, &color_primaries, &color_trc, &color_space, &chroma_location,
+                &params->profile, &params->level, &params->video_delay,
+                &params->bits_per_coded_sample, &params->bits_per_raw_sample,
+                &params->stream_sample_aspect_ratio.num, &params->stream_sample_aspect_ratio.den,
+                &params->avg_frame_rate.num, &params->avg_frame_rate.den,
+                &params->r_frame_rate.num, &params->r_frame_rate.den ) != 26 )
+        return -1;
+    params->present         = 1;
+    params->codec_id        = (enum AVCodecID)codec_id;
+    params->pixel_format    = av_get_pix_fmt( (const char *)pix_fmt );
+    params->field_order     = (enum AVFieldOrder)field_order;
+    params->color_range     = (enum AVColorRange)color_range;
+    params->color_primaries = (enum AVColorPrimaries)color_primaries;
+    params->color_trc       = (enum AVColorTransferCharacteristic)color_trc;
+    params->color_space     = (enum AVColorSpace)color_space;
+    params->chroma_location = (enum AVChromaLocation)chroma_location;
+    return 0;
+}
+
 static void write_audio_extradata
 (
     FILE                *index,
@@ -1944,6 +2883,19 @@ static void disable_video_stream( lwlibav_video_decode_handler_t *vdhp )
     vdhp->frame_count         = 0;
 }
 
+static void free_extradata_entries
+(
+    lwlibav_extradata_handler_t *exhp
+)
+{
+    if( !exhp->entries )
+        return;
+    for( int i = 0; i < exhp->entry_count; i++ )
+        av_freep( &exhp->entries[i].extradata );
+    lw_freep( &exhp->entries );
+    exhp->entry_count = 0;
+}
+
 static void cleanup_index_helpers( lwindex_indexer_t *indexer, AVFormatContext *format_ctx )
 {
     for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
@@ -1954,741 +2906,3858 @@ static void cleanup_index_helpers( lwindex_indexer_t *indexer, AVFormatContext *
         avcodec_free_context( &helper->codec_ctx );
         av_parser_close( helper->parser_ctx );
         av_bsf_free( &helper->bsf_ctx );
+        av_packet_free( &helper->bsf_pkt );
         av_frame_free( &helper->picture );
         av_packet_unref( &helper->pkt );
-        lwlibav_extradata_handler_t *list = &helper->exh;
-        if( list->entries )
-        {
-            for( int i = 0; i < list->entry_count; i++ )
-                av_freep( &list->entries[i].extradata );
-            free( list->entries );
-        }
+        free_extradata_entries( &helper->exh );
+        free_extradata_table( &helper->extradata_table );
+        lw_free( helper->stats );
         /* Free an index helper. */
         lw_free( helper );
     }
     av_freep( &indexer->helpers );
 }
 
-static void create_index
+static void write_binary_index_data
 (
-    lwlibav_file_handler_t         *lwhp,
-    lwlibav_video_decode_handler_t *vdhp,
-    lwlibav_video_output_handler_t *vohp,
-    lwlibav_audio_decode_handler_t *adhp,
-    lwlibav_audio_output_handler_t *aohp,
-    AVFormatContext                *format_ctx,
-    lwlibav_option_t               *opt,
-    progress_indicator_t           *indicator,
-    progress_handler_t             *php
+    lwindex_binary_writer_t *writer,
+    const void              *data,
+    size_t                   size
 )
 {
-    uint32_t video_info_count = 1 << 16;
-    uint32_t audio_info_count = 1 << 16;
-    video_frame_info_t *video_info = (video_frame_info_t *)lw_malloc_zero( video_info_count * sizeof(video_frame_info_t) );
-    if( !video_info )
+    if( size == 0 || writer->error )
         return;
-    audio_frame_info_t *audio_info = (audio_frame_info_t *)lw_malloc_zero( audio_info_count * sizeof(audio_frame_info_t) );
-    if( !audio_info )
+    if( fwrite( data, 1, size, writer->fp ) != size )
+        writer->error = 1;
+    writer->offset += size;
+}
+
+static void align_binary_index
+(
+    lwindex_binary_writer_t *writer
+)
+{
+    static const uint8_t zero[LWINDEX_BINARY_ALIGNMENT] = { 0 };
+    size_t padding = (LWINDEX_BINARY_ALIGNMENT - (writer->offset % LWINDEX_BINARY_ALIGNMENT)) % LWINDEX_BINARY_ALIGNMENT;
+    write_binary_index_data( writer, zero, padding );
+}
+
+static lwindex_binary_section_t *begin_binary_index_section
+(
+    lwindex_binary_writer_t *writer,
+    uint32_t                 type,
+    int                      stream_index,
+    int                      codec_type
+)
+{
+    lwindex_binary_section_t *temp = (lwindex_binary_section_t *)realloc( writer->sections, (writer->section_count + 1) * sizeof(lwindex_binary_section_t) );
+    if( !temp )
     {
-        free( video_info );
+        writer->error = 1;
+        return NULL;
+    }
+    writer->sections = temp;
+    align_binary_index( writer );
+    lwindex_binary_section_t *section = &writer->sections[ writer->section_count++ ];
+    memset( section, 0, sizeof(lwindex_binary_section_t) );
+    section->type         = type;
+    section->stream_index = stream_index;
+    section->codec_type   = codec_type;
+    section->offset       = writer->offset;
+    return section;
+}
+
+static void end_binary_index_section
+(
+    lwindex_binary_writer_t  *writer,
+    lwindex_binary_section_t *section
+)
+{
+    if( section )
+        section->size = writer->offset - section->offset;
+}
+
+static void write_binary_index_string
+(
+    lwindex_binary_writer_t *writer,
+    uint32_t                 type,
+    const char              *string
+)
+{
+    lwindex_binary_section_t *section = begin_binary_index_section( writer, type, -1, AVMEDIA_TYPE_UNKNOWN );
+    if( !section )
+        return;
+    write_binary_index_data( writer, string, strlen( string ) + 1 );
+    end_binary_index_section( writer, section );
+}
+
+static void free_binary_index_writer
+(
+    lwindex_binary_writer_t *writer
+)
+{
+    if( !writer )
         return;
+    for( int i = 0; i < writer->number_of_streams; i++ )
+        lw_freep( &writer->frames[i].records );
+    lw_freep( &writer->frames );
+    lw_freep( &writer->sections );
+    writer->number_of_streams = 0;
+    writer->section_count     = 0;
+}
+
+static int open_binary_index_writer
+(
+    lwindex_binary_writer_t *writer,
+    FILE                    *fp,
+    lwlibav_file_handler_t  *lwhp,
+    int                      fixed_records
+)
+{
+    memset( writer, 0, sizeof(lwindex_binary_writer_t) );
+    writer->fp                 = fp;
+    writer->fixed_records      = fixed_records;
+    writer->active_video_index = -1;
+    writer->active_audio_index = -1;
+    /* Reserve the header. It is filled when closing. */
+    lwindex_binary_header_t header;
+    memset( &header, 0, sizeof(lwindex_binary_header_t) );
+    write_binary_index_data( writer, &header, sizeof(lwindex_binary_header_t) );
+    write_binary_index_string( writer, LWINDEX_SECTION_INPUT_FILE_PATH, lwhp->file_path );
+    write_binary_index_string( writer, LWINDEX_SECTION_FORMAT_NAME,     lwhp->format_name );
+    return writer->error ? -1 : 0;
+}
+
+static uint8_t *put_packed_uint
+(
+    uint8_t *p,
+    uint64_t value
+)
+{
+    while( value >= 0x80 )
+    {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
     }
-    /*
-        # Structure of Libav reader index file
-        <LibavReaderIndexFile=13>
-        <InputFilePath>foobar.omo</InputFilePath>
-        <LibavReaderIndex=0x00000208,0,marumoska>
-        <ActiveVideoStreamIndex>+0000000000</ActiveVideoStreamIndex>
-        <ActiveAudioStreamIndex>-0000000001</ActiveAudioStreamIndex>
-        Index=0,Type=0,Codec=2,TimeBase=1001/24000,POS=0,PTS=2002,DTS=0,EDI=0
-        Key=1,Pic=1,POC=0,Repeat=1,Field=0,Width=1920,Height=1080,Format=yuv420p,ColorSpace=5
-        </LibavReaderIndex>
-        <StreamDuration=0,0>5000</StreamDuration>
-        <StreamIndexEntries=0,0,1>
-        POS=0,TS=2002,Flags=1,Size=1024,Distance=0
-        </StreamIndexEntries>
-        <ExtraDataList=0,0,1>
-        Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
-        ... binary string ...
-        </ExtraDataList>
-        </LibavReaderIndexFile>
-     */
-    char index_path[512] = { 0 };
-    sprintf( index_path, "%s.lwi", lwhp->file_path );
-    FILE *index = !opt->no_create_index ? lw_fopen( index_path, "wb" ) : NULL;
-    if( !index && !opt->no_create_index )
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static uint8_t *put_packed_int
+(
+    uint8_t *p,
+    int64_t  value
+)
+{
+    return put_packed_uint( p, value < 0 ? ~((uint64_t)value << 1) : (uint64_t)value << 1 );
+}
+
+static uint8_t *put_packed_delta
+(
+    uint8_t *p,
+    int64_t  value,
+    int64_t  base
+)
+{
+    /* Wrap around instead of overflow. */
+    return put_packed_int( p, (int64_t)((uint64_t)value - (uint64_t)base) );
+}
+
+static uint8_t *pack_video_record
+(
+    uint8_t                      *p,
+    lwindex_video_record_t       *last,
+    const lwindex_video_record_t *record,
+    int                           first
+)
+{
+    uint8_t *flags = p++;
+    *flags = record->key ? LWINDEX_PACKED_KEY : 0;
+    p = put_packed_delta( p, record->pos, last->pos );
+    if( record->pts == AV_NOPTS_VALUE )
+        *flags |= LWINDEX_PACKED_PTS_NONE;
+    else
+        p = put_packed_delta( p, record->pts, last->pts );
+    if( record->dts == AV_NOPTS_VALUE )
+        *flags |= LWINDEX_PACKED_DTS_NONE;
+    else
+        p = put_packed_delta( p, record->dts, last->dts );
+    p = put_packed_int( p, record->pict_type );
+    p = put_packed_int( p, record->poc );
+    p = put_packed_int( p, record->repeat_pict );
+    p = put_packed_int( p, record->field_info );
+    if( first || record->extradata_index != last->extradata_index )
     {
-        free( video_info );
-        free( audio_info );
-        return;
+        *flags |= LWINDEX_PACKED_EXTRADATA;
+        p = put_packed_int( p, record->extradata_index );
     }
-    lwhp->format_name  = (char *)format_ctx->iformat->name;
-    lwhp->format_flags = format_ctx->iformat->flags;
-    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
-    vdhp->format       = format_ctx;
-    adhp->format       = format_ctx;
-    adhp->dv_in_avi    = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
-    int32_t video_index_pos = 0;
-    int32_t audio_index_pos = 0;
-    if( index )
+    if( first || record->width != last->width || record->height != last->height )
     {
-        /* Write Index file header. */
-        uint8_t lwindex_version[4] =
-        {
-            (LWINDEX_VERSION >> 24) & 0xff,
-            (LWINDEX_VERSION >> 16) & 0xff,
-            (LWINDEX_VERSION >>  8) & 0xff,
-             LWINDEX_VERSION        & 0xff
-        };
-        fprintf( index, "<LSMASHWorksIndexVersion=%" PRIu8 ".%" PRIu8 ".%" PRIu8 ".%" PRIu8 ">\n",
-                 lwindex_version[0], lwindex_version[1], lwindex_version[2], lwindex_version[3] );
-        fprintf( index, "<LibavReaderIndexFile=%d>\n", LWINDEX_INDEX_FILE_VERSION );
-        fprintf( index, "<InputFilePath>%s</InputFilePath>\n", lwhp->file_path );
-        fprintf( index, "<LibavReaderIndex=0x%08x,%d,%s>\n", lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
-        video_index_pos = ftell( index );
-        fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", -1 );
-        audio_index_pos = ftell( index );
-        fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", -1 );
+        *flags |= LWINDEX_PACKED_RESOLUTION;
+        p = put_packed_int( p, record->width );
+        p = put_packed_int( p, record->height );
     }
-    AVPacket pkt = { 0 };
-    av_init_packet( &pkt );
-    int       video_resolution      = 0;
-    int       is_attached_pic       = 0;
-    uint32_t  video_sample_count    = 0;
-    uint32_t  invisible_count       = 0;
-    uint32_t  video_keyframe_count  = 0;
-    int64_t   last_keyframe_pts     = AV_NOPTS_VALUE;
-    uint32_t  audio_sample_count    = 0;
-    int       audio_sample_rate     = 0;
-    int       constant_frame_length = 1;
-    uint64_t  audio_duration        = 0;
-    int64_t   first_dts             = AV_NOPTS_VALUE;
-    int64_t   filesize              = avio_size( format_ctx->pb );
-    if( indicator->open )
-        indicator->open( php );
-    /* Start to read frames and write the index file. */
-    lwindex_indexer_t indexer =
+    if( first || record->pix_fmt != last->pix_fmt )
     {
-        0,                              /* number_of_helpers */
-        NULL,                           /* helpers */
-        vdhp->preferred_decoder_names,  /* preferred_video_decoder_names */
-        adhp->preferred_decoder_names,  /* preferred_audio_decoder_names */
-        lwhp->threads,                  /* thread_count */
-        lwhp->format_name               /* format_name */
-    };
-    while( read_av_frame( format_ctx, &pkt ) >= 0 )
+        *flags |= LWINDEX_PACKED_PIX_FMT;
+        p = put_packed_int( p, record->pix_fmt );
+    }
+    if( first || record->colorspace != last->colorspace )
     {
-        AVStream          *stream   = format_ctx->streams[ pkt.stream_index ];
-        AVCodecParameters *codecpar = stream->codecpar;
-        if( codecpar->codec_type != AVMEDIA_TYPE_VIDEO
-         && codecpar->codec_type != AVMEDIA_TYPE_AUDIO )
-            continue;
-        if( codecpar->codec_id == AV_CODEC_ID_NONE )
-            continue;
-        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-        if( !helper )
+        *flags |= LWINDEX_PACKED_COLORSPACE;
+        p = put_packed_int( p, record->colorspace );
+    }
+    int64_t pts = record->pts == AV_NOPTS_VALUE ? last->pts : record->pts;
+    int64_t dts = record->dts == AV_NOPTS_VALUE ? last->dts : record->dts;
+    *last = *record;
+    last->pts = pts;
+    last->dts = dts;
+    return p;
+}
+
+static uint8_t *pack_audio_record
+(
+    uint8_t                      *p,
+    lwindex_audio_record_t       *last,
+    const lwindex_audio_record_t *record,
+    int                           first
+)
+{
+    uint8_t *flags = p++;
+    *flags = 0;
+    p = put_packed_delta( p, record->pos, last->pos );
+    if( record->pts == AV_NOPTS_VALUE )
+        *flags |= LWINDEX_PACKED_PTS_NONE;
+    else
+        p = put_packed_delta( p, record->pts, last->pts );
+    if( record->dts == AV_NOPTS_VALUE )
+        *flags |= LWINDEX_PACKED_DTS_NONE;
+    else
+        p = put_packed_delta( p, record->dts, last->dts );
+    if( first || record->extradata_index != last->extradata_index )
+    {
+        *flags |= LWINDEX_PACKED_EXTRADATA;
+        p = put_packed_int( p, record->extradata_index );
+    }
+    if( first || record->channels != last->channels || record->channel_layout != last->channel_layout )
+    {
+        *flags |= LWINDEX_PACKED_CHANNELS;
+        p = put_packed_int ( p, record->channels );
+        p = put_packed_uint( p, record->channel_layout );
+    }
+    if( first || record->sample_rate != last->sample_rate )
+    {
+        *flags |= LWINDEX_PACKED_SAMPLE_RATE;
+        p = put_packed_int( p, record->sample_rate );
+    }
+    if( first || record->sample_fmt != last->sample_fmt || record->bits_per_sample != last->bits_per_sample )
+    {
+        *flags |= LWINDEX_PACKED_SAMPLE_FMT;
+        p = put_packed_int( p, record->sample_fmt );
+        p = put_packed_int( p, record->bits_per_sample );
+    }
+    if( first || record->frame_length != last->frame_length )
+    {
+        *flags |= LWINDEX_PACKED_FRAME_LENGTH;
+        p = put_packed_int( p, record->frame_length );
+    }
+    int64_t pts = record->pts == AV_NOPTS_VALUE ? last->pts : record->pts;
+    int64_t dts = record->dts == AV_NOPTS_VALUE ? last->dts : record->dts;
+    *last = *record;
+    last->pts = pts;
+    last->dts = dts;
+    return p;
+}
+
+/* Pack a frame record of the stream. 'record' is lwindex_video_record_t for video and lwindex_audio_record_t for audio. */
+static void append_binary_index_record
+(
+    lwindex_binary_writer_t *writer,
+    AVStream                *stream,
+    int                      codec_type,
+    enum AVCodecID           codec_id,
+    const void              *record
+)
+{
+    if( !writer || writer->error )
+        return;
+    if( writer->number_of_streams <= stream->index )
+    {
+        lwindex_binary_frames_t *temp = (lwindex_binary_frames_t *)realloc( writer->frames, (stream->index + 1) * sizeof(lwindex_binary_frames_t) );
+        if( !temp )
         {
-            av_packet_unref( &pkt );
-            goto fail_index;
+            writer->error = 1;
+            return;
         }
-        AVCodecContext *pkt_ctx = helper->codec_ctx;
-        if( !pkt_ctx )
-            continue;
-        int extradata_index = append_extradata_if_new( helper, pkt_ctx, &pkt );
-        if( extradata_index < 0 )
+        memset( temp + writer->number_of_streams, 0, (stream->index + 1 - writer->number_of_streams) * sizeof(lwindex_binary_frames_t) );
+        writer->frames            = temp;
+        writer->number_of_streams = stream->index + 1;
+    }
+    lwindex_binary_frames_t *frames = &writer->frames[ stream->index ];
+    size_t record_size = codec_type == AVMEDIA_TYPE_VIDEO ? sizeof(lwindex_video_record_t) : sizeof(lwindex_audio_record_t);
+    if( frames->capacity - frames->size < MAX( record_size, LWINDEX_PACKED_RECORD_MAX_SIZE ) )
+    {
+        size_t capacity = frames->capacity ? frames->capacity << 1 : 1 << 20;
+        uint8_t *temp = (uint8_t *)realloc( frames->records, capacity );
+        if( !temp )
         {
-            av_packet_unref( &pkt );
-            goto fail_index;
+            writer->error = 1;
+            return;
         }
-        if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
-        {
-            if( pkt_ctx->pix_fmt == AV_PIX_FMT_NONE )
-                investigate_pix_fmt_by_decoding( pkt_ctx, &pkt, vdhp->frame_buffer );
-            int dv_in_avi_init = 0;
-            if( adhp->dv_in_avi    == -1
-             && vdhp->stream_index == -1
-             && pkt_ctx->codec_id  == AV_CODEC_ID_DVVIDEO
-             && opt->force_audio   == 0 )
-            {
-                dv_in_avi_init     = 1;
+        frames->records  = temp;
+        frames->capacity = capacity;
+    }
+    int first = (frames->record_count == 0);
+    if( first )
+    {
+        frames->codec_type = codec_type;
+        frames->codec_id   = codec_id;
+        frames->time_base  = stream->time_base;
+        memset( &frames->last, 0, sizeof(frames->last) );
+    }
+    uint8_t *p = frames->records + frames->size;
+    if( writer->fixed_records )
+    {
+        memcpy( p, record, record_size );
+        p += record_size;
+    }
+    else if( codec_type == AVMEDIA_TYPE_VIDEO )
+        p = pack_video_record( p, &frames->last.video, (const lwindex_video_record_t *)record, first );
+    else
+        p = pack_audio_record( p, &frames->last.audio, (const lwindex_audio_record_t *)record, first );
+    frames->size = p - frames->records;
+    ++ frames->record_count;
+}
+
+static void write_binary_index_frames
+(
+    lwindex_binary_writer_t *writer,
+    AVStream                *stream
+)
+{
+    if( !writer )
+        return;
+    lwindex_binary_section_t *section = begin_binary_index_section( writer, writer->fixed_records ? LWINDEX_SECTION_FRAMES
+                                                                                                  : LWINDEX_SECTION_PACKED_FRAMES,
+                                                                    stream->index, stream->codecpar->codec_type );
+    if( !section )
+        return;
+    lwindex_binary_frames_t *frames = stream->index < writer->number_of_streams ? &writer->frames[ stream->index ] : NULL;
+    section->codec_id        = frames && frames->record_count ? frames->codec_id : stream->codecpar->codec_id;
+    section->time_base_num   = stream->time_base.num;
+    section->time_base_den   = stream->time_base.den;
+    section->stream_duration = stream->duration;
+    section->entry_size      = !writer->fixed_records ? 0   /* variable */
+                             : stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? sizeof(lwindex_video_record_t)
+                             :                                                      sizeof(lwindex_audio_record_t);
+    if( frames && frames->record_count )
+    {
+        section->entry_count = frames->record_count;
+        write_binary_index_data( writer, frames->records, frames->size );
+        lw_freep( &frames->records );
+        frames->size     = 0;
+        frames->capacity = 0;
+    }
+    end_binary_index_section( writer, section );
+}
+
+static void write_binary_index_entries
+(
+    lwindex_binary_writer_t *writer,
+    AVStream                *stream
+)
+{
+    if( !writer )
+        return;
+    lwindex_binary_section_t *section = begin_binary_index_section( writer, LWINDEX_SECTION_INDEX_ENTRIES,
+                                                                    stream->index, stream->codecpar->codec_type );
+    if( !section )
+        return;
+    section->entry_count = stream->nb_index_entries;
+    section->entry_size  = sizeof(lwindex_index_entry_record_t);
+    for( int i = 0; i < stream->nb_index_entries; i++ )
+    {
+        AVIndexEntry *ie = &stream->index_entries[i];
+        lwindex_index_entry_record_t record = { ie->pos, ie->timestamp, ie->flags, ie->size, ie->min_distance, 0 };
+        write_binary_index_data( writer, &record, sizeof(lwindex_index_entry_record_t) );
+    }
+    end_binary_index_section( writer, section );
+}
+
+static void write_binary_index_extradata
+(
+    lwindex_binary_writer_t     *writer,
+    AVStream                    *stream,
+    lwlibav_extradata_handler_t *list
+)
+{
+    if( !writer )
+        return;
+    lwindex_binary_section_t *section = begin_binary_index_section( writer, LWINDEX_SECTION_EXTRADATA,
+                                                                    stream->index, stream->codecpar->codec_type );
+    if( !section )
+        return;
+    section->entry_count = list->entry_count;
+    section->entry_size  = sizeof(lwindex_extradata_record_t);
+    for( int i = 0; i < list->entry_count; i++ )
+    {
+        lwlibav_extradata_t *entry = &list->entries[i];
+        lwindex_extradata_record_t record =
+        {
+            entry->extradata_size,
+            entry->codec_id,
+            entry->codec_tag,
+            entry->width,
+            entry->height,
+            entry->pixel_format,
+            entry->video_delay,
+            entry->channel_layout,
+            entry->sample_format,
+            entry->sample_rate,
+            entry->bits_per_sample,
+            entry->block_align
+        };
+        write_binary_index_data( writer, &record, sizeof(lwindex_extradata_record_t) );
+        if( entry->extradata_size > 0 )
+            write_binary_index_data( writer, entry->extradata, entry->extradata_size );
+        align_binary_index( writer );
+    }
+    end_binary_index_section( writer, section );
+}
+
+static int close_binary_index_writer
+(
+    lwindex_binary_writer_t *writer,
+    lwlibav_file_handler_t  *lwhp
+)
+{
+    if( !writer )
+        return 0;
+    align_binary_index( writer );
+    lwindex_binary_header_t header;
+    memset( &header, 0, sizeof(lwindex_binary_header_t) );
+    memcpy( header.magic, LWINDEX_BINARY_MAGIC, LWINDEX_BINARY_MAGIC_SIZE );
+    header.lwindex_version        = LWINDEX_VERSION;
+    header.index_file_version     = LWINDEX_INDEX_FILE_VERSION;
+    header.byte_order_mark        = LWINDEX_BINARY_BYTE_ORDER_MARK;
+    header.avutil_version         = LIBAVUTIL_VERSION_INT;
+    header.format_flags           = lwhp->format_flags;
+    header.raw_demuxer            = lwhp->raw_demuxer;
+    header.active_video_index     = writer->active_video_index;
+    header.active_audio_index     = writer->active_audio_index;
+    header.section_count          = writer->section_count;
+    header.section_table_offset   = writer->offset;
+    header.input_file_size        = writer->file_status.size;
+    header.input_file_mtime       = writer->file_status.mtime;
+    header.input_file_fingerprint = writer->file_status.fingerprint;
+    write_binary_index_data( writer, writer->sections, writer->section_count * sizeof(lwindex_binary_section_t) );
+    /* Write the header at the last. */
+    if( !writer->error
+     && (fseek( writer->fp, 0, SEEK_SET ) != 0
+      || fwrite( &header, 1, sizeof(lwindex_binary_header_t), writer->fp ) != sizeof(lwindex_binary_header_t)) )
+        writer->error = 1;
+    int ret = writer->error ? -1 : 0;
+    free_binary_index_writer( writer );
+    return ret;
+}
+
+/* Get the next packet to be indexed from the demuxer and assign it to the parse stage.
+ * Return 1 if any packet is got, otherwise return 0 at the end of the input. */
+static int demux_index_packet
+(
+    lwindex_pipeline_t *pipeline,
+    lwindex_packet_t   *ipkt
+)
+{
+    AVFormatContext *format_ctx = pipeline->format_ctx;
+    lwindex_stats_t *stats      = pipeline->indexer->stats;
+    memset( ipkt, 0, sizeof(lwindex_packet_t) );
+    av_init_packet( &ipkt->pkt );
+    while( 1 )
+    {
+        lwindex_stage_time_t elapsed;
+        start_index_stage( stats, &elapsed );
+        int ret = read_av_frame( format_ctx, &ipkt->pkt );
+        end_index_stage( stats, LWINDEX_STAGE_DEMUX, &elapsed );
+        if( ret < 0 )
+            break;
+        AVStream          *stream   = format_ctx->streams[ ipkt->pkt.stream_index ];
+        AVCodecParameters *codecpar = stream->codecpar;
+        if( (codecpar->codec_type != AVMEDIA_TYPE_VIDEO && codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
+         || codecpar->codec_id == AV_CODEC_ID_NONE )
+        {
+            av_packet_unref( &ipkt->pkt );
+            continue;
+        }
+        lwindex_resume_t *resume = pipeline->indexer->resume;
+        if( resume && ipkt->pkt.stream_index < resume->number_of_streams
+         && ipkt->pkt.pos >= 0 && ipkt->pkt.pos <= resume->last_pos[ ipkt->pkt.stream_index ] )
+        {
+            /* This packet is already in the part of the index file to be kept. */
+            av_packet_unref( &ipkt->pkt );
+            continue;
+        }
+        lwindex_helper_t *helper = get_index_helper( pipeline->indexer, stream );
+        if( helper && !helper->codec_ctx )
+        {
+            av_packet_unref( &ipkt->pkt );
+            continue;
+        }
+        if( helper && helper->stats )
+        {
+            /* The demuxing time is attributed to the stream of the got packet. */
+            helper->stats->stage[LWINDEX_STAGE_DEMUX].wall += elapsed.wall;
+            helper->stats->stage[LWINDEX_STAGE_DEMUX].cpu  += elapsed.cpu;
+            helper->stats->packets += 1;
+            helper->stats->bytes   += ipkt->pkt.size;
+        }
+        ipkt->stream = stream;
+        ipkt->helper = helper;
+        ipkt->error  = !helper;
+        ipkt->worker = pipeline->number_of_workers > 0 ? ipkt->pkt.stream_index % pipeline->number_of_workers : 0;
+        if( helper && helper->codec_ctx->codec_type != AVMEDIA_TYPE_VIDEO )
+        {
+            /* The active audio stream is the first one that appears in the demuxed order,
+             * so it can be decided here in the same way as the commit stage. */
+            lwlibav_option_t *opt = pipeline->opt;
+            if( pipeline->active_audio_index == -1 && (!opt->force_audio || ipkt->pkt.stream_index == opt->force_audio_index) )
+                pipeline->active_audio_index = ipkt->pkt.stream_index;
+            ipkt->active_audio = (ipkt->pkt.stream_index == pipeline->active_audio_index);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* Parse a packet by the index helper of its stream.
+ * This function touches only the index helper and the packet, so packets of different streams can be parsed in parallel. */
+static void parse_index_packet
+(
+    lwindex_packet_t *ipkt,
+    AVFrame          *frame_buffer
+)
+{
+    lwindex_helper_t *helper  = ipkt->helper;
+    AVCodecContext   *pkt_ctx = helper->codec_ctx;
+    AVPacket         *pkt     = &ipkt->pkt;
+    helper->already_decoded = 0;
+    ipkt->codec_type      = pkt_ctx->codec_type;
+    ipkt->extradata_index = append_extradata_if_new( helper, pkt_ctx, pkt );
+    if( ipkt->extradata_index < 0 )
+    {
+        ipkt->error = 1;
+        return;
+    }
+    if( pkt_ctx->codec_type == AVMEDIA_TYPE_VIDEO )
+    {
+        if( pkt_ctx->pix_fmt == AV_PIX_FMT_NONE )
+        {
+            lwindex_stage_time_t start;
+            start_index_stage( helper->stats, &start );
+            investigate_pix_fmt_by_decoding( pkt_ctx, pkt, frame_buffer );
+            end_index_stage( helper->stats, LWINDEX_STAGE_PIX_FMT, &start );
+        }
+        ipkt->pre_width      = pkt_ctx->width;
+        ipkt->pre_height     = pkt_ctx->height;
+        ipkt->pre_colorspace = pkt_ctx->colorspace;
+        /* Get picture type. */
+        ipkt->pict_type = get_picture_type( helper, pkt_ctx, pkt );
+        if( ipkt->pict_type < 0 )
+        {
+            ipkt->error = 1;
+            return;
+        }
+        /* Get Picture Order Count. */
+        ipkt->poc = helper->parser_ctx ? helper->parser_ctx->output_picture_number : 0;
+        /* Get field information. */
+        if( helper->parser_ctx )
+        {
+            if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD
+             || helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_BOTTOM_FIELD )
+            {
+                /* field coded picture */
+                if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD )
+                    ipkt->field_info = LW_FIELD_INFO_TOP;
+                else
+                    ipkt->field_info = LW_FIELD_INFO_BOTTOM;
+                ipkt->repeat_pict = helper->parser_ctx->repeat_pict;
+            }
+            else
+            {
+                /* frame coded picture */
+                if( helper->parser_ctx->field_order == AV_FIELD_TT
+                 || helper->parser_ctx->field_order == AV_FIELD_TB )
+                    ipkt->field_info = LW_FIELD_INFO_TOP;
+                else if( helper->parser_ctx->field_order == AV_FIELD_BB
+                      || helper->parser_ctx->field_order == AV_FIELD_BT )
+                    ipkt->field_info = LW_FIELD_INFO_BOTTOM;
+                else
+                    ipkt->field_info = helper->last_field_info;
+                if( get_ticks_per_frame( pkt_ctx ) == 2 && helper->parser_ctx->repeat_pict != 0 )
+                    ipkt->repeat_pict = helper->parser_ctx->repeat_pict;
+                else
+                    ipkt->repeat_pict = 2 * helper->parser_ctx->repeat_pict + 1;
+            }
+            helper->last_field_info = ipkt->field_info;
+        }
+        else
+        {
+            ipkt->repeat_pict = 1;
+            ipkt->field_info  = helper->last_field_info;
+        }
+        ipkt->invisible = (pkt_ctx->codec_id == AV_CODEC_ID_VP8 && check_vp8_invisible_frame( pkt ))
+                       || (pkt_ctx->codec_id == AV_CODEC_ID_VP9 && check_vp9_invisible_frame( pkt ));
+        /* Set width, height and pixel_format for the current extradata. */
+        lwlibav_extradata_handler_t *list = &helper->exh;
+        lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
+        if( entry->width < pkt_ctx->width )
+            entry->width = pkt_ctx->width;
+        if( entry->height < pkt_ctx->height )
+            entry->height = pkt_ctx->height;
+        if( entry->pixel_format == AV_PIX_FMT_NONE )
+            entry->pixel_format = pkt_ctx->pix_fmt;
+        /* The decoder delay is recorded only once the resolution and the pixel format are known,
+         * so that the probe decoding is skipped at the extradata switch only if the entry is completely probed. */
+        if( pkt_ctx->width > 0 && pkt_ctx->height > 0 && pkt_ctx->pix_fmt != AV_PIX_FMT_NONE
+         && entry->video_delay < pkt_ctx->has_b_frames )
+            entry->video_delay = pkt_ctx->has_b_frames;
+        if( entry->bits_per_sample == 0 )
+            entry->bits_per_sample = pkt_ctx->bits_per_coded_sample;
+        if( entry->codec_id == AV_CODEC_ID_NONE )
+            entry->codec_id = pkt_ctx->codec_id;
+        if( entry->codec_tag == 0 )
+            entry->codec_tag = pkt_ctx->codec_tag;
+        ipkt->width      = pkt_ctx->width;
+        ipkt->height     = pkt_ctx->height;
+        ipkt->pix_fmt    = pkt_ctx->pix_fmt;
+        ipkt->colorspace = pkt_ctx->colorspace;
+    }
+    else
+    {
+        ipkt->bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
+                              : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
+                              : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
+        /* Get audio frame_length. */
+        ipkt->frame_length = get_audio_frame_length( helper, pkt_ctx, pkt );
+        ipkt->delay_count  = helper->delay_count;
+        if( ipkt->active_audio )
+        {
+            if( ipkt->frame_length != -1 )
+                helper->audio_duration += ipkt->frame_length;
+            if( helper->audio_duration <= INT32_MAX && pkt_ctx->channel_layout == 0 )
+                pkt_ctx->channel_layout = av_get_default_channel_layout( pkt_ctx->channels );
+        }
+        /* Set channel_layout, sample_rate, sample_format and bits_per_sample for the current extradata. */
+        lwlibav_extradata_handler_t *list = &helper->exh;
+        lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
+        if( entry->channel_layout == 0 )
+            entry->channel_layout = pkt_ctx->channel_layout;
+        if( entry->sample_rate == 0 )
+            entry->sample_rate = pkt_ctx->sample_rate;
+        if( entry->sample_format == AV_SAMPLE_FMT_NONE )
+            entry->sample_format = pkt_ctx->sample_fmt;
+        if( entry->bits_per_sample == 0 )
+            entry->bits_per_sample = ipkt->bits_per_sample;
+        if( entry->block_align == 0 )
+            entry->block_align = pkt_ctx->block_align;
+        if( entry->codec_id == AV_CODEC_ID_NONE )
+            entry->codec_id = pkt_ctx->codec_id;
+        if( entry->codec_tag == 0 )
+            entry->codec_tag = pkt_ctx->codec_tag;
+        ipkt->channels       = pkt_ctx->channels;
+        ipkt->channel_layout = pkt_ctx->channel_layout;
+        ipkt->sample_rate    = pkt_ctx->sample_rate;
+        ipkt->sample_fmt     = pkt_ctx->sample_fmt;
+    }
+    ipkt->codec_id = pkt_ctx->codec_id;
+}
+
+static void *index_demuxer_thread( void *arg )
+{
+    lwindex_pipeline_t *pipeline = (lwindex_pipeline_t *)arg;
+    int stop = 0;
+    while( !stop )
+    {
+        lw_mutex_lock( pipeline->mutex );
+        while( !pipeline->abort && (pipeline->hold || pipeline->demuxed - pipeline->committed >= pipeline->queue_size) )
+            lw_cond_wait( pipeline->cond, pipeline->mutex );
+        stop = pipeline->abort;
+        pipeline->demuxing = !stop;
+        lw_mutex_unlock( pipeline->mutex );
+        if( stop )
+            break;
+        lwindex_packet_t ipkt;
+        int got_packet = demux_index_packet( pipeline, &ipkt );
+        lw_mutex_lock( pipeline->mutex );
+        pipeline->demuxing = 0;
+        if( got_packet && !pipeline->abort )
+        {
+            ipkt.done = ipkt.error;     /* The commit stage handles the error in the demuxed order. */
+            pipeline->packets[ pipeline->demuxed++ % pipeline->queue_size ] = ipkt;
+        }
+        else if( got_packet )
+            av_packet_unref( &ipkt.pkt );
+        stop = !got_packet || ipkt.error || pipeline->abort;
+        if( stop )
+            pipeline->eof = 1;
+        lw_cond_broadcast( pipeline->cond );
+        lw_mutex_unlock( pipeline->mutex );
+    }
+    return NULL;
+}
+
+static void *index_worker_thread( void *arg )
+{
+    lwindex_worker_t   *worker   = (lwindex_worker_t *)arg;
+    lwindex_pipeline_t *pipeline = worker->pipeline;
+    uint64_t number = 0;
+    lw_mutex_lock( pipeline->mutex );
+    while( 1 )
+    {
+        if( number < pipeline->committed )
+            number = pipeline->committed;   /* All the preceding packets have already been parsed. */
+        if( pipeline->abort || (number >= pipeline->demuxed && pipeline->eof) )
+            break;
+        if( number >= pipeline->demuxed )
+        {
+            lw_cond_wait( pipeline->cond, pipeline->mutex );
+            continue;
+        }
+        lwindex_packet_t *ipkt = &pipeline->packets[ number++ % pipeline->queue_size ];
+        if( ipkt->worker != worker->id || ipkt->done )
+            continue;
+        lw_mutex_unlock( pipeline->mutex );
+        parse_index_packet( ipkt, worker->frame_buffer );
+        lw_mutex_lock( pipeline->mutex );
+        ipkt->done = 1;
+        lw_cond_broadcast( pipeline->cond );
+    }
+    lw_mutex_unlock( pipeline->mutex );
+    return NULL;
+}
+
+static void write_index_text_chunk
+(
+    FILE                 *index,
+    lwindex_text_chunk_t *chunk
+)
+{
+    if( chunk->pos < 0 )
+    {
+        fwrite( chunk->data, 1, chunk->size, index );
+        return;
+    }
+    int64_t current_pos = lw_ftell( index );
+    fseek( index, chunk->pos, SEEK_SET );
+    fwrite( chunk->data, 1, chunk->size, index );
+    lw_fseek( index, current_pos, SEEK_SET );
+}
+
+static void *index_writer_thread( void *arg )
+{
+    lwindex_pipeline_t *pipeline = (lwindex_pipeline_t *)arg;
+    lw_mutex_lock( pipeline->mutex );
+    while( 1 )
+    {
+        lwindex_text_chunk_t *chunk = pipeline->chunk_head;
+        if( !chunk )
+        {
+            if( pipeline->writer_eof )
+                break;
+            lw_cond_wait( pipeline->cond, pipeline->mutex );
+            continue;
+        }
+        pipeline->chunk_head = chunk->next;
+        if( !pipeline->chunk_head )
+            pipeline->chunk_tail = NULL;
+        pipeline->writing = 1;
+        lw_mutex_unlock( pipeline->mutex );
+        lwindex_stage_time_t start;
+        start_index_stage( pipeline->indexer->stats, &start );
+        write_index_text_chunk( pipeline->index, chunk );
+        end_index_stage( pipeline->indexer->stats, LWINDEX_STAGE_WRITE, &start );
+        free( chunk );
+        lw_mutex_lock( pipeline->mutex );
+        pipeline->writing = 0;
+        lw_cond_broadcast( pipeline->cond );
+    }
+    lw_mutex_unlock( pipeline->mutex );
+    return NULL;
+}
+
+static lwindex_text_chunk_t *alloc_index_text_chunk
+(
+    size_t  capacity,
+    int32_t pos
+)
+{
+    lwindex_text_chunk_t *chunk = (lwindex_text_chunk_t *)malloc( sizeof(lwindex_text_chunk_t) + capacity );
+    if( !chunk )
+        return NULL;
+    chunk->next     = NULL;
+    chunk->pos      = pos;
+    chunk->size     = 0;
+    chunk->capacity = capacity;
+    chunk->data     = (char *)(chunk + 1);
+    return chunk;
+}
+
+static void submit_index_text_chunk
+(
+    lwindex_pipeline_t   *pipeline,
+    lwindex_text_chunk_t *chunk
+)
+{
+    lw_mutex_lock( pipeline->mutex );
+    if( pipeline->chunk_tail )
+        pipeline->chunk_tail->next = chunk;
+    else
+        pipeline->chunk_head = chunk;
+    pipeline->chunk_tail = chunk;
+    lw_cond_broadcast( pipeline->cond );
+    lw_mutex_unlock( pipeline->mutex );
+}
+
+static void flush_index_text
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    if( pipeline->chunk && pipeline->chunk->size > 0 )
+    {
+        submit_index_text_chunk( pipeline, pipeline->chunk );
+        pipeline->chunk = NULL;
+    }
+}
+
+/* Write text at pos of the index file, or append text if pos is negative. */
+static void put_index_text
+(
+    lwindex_pipeline_t *pipeline,
+    int32_t             pos,
+    const char         *text,
+    size_t              size
+)
+{
+    if( pos < 0 )
+        pipeline->text_pos += size;
+    if( !pipeline->writer_thread )
+    {
+        lwindex_text_chunk_t chunk = { NULL, pos, size, size, (char *)text };
+        lwindex_stage_time_t start;
+        start_index_stage( pipeline->indexer->stats, &start );
+        write_index_text_chunk( pipeline->index, &chunk );
+        end_index_stage( pipeline->indexer->stats, LWINDEX_STAGE_WRITE, &start );
+        return;
+    }
+    if( pos >= 0 )
+    {
+        /* Overwriting must follow the preceding text to keep the order of writes. */
+        flush_index_text( pipeline );
+        lwindex_text_chunk_t *chunk = alloc_index_text_chunk( size, pos );
+        if( !chunk )
+            return;
+        memcpy( chunk->data, text, size );
+        chunk->size = size;
+        submit_index_text_chunk( pipeline, chunk );
+        return;
+    }
+    if( pipeline->chunk && pipeline->chunk->capacity - pipeline->chunk->size < size )
+        flush_index_text( pipeline );
+    if( !pipeline->chunk )
+    {
+        pipeline->chunk = alloc_index_text_chunk( MAX( size, 1 << 16 ), -1 );
+        if( !pipeline->chunk )
+            return;
+    }
+    memcpy( pipeline->chunk->data + pipeline->chunk->size, text, size );
+    pipeline->chunk->size += size;
+}
+
+static void print_index_text
+(
+    lwindex_pipeline_t *pipeline,
+    int32_t             pos,
+    const char         *format,
+    ...
+)
+{
+    if( !pipeline->index )
+        return;
+    char text[1024];
+    va_list args;
+    va_start( args, format );
+    int length = vsnprintf( text, sizeof(text), format, args );
+    va_end( args );
+    if( length > 0 )
+        put_index_text( pipeline, pos, text, MIN( (size_t)length, sizeof(text) - 1 ) );
+}
+
+static int is_index_pipeline_idle
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    if( pipeline->demuxing || pipeline->writing || pipeline->chunk_head )
+        return 0;
+    for( uint64_t number = pipeline->committed; number < pipeline->demuxed; number++ )
+        if( !pipeline->packets[ number % pipeline->queue_size ].done )
+            return 0;
+    return 1;
+}
+
+/* Stop the demuxer, and wait until every demuxed packet is parsed and every text is written into the index file.
+ * Until release_index_pipeline() is called, the caller can touch the index helpers and the index file. */
+static void hold_index_pipeline
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    if( !pipeline->mutex )
+        return;
+    flush_index_text( pipeline );
+    lw_mutex_lock( pipeline->mutex );
+    pipeline->hold = 1;
+    while( !pipeline->abort && !is_index_pipeline_idle( pipeline ) )
+        lw_cond_wait( pipeline->cond, pipeline->mutex );
+    lw_mutex_unlock( pipeline->mutex );
+}
+
+static void release_index_pipeline
+(
+    lwindex_pipeline_t *pipeline
+)
+{
+    if( !pipeline->mutex )
+        return;
+    lw_mutex_lock( pipeline->mutex );
+    pipeline->hold = 0;
+    lw_cond_broadcast( pipeline->cond );
+    lw_mutex_unlock( pipeline->mutex );
+}
+
+static void close_index_pipeline
+(
+    lwindex_pipeline_t *pipeline,
+    int                 abort
+)
+{
+    if( pipeline->mutex )
+    {
+        lw_mutex_lock( pipeline->mutex );
+        pipeline->abort |= abort;
+        lw_cond_broadcast( pipeline->cond );
+        lw_mutex_unlock( pipeline->mutex );
+    }
+    lw_thread_join( pipeline->demuxer_thread );
+    pipeline->demuxer_thread = NULL;
+    for( int i = 0; i < pipeline->number_of_workers; i++ )
+        if( pipeline->worker_threads )
+        {
+            lw_thread_join( pipeline->worker_threads[i] );
+            pipeline->worker_threads[i] = NULL;
+        }
+    if( pipeline->writer_thread )
+    {
+        flush_index_text( pipeline );
+        lw_mutex_lock( pipeline->mutex );
+        pipeline->writer_eof = 1;
+        lw_cond_broadcast( pipeline->cond );
+        lw_mutex_unlock( pipeline->mutex );
+        lw_thread_join( pipeline->writer_thread );
+        pipeline->writer_thread = NULL;
+    }
+    lw_freep( &pipeline->chunk );
+    if( pipeline->packets )
+    {
+        for( uint64_t number = pipeline->committed; number < pipeline->demuxed; number++ )
+            av_packet_unref( &pipeline->packets[ number % pipeline->queue_size ].pkt );
+        lw_freep( &pipeline->packets );
+    }
+    if( pipeline->workers )
+    {
+        for( int i = 0; i < pipeline->number_of_workers; i++ )
+            av_frame_free( &pipeline->workers[i].frame_buffer );
+        lw_freep( &pipeline->workers );
+    }
+    lw_freep( &pipeline->worker_threads );
+    lw_cond_destroy( pipeline->cond );
+    lw_mutex_destroy( pipeline->mutex );
+    pipeline->cond              = NULL;
+    pipeline->mutex             = NULL;
+    pipeline->number_of_workers = 0;
+}
+
+/* Start the indexing pipeline.
+ * Fall back to indexing on the caller thread if multi-threading is unavailable or not requested. */
+static void open_index_pipeline
+(
+    lwindex_pipeline_t *pipeline,
+    AVFormatContext    *format_ctx,
+    lwindex_indexer_t  *indexer,
+    lwlibav_option_t   *opt,
+    FILE               *index,
+    AVFrame            *frame_buffer,
+    int                 multithreaded
+)
+{
+    memset( pipeline, 0, sizeof(lwindex_pipeline_t) );
+    pipeline->format_ctx         = format_ctx;
+    pipeline->indexer            = indexer;
+    pipeline->opt                = opt;
+    pipeline->index              = index;
+    pipeline->frame_buffer       = frame_buffer;
+    pipeline->active_audio_index = indexer->resume ? indexer->resume->active_audio_index : -1;
+    pipeline->text_pos           = index ? lw_ftell( index ) : 0;
+    if( !multithreaded )
+        return;
+    /* The demuxer and the writer take two of the processors.
+     * The pipeline is requested explicitly, so run at least one worker even on fewer processors. */
+    int number_of_workers = MAX( MIN( lw_get_cpu_count() - 2, (int)format_ctx->nb_streams ), 1 );
+    /* Avoid moving the table of the index helpers under the workers as far as possible. */
+    if( reserve_index_helpers( indexer, (int)format_ctx->nb_streams ) < 0 )
+        return;
+    pipeline->queue_size     = 1024;
+    pipeline->packets        = (lwindex_packet_t *)lw_malloc_zero( pipeline->queue_size * sizeof(lwindex_packet_t) );
+    pipeline->workers        = (lwindex_worker_t *)lw_malloc_zero( number_of_workers * sizeof(lwindex_worker_t) );
+    pipeline->worker_threads = (lw_thread_t **)lw_malloc_zero( number_of_workers * sizeof(lw_thread_t *) );
+    pipeline->mutex          = lw_mutex_create();
+    pipeline->cond           = lw_cond_create();
+    if( !pipeline->packets || !pipeline->workers || !pipeline->worker_threads || !pipeline->mutex || !pipeline->cond )
+        goto fail;
+    pipeline->number_of_workers = number_of_workers;
+    for( int i = 0; i < number_of_workers; i++ )
+    {
+        pipeline->workers[i].pipeline     = pipeline;
+        pipeline->workers[i].id           = i;
+        pipeline->workers[i].frame_buffer = av_frame_alloc();
+        if( !pipeline->workers[i].frame_buffer )
+            goto fail;
+    }
+    if( index )
+    {
+        pipeline->writer_thread = lw_thread_create( index_writer_thread, pipeline );
+        if( !pipeline->writer_thread )
+            goto fail;
+    }
+    for( int i = 0; i < number_of_workers; i++ )
+    {
+        pipeline->worker_threads[i] = lw_thread_create( index_worker_thread, &pipeline->workers[i] );
+        if( !pipeline->worker_threads[i] )
+            goto fail;
+    }
+    pipeline->demuxer_thread = lw_thread_create( index_demuxer_thread, pipeline );
+    if( !pipeline->demuxer_thread )
+        goto fail;
+    return;
+fail:
+    /* Nothing has been demuxed yet, so just run every stage on the caller thread. */
+    close_index_pipeline( pipeline, 1 );
+    pipeline->abort = 0;
+}
+
+/* Get the next parsed packet in the demuxed order.
+ * Return 1 if any packet is got, otherwise return 0 at the end of the input. */
+static int get_next_index_packet
+(
+    lwindex_pipeline_t *pipeline,
+    lwindex_packet_t   *ipkt
+)
+{
+    if( pipeline->number_of_workers == 0 )
+    {
+        if( !demux_index_packet( pipeline, ipkt ) )
+            return 0;
+        if( !ipkt->error )
+            parse_index_packet( ipkt, pipeline->frame_buffer );
+        return 1;
+    }
+    lw_mutex_lock( pipeline->mutex );
+    while( pipeline->committed == pipeline->demuxed
+         ? !pipeline->eof
+         : !pipeline->packets[ pipeline->committed % pipeline->queue_size ].done )
+        lw_cond_wait( pipeline->cond, pipeline->mutex );
+    int got_packet = pipeline->committed < pipeline->demuxed;
+    if( got_packet )
+    {
+        *ipkt = pipeline->packets[ pipeline->committed++ % pipeline->queue_size ];
+        lw_cond_broadcast( pipeline->cond );
+    }
+    lw_mutex_unlock( pipeline->mutex );
+    return got_packet;
+}
+
+/* Parallel indexing of byte ranges of an MPEG-TS/PS file
+ * The demuxer of such a file can start from any file offset, so the file is split into byte ranges, and each range
+ * is demuxed and parsed by its own thread with its own demuxer and index helpers. Every range goes on beyond its end
+ * until its packets are the same as the ones of the next range, parsed from a fresh state, in a row. From there, the
+ * parse results of the next range are the same as the ones of this range since the stream parsers and the decoders
+ * have converged, so the next range takes over. If the next range never converges with this range, this range goes
+ * on to the end of the input file by itself.
+ * All parsed packets are held in memory until committed, so this is enabled only on 64-bit systems. */
+#define LWINDEX_RANGE_MAX_COUNT         16
+#define LWINDEX_RANGE_MIN_SIZE          (INT64_C(64) * 1024 * 1024)
+#define LWINDEX_RANGE_MATCH_COUNT       256     /* the number of the same packets in a row required for a handoff */
+#define LWINDEX_RANGE_NOTIFY_INTERVAL   1024
+
+typedef struct
+{
+    lwindex_packet_t ipkt;              /* without the packet data */
+    uint64_t         extradata_hash;    /* the hash of the extradata referenced by the packet */
+} lwindex_range_record_t;
+
+typedef struct lwindex_ranges_tag lwindex_ranges_t;
+
+typedef struct
+{
+    lwindex_ranges_t     *ranges;
+    int                   id;
+    int64_t               start_pos;
+    int64_t               end_pos;
+    AVFormatContext      *format_ctx;   /* the one of the caller for the first range */
+    lwindex_indexer_t    *indexer;      /* the one of the caller for the first range */
+    lwindex_indexer_t     own_indexer;
+    lwindex_stats_t       stats;
+    AVFrame              *frame_buffer;
+    lwindex_pipeline_t    pipeline;
+    lw_thread_t          *thread;
+    lwindex_frame_store_t store;        /* the parsed packets */
+    uint32_t              count;
+    int64_t               current_pos;  /* the largest file offset of the parsed packets */
+    int                   audio_decided;
+    int                   active_audio_index;
+    int                   eof;          /* 1: the range reached the end of the input file or a broken packet */
+    int                   error;        /* 1: a parsed packet is lost */
+    int                   finished;
+    /* handoff */
+    int                   handoff_found;
+    uint32_t              handoff;      /* the first packet of this range taken over by the next range */
+    uint32_t              next_start;   /* the packet of the next range which is the same as the handoff one */
+} lwindex_range_t;
+
+struct lwindex_ranges_tag
+{
+    int                count;
+    lwindex_range_t   *range;
+    lw_mutex_t        *mutex;
+    lw_cond_t         *cond;
+    int                abort;
+    lwlibav_option_t  *opt;
+    const char        *file_path;
+    lwindex_indexer_t *indexer;         /* the indexer of the caller */
+    /* commit */
+    int                current;
+    uint32_t           position;
+};
+
+/* The state of the search for the packets of the next range which are the same as the ones of a range. */
+typedef struct
+{
+    int       started;                  /* 1: the range has reached its end */
+    uint32_t *scan;                     /* per stream, the first packet of the next range not examined yet */
+    int       scan_size;
+    uint32_t  run;                      /* the number of the same packets in a row */
+    uint32_t  own_start;
+    uint32_t  next_start;
+    int       video;
+    int       video_key;
+} lwindex_range_match_t;
+
+/* Get a copy of the parsed packet of number in the range, waiting for it to be parsed.
+ * Return 1 on success, otherwise return 0 if the range has finished without it. */
+static int get_index_range_record
+(
+    lwindex_ranges_t       *ranges,
+    lwindex_range_t        *range,
+    uint32_t                number,
+    lwindex_range_record_t *record
+)
+{
+    lw_mutex_lock( ranges->mutex );
+    while( !ranges->abort && !range->finished && number >= range->count )
+        lw_cond_wait( ranges->cond, ranges->mutex );
+    int got_record = number < range->count;
+    if( got_record )
+        *record = *(lwindex_range_record_t *)get_frame_store_entry( &range->store, number );
+    lw_mutex_unlock( ranges->mutex );
+    return got_record;
+}
+
+static int is_same_index_range_record
+(
+    const lwindex_range_record_t *a,
+    const lwindex_range_record_t *b
+)
+{
+    const lwindex_packet_t *x = &a->ipkt;
+    const lwindex_packet_t *y = &b->ipkt;
+    return x->pkt.stream_index    == y->pkt.stream_index
+        && x->pkt.pos             == y->pkt.pos
+        && x->pkt.pts             == y->pkt.pts
+        && x->pkt.dts             == y->pkt.dts
+        && x->pkt.flags           == y->pkt.flags
+        && x->pkt.size            == y->pkt.size
+        && x->active_audio        == y->active_audio
+        && x->error               == y->error
+        && x->codec_type          == y->codec_type
+        && x->codec_id            == y->codec_id
+        && x->pre_width           == y->pre_width
+        && x->pre_height          == y->pre_height
+        && x->pre_colorspace      == y->pre_colorspace
+        && x->pict_type           == y->pict_type
+        && x->poc                 == y->poc
+        && x->repeat_pict         == y->repeat_pict
+        && x->field_info          == y->field_info
+        && x->invisible           == y->invisible
+        && x->width               == y->width
+        && x->height              == y->height
+        && x->pix_fmt             == y->pix_fmt
+        && x->colorspace          == y->colorspace
+        && x->bits_per_sample     == y->bits_per_sample
+        && x->frame_length        == y->frame_length
+        && x->delay_count         == y->delay_count
+        && x->channels            == y->channels
+        && x->channel_layout      == y->channel_layout
+        && x->sample_rate         == y->sample_rate
+        && x->sample_fmt          == y->sample_fmt
+        && a->extradata_hash      == b->extradata_hash;
+}
+
+/* Compare the last parsed packet of a range with the ones of the next range.
+ * Return 1 if the next range can take over, -1 if the next range has finished without taking over, otherwise 0. */
+static int match_index_range
+(
+    lwindex_range_t              *range,
+    const lwindex_range_record_t *record,
+    lwindex_range_match_t        *match
+)
+{
+    lwindex_ranges_t      *ranges = range->ranges;
+    lwindex_range_t       *next   = range + 1;
+    lwindex_range_record_t candidate;
+    if( match->run > 0 )
+    {
+        int got_record = get_index_range_record( ranges, next, match->next_start + match->run, &candidate );
+        if( got_record && is_same_index_range_record( record, &candidate ) )
+        {
+            ++match->run;
+            if( record->ipkt.codec_type == AVMEDIA_TYPE_VIDEO )
+            {
+                match->video      = 1;
+                match->video_key |= !!(record->ipkt.pkt.flags & AV_PKT_FLAG_KEY);
+            }
+            /* The decoders of video streams converge after a keyframe at the latest. */
+            if( match->run < LWINDEX_RANGE_MATCH_COUNT || (match->video && !match->video_key) )
+                return 0;
+            range->handoff       = match->own_start;
+            range->next_start    = match->next_start;
+            range->handoff_found = 1;
+            return 1;
+        }
+        match->run = 0;
+        if( !got_record )
+            return -1;
+    }
+    if( record->ipkt.pkt.pos < 0 )
+        return 0;
+    int stream_index = record->ipkt.pkt.stream_index;
+    if( stream_index >= match->scan_size )
+    {
+        uint32_t *temp = (uint32_t *)realloc( match->scan, (stream_index + 1) * sizeof(uint32_t) );
+        if( !temp )
+            return -1;
+        memset( temp + match->scan_size, 0, (stream_index + 1 - match->scan_size) * sizeof(uint32_t) );
+        match->scan      = temp;
+        match->scan_size = stream_index + 1;
+    }
+    /* The file offsets of the packets increase within a stream, so the packet of the same file offset, if any,
+     * follows the ones of the same stream examined so far. */
+    for( uint32_t number = match->scan[stream_index]; ; number++ )
+    {
+        if( !get_index_range_record( ranges, next, number, &candidate ) )
+            return -1;
+        if( candidate.ipkt.pkt.stream_index != stream_index
+         || candidate.ipkt.pkt.pos          <  0
+         || candidate.ipkt.pkt.pos          <  record->ipkt.pkt.pos )
+            continue;
+        match->scan[stream_index] = number;
+        if( candidate.ipkt.pkt.pos == record->ipkt.pkt.pos && is_same_index_range_record( record, &candidate ) )
+        {
+            match->run        = 1;
+            match->own_start  = range->count - 1;
+            match->next_start = number;
+            match->video      = (record->ipkt.codec_type == AVMEDIA_TYPE_VIDEO);
+            match->video_key  = match->video && (record->ipkt.pkt.flags & AV_PKT_FLAG_KEY);
+            match->scan[stream_index] = number + 1;
+        }
+        return 0;
+    }
+}
+
+static void *index_range_thread( void *arg )
+{
+    lwindex_range_t  *range  = (lwindex_range_t *)arg;
+    lwindex_ranges_t *ranges = range->ranges;
+    lwindex_range_t  *next   = range->id + 1 < ranges->count ? range + 1 : NULL;
+    lwindex_range_match_t match = { 0 };
+    int active_audio_index = -1;
+    if( range->id > 0 )
+    {
+        /* The active audio stream is the first audio stream in the demuxed order of the whole input file,
+         * so take over the decision of the preceding range. */
+        lw_mutex_lock( ranges->mutex );
+        while( !ranges->abort && !range[-1].audio_decided )
+            lw_cond_wait( ranges->cond, ranges->mutex );
+        active_audio_index = range[-1].active_audio_index;
+        if( active_audio_index != -1 )
+        {
+            range->audio_decided      = 1;
+            range->active_audio_index = active_audio_index;
+            lw_cond_broadcast( ranges->cond );
+        }
+        lw_mutex_unlock( ranges->mutex );
+        /* Each range has its own demuxer. */
+        if( lavf_open_file( &range->format_ctx, ranges->file_path, NULL ) < 0
+         || av_seek_frame( range->format_ctx, -1, range->start_pos, AVSEEK_FLAG_BYTE ) < 0 )
+        {
+            lavf_close_file( &range->format_ctx );
+            goto finish;
+        }
+    }
+    open_index_pipeline( &range->pipeline, range->format_ctx, range->indexer, ranges->opt, NULL, range->frame_buffer, 0 );
+    if( range->id > 0 )
+        range->pipeline.active_audio_index = active_audio_index;
+    lwindex_packet_t ipkt;
+    while( 1 )
+    {
+        if( !get_next_index_packet( &range->pipeline, &ipkt ) )
+        {
+            range->eof = 1;
+            break;
+        }
+        lwindex_range_record_t record;
+        record.ipkt           = ipkt;
+        record.extradata_hash = 0;
+        if( !ipkt.error )
+        {
+            lwlibav_extradata_t *entry = &ipkt.helper->exh.entries[ ipkt.extradata_index ];
+            record.extradata_hash = get_extradata_hash( entry->extradata, entry->extradata_size );
+        }
+        /* Only the properties of the packet are needed hereafter. */
+        av_packet_unref( &ipkt.pkt );
+        record.ipkt.pkt.buf             = NULL;
+        record.ipkt.pkt.data            = NULL;
+        record.ipkt.pkt.side_data       = NULL;
+        record.ipkt.pkt.side_data_elems = 0;
+        lw_mutex_lock( ranges->mutex );
+        lwindex_range_record_t *entry = (lwindex_range_record_t *)reserve_frame_store_entry( &range->store, range->count );
+        if( entry )
+        {
+            *entry = record;
+            ++range->count;
+        }
+        if( range->current_pos < record.ipkt.pkt.pos )
+            range->current_pos = record.ipkt.pkt.pos;
+        if( !range->audio_decided
+         && (range->pipeline.active_audio_index != -1 || record.ipkt.pkt.pos >= range->end_pos) )
+        {
+            range->audio_decided      = 1;
+            range->active_audio_index = range->pipeline.active_audio_index;
+            lw_cond_broadcast( ranges->cond );
+        }
+        else if( range->count % LWINDEX_RANGE_NOTIFY_INTERVAL == 0 )
+            lw_cond_broadcast( ranges->cond );
+        int abort = ranges->abort;
+        lw_mutex_unlock( ranges->mutex );
+        if( !entry || record.ipkt.error )
+        {
+            range->error = !entry;
+            range->eof   = 1;
+            break;
+        }
+        if( abort )
+            break;
+        if( next && (match.started || record.ipkt.pkt.pos >= range->end_pos) )
+        {
+            match.started = 1;
+            int ret = match_index_range( range, &record, &match );
+            if( ret > 0 )
+                break;
+            if( ret < 0 )
+                /* Go on to the end of the input file by itself. */
+                next = NULL;
+        }
+    }
+    lw_free( match.scan );
+finish:
+    lw_mutex_lock( ranges->mutex );
+    if( !range->audio_decided )
+    {
+        range->audio_decided      = 1;
+        range->active_audio_index = range->format_ctx ? range->pipeline.active_audio_index : active_audio_index;
+    }
+    range->finished = 1;
+    lw_cond_broadcast( ranges->cond );
+    lw_mutex_unlock( ranges->mutex );
+    return NULL;
+}
+
+static void close_index_ranges
+(
+    lwindex_ranges_t *ranges
+)
+{
+    if( ranges->mutex )
+    {
+        lw_mutex_lock( ranges->mutex );
+        ranges->abort = 1;
+        lw_cond_broadcast( ranges->cond );
+        lw_mutex_unlock( ranges->mutex );
+    }
+    for( int i = 0; i < ranges->count; i++ )
+    {
+        lw_thread_join( ranges->range[i].thread );
+        ranges->range[i].thread = NULL;
+    }
+    for( int i = 0; i < ranges->count; i++ )
+    {
+        lwindex_range_t *range = &ranges->range[i];
+        if( range->format_ctx )
+            close_index_pipeline( &range->pipeline, 1 );
+        free_frame_store( &range->store );
+        av_frame_free( &range->frame_buffer );
+        if( range->id > 0 && range->format_ctx )
+        {
+            cleanup_index_helpers( range->indexer, range->format_ctx );
+            lavf_close_file( &range->format_ctx );
+        }
+    }
+    lw_freep( &ranges->range );
+    lw_cond_destroy( ranges->cond );
+    lw_mutex_destroy( ranges->mutex );
+    ranges->cond  = NULL;
+    ranges->mutex = NULL;
+    ranges->count = 0;
+}
+
+/* Start indexing byte ranges of the input file in parallel if worth it.
+ * Return 0 on success, otherwise -1, in which case the input file shall be indexed sequentially. */
+static int open_index_ranges
+(
+    lwindex_ranges_t  *ranges,
+    AVFormatContext   *format_ctx,
+    lwindex_indexer_t *indexer,
+    lwlibav_option_t  *opt,
+    const char        *file_path,
+    int64_t            filesize
+)
+{
+    memset( ranges, 0, sizeof(lwindex_ranges_t) );
+    if( sizeof(void *) < 8 || filesize <= 0 )
+        return -1;
+    int count = (int)MIN( MIN( lw_get_cpu_count(), LWINDEX_RANGE_MAX_COUNT ), filesize / LWINDEX_RANGE_MIN_SIZE );
+    if( count < 2 )
+        return -1;
+    ranges->range = (lwindex_range_t *)lw_malloc_zero( count * sizeof(lwindex_range_t) );
+    ranges->mutex = lw_mutex_create();
+    ranges->cond  = lw_cond_create();
+    if( !ranges->range || !ranges->mutex || !ranges->cond )
+        goto fail;
+    ranges->count     = count;
+    ranges->opt       = opt;
+    ranges->file_path = file_path;
+    ranges->indexer   = indexer;
+    for( int i = 0; i < count; i++ )
+    {
+        lwindex_range_t *range = &ranges->range[i];
+        range->ranges             = ranges;
+        range->id                 = i;
+        range->start_pos          = filesize / count * i;
+        range->end_pos            = i + 1 < count ? filesize / count * (i + 1) : INT64_MAX;
+        range->active_audio_index = -1;
+        range->frame_buffer       = av_frame_alloc();
+        if( !range->frame_buffer || init_frame_store( &range->store, sizeof(lwindex_range_record_t) ) < 0 )
+            goto fail;
+        if( i == 0 )
+        {
+            range->format_ctx = format_ctx;
+            range->indexer    = indexer;
+            continue;
+        }
+        range->own_indexer                   = *indexer;
+        range->own_indexer.number_of_helpers = 0;
+        range->own_indexer.helpers           = NULL;
+        range->own_indexer.resume            = NULL;
+        range->own_indexer.stats             = indexer->stats ? &range->stats : NULL;
+        range->indexer                       = &range->own_indexer;
+    }
+    /* The first range touches the demuxer and the index helpers of the caller, so it starts last
+     * in order that they are left untouched on failure. */
+    for( int i = count - 1; i >= 0; i-- )
+    {
+        ranges->range[i].thread = lw_thread_create( index_range_thread, &ranges->range[i] );
+        if( !ranges->range[i].thread )
+            goto fail;
+    }
+    return 0;
+fail:
+    close_index_ranges( ranges );
+    return -1;
+}
+
+/* Wait for every range to be indexed while updating the progress.
+ * Return 0 on success, otherwise -1 if aborted. */
+static int wait_for_index_ranges
+(
+    lwindex_ranges_t     *ranges,
+    progress_indicator_t *indicator,
+    progress_handler_t   *php,
+    const char           *message,
+    int64_t               filesize
+)
+{
+    int abort        = 0;
+    int last_percent = -1;
+    lw_mutex_lock( ranges->mutex );
+    while( 1 )
+    {
+        int     finished = 0;
+        int64_t done     = 0;
+        for( int i = 0; i < ranges->count; i++ )
+        {
+            lwindex_range_t *range = &ranges->range[i];
+            finished += range->finished;
+            if( range->current_pos > range->start_pos )
+                done += MIN( range->current_pos, range->end_pos ) - range->start_pos;
+        }
+        if( finished == ranges->count )
+            break;
+        int percent = (int)(100.0 * ((double)done / filesize) + 0.5);
+        if( indicator->update && percent != last_percent )
+        {
+            /* Any range may finish in the meantime, so examine the ranges again after updating. */
+            lw_mutex_unlock( ranges->mutex );
+            abort = indicator->update( php, message, percent );
+            lw_mutex_lock( ranges->mutex );
+            last_percent = percent;
+            if( abort )
+            {
+                ranges->abort = 1;
+                lw_cond_broadcast( ranges->cond );
+                break;
+            }
+            continue;
+        }
+        lw_cond_wait( ranges->cond, ranges->mutex );
+    }
+    lw_mutex_unlock( ranges->mutex );
+    for( int i = 0; i < ranges->count; i++ )
+    {
+        lw_thread_join( ranges->range[i].thread );
+        ranges->range[i].thread = NULL;
+    }
+    if( abort )
+        return -1;
+    /* A range takes over from the preceding one only if both know the same streams in the same order,
+     * otherwise the stream indexes of the packets could differ from the ones in the sequential indexing. */
+    for( int i = 0; i + 1 < ranges->count; i++ )
+    {
+        lwindex_range_t *range = &ranges->range[i];
+        lwindex_range_t *next  = &ranges->range[i + 1];
+        if( !range->handoff_found )
+            continue;
+        if( !next->format_ctx || next->format_ctx->nb_streams != range->format_ctx->nb_streams )
+        {
+            range->handoff_found = 0;
+            continue;
+        }
+        for( unsigned int stream_index = 0; stream_index < range->format_ctx->nb_streams; stream_index++ )
+        {
+            AVStream *a = range->format_ctx->streams[stream_index];
+            AVStream *b = next ->format_ctx->streams[stream_index];
+            if( a->id                  != b->id
+             || a->codecpar->codec_type != b->codecpar->codec_type
+             || a->time_base.num       != b->time_base.num
+             || a->time_base.den       != b->time_base.den )
+            {
+                range->handoff_found = 0;
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Make a packet parsed by a range other than the first one refer to the index helper of the caller,
+ * and its extradata index to the same extradata in the list of the helper, appending the extradata if new.
+ * Return 0 on success, otherwise -1. */
+static int map_index_range_packet
+(
+    lwindex_ranges_t *ranges,
+    lwindex_range_t  *range,
+    lwindex_packet_t *ipkt
+)
+{
+    if( range->id == 0 )
+        return 0;
+    lwindex_helper_t *helper = get_index_helper( ranges->indexer, ipkt->stream );
+    if( !helper || !helper->codec_ctx )
+        return -1;
+    lwlibav_extradata_t *entry = &ipkt->helper->exh.entries[ ipkt->extradata_index ];
+    int index = find_extradata_entry( helper, entry->extradata, entry->extradata_size, entry->codec_id );
+    if( index < 0 )
+    {
+        uint8_t *extradata = NULL;
+        if( entry->extradata_size > 0 )
+        {
+            extradata = (uint8_t *)av_malloc( entry->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+            if( !extradata )
+                return -1;
+            memcpy( extradata, entry->extradata, entry->extradata_size );
+            memset( extradata + entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
+        }
+        index = helper->exh.entry_count;
+        lwlibav_extradata_t *new_entry = alloc_extradata_entries( &helper->exh, index + 1 );
+        if( !new_entry )
+        {
+            av_free( extradata );
+            return -1;
+        }
+        *new_entry = *entry;
+        new_entry->extradata = extradata;
+    }
+    ipkt->helper              = helper;
+    ipkt->extradata_index     = index;
+    return 0;
+}
+
+/* Get the next packet to be committed in the order of the sequential indexing.
+ * Return 1 if any packet is got, otherwise return 0 at the end of the input. */
+static int get_next_ranged_index_packet
+(
+    lwindex_ranges_t *ranges,
+    lwindex_packet_t *ipkt
+)
+{
+    lwindex_range_t *range;
+    while( 1 )
+    {
+        range = &ranges->range[ ranges->current ];
+        uint32_t end = range->handoff_found ? range->handoff : range->count;
+        if( ranges->position < end )
+        {
+            *ipkt = ((lwindex_range_record_t *)get_frame_store_entry( &range->store, ranges->position++ ))->ipkt;
+            break;
+        }
+        if( range->handoff_found )
+        {
+            ranges->position = range->next_start;
+            ++ranges->current;
+            continue;
+        }
+        if( range->error )
+        {
+            /* Some parsed packets are lost. */
+            memset( ipkt, 0, sizeof(lwindex_packet_t) );
+            av_init_packet( &ipkt->pkt );
+            ipkt->error = 1;
+            return 1;
+        }
+        /* No range takes over, so go on indexing by this range. */
+        if( range->eof || !get_next_index_packet( &range->pipeline, ipkt ) )
+            return 0;
+        break;
+    }
+    if( !ipkt->error && map_index_range_packet( ranges, range, ipkt ) < 0 )
+        ipkt->error = 1;
+    return 1;
+}
+
+static void merge_index_stats
+(
+    lwindex_stats_t       *dst,
+    const lwindex_stats_t *src
+)
+{
+    if( !dst || !src )
+        return;
+    dst->packets     += src->packets;
+    dst->bytes       += src->bytes;
+    dst->allocations += src->allocations;
+    for( int stage = 0; stage < LWINDEX_STAGE_COUNT; stage++ )
+    {
+        dst->stage[stage].wall += src->stage[stage].wall;
+        dst->stage[stage].cpu  += src->stage[stage].cpu;
+    }
+}
+
+/* Merge the properties of the extradata and the stats of every committed range into the index helpers of the caller,
+ * and then move the decoders of the last committed range, which parsed the end of the input file, into them.
+ * Return the demuxer of the last committed range. */
+static AVFormatContext *finish_index_ranges
+(
+    lwindex_ranges_t *ranges
+)
+{
+    lwindex_indexer_t *indexer = ranges->indexer;
+    for( int i = 1; i < ranges->count; i++ )
+    {
+        lwindex_range_t *range = &ranges->range[i];
+        if( !range->format_ctx )
+            continue;
+        merge_index_stats( indexer->stats, range->indexer->stats );
+        for( int stream_index = 0; stream_index < range->indexer->number_of_helpers; stream_index++ )
+        {
+            lwindex_helper_t *src = range->indexer->helpers[stream_index];
+            lwindex_helper_t *dst = stream_index < indexer->number_of_helpers ? indexer->helpers[stream_index] : NULL;
+            if( !src || !dst )
+                continue;
+            merge_index_stats( dst->stats, src->stats );
+            if( i > ranges->current )
+                continue;
+            for( int j = 0; j < src->exh.entry_count; j++ )
+            {
+                lwlibav_extradata_t *s = &src->exh.entries[j];
+                int index = find_extradata_entry( dst, s->extradata, s->extradata_size, s->codec_id );
+                if( index < 0 )
+                    continue;
+                lwlibav_extradata_t *d = &dst->exh.entries[index];
+                d->width  = MAX( d->width,  s->width );
+                d->height = MAX( d->height, s->height );
+                if( d->pixel_format == AV_PIX_FMT_NONE )
+                    d->pixel_format = s->pixel_format;
+                d->video_delay = MAX( d->video_delay, s->video_delay );
+                if( d->bits_per_sample == 0 )
+                    d->bits_per_sample = s->bits_per_sample;
+                if( d->codec_id == AV_CODEC_ID_NONE )
+                    d->codec_id = s->codec_id;
+                if( d->codec_tag == 0 )
+                    d->codec_tag = s->codec_tag;
+                if( d->channel_layout == 0 )
+                    d->channel_layout = s->channel_layout;
+                if( d->sample_rate == 0 )
+                    d->sample_rate = s->sample_rate;
+                if( d->sample_format == AV_SAMPLE_FMT_NONE )
+                    d->sample_format = s->sample_format;
+                if( d->block_align == 0 )
+                    d->block_align = s->block_align;
+            }
+        }
+    }
+    lwindex_range_t *last = &ranges->range[ ranges->current ];
+    if( last->id == 0 )
+        return last->format_ctx;
+    for( unsigned int stream_index = 0; stream_index < last->format_ctx->nb_streams; stream_index++ )
+    {
+        if( (int)stream_index >= last->indexer->number_of_helpers || !last->indexer->helpers[stream_index] )
+            continue;
+        lwindex_helper_t *src = last->indexer->helpers[stream_index];
+        lwindex_helper_t *dst = get_index_helper( indexer, last->format_ctx->streams[stream_index] );
+        if( !dst )
+            continue;
+        lwindex_helper_t temp = *dst;
+        *dst = *src;
+        *src = temp;
+        /* Keep the extradata list and the stats in the index helper of the caller. */
+        lwlibav_extradata_handler_t exh   = dst->exh;
+        lwindex_extradata_table_t   table = dst->extradata_table;
+        lwindex_stats_t            *stats = dst->stats;
+        dst->exh             = src->exh;
+        dst->extradata_table = src->extradata_table;
+        dst->stats           = src->stats;
+        src->exh             = exh;
+        src->extradata_table = table;
+        src->stats           = stats;
+    }
+    return last->format_ctx;
+}
+
+static char *get_checkpoint_file_path
+(
+    const char *index_file_path
+)
+{
+    size_t length = strlen( index_file_path );
+    char *checkpoint_file_path = (char *)lw_malloc_zero( length + strlen( LWINDEX_CHECKPOINT_EXTENSION ) + 1 );
+    if( !checkpoint_file_path )
+        return NULL;
+    memcpy( checkpoint_file_path, index_file_path, length );
+    memcpy( checkpoint_file_path + length, LWINDEX_CHECKPOINT_EXTENSION, strlen( LWINDEX_CHECKPOINT_EXTENSION ) );
+    return checkpoint_file_path;
+}
+
+/*
+    # Structure of Libav reader index checkpoint file
+    <LibavReaderIndexCheckpoint=16>
+    <InputFileStatus>+00000000012345678,+00000001500000000,0x0123456789abcdef</InputFileStatus>
+    <Checkpoint>+00000000000000123456,+00000000000012345678</Checkpoint>
+    <ExtraDataList=0,0,1>
+    Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
+    ... binary string ...
+    </ExtraDataList>
+    </LibavReaderIndexCheckpoint>
+    The checkpoint says that the records before the first value of <Checkpoint> in the index file are complete,
+    and indexing can be resumed by demuxing from the second value, the file offset of the input file.
+    The extradata lists are the ones of the index helpers at the checkpoint.
+    A checkpoint file without the last line is incomplete and just ignored.
+ */
+static void write_index_checkpoint
+(
+    lwindex_pipeline_t          *pipeline,
+    const char                  *checkpoint_file_path,
+    const lwindex_file_status_t *status,
+    int64_t                      index_pos,
+    int64_t                      seek_pos
+)
+{
+    hold_index_pipeline( pipeline );
+    /* The records before index_pos must reach the index file before the checkpoint. */
+    fflush( pipeline->index );
+    FILE *checkpoint = lw_fopen( checkpoint_file_path, "wb" );
+    if( checkpoint )
+    {
+        fprintf( checkpoint, "<LibavReaderIndexCheckpoint=%d>\n", LWINDEX_INDEX_FILE_VERSION );
+        fprintf( checkpoint, "<InputFileStatus>%+021" PRId64 ",%+021" PRId64 ",0x%016" PRIx64 "</InputFileStatus>\n",
+                 status->size, status->mtime, status->fingerprint );
+        fprintf( checkpoint, "<Checkpoint>%+021" PRId64 ",%+021" PRId64 "</Checkpoint>\n", index_pos, seek_pos );
+        lwindex_indexer_t *indexer = pipeline->indexer;
+        for( int stream_index = 0; stream_index < indexer->number_of_helpers; stream_index++ )
+        {
+            lwindex_helper_t *helper = indexer->helpers[stream_index];
+            if( !helper || !helper->codec_ctx )
+                continue;
+            int codec_type = pipeline->format_ctx->streams[stream_index]->codecpar->codec_type;
+            void (*write_av_extradata)( FILE *, lwlibav_extradata_t * ) = codec_type == AVMEDIA_TYPE_VIDEO
+                                                                        ? write_video_extradata
+                                                                        : write_audio_extradata;
+            fprintf( checkpoint, "<ExtraDataList=%d,%d,%d>\n", stream_index, codec_type, helper->exh.entry_count );
+            for( int i = 0; i < helper->exh.entry_count; i++ )
+                write_av_extradata( checkpoint, &helper->exh.entries[i] );
+            fprintf( checkpoint, "</ExtraDataList>\n" );
+        }
+        fprintf( checkpoint, "</LibavReaderIndexCheckpoint>\n" );
+        fclose( checkpoint );
+    }
+    release_index_pipeline( pipeline );
+}
+
+static void report_index_stats
+(
+    lw_log_handler_t  *lhp,
+    lwindex_indexer_t *indexer,
+    AVFormatContext   *format_ctx,
+    const char        *file_path,
+    int64_t            elapsed
+)
+{
+    static const char *stage_names[LWINDEX_STAGE_COUNT] = { "demux", "bsf", "parse", "decode", "pix_fmt", "write" };
+    const char *report_path = getenv( "LWINDEX_STATS" );
+    FILE *report = report_path && strcmp( report_path, "1" ) ? lw_fopen( report_path, "a" ) : NULL;
+    char line[1024];
+    snprintf( line, sizeof(line), "Indexing stats: %s, %s, %.3f s elapsed, times are wall/CPU in seconds",
+              file_path, indexer->format_name, elapsed / 1000000.0 );
+    lw_log_show( lhp, LW_LOG_INFO, "%s", line );
+    if( report )
+        fprintf( report, "%s\n", line );
+    for( int stream_index = -1; stream_index < indexer->number_of_helpers; stream_index++ )
+    {
+        /* The first line is of the stages over all streams. */
+        lwindex_stats_t *stats = indexer->stats;
+        int length;
+        if( stream_index < 0 )
+            length = snprintf( line, sizeof(line), "  total:" );
+        else
+        {
+            lwindex_helper_t *helper = indexer->helpers[stream_index];
+            if( !helper || !helper->stats )
+                continue;
+            stats = helper->stats;
+            AVCodecParameters *codecpar   = format_ctx->streams[stream_index]->codecpar;
+            const char        *media_type = av_get_media_type_string( codecpar->codec_type );
+            length = snprintf( line, sizeof(line), "  stream %d (%s, %s): %" PRIu64 " packets, %" PRIu64 " bytes, %" PRIu64 " allocations,",
+                               stream_index, media_type ? media_type : "unknown",
+                               avcodec_get_name( codecpar->codec_id ), stats->packets, stats->bytes, stats->allocations );
+        }
+        for( int stage = 0; stage < LWINDEX_STAGE_COUNT && length > 0 && length < (int)sizeof(line); stage++ )
+            if( stats->stage[stage].wall > 0 || stats->stage[stage].cpu > 0 )
+                length += snprintf( line + length, sizeof(line) - length, " %s %.3f/%.3f", stage_names[stage],
+                                    stats->stage[stage].wall / 1000000.0, stats->stage[stage].cpu / 1000000.0 );
+        lw_log_show( lhp, LW_LOG_INFO, "%s", line );
+        if( report )
+            fprintf( report, "%s\n", line );
+    }
+    if( report )
+        fclose( report );
+}
+
+static void create_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt,
+    progress_indicator_t           *indicator,
+    progress_handler_t             *php,
+    lw_log_handler_t               *lhp,
+    const char                     *index_file_path,
+    lwindex_resume_t               *resume
+)
+{
+    lwindex_frame_store_t video_store;
+    lwindex_frame_store_t audio_store;
+    if( init_frame_store( &video_store, sizeof(video_frame_info_t) ) < 0 )
+    {
+        free_frame_store( &video_store );
+        return;
+    }
+    if( init_frame_store( &audio_store, sizeof(audio_frame_info_t) ) < 0 )
+    {
+        free_frame_store( &video_store );
+        free_frame_store( &audio_store );
+        return;
+    }
+    video_frame_info_t *video_info = NULL;
+    audio_frame_info_t *audio_info = NULL;
+    /*
+        # Structure of Libav reader index file
+        <LibavReaderIndexFile=18>
+        <InputFilePath>foobar.omo</InputFilePath>
+        <LibavReaderIndex=0x00000208,0,marumoska>
+        <ActiveVideoStreamIndex>+0000000000</ActiveVideoStreamIndex>
+        <ActiveAudioStreamIndex>-0000000001</ActiveAudioStreamIndex>
+        <ResumePoint>+00000000000012345678,+00000000000000000424</ResumePoint>
+        <InputFileStatus>+00000000001500000000,0x0123456789abcdef</InputFileStatus>
+        Index=0,Type=0,Codec=2,TimeBase=1001/24000,POS=0,PTS=2002,DTS=0,EDI=0
+        Key=1,Pic=1,POC=0,Repeat=1,Field=0,Width=1920,Height=1080,Format=yuv420p,ColorSpace=5
+        </LibavReaderIndex>
+        <StreamDuration=0,0>5000</StreamDuration>
+        <StreamIndexEntries=0,0,1,Size=+0000000046>
+        POS=0,TS=2002,Flags=1,Size=1024,Distance=0
+        </StreamIndexEntries>
+        <ExtraDataList=0,0,1,Size=+0000000334>
+        Size=252,Codec=28,4CC=0x564d4448,Width=1920,Height=1080,Format=yuv420p,BPS=0
+        ... binary string ...
+        </ExtraDataList>
+        </LibavReaderIndexFile>
+     */
+    if( resume && (opt->no_create_index || opt->binary_index
+     || av_seek_frame( format_ctx, -1, resume->seek_pos, AVSEEK_FLAG_BYTE ) < 0) )
+        /* Fall back to indexing from the beginning. */
+        resume = NULL;
+    FILE *index = !opt->no_create_index ? lw_fopen( index_file_path, resume ? "r+b" : "wb" ) : NULL;
+    if( !index && !opt->no_create_index )
+    {
+        free_frame_store( &video_store );
+        free_frame_store( &audio_store );
+        return;
+    }
+    lwhp->format_name  = (char *)format_ctx->iformat->name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
+    vdhp->format       = format_ctx;
+    adhp->format       = format_ctx;
+    adhp->dv_in_avi    = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    int32_t video_index_pos  = 0;
+    int32_t audio_index_pos  = 0;
+    int32_t resume_point_pos = 0;
+    lwindex_binary_writer_t  binary_index;
+    lwindex_binary_writer_t *bin_index  = NULL;
+    FILE                    *text_index = NULL;
+    if( index && opt->binary_index )
+    {
+        if( open_binary_index_writer( &binary_index, index, lwhp, opt->binary_index == 2 ) < 0 )
+        {
+            free_binary_index_writer( &binary_index );
+            fclose( index );
+            free_frame_store( &video_store );
+            free_frame_store( &audio_store );
+            return;
+        }
+        bin_index = &binary_index;
+    }
+    else if( index && resume )
+    {
+        text_index = index;
+        /* Invalidate the index file until it is extended completely. */
+        resume_point_pos = resume->resume_point_pos;
+        update_resume_point( index, resume_point_pos, NULL, -1 );
+        lw_fseek( index, resume->index_pos, SEEK_SET );
+    }
+    else if( index )
+    {
+        text_index = index;
+        /* Write Index file header. */
+        uint8_t lwindex_version[4] =
+        {
+            (LWINDEX_VERSION >> 24) & 0xff,
+            (LWINDEX_VERSION >> 16) & 0xff,
+            (LWINDEX_VERSION >>  8) & 0xff,
+             LWINDEX_VERSION        & 0xff
+        };
+        fprintf( index, "<LSMASHWorksIndexVersion=%" PRIu8 ".%" PRIu8 ".%" PRIu8 ".%" PRIu8 ">\n",
+                 lwindex_version[0], lwindex_version[1], lwindex_version[2], lwindex_version[3] );
+        fprintf( index, "<LibavReaderIndexFile=%d>\n", LWINDEX_INDEX_FILE_VERSION );
+        fprintf( index, "<InputFilePath>%s</InputFilePath>\n", lwhp->file_path );
+        fprintf( index, "<LibavReaderIndex=0x%08x,%d,%s>\n", lwhp->format_flags, lwhp->raw_demuxer, lwhp->format_name );
+        video_index_pos = ftell( index );
+        fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", -1 );
+        audio_index_pos = ftell( index );
+        fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", -1 );
+        resume_point_pos = ftell( index );
+        update_resume_point( index, resume_point_pos, NULL, -1 );
+        /* The stream parameters are taken before reading any packet, i.e. just as avformat_find_stream_info() set. */
+        for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+            if( format_ctx->streams[stream_index]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+                write_video_stream_parameters( index, stream_index, format_ctx->streams[stream_index] );
+    }
+    AVPacket pkt = { 0 };
+    av_init_packet( &pkt );
+    int       video_resolution      = 0;
+    int       is_attached_pic       = 0;
+    uint32_t  video_sample_count    = 0;
+    uint32_t  invisible_count       = 0;
+    uint32_t  video_keyframe_count  = 0;
+    int64_t   last_keyframe_pts     = AV_NOPTS_VALUE;
+    uint32_t  audio_sample_count    = 0;
+    int       audio_sample_rate     = 0;
+    int       constant_frame_length = 1;
+    uint64_t  audio_duration        = 0;
+    int64_t   first_dts             = AV_NOPTS_VALUE;
+    int64_t   filesize              = avio_size( format_ctx->pb );
+    int64_t   resume_index_pos      = resume ? resume->index_pos : -1;
+    int64_t   resume_seek_pos       = INT64_MAX;    /* the minimum file offset of the records from resume_index_pos */
+    int64_t   checkpoint_interval   = opt->checkpoint_interval > 0 ? (int64_t)opt->checkpoint_interval * 1024 * 1024
+                                                                   : LWINDEX_CHECKPOINT_INTERVAL;
+    int64_t   next_checkpoint_pos   = (resume ? resume->seek_pos : 0) + checkpoint_interval;
+    /* Record the status of the input file before indexing since it may grow during indexing. */
+    lwindex_file_status_t file_status = { filesize, -1, 0 };
+    if( index && get_input_file_status( lwhp->file_path, filesize, &file_status ) < 0 )
+    {
+        file_status.size  = filesize;
+        file_status.mtime = -1;
+    }
+    if( bin_index )
+        bin_index->file_status = file_status;
+    /* The checkpoint of the previous indexing is useless unless indexing is resumed from it. */
+    char *checkpoint_file_path = index ? get_checkpoint_file_path( index_file_path ) : NULL;
+    if( checkpoint_file_path && !resume )
+        lw_remove_file( checkpoint_file_path );
+    if( checkpoint_file_path && (!text_index || !is_appendable_format( lwhp->format_name ) || file_status.mtime < 0) )
+        lw_freep( &checkpoint_file_path );
+    if( resume )
+    {
+        /* Keep the active streams of the index file to be extended. */
+        vdhp->stream_index = resume->active_video_index;
+        adhp->stream_index = resume->active_audio_index;
+    }
+    if( indicator->open )
+        indicator->open( php );
+    const char     *stats_env   = getenv( "LWINDEX_STATS" );
+    lwindex_stats_t stats       = { 0 };
+    int64_t         start_clock = lw_get_wall_clock();
+    /* Start to read frames and write the index file. */
+    lwindex_indexer_t indexer =
+    {
+        0,                              /* number_of_helpers */
+        NULL,                           /* helpers */
+        vdhp->preferred_decoder_names,  /* preferred_video_decoder_names */
+        adhp->preferred_decoder_names,  /* preferred_audio_decoder_names */
+        lwhp->threads,                  /* thread_count */
+        lwhp->format_name,              /* format_name */
+        resume,                         /* resume */
+        stats_env && stats_env[0] && strcmp( stats_env, "0" ) ? &stats : NULL  /* stats */
+    };
+    /* Index byte ranges of the input file in parallel if requested and the demuxer can start from any file offset.
+     * Then, the pipeline is used only to write the index file. */
+    lwindex_ranges_t ranges;
+    int ranged = opt->ranged_index && !resume && is_appendable_format( lwhp->format_name )
+              && open_index_ranges( &ranges, format_ctx, &indexer, opt, lwhp->file_path, filesize ) == 0;
+    lwindex_pipeline_t pipeline;
+    open_index_pipeline( &pipeline, format_ctx, &indexer, opt, text_index, vdhp->frame_buffer, !ranged && opt->pipeline_index );
+    if( ranged )
+    {
+        /* No checkpoint is taken since no packet is committed until every range is indexed.
+         * This is why ranged indexing is not the default. */
+        lw_freep( &checkpoint_file_path );
+        if( wait_for_index_ranges( &ranges, indicator, php, index ? "Creating Index file" : "Parsing input file", filesize ) < 0 )
+            goto fail_index;
+    }
+    lwindex_packet_t ipkt;
+    while( ranged ? get_next_ranged_index_packet( &ranges, &ipkt ) : get_next_index_packet( &pipeline, &ipkt ) )
+    {
+        pkt = ipkt.pkt;
+        if( ipkt.error )
+        {
+            av_packet_unref( &pkt );
+            goto fail_index;
+        }
+        AVStream         *stream          = ipkt.stream;
+        lwindex_helper_t *helper          = ipkt.helper;
+        AVCodecContext   *pkt_ctx         = helper->codec_ctx;
+        int               extradata_index = ipkt.extradata_index;
+        if( ipkt.codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            int dv_in_avi_init = 0;
+            if( adhp->dv_in_avi    == -1
+             && vdhp->stream_index == -1
+             && ipkt.codec_id      == AV_CODEC_ID_DVVIDEO
+             && opt->force_audio   == 0 )
+            {
+                dv_in_avi_init     = 1;
                 adhp->dv_in_avi    = 1;
                 vdhp->stream_index = pkt.stream_index;
             }
             /* Replace lower resolution stream with higher. Override attached picture. */
-            int higher_priority = ((pkt_ctx->width * pkt_ctx->height > video_resolution)
+            int higher_priority = ((ipkt.pre_width * ipkt.pre_height > video_resolution)
                                 || (is_attached_pic && !(stream->disposition & AV_DISPOSITION_ATTACHED_PIC)));
-            if( dv_in_avi_init
-             || (!opt->force_video && (vdhp->stream_index == -1 || (pkt.stream_index != vdhp->stream_index && higher_priority)))
-             || (opt->force_video && vdhp->stream_index == -1 && pkt.stream_index == opt->force_video_index) )
+            if( !resume
+             && (dv_in_avi_init
+              || (!opt->force_video && (vdhp->stream_index == -1 || (pkt.stream_index != vdhp->stream_index && higher_priority)))
+              || (opt->force_video && vdhp->stream_index == -1 && pkt.stream_index == opt->force_video_index)) )
+            {
+                /* Update active video stream. */
+                if( bin_index )
+                    bin_index->active_video_index = pkt.stream_index;
+                else
+                    print_index_text( &pipeline, video_index_pos, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", pkt.stream_index );
+                clear_frame_store( &video_store, video_sample_count );
+                vdhp->ctx                = pkt_ctx;
+                vdhp->codec_id           = ipkt.codec_id;
+                vdhp->stream_index       = pkt.stream_index;
+                video_resolution         = ipkt.pre_width * ipkt.pre_height;
+                is_attached_pic          = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
+                video_sample_count       = 0;
+                last_keyframe_pts        = AV_NOPTS_VALUE;
+                resume_index_pos         = -1;
+                vdhp->max_width          = ipkt.pre_width;
+                vdhp->max_height         = ipkt.pre_height;
+                vdhp->initial_width      = ipkt.pre_width;
+                vdhp->initial_height     = ipkt.pre_height;
+                vdhp->initial_colorspace = ipkt.pre_colorspace;
+            }
+            /* Set video frame info if this stream is active. */
+            if( pkt.stream_index == vdhp->stream_index )
+            {
+                ++video_sample_count;
+                video_frame_info_t *info = get_video_frame_info( &video_store, video_sample_count );
+                info->pts             = pkt.pts;
+                info->dts             = pkt.dts;
+                info->file_offset     = pkt.pos;
+                info->sample_number   = video_sample_count;
+                info->extradata_index = extradata_index;
+                info->pict_type       = ipkt.pict_type;
+                info->poc             = ipkt.poc;
+                info->repeat_pict     = ipkt.repeat_pict;
+                info->field_info      = ipkt.field_info;
+                if( pkt.pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pkt.pts < last_keyframe_pts )
+                    info->flags |= LW_VFRAME_FLAG_LEADING;
+                if( pkt.flags & AV_PKT_FLAG_KEY )
+                {
+                    /* For the present, treat this frame as a keyframe. */
+                    info->flags |= LW_VFRAME_FLAG_KEY;
+                    last_keyframe_pts = pkt.pts;
+                    ++video_keyframe_count;
+                    /* Indexing can be resumed from here since the stream parser needs no preceding packets. */
+                    if( pkt.pos >= 0 )
+                    {
+                        resume_index_pos = pipeline.text_pos;
+                        resume_seek_pos  = pkt.pos;
+                    }
+                }
+                if( ipkt.repeat_pict == 0 && ipkt.field_info == LW_FIELD_INFO_UNKNOWN && ipkt.pix_fmt == AV_PIX_FMT_NONE
+                 && (ipkt.codec_id == AV_CODEC_ID_H264 || ipkt.codec_id == AV_CODEC_ID_HEVC)
+                 && (ipkt.width == 0 || ipkt.height == 0) )
+                    info->flags |= LW_VFRAME_FLAG_CORRUPT;
+                if( ipkt.invisible )
+                {
+                    /* VPx invisible altref frame. */
+                    info->flags |= LW_VFRAME_FLAG_INVISIBLE;
+                    ++invisible_count;
+                    /* backward compatible hack for the index */
+                    pkt.pts = AV_NOPTS_VALUE;
+                    pkt.dts = AV_NOPTS_VALUE;
+                    pkt.pos = -1;
+                }
+                if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
+                {
+                    vdhp->time_base.num = stream->time_base.num;
+                    vdhp->time_base.den = stream->time_base.den;
+                }
+                /* Set maximum resolution. */
+                if( vdhp->max_width  < ipkt.width )
+                    vdhp->max_width  = ipkt.width;
+                if( vdhp->max_height < ipkt.height )
+                    vdhp->max_height = ipkt.height;
+                if( !reserve_frame_store_entry( &video_store, video_sample_count + 1 ) )
+                {
+                    av_packet_unref( &pkt );
+                    goto fail_index;
+                }
+            }
+            /* Write a video packet info to the index file. */
+            print_index_text( &pipeline, -1, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
+                              "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%s,ColorSpace=%d\n",
+                              pkt.stream_index, AVMEDIA_TYPE_VIDEO, ipkt.codec_id,
+                              stream->time_base.num, stream->time_base.den,
+                              pkt.pos, pkt.pts, pkt.dts, extradata_index,
+                              !!(pkt.flags & AV_PKT_FLAG_KEY), ipkt.pict_type, ipkt.poc, ipkt.repeat_pict, ipkt.field_info,
+                              ipkt.width, ipkt.height,
+                              av_get_pix_fmt_name( ipkt.pix_fmt ) ? av_get_pix_fmt_name( ipkt.pix_fmt ) : "none",
+                              ipkt.colorspace );
+            if( bin_index )
+            {
+                lwindex_video_record_t record =
+                {
+                    pkt.pos, pkt.pts, pkt.dts, extradata_index,
+                    !!(pkt.flags & AV_PKT_FLAG_KEY), ipkt.pict_type, ipkt.poc, ipkt.repeat_pict, ipkt.field_info,
+                    ipkt.width, ipkt.height, ipkt.pix_fmt, ipkt.colorspace
+                };
+                append_binary_index_record( bin_index, stream, AVMEDIA_TYPE_VIDEO, ipkt.codec_id, &record );
+            }
+        }
+        else
+        {
+            if( !resume && adhp->stream_index == -1 && ipkt.active_audio )
+            {
+                /* Update active audio stream. */
+                if( bin_index )
+                    bin_index->active_audio_index = pkt.stream_index;
+                else
+                    print_index_text( &pipeline, audio_index_pos, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", pkt.stream_index );
+                adhp->ctx          = pkt_ctx;
+                adhp->codec_id     = ipkt.codec_id;
+                adhp->stream_index = pkt.stream_index;
+            }
+            int frame_length = ipkt.frame_length;
+            /* Set audio frame info if this stream is active. */
+            if( pkt.stream_index == adhp->stream_index )
+            {
+                if( vdhp->stream_index < 0 && pkt.pos >= 0 )
+                {
+                    resume_index_pos = pipeline.text_pos;
+                    resume_seek_pos  = pkt.pos;
+                }
+                if( frame_length != -1 )
+                    audio_duration += frame_length;
+                if( audio_duration <= INT32_MAX )
+                {
+                    /* Set up audio frame info. */
+                    ++audio_sample_count;
+                    audio_frame_info_t *info = get_audio_frame_info( &audio_store, audio_sample_count );
+                    info->pts             = pkt.pts;
+                    info->dts             = pkt.dts;
+                    info->file_offset     = pkt.pos;
+                    info->sample_number   = audio_sample_count;
+                    info->extradata_index = extradata_index;
+                    info->sample_rate     = ipkt.sample_rate;
+                    if( frame_length != -1 && audio_sample_count > ipkt.delay_count )
+                    {
+                        uint32_t audio_frame_number = audio_sample_count - ipkt.delay_count;
+                        get_audio_frame_info( &audio_store, audio_frame_number )->length = frame_length;
+                        if( audio_frame_number > 1 && frame_length != get_audio_frame_info( &audio_store, audio_frame_number - 1 )->length )
+                            constant_frame_length = 0;
+                    }
+                    if( audio_sample_rate == 0 )
+                        audio_sample_rate = ipkt.sample_rate;
+                    if( !reserve_frame_store_entry( &audio_store, audio_sample_count + 1 ) )
+                    {
+                        av_packet_unref( &pkt );
+                        goto fail_index;
+                    }
+                    /* The default channel layout has been already set by the parse stage. */
+                    if( av_get_channel_layout_nb_channels( ipkt.channel_layout )
+                      > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
+                        aohp->output_channel_layout = ipkt.channel_layout;
+                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, ipkt.sample_fmt );
+                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
+                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, ipkt.bits_per_sample );
+                }
+                if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
+                {
+                    adhp->time_base.num = stream->time_base.num;
+                    adhp->time_base.den = stream->time_base.den;
+                }
+            }
+            /* Write an audio packet info to the index file. */
+            print_index_text( &pipeline, -1, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
+                              "Channels=%d:0x%" PRIx64 ",Rate=%d,Format=%s,BPS=%d,Length=%d\n",
+                              pkt.stream_index, AVMEDIA_TYPE_AUDIO, ipkt.codec_id,
+                              stream->time_base.num, stream->time_base.den,
+                              pkt.pos, pkt.pts, pkt.dts, extradata_index,
+                              ipkt.channels, ipkt.channel_layout, ipkt.sample_rate,
+                              av_get_sample_fmt_name( ipkt.sample_fmt ) ? av_get_sample_fmt_name( ipkt.sample_fmt ) : "none",
+                              ipkt.bits_per_sample, frame_length );
+            if( bin_index )
+            {
+                lwindex_audio_record_t record =
+                {
+                    pkt.pos, pkt.pts, pkt.dts, ipkt.channel_layout, extradata_index,
+                    ipkt.channels, ipkt.sample_rate, ipkt.sample_fmt, ipkt.bits_per_sample, frame_length
+                };
+                append_binary_index_record( bin_index, stream, AVMEDIA_TYPE_AUDIO, ipkt.codec_id, &record );
+            }
+        }
+        if( resume_index_pos >= 0 && pkt.pos >= 0 && resume_seek_pos > pkt.pos )
+            resume_seek_pos = pkt.pos;
+        if( checkpoint_file_path && resume_index_pos >= 0 && pkt.pos >= next_checkpoint_pos )
+        {
+            /* Indexing can be resumed from here even if aborted hereafter. */
+            write_index_checkpoint( &pipeline, checkpoint_file_path, &file_status, resume_index_pos, resume_seek_pos );
+            next_checkpoint_pos = pkt.pos + checkpoint_interval;
+        }
+        if( indicator->update )
+        {
+            /* Update progress dialog. */
+            int percent = 0;
+            if( first_dts == AV_NOPTS_VALUE )
+                first_dts = pkt.dts;
+            if( filesize > 0 && pkt.pos > 0 )
+                /* Update if packet's file offset is valid. */
+                percent = (int)(100.0 * ((double)pkt.pos / filesize) + 0.5);
+            else if( format_ctx->duration > 0 && first_dts != AV_NOPTS_VALUE && pkt.dts != AV_NOPTS_VALUE )
+                /* Update if packet's DTS is valid. */
+                percent = (int)(100.0
+                             * (pkt.dts - first_dts) * (stream->time_base.num / (double)stream->time_base.den)
+                             / (format_ctx->duration / AV_TIME_BASE)
+                             + 0.5);
+            const char *message = index ? "Creating Index file" : "Parsing input file";
+            int abort = indicator->update( php, message, percent );
+            av_packet_unref( &pkt );
+            if( abort )
+                goto fail_index;
+        }
+        else
+            av_packet_unref( &pkt );
+    }
+    /* Every packet has been parsed, so the index helpers are no longer touched by other threads. */
+    close_index_pipeline( &pipeline, 0 );
+    if( ranged )
+    {
+        /* The rest refers to the demuxer and the decoders which reached the end of the input file. */
+        format_ctx = finish_index_ranges( &ranges );
+        if( vdhp->stream_index >= 0 )
+        {
+            lwindex_helper_t *helper = get_index_helper( &indexer, format_ctx->streams[ vdhp->stream_index ] );
+            if( !helper || !helper->codec_ctx )
+                goto fail_index;
+            vdhp->ctx = helper->codec_ctx;
+        }
+        if( adhp->stream_index >= 0 )
+        {
+            lwindex_helper_t *helper = get_index_helper( &indexer, format_ctx->streams[ adhp->stream_index ] );
+            if( !helper || !helper->codec_ctx )
+                goto fail_index;
+            adhp->ctx = helper->codec_ctx;
+        }
+    }
+    /* Handle delay derived from the audio decoder. */
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream         *stream = format_ctx->streams[stream_index];
+        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
+        if( !helper || !helper->codec_ctx || !helper->decode || stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO )
+            continue;
+        AVCodecContext *pkt_ctx = helper->codec_ctx;
+        /* Flush if decoding is delayed. */
+        for( uint32_t i = 1; i <= helper->delay_count; i++ )
+        {
+            AVPacket null_pkt = { 0 };
+            av_init_packet( &null_pkt );
+            null_pkt.data = NULL;
+            null_pkt.size = 0;
+            int decode_complete;
+            if( helper->decode( pkt_ctx, helper->picture, &decode_complete, &null_pkt ) >= 0 )
+            {
+                int frame_length = decode_complete ? helper->picture->nb_samples : 0;
+                if( stream_index == adhp->stream_index )
+                {
+                    audio_duration += frame_length;
+                    if( audio_duration > INT32_MAX )
+                        break;
+                    uint32_t audio_frame_number = audio_sample_count - helper->delay_count + i;
+                    get_audio_frame_info( &audio_store, audio_frame_number )->length = frame_length;
+                    if( audio_frame_number > 1
+                     && frame_length != get_audio_frame_info( &audio_store, audio_frame_number - 1 )->length )
+                        constant_frame_length = 0;
+                }
+                print_index( text_index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=-1,PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=-1\n"
+                             "Channels=0:0x0,Rate=0,Format=none,BPS=0,Length=%d\n",
+                             stream_index, AVMEDIA_TYPE_AUDIO, pkt_ctx->codec_id,
+                             format_ctx->streams[stream_index]->time_base.num,
+                             format_ctx->streams[stream_index]->time_base.den,
+                             AV_NOPTS_VALUE, AV_NOPTS_VALUE, frame_length );
+                if( bin_index )
+                {
+                    lwindex_audio_record_t record =
+                    {
+                        -1, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0, -1,
+                        0, 0, AV_SAMPLE_FMT_NONE, 0, frame_length
+                    };
+                    append_binary_index_record( bin_index, stream, AVMEDIA_TYPE_AUDIO, pkt_ctx->codec_id, &record );
+                }
+            }
+        }
+    }
+    print_index( text_index, "</LibavReaderIndex>\n" );
+    /* Gather the frame info of the active streams into arrays of the exact size.
+     * Deallocate the frame info if no active stream. */
+    if( vdhp->stream_index >= 0 )
+    {
+        video_info = (video_frame_info_t *)gather_frame_store( &video_store, video_sample_count );
+        if( !video_info )
+            goto fail_index;
+    }
+    else
+        free_frame_store( &video_store );
+    if( adhp->stream_index < 0 )
+        free_frame_store( &audio_store );
+    else
+    {
+        audio_info = (audio_frame_info_t *)gather_frame_store( &audio_store, audio_sample_count );
+        if( !audio_info )
+            goto fail_index;
+        /* Check the active stream is DV in AVI Type-1 or not. */
+        if( adhp->dv_in_avi == 1 && format_ctx->streams[ adhp->stream_index ]->nb_index_entries == 0 )
+        {
+            /* DV in AVI Type-1 */
+            audio_sample_count = video_info ? MIN( video_sample_count, audio_sample_count ) : 0;
+            for( uint32_t i = 1; i <= audio_sample_count; i++ )
             {
-                /* Update active video stream. */
-                if( index )
-                {
-                    int32_t current_pos = ftell( index );
-                    fseek( index, video_index_pos, SEEK_SET );
-                    fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", pkt.stream_index );
-                    fseek( index, current_pos, SEEK_SET );
-                }
-                memset( video_info, 0, (video_sample_count + 1) * sizeof(video_frame_info_t) );
-                vdhp->ctx                = pkt_ctx;
-                vdhp->codec_id           = pkt_ctx->codec_id;
-                vdhp->stream_index       = pkt.stream_index;
-                video_resolution         = pkt_ctx->width * pkt_ctx->height;
-                is_attached_pic          = !!(stream->disposition & AV_DISPOSITION_ATTACHED_PIC);
-                video_sample_count       = 0;
-                last_keyframe_pts        = AV_NOPTS_VALUE;
-                vdhp->max_width          = pkt_ctx->width;
-                vdhp->max_height         = pkt_ctx->height;
-                vdhp->initial_width      = pkt_ctx->width;
-                vdhp->initial_height     = pkt_ctx->height;
-                vdhp->initial_colorspace = pkt_ctx->colorspace;
+                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
+                audio_info[i].sample_number   = video_info[i].sample_number;
+                audio_info[i].pts             = video_info[i].pts;
+                audio_info[i].dts             = video_info[i].dts;
+                audio_info[i].file_offset     = video_info[i].file_offset;
+                audio_info[i].extradata_index = video_info[i].extradata_index;
             }
-            /* Get picture type. */
-            int pict_type = get_picture_type( helper, pkt_ctx, &pkt );
-            if( pict_type < 0 )
+        }
+        else
+        {
+            if( adhp->dv_in_avi == 1 && opt->force_video && opt->force_video_index == -1 )
             {
-                av_packet_unref( &pkt );
-                goto fail_index;
+                /* Disable DV video stream. */
+                disable_video_stream( vdhp );
+                video_info = NULL;
             }
-            /* Get Picture Order Count. */
-            int poc = helper->parser_ctx ? helper->parser_ctx->output_picture_number : 0;
-            /* Get field information. */
-            int             repeat_pict;
-            lw_field_info_t field_info;
-            if( helper->parser_ctx )
+            adhp->dv_in_avi = 0;
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+         || stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            print_index( text_index, "<StreamDuration=%d,%d>%" PRId64 "</StreamDuration>\n",
+                         stream_index, stream->codecpar->codec_type, stream->duration );
+            write_binary_index_frames( bin_index, stream );
+        }
+    }
+    if( !strcmp( lwhp->format_name, "asf" ) )
+    {
+        /* Pretty hackish workaround for the ASF demuxer
+         * The Simple Index Object does not always describe all keyframes in corresponding video stream.
+         * Since the Simple Index Object cannot indicate PTS offset derived from missing indexes of early keyframes,
+         * the Simple Index Object is unreliable on frame-accurate seek. So, this section makes up the indexes from
+         * the actual timestamps and file offsets without the Simple Index Object.
+         * Here, also construct the indexes for audio stream from the actual timestamps and file offsets if present. */
+        for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+        {
+            AVStream *stream = format_ctx->streams[stream_index];
+            AVIndexEntry *temp = NULL;
+            if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
             {
-                if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD
-                 || helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_BOTTOM_FIELD )
+                unsigned int allocated_size = video_keyframe_count * sizeof(AVIndexEntry);
+                temp = (AVIndexEntry *)av_realloc( stream->index_entries, allocated_size );
+                if( temp )
                 {
-                    /* field coded picture */
-                    if( helper->parser_ctx->picture_structure == AV_PICTURE_STRUCTURE_TOP_FIELD )
-                        field_info = LW_FIELD_INFO_TOP;
-                    else
-                        field_info = LW_FIELD_INFO_BOTTOM;
-                    repeat_pict = helper->parser_ctx->repeat_pict;
+                    uint32_t i = 0;
+                    for( uint32_t j = 1; j <= video_sample_count && i < video_keyframe_count; j++ )
+                        if( (video_info[j].flags & LW_VFRAME_FLAG_KEY)
+                         && (video_info[j].pts != AV_NOPTS_VALUE
+                          || video_info[j].dts != AV_NOPTS_VALUE) )
+                        {
+                            temp[i].pos          = video_info[j].file_offset;
+                            temp[i].timestamp    = video_info[j].pts != AV_NOPTS_VALUE ? video_info[j].pts : video_info[j].dts;
+                            temp[i].flags        = AVINDEX_KEYFRAME;
+                            temp[i].size         = 0;
+                            temp[i].min_distance = 0;
+                            ++i;
+                        }
+                    stream->index_entries                = temp;
+                    stream->index_entries_allocated_size = allocated_size;
+                    stream->nb_index_entries             = i;
                 }
-                else
+            }
+            else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+            {
+                unsigned int allocated_size = audio_sample_count * sizeof(AVIndexEntry);
+                temp = (AVIndexEntry *)av_realloc( stream->index_entries, allocated_size );
+                if( temp )
                 {
-                    /* frame coded picture */
-                    if( helper->parser_ctx->field_order == AV_FIELD_TT
-                     || helper->parser_ctx->field_order == AV_FIELD_TB )
-                        field_info = LW_FIELD_INFO_TOP;
-                    else if( helper->parser_ctx->field_order == AV_FIELD_BB
-                          || helper->parser_ctx->field_order == AV_FIELD_BT )
-                        field_info = LW_FIELD_INFO_BOTTOM;
-                    else
-                        field_info = helper->last_field_info;
-                    if( get_ticks_per_frame( pkt_ctx ) == 2 && helper->parser_ctx->repeat_pict != 0 )
-                        repeat_pict = helper->parser_ctx->repeat_pict;
-                    else
-                        repeat_pict = 2 * helper->parser_ctx->repeat_pict + 1;
+                    uint32_t i = 0;
+                    for( uint32_t j = 1; j <= audio_sample_count && i < audio_sample_count; j++ )
+                    {
+                        if( audio_info[j].pts != AV_NOPTS_VALUE
+                         || audio_info[j].dts != AV_NOPTS_VALUE )
+                        {
+                            temp[i].pos          = audio_info[j].file_offset;
+                            temp[i].timestamp    = audio_info[j].pts != AV_NOPTS_VALUE ? audio_info[j].pts : audio_info[j].dts;
+                            temp[i].flags        = AVINDEX_KEYFRAME;
+                            temp[i].size         = 0;
+                            temp[i].min_distance = 0;
+                            ++i;
+                        }
+                    }
+                    stream->index_entries                = temp;
+                    stream->index_entries_allocated_size = allocated_size;
+                    stream->nb_index_entries             = i;
                 }
-                helper->last_field_info = field_info;
             }
-            else
+            if( !temp )
             {
-                repeat_pict = 1;
-                field_info = helper->last_field_info;
+                /* Anyway clear the index entries. */
+                av_freep( &stream->index_entries );
+                stream->index_entries_allocated_size = 0;
+                stream->nb_index_entries             = 0;
             }
-            /* Set video frame info if this stream is active. */
-            if( pkt.stream_index == vdhp->stream_index )
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream *stream = format_ctx->streams[stream_index];
+        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            print_index( text_index, "<StreamIndexEntries=%d,%d,%d", stream_index, AVMEDIA_TYPE_VIDEO, stream->nb_index_entries );
+            int64_t body_pos = begin_index_section( text_index );
+            if( resume || vdhp->stream_index != stream_index )
+                for( int i = 0; i < stream->nb_index_entries; i++ )
+                    write_av_index_entry( text_index, &stream->index_entries[i] );
+            else if( stream->nb_index_entries > 0 )
             {
-                ++video_sample_count;
-                video_frame_info_t *info = &video_info[video_sample_count];
-                info->pts             = pkt.pts;
-                info->dts             = pkt.dts;
-                info->file_offset     = pkt.pos;
-                info->sample_number   = video_sample_count;
-                info->extradata_index = extradata_index;
-                info->pict_type       = pict_type;
-                info->poc             = poc;
-                info->repeat_pict     = repeat_pict;
-                info->field_info      = field_info;
-                if( pkt.pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pkt.pts < last_keyframe_pts )
-                    info->flags |= LW_VFRAME_FLAG_LEADING;
-                if( pkt.flags & AV_PKT_FLAG_KEY )
-                {
-                    /* For the present, treat this frame as a keyframe. */
-                    info->flags |= LW_VFRAME_FLAG_KEY;
-                    last_keyframe_pts = pkt.pts;
-                    ++video_keyframe_count;
-                }
-                if( repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN && pkt_ctx->pix_fmt == AV_PIX_FMT_NONE
-                 && (pkt_ctx->codec_id == AV_CODEC_ID_H264 || pkt_ctx->codec_id == AV_CODEC_ID_HEVC)
-                 && (pkt_ctx->width == 0 || pkt_ctx->height == 0) )
-                    info->flags |= LW_VFRAME_FLAG_CORRUPT;
-                if( (pkt_ctx->codec_id == AV_CODEC_ID_VP8 && check_vp8_invisible_frame( &pkt ))
-                 || (pkt_ctx->codec_id == AV_CODEC_ID_VP9 && check_vp9_invisible_frame( &pkt )) )
-                {
-                    /* VPx invisible altref frame. */
-                    info->flags |= LW_VFRAME_FLAG_INVISIBLE;
-                    ++invisible_count;
-                    /* backward compatible hack for the index */
-                    pkt.pts = AV_NOPTS_VALUE;
-                    pkt.dts = AV_NOPTS_VALUE;
-                    pkt.pos = -1;
-                }
-                if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
+                vdhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
+                if( !vdhp->index_entries )
+                    goto fail_index;
+                for( int i = 0; i < stream->nb_index_entries; i++ )
                 {
-                    vdhp->time_base.num = stream->time_base.num;
-                    vdhp->time_base.den = stream->time_base.den;
+                    AVIndexEntry *ie = &stream->index_entries[i];
+                    vdhp->index_entries[i] = *ie;
+                    write_av_index_entry( text_index, ie );
                 }
-                /* Set maximum resolution. */
-                if( vdhp->max_width  < pkt_ctx->width )
-                    vdhp->max_width  = pkt_ctx->width;
-                if( vdhp->max_height < pkt_ctx->height )
-                    vdhp->max_height = pkt_ctx->height;
-                if( video_sample_count + 1 == video_info_count )
+                vdhp->index_entries_count = stream->nb_index_entries;
+            }
+            end_index_section( text_index, body_pos );
+            print_index( text_index, "</StreamIndexEntries>\n" );
+            write_binary_index_entries( bin_index, stream );
+        }
+        else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            print_index( text_index, "<StreamIndexEntries=%d,%d,%d", stream_index, AVMEDIA_TYPE_AUDIO, stream->nb_index_entries );
+            int64_t body_pos = begin_index_section( text_index );
+            if( resume || adhp->stream_index != stream_index )
+                for( int i = 0; i < stream->nb_index_entries; i++ )
+                    write_av_index_entry( text_index, &stream->index_entries[i] );
+            else if( stream->nb_index_entries > 0 )
+            {
+                /* Audio stream in matroska container requires index_entries for seeking.
+                 * This avoids for re-reading the file to create index_entries since the file will be closed once. */
+                adhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
+                if( !adhp->index_entries )
+                    goto fail_index;
+                for( int i = 0; i < stream->nb_index_entries; i++ )
                 {
-                    video_info_count <<= 1;
-                    video_frame_info_t *temp = (video_frame_info_t *)realloc( video_info, video_info_count * sizeof(video_frame_info_t) );
-                    if( !temp )
-                    {
-                        av_packet_unref( &pkt );
-                        goto fail_index;
-                    }
-                    video_info = temp;
+                    AVIndexEntry *ie = &stream->index_entries[i];
+                    adhp->index_entries[i] = *ie;
+                    write_av_index_entry( text_index, ie );
                 }
+                adhp->index_entries_count = stream->nb_index_entries;
             }
-            /* Set width, height and pixel_format for the current extradata. */
-            if( extradata_index >= 0 )
+            end_index_section( text_index, body_pos );
+            print_index( text_index, "</StreamIndexEntries>\n" );
+            write_binary_index_entries( bin_index, stream );
+        }
+    }
+    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    {
+        AVStream          *stream   = format_ctx->streams[stream_index];
+        AVCodecParameters *codecpar = stream->codecpar;
+        if( codecpar->codec_type == AVMEDIA_TYPE_VIDEO || codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            lwindex_helper_t *helper = get_index_helper( &indexer, stream );
+            if( !helper || !helper->codec_ctx )
+                continue;
+            lwlibav_extradata_handler_t *list = &helper->exh;
+            void (*write_av_extradata)( FILE *, lwlibav_extradata_t * ) = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+                                                                        ? write_video_extradata
+                                                                        : write_audio_extradata;
+            print_index( text_index, "<ExtraDataList=%d,%d,%d", stream_index, codecpar->codec_type, list->entry_count );
+            int64_t body_pos = begin_index_section( text_index );
+            write_binary_index_extradata( bin_index, stream, list );
+            if( !resume
+             && ((codecpar->codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+              || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index)) )
             {
-                lwlibav_extradata_handler_t *list = &helper->exh;
-                lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-                if( entry->width < pkt_ctx->width )
-                    entry->width = pkt_ctx->width;
-                if( entry->height < pkt_ctx->height )
-                    entry->height = pkt_ctx->height;
-                if( entry->pixel_format == AV_PIX_FMT_NONE )
-                    entry->pixel_format = pkt_ctx->pix_fmt;
-                if( entry->bits_per_sample == 0 )
-                    entry->bits_per_sample = pkt_ctx->bits_per_coded_sample;
-                if( entry->codec_id == AV_CODEC_ID_NONE )
-                    entry->codec_id = pkt_ctx->codec_id;
-                if( entry->codec_tag == 0 )
-                    entry->codec_tag = pkt_ctx->codec_tag;
+                for( int i = 0; i < list->entry_count; i++ )
+                    write_av_extradata( text_index, &list->entries[i] );
+                lwlibav_extradata_handler_t *exhp = codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
+                exhp->entry_count   = list->entry_count;
+                exhp->entries       = list->entries;
+                exhp->current_index = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+                                    ? video_info[1].extradata_index
+                                    : audio_info[1].extradata_index;
+                /* Avoid freeing entries. */
+                list->entry_count = 0;
+                list->entries     = NULL;
             }
-            /* Write a video packet info to the index file. */
-            print_index( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
-                         "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%s,ColorSpace=%d\n",
-                         pkt.stream_index, AVMEDIA_TYPE_VIDEO, pkt_ctx->codec_id,
-                         stream->time_base.num, stream->time_base.den,
-                         pkt.pos, pkt.pts, pkt.dts, extradata_index,
-                         !!(pkt.flags & AV_PKT_FLAG_KEY), pict_type, poc, repeat_pict, field_info,
-                         pkt_ctx->width, pkt_ctx->height,
-                         av_get_pix_fmt_name( pkt_ctx->pix_fmt ) ? av_get_pix_fmt_name( pkt_ctx->pix_fmt ) : "none",
-                         pkt_ctx->colorspace );
+            else
+                for( int i = 0; i < list->entry_count; i++ )
+                    write_av_extradata( text_index, &list->entries[i] );
+            end_index_section( text_index, body_pos );
+            print_index( text_index, "</ExtraDataList>\n" );
+        }
+    }
+    print_index( text_index, "</LibavReaderIndexFile>\n" );
+    lwindex_stage_time_t write_start;
+    start_index_stage( indexer.stats, &write_start );
+    close_binary_index_writer( bin_index, lwhp );
+    end_index_stage( indexer.stats, LWINDEX_STAGE_WRITE, &write_start );
+    if( text_index )
+    {
+        /* Enable the index file.
+         * Even if the input file has grown during indexing, the index file can be extended later from filesize. */
+        if( resume && lw_truncate_file( text_index, lw_ftell( text_index ) ) < 0 )
+            goto fail_index;
+        update_resume_point( text_index, resume_point_pos, &file_status, is_appendable_format( lwhp->format_name ) ? resume_index_pos : -1 );
+    }
+    if( checkpoint_file_path )
+    {
+        /* The index file is complete, so the checkpoint is no longer needed. */
+        lw_remove_file( checkpoint_file_path );
+        lw_freep( &checkpoint_file_path );
+    }
+    if( resume )
+    {
+        /* The frame lists are set up by parsing the whole extended index file. */
+        resume->resumed = 1;
+        lw_freep( &video_info );
+        lw_freep( &audio_info );
+    }
+    else if( vdhp->stream_index >= 0 )
+    {
+        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
+        if( !vdhp->keyframe_list )
+            goto fail_index;
+        vdhp->frame_list      = video_info;
+        vdhp->frame_count     = video_sample_count;
+        vdhp->initial_pix_fmt = vdhp->ctx->pix_fmt;
+        video_info = NULL;
+        if( decide_video_seek_method( lwhp, vdhp, video_sample_count ) )
+            goto fail_index;
+        /* Compute the stream duration. */
+        compute_stream_duration( lwhp, vdhp, format_ctx->streams[ vdhp->stream_index ]->duration );
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+        /* Exclude invisible frames from the output handler. */
+        create_video_visible_frame_list( vdhp, vohp, invisible_count );
+    }
+    if( !resume && adhp->stream_index >= 0 )
+    {
+        adhp->frame_list   = audio_info;
+        adhp->frame_count  = audio_sample_count;
+        adhp->frame_length = constant_frame_length ? adhp->frame_list[1].length : 0;
+        decide_audio_seek_method( lwhp, adhp, audio_sample_count );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, audio_sample_rate );
+    }
+    if( indexer.stats )
+        report_index_stats( lhp, &indexer, format_ctx, lwhp->file_path, lw_get_wall_clock() - start_clock );
+    cleanup_index_helpers( &indexer, format_ctx );
+    if( ranged )
+        close_index_ranges( &ranges );
+    if( index )
+        fclose( index );
+    if( indicator->close )
+        indicator->close( php );
+    vdhp->format = NULL;
+    adhp->format = NULL;
+    return;
+fail_index:
+    /* Keep the checkpoint to resume indexing later. */
+    lw_free( checkpoint_file_path );
+    close_index_pipeline( &pipeline, 1 );
+    free_binary_index_writer( bin_index );
+    if( indexer.stats )
+        report_index_stats( lhp, &indexer, format_ctx, lwhp->file_path, lw_get_wall_clock() - start_clock );
+    cleanup_index_helpers( &indexer, format_ctx );
+    if( ranged )
+        close_index_ranges( &ranges );
+    free_frame_store( &video_store );
+    free_frame_store( &audio_store );
+    free( video_info );
+    free( audio_info );
+    if( index )
+        fclose( index );
+    if( indicator->close )
+        indicator->close( php );
+    vdhp->format = NULL;
+    adhp->format = NULL;
+    return;
+}
+
+static int init_index_parser
+(
+    lwindex_parser_t               *parser,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp
+)
+{
+    memset( parser, 0, sizeof(lwindex_parser_t) );
+    parser->last_keyframe_pts     = AV_NOPTS_VALUE;
+    parser->constant_frame_length = 1;
+    if( vdhp->stream_index >= 0 && init_frame_store( &parser->video_store, sizeof(video_frame_info_t) ) < 0 )
+        return -1;
+    if( adhp->stream_index >= 0 && init_frame_store( &parser->audio_store, sizeof(audio_frame_info_t) ) < 0 )
+        return -1;
+    vdhp->codec_id             = AV_CODEC_ID_NONE;
+    adhp->codec_id             = AV_CODEC_ID_NONE;
+    vdhp->initial_pix_fmt      = AV_PIX_FMT_NONE;
+    vdhp->initial_colorspace   = AVCOL_SPC_NB;
+    aohp->output_sample_format = AV_SAMPLE_FMT_NONE;
+    return 0;
+}
+
+static int check_dv_in_avi
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwindex_parser_t               *parser,
+    lwlibav_option_t               *opt,
+    int                             stream_index,
+    enum AVCodecID                  codec_id
+)
+{
+    if( adhp->dv_in_avi == -1 && codec_id == AV_CODEC_ID_DVVIDEO && !opt->force_audio )
+    {
+        adhp->dv_in_avi = 1;
+        if( vdhp->stream_index == -1 )
+        {
+            vdhp->stream_index = stream_index;
+            if( init_frame_store( &parser->video_store, sizeof(video_frame_info_t) ) < 0 )
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int import_video_record
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwindex_parser_t               *parser,
+    enum AVCodecID                  codec_id,
+    AVRational                      time_base,
+    const lwindex_video_record_t   *record
+)
+{
+    if( vdhp->codec_id == AV_CODEC_ID_NONE )
+        vdhp->codec_id = codec_id;
+    if( (record->key | record->width | record->height) || record->pict_type == -1 || record->colorspace != AVCOL_SPC_NB )
+    {
+        if( vdhp->initial_width == 0 || vdhp->initial_height == 0 )
+        {
+            vdhp->initial_width  = record->width;
+            vdhp->initial_height = record->height;
+            vdhp->max_width      = record->width;
+            vdhp->max_height     = record->height;
         }
         else
         {
-            if( adhp->stream_index == -1 && (!opt->force_audio || (opt->force_audio && pkt.stream_index == opt->force_audio_index)) )
+            if( vdhp->max_width  < record->width )
+                vdhp->max_width  = record->width;
+            if( vdhp->max_height < record->width )
+                vdhp->max_height = record->height;
+        }
+        if( vdhp->initial_pix_fmt == AV_PIX_FMT_NONE )
+            vdhp->initial_pix_fmt = (enum AVPixelFormat)record->pix_fmt;
+        if( vdhp->initial_colorspace == AVCOL_SPC_NB )
+            vdhp->initial_colorspace = (enum AVColorSpace)record->colorspace;
+        if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
+        {
+            vdhp->time_base.num = time_base.num;
+            vdhp->time_base.den = time_base.den;
+        }
+        ++ parser->video_sample_count;
+        video_frame_info_t *info = get_video_frame_info( &parser->video_store, parser->video_sample_count );
+        info->pts             = record->pts;
+        info->dts             = record->dts;
+        info->file_offset     = record->pos;
+        info->sample_number   = parser->video_sample_count;
+        info->extradata_index = record->extradata_index;
+        info->pict_type       = record->pict_type;
+        info->poc             = record->poc;
+        info->repeat_pict     = record->repeat_pict;
+        info->field_info      = (lw_field_info_t)record->field_info;
+        if( record->pts != AV_NOPTS_VALUE && parser->last_keyframe_pts != AV_NOPTS_VALUE && record->pts < parser->last_keyframe_pts )
+            info->flags |= LW_VFRAME_FLAG_LEADING;
+        if( record->key )
+        {
+            info->flags |= LW_VFRAME_FLAG_KEY;
+            parser->last_keyframe_pts = record->pts;
+        }
+        if( record->repeat_pict == 0 && record->field_info == LW_FIELD_INFO_UNKNOWN
+         && record->pix_fmt == AV_PIX_FMT_NONE
+         && (codec_id == AV_CODEC_ID_H264 || codec_id == AV_CODEC_ID_HEVC)
+         && (record->width == 0 || record->height == 0) )
+            info->flags |= LW_VFRAME_FLAG_CORRUPT;
+        if( (codec_id == AV_CODEC_ID_VP8 || codec_id == AV_CODEC_ID_VP9)
+         && record->pts == AV_NOPTS_VALUE && record->dts == AV_NOPTS_VALUE && record->pos == -1 )
+        {
+            /* VPx invisible altref frame. */
+            info->flags |= LW_VFRAME_FLAG_INVISIBLE;
+            ++ parser->invisible_count;
+        }
+    }
+    if( !reserve_frame_store_entry( &parser->video_store, parser->video_sample_count + 1 ) )
+        return -1;
+    return 0;
+}
+
+static int import_audio_record
+(
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwindex_parser_t               *parser,
+    enum AVCodecID                  codec_id,
+    AVRational                      time_base,
+    const lwindex_audio_record_t   *record
+)
+{
+    if( adhp->codec_id == AV_CODEC_ID_NONE )
+        adhp->codec_id = codec_id;
+    lwindex_frame_store_t *audio_store = &parser->audio_store;
+    if( (record->channels | record->channel_layout | record->sample_rate | record->bits_per_sample) && parser->audio_duration <= INT32_MAX )
+    {
+        if( parser->audio_sample_rate == 0 )
+            parser->audio_sample_rate = record->sample_rate;
+        if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
+        {
+            adhp->time_base.num = time_base.num;
+            adhp->time_base.den = time_base.den;
+        }
+        uint64_t layout = record->channel_layout ? record->channel_layout : av_get_default_channel_layout( record->channels );
+        if( av_get_channel_layout_nb_channels( layout )
+          > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
+            aohp->output_channel_layout = layout;
+        aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format,
+                                                                    (enum AVSampleFormat)record->sample_fmt );
+        aohp->output_sample_rate     = MAX( aohp->output_sample_rate, parser->audio_sample_rate );
+        aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, record->bits_per_sample );
+        ++ parser->audio_sample_count;
+        audio_frame_info_t *info = get_audio_frame_info( audio_store, parser->audio_sample_count );
+        info->pts             = record->pts;
+        info->dts             = record->dts;
+        info->file_offset     = record->pos;
+        info->sample_number   = parser->audio_sample_count;
+        info->extradata_index = record->extradata_index;
+        info->sample_rate     = record->sample_rate;
+    }
+    else
+        for( uint32_t i = 1; i <= adhp->exh.delay_count; i++ )
+        {
+            uint32_t audio_frame_number = parser->audio_sample_count - adhp->exh.delay_count + i;
+            if( audio_frame_number > parser->audio_sample_count )
+                return -1;
+            get_audio_frame_info( audio_store, audio_frame_number )->length = record->frame_length;
+            if( audio_frame_number > 1 && record->frame_length != get_audio_frame_info( audio_store, audio_frame_number - 1 )->length )
+                parser->constant_frame_length = 0;
+            parser->audio_duration += record->frame_length;
+        }
+    if( !reserve_frame_store_entry( audio_store, parser->audio_sample_count + 1 ) )
+        return -1;
+    if( record->frame_length == -1 )
+        ++ adhp->exh.delay_count;
+    else if( parser->audio_sample_count > adhp->exh.delay_count )
+    {
+        uint32_t audio_frame_number = parser->audio_sample_count - adhp->exh.delay_count;
+        get_audio_frame_info( audio_store, audio_frame_number )->length = record->frame_length;
+        if( audio_frame_number > 1 && record->frame_length != get_audio_frame_info( audio_store, audio_frame_number - 1 )->length )
+            parser->constant_frame_length = 0;
+        parser->audio_duration += record->frame_length;
+    }
+    return 0;
+}
+
+static inline int need_reindexing
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    lwindex_parser_t               *parser,
+    lwlibav_option_t               *opt,
+    int                             video_present,
+    int                             audio_present
+)
+{
+    if( video_present && opt->force_video && opt->force_video_index != -1
+     && (parser->video_sample_count == 0 || vdhp->initial_pix_fmt == AV_PIX_FMT_NONE || vdhp->initial_width == 0 || vdhp->initial_height == 0) )
+        return 1;
+    if( audio_present && opt->force_audio && opt->force_audio_index != -1 && (parser->audio_sample_count == 0 || parser->audio_duration == 0) )
+        return 1;
+    return 0;
+}
+
+/* Set up the decode and output handlers from the frame lists reconstructed from an index file.
+ * The frame lists are handed over to the decode handlers on success. */
+static int setup_parsed_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    lwindex_parser_t               *parser,
+    int                             active_video_index
+)
+{
+    /* Every record has been imported, so gather the frame lists into arrays of the exact size. */
+    if( vdhp->stream_index >= 0 )
+    {
+        parser->video_info = (video_frame_info_t *)gather_frame_store( &parser->video_store, parser->video_sample_count );
+        if( !parser->video_info )
+            return -1;
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        parser->audio_info = (audio_frame_info_t *)gather_frame_store( &parser->audio_store, parser->audio_sample_count );
+        if( !parser->audio_info )
+            return -1;
+    }
+    video_frame_info_t *video_info = parser->video_info;
+    audio_frame_info_t *audio_info = parser->audio_info;
+    if( vdhp->stream_index >= 0 )
+    {
+        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (parser->video_sample_count + 1) * sizeof(uint8_t) );
+        if( !vdhp->keyframe_list )
+            return -1;
+        vdhp->frame_list  = video_info;
+        vdhp->frame_count = parser->video_sample_count;
+        parser->video_info = NULL;
+        if( decide_video_seek_method( lwhp, vdhp, parser->video_sample_count ) )
+            return -1;
+        /* Compute the stream duration. */
+        compute_stream_duration( lwhp, vdhp, vdhp->stream_duration );
+        /* Create the repeat control info. */
+        create_video_frame_order_list( vdhp, vohp, opt );
+        /* Exclude invisible frames from the output handler. */
+        create_video_visible_frame_list( vdhp, vohp, parser->invisible_count );
+    }
+    if( adhp->stream_index >= 0 )
+    {
+        if( adhp->dv_in_avi == 1 && adhp->index_entries_count == 0 )
+        {
+            /* DV in AVI Type-1 */
+            parser->audio_sample_count = MIN( parser->video_sample_count, parser->audio_sample_count );
+            for( uint32_t i = 0; i <= parser->audio_sample_count; i++ )
             {
-                /* Update active audio stream. */
-                if( index )
-                {
-                    int32_t current_pos = ftell( index );
-                    fseek( index, audio_index_pos, SEEK_SET );
-                    fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", pkt.stream_index );
-                    fseek( index, current_pos, SEEK_SET );
-                }
-                adhp->ctx          = pkt_ctx;
-                adhp->codec_id     = pkt_ctx->codec_id;
-                adhp->stream_index = pkt.stream_index;
+                audio_info[i].keyframe        = !!(vdhp->frame_list[i].flags & LW_VFRAME_FLAG_KEY);
+                audio_info[i].sample_number   = vdhp->frame_list[i].sample_number;
+                audio_info[i].pts             = vdhp->frame_list[i].pts;
+                audio_info[i].dts             = vdhp->frame_list[i].dts;
+                audio_info[i].file_offset     = vdhp->frame_list[i].file_offset;
+                audio_info[i].extradata_index = vdhp->frame_list[i].extradata_index;
             }
-            int bits_per_sample = pkt_ctx->bits_per_raw_sample   > 0 ? pkt_ctx->bits_per_raw_sample
-                                : pkt_ctx->bits_per_coded_sample > 0 ? pkt_ctx->bits_per_coded_sample
-                                : av_get_bytes_per_sample( pkt_ctx->sample_fmt ) << 3;
-            /* Get audio frame_length. */
-            int frame_length = get_audio_frame_length( helper, pkt_ctx, &pkt );
-            /* Set audio frame info if this stream is active. */
-            if( pkt.stream_index == adhp->stream_index )
+        }
+        else
+        {
+            if( adhp->dv_in_avi == 1 && ((!opt->force_video && active_video_index == -1) || (opt->force_video && opt->force_video_index == -1)) )
             {
-                if( frame_length != -1 )
-                    audio_duration += frame_length;
-                if( audio_duration <= INT32_MAX )
-                {
-                    /* Set up audio frame info. */
-                    ++audio_sample_count;
-                    audio_frame_info_t *info = &audio_info[audio_sample_count];
-                    info->pts             = pkt.pts;
-                    info->dts             = pkt.dts;
-                    info->file_offset     = pkt.pos;
-                    info->sample_number   = audio_sample_count;
-                    info->extradata_index = extradata_index;
-                    info->sample_rate     = pkt_ctx->sample_rate;
-                    if( frame_length != -1 && audio_sample_count > helper->delay_count )
-                    {
-                        uint32_t audio_frame_number = audio_sample_count - helper->delay_count;
-                        audio_info[audio_frame_number].length = frame_length;
-                        if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                            constant_frame_length = 0;
-                    }
-                    if( audio_sample_rate == 0 )
-                        audio_sample_rate = pkt_ctx->sample_rate;
-                    if( audio_sample_count + 1 == audio_info_count )
-                    {
-                        audio_info_count <<= 1;
-                        audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, audio_info_count * sizeof(audio_frame_info_t) );
-                        if( !temp )
-                        {
-                            av_packet_unref( &pkt );
-                            goto fail_index;
-                        }
-                        audio_info = temp;
-                    }
-                    if( pkt_ctx->channel_layout == 0 )
-                        pkt_ctx->channel_layout = av_get_default_channel_layout( pkt_ctx->channels );
-                    if( av_get_channel_layout_nb_channels( pkt_ctx->channel_layout )
-                      > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
-                        aohp->output_channel_layout = pkt_ctx->channel_layout;
-                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format, pkt_ctx->sample_fmt );
-                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
-                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
-                }
-                if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
-                {
-                    adhp->time_base.num = stream->time_base.num;
-                    adhp->time_base.den = stream->time_base.den;
-                }
+                /* Disable DV video stream. */
+                disable_video_stream( vdhp );
             }
-            /* Set channel_layout, sample_rate, sample_format and bits_per_sample for the current extradata. */
-            if( extradata_index >= 0 )
+            adhp->dv_in_avi = 0;
+        }
+        adhp->frame_list   = audio_info;
+        adhp->frame_count  = parser->audio_sample_count;
+        adhp->frame_length = parser->constant_frame_length ? audio_info[1].length : 0;
+        decide_audio_seek_method( lwhp, adhp, parser->audio_sample_count );
+        if( opt->av_sync && vdhp->stream_index >= 0 )
+            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, parser->audio_sample_rate );
+    }
+    return 0;
+}
+
+/* Read extradata entries from the first line of them stored in buf.
+ * If exhp is NULL, just skip them.
+ * On return, buf holds the line following the read entries. */
+static int read_extradata_entries
+(
+    FILE                        *index,
+    char                        *buf,
+    int                          buf_size,
+    int                          codec_type,
+    int                          entry_count,
+    lwlibav_extradata_handler_t *exhp
+)
+{
+    if( !exhp )
+    {
+        for( int i = 0; i < entry_count; i++ )
+        {
+            /* extradata size */
+            int extradata_size;
+            if( sscanf( buf, "Size=%d", &extradata_size ) != 1 )
+                return -1;
+            /* extradata */
+            for( int i = 0; i < extradata_size; i++ )
+                if( fgetc( index ) == EOF )
+                    return -1;
+            if( !fgets( buf, buf_size, index )   /* new line ('\n') */
+             || !fgets( buf, buf_size, index ) ) /* the first line of the next entry */
+                return -1;
+        }
+        return 0;
+    }
+    if( !alloc_extradata_entries( exhp, entry_count ) )
+        return -1;
+    for( int i = 0; i < exhp->entry_count; i++ )
+    {
+        lwlibav_extradata_t *entry = &exhp->entries[i];
+        /* Get extradata size and others. */
+        int codec_id;
+        if( codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            char pix_fmt[64];
+            if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%[^,],BPS=%d,Delay=%d",
+                        &entry->extradata_size, &codec_id, &entry->codec_tag,
+                        &entry->width, &entry->height,
+                        pix_fmt, &entry->bits_per_sample, &entry->video_delay ) != 8 )
+                break;
+            entry->pixel_format = av_get_pix_fmt( (const char *)pix_fmt );
+        }
+        else
+        {
+            char sample_fmt[64];
+            if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Layout=0x%" SCNx64 ",Rate=%d,Format=%[^,],BPS=%d,Align=%d",
+                        &entry->extradata_size, &codec_id, &entry->codec_tag,
+                        &entry->channel_layout, &entry->sample_rate,
+                        sample_fmt, &entry->bits_per_sample, &entry->block_align ) != 8 )
+                break;
+            entry->sample_format = av_get_sample_fmt( (const char *)sample_fmt );
+        }
+        entry->codec_id = (enum AVCodecID)codec_id;
+        /* Get extradata. */
+        if( entry->extradata_size > 0 )
+        {
+            entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+            if( !entry->extradata )
+                return -1;
+            if( fread( entry->extradata, 1, entry->extradata_size, index ) != entry->extradata_size )
             {
-                lwlibav_extradata_handler_t *list = &helper->exh;
-                lwlibav_extradata_t *entry = &list->entries[ list->current_index ];
-                if( entry->channel_layout == 0 )
-                    entry->channel_layout = pkt_ctx->channel_layout;
-                if( entry->sample_rate == 0 )
-                    entry->sample_rate = pkt_ctx->sample_rate;
-                if( entry->sample_format == AV_SAMPLE_FMT_NONE )
-                    entry->sample_format = pkt_ctx->sample_fmt;
-                if( entry->bits_per_sample == 0 )
-                    entry->bits_per_sample = bits_per_sample;
-                if( entry->block_align == 0 )
-                    entry->block_align = pkt_ctx->block_align;
-                if( entry->codec_id == AV_CODEC_ID_NONE )
-                    entry->codec_id = pkt_ctx->codec_id;
-                if( entry->codec_tag == 0 )
-                    entry->codec_tag = pkt_ctx->codec_tag;
+                av_freep( &entry->extradata );
+                return -1;
             }
-            /* Write an audio packet info to the index file. */
-            print_index( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" PRId64 ",PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=%d\n"
-                         "Channels=%d:0x%" PRIx64 ",Rate=%d,Format=%s,BPS=%d,Length=%d\n",
-                         pkt.stream_index, AVMEDIA_TYPE_AUDIO, pkt_ctx->codec_id,
-                         stream->time_base.num, stream->time_base.den,
-                         pkt.pos, pkt.pts, pkt.dts, extradata_index,
-                         pkt_ctx->channels, pkt_ctx->channel_layout, pkt_ctx->sample_rate,
-                         av_get_sample_fmt_name( pkt_ctx->sample_fmt ) ? av_get_sample_fmt_name( pkt_ctx->sample_fmt ) : "none",
-                         bits_per_sample, frame_length );
+            memset( entry->extradata + entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
         }
-        if( indicator->update )
+        if( !fgets( buf, buf_size, index )   /* new line ('\n') */
+         || !fgets( buf, buf_size, index ) ) /* the first line of the next entry */
+            return -1;
+    }
+    return 0;
+}
+
+static int grow_resume_streams
+(
+    lwindex_resume_t *resume,
+    int               number_of_streams
+)
+{
+    if( number_of_streams <= resume->number_of_streams )
+        return 0;
+    int64_t *last_pos = (int64_t *)realloc( resume->last_pos, number_of_streams * sizeof(int64_t) );
+    if( !last_pos )
+        return -1;
+    resume->last_pos = last_pos;
+    lwlibav_extradata_handler_t *exh = (lwlibav_extradata_handler_t *)realloc( resume->exh, number_of_streams * sizeof(lwlibav_extradata_handler_t) );
+    if( !exh )
+        return -1;
+    resume->exh = exh;
+    for( int i = resume->number_of_streams; i < number_of_streams; i++ )
+    {
+        last_pos[i] = -1;
+        memset( &exh[i], 0, sizeof(lwlibav_extradata_handler_t) );
+        exh[i].current_index = -1;  /* no record is kept */
+    }
+    resume->number_of_streams = number_of_streams;
+    return 0;
+}
+
+static void cleanup_resume
+(
+    lwindex_resume_t *resume
+)
+{
+    for( int i = 0; i < resume->number_of_streams; i++ )
+        free_extradata_entries( &resume->exh[i] );
+    lw_freep( &resume->exh );
+    lw_freep( &resume->last_pos );
+    resume->number_of_streams = 0;
+}
+
+/* Collect the state to extend the index file from the records following the header.
+ * The records before resume->index_pos are kept as they are, and the others are rewritten.
+ * If checkpoint is given, resume->seek_pos has been set from it, and the extradata lists are read from it
+ * since the records from resume->index_pos may be incomplete. */
+static int parse_index_for_resume
+(
+    FILE             *index,
+    FILE             *checkpoint,
+    lwindex_resume_t *resume
+)
+{
+    char buf[1024];
+    int  found = 0;
+    if( !checkpoint )
+        resume->seek_pos = INT64_MAX;
+    while( 1 )
+    {
+        int64_t record_pos = lw_ftell( index );
+        if( checkpoint && record_pos >= resume->index_pos )
         {
-            /* Update progress dialog. */
-            int percent = 0;
-            if( first_dts == AV_NOPTS_VALUE )
-                first_dts = pkt.dts;
-            if( filesize > 0 && pkt.pos > 0 )
-                /* Update if packet's file offset is valid. */
-                percent = (int)(100.0 * ((double)pkt.pos / filesize) + 0.5);
-            else if( format_ctx->duration > 0 && first_dts != AV_NOPTS_VALUE && pkt.dts != AV_NOPTS_VALUE )
-                /* Update if packet's DTS is valid. */
-                percent = (int)(100.0
-                             * (pkt.dts - first_dts) * (stream->time_base.num / (double)stream->time_base.den)
-                             / (format_ctx->duration / AV_TIME_BASE)
-                             + 0.5);
-            const char *message = index ? "Creating Index file" : "Parsing input file";
-            int abort = indicator->update( php, message, percent );
-            av_packet_unref( &pkt );
-            if( abort )
-                goto fail_index;
+            found = (record_pos == resume->index_pos);
+            break;
+        }
+        if( !fgets( buf, sizeof(buf), index ) )
+            return -1;
+        int stream_index;
+        int codec_type;
+        int codec_id;
+        int extradata_index;
+        AVRational time_base;
+        int64_t pos;
+        int64_t pts;
+        int64_t dts;
+        if( sscanf( buf, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" SCNd64 ",PTS=%" SCNd64 ",DTS=%" SCNd64 ",EDI=%d",
+                    &stream_index, &codec_type, &codec_id, &time_base.num, &time_base.den, &pos, &pts, &dts, &extradata_index ) != 9 )
+            break;
+        if( stream_index < 0 || !fgets( buf, sizeof(buf), index ) )
+            return -1;
+        if( record_pos < resume->index_pos )
+        {
+            if( grow_resume_streams( resume, stream_index + 1 ) < 0 )
+                return -1;
+            if( pos >= 0 )
+                resume->last_pos[stream_index] = pos;
+            if( extradata_index >= 0 )
+                resume->exh[stream_index].current_index = extradata_index;
         }
         else
-            av_packet_unref( &pkt );
+        {
+            found |= (record_pos == resume->index_pos);
+            if( pos >= 0 && resume->seek_pos > pos )
+                resume->seek_pos = pos;
+        }
     }
-    /* Handle delay derived from the audio decoder. */
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    if( !found || resume->seek_pos == INT64_MAX )
+        return -1;
+    const char *end_tag = "</LibavReaderIndexFile>";
+    if( checkpoint )
     {
-        AVStream         *stream = format_ctx->streams[stream_index];
-        lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-        if( !helper || !helper->codec_ctx || !helper->decode || stream->codecpar->codec_type != AVMEDIA_TYPE_AUDIO )
-            continue;
-        AVCodecContext *pkt_ctx = helper->codec_ctx;
-        /* Flush if decoding is delayed. */
-        for( uint32_t i = 1; i <= helper->delay_count; i++ )
+        end_tag = "</LibavReaderIndexCheckpoint>";
+        index   = checkpoint;
+        if( !fgets( buf, sizeof(buf), index ) )
+            return -1;
+    }
+    else
+    {
+        if( strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
+            return -1;
+        /* Skip stream durations and AVIndexEntry. */
+        do
+            if( !fgets( buf, sizeof(buf), index ) )
+                return -1;
+        while( strncmp( buf, "<ExtraDataList=", strlen( "<ExtraDataList=" ) )
+            && strncmp( buf, end_tag, strlen( end_tag ) ) );
+    }
+    /* Get extradata lists referenced from the kept records. */
+    while( !strncmp( buf, "<ExtraDataList=", strlen( "<ExtraDataList=" ) ) )
+    {
+        int stream_index;
+        int codec_type;
+        int entry_count;
+        if( sscanf( buf, "<ExtraDataList=%d,%d,%d>", &stream_index, &codec_type, &entry_count ) != 3
+         || !fgets( buf, sizeof(buf), index ) )
+            return -1;
+        lwlibav_extradata_handler_t *exhp = stream_index >= 0 && stream_index < resume->number_of_streams
+                                         && resume->exh[stream_index].current_index >= 0
+                                          ? &resume->exh[stream_index]
+                                          : NULL;
+        if( entry_count > 0 && read_extradata_entries( index, buf, sizeof(buf), codec_type, entry_count, exhp ) < 0 )
+            return -1;
+        if( strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) )
+         || !fgets( buf, sizeof(buf), index ) )
+            return -1;
+    }
+    if( strncmp( buf, end_tag, strlen( end_tag ) ) )
+        return -1;
+    for( int i = 0; i < resume->number_of_streams; i++ )
+        if( resume->exh[i].current_index >= resume->exh[i].entry_count )
+            return -1;
+    return 0;
+}
+
+/* Set up resume from the checkpoint of the incomplete index file.
+ * Return 0 on success, otherwise -1. */
+static int parse_index_checkpoint
+(
+    FILE             *index,
+    const char       *index_file_path,
+    const char       *file_path,
+    int64_t           file_size,
+    int64_t           file_mtime,
+    lwindex_resume_t *resume
+)
+{
+    char *checkpoint_file_path = get_checkpoint_file_path( index_file_path );
+    if( !checkpoint_file_path )
+        return -1;
+    FILE *checkpoint = lw_fopen( checkpoint_file_path, "rb" );
+    free( checkpoint_file_path );
+    if( !checkpoint )
+        return -1;
+    int ret = -1;
+    int version;
+    int64_t index_pos;
+    lwindex_file_status_t status;
+    if( fscanf( checkpoint, "<LibavReaderIndexCheckpoint=%d>\n", &version ) == 1
+     && version == LWINDEX_INDEX_FILE_VERSION
+     && fscanf( checkpoint, "<InputFileStatus>%" SCNd64 ",%" SCNd64 ",0x%" SCNx64 "</InputFileStatus>\n",
+                &status.size, &status.mtime, &status.fingerprint ) == 3
+     && fscanf( checkpoint, "<Checkpoint>%" SCNd64 ",%" SCNd64 "</Checkpoint>\n", &index_pos, &resume->seek_pos ) == 2
+     && is_input_file_unchanged( file_path, file_size, file_mtime, &status ) )
+    {
+        resume->index_pos = index_pos;
+        ret = parse_index_for_resume( index, checkpoint, resume );
+    }
+    fclose( checkpoint );
+    return ret;
+}
+
+/* Return 0 if the index file is available as it is.
+ * Return 1 if the index file can be extended for the grown input file, or indexing can be resumed
+ * from the checkpoint of the incomplete index file, and then set up resume.
+ * Otherwise return -1. */
+static int parse_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    FILE                           *index,
+    const char                     *index_file_path,
+    lwindex_resume_t               *resume
+)
+{
+    /* Test to open the target file.
+     * If the path to the target file is already given, it takes precedence over the recorded one. */
+    char file_path[512] = { 0 };
+    if( fscanf( index, "<InputFilePath>%[^\n<]</InputFilePath>\n", file_path ) != 1 )
+        return -1;
+    FILE *target = lw_fopen( lwhp->file_path ? lwhp->file_path : file_path, "rb" );
+    if( !target )
+        return -1;
+    int64_t file_size  = lw_get_file_size( target );
+    int64_t file_mtime = lw_get_file_mtime( target );
+    fclose( target );
+    if( !lwhp->file_path )
+    {
+        size_t file_path_length = strlen( file_path );
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            return -1;
+        memcpy( lwhp->file_path, file_path, file_path_length );
+    }
+    /* Parse the index file. */
+    char format_name[256];
+    int active_video_index;
+    int active_audio_index;
+    if( fscanf( index, "<LibavReaderIndex=0x%x,%d,%[^>]>\n",
+                (unsigned int *)&lwhp->format_flags, &lwhp->raw_demuxer, format_name ) != 3 )
+        return -1;
+    int32_t active_index_pos = ftell( index );
+    if( fscanf( index, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
+     || fscanf( index, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1 )
+        return -1;
+    int32_t resume_point_pos = ftell( index );
+    lwindex_file_status_t indexed_status;
+    int64_t resume_index_pos;
+    if( fscanf( index, "<ResumePoint>%" SCNd64 ",%" SCNd64 "</ResumePoint>\n", &indexed_status.size, &resume_index_pos ) != 2
+     || fscanf( index, "<InputFileStatus>%" SCNd64 ",0x%" SCNx64 "</InputFileStatus>\n",
+                &indexed_status.mtime, &indexed_status.fingerprint ) != 2 )
+        return -1;
+    /* Get the parameters of the video stream to be active. */
+    lwlibav_video_stream_parameters_t stream_params = { 0 };
+    int params_stream_index = opt->force_video ? opt->force_video_index : active_video_index;
+    while( 1 )
+    {
+        char line[512];
+        int32_t line_pos = ftell( index );
+        if( !fgets( line, sizeof(line), index ) || strncmp( line, "<StreamParameters=", strlen( "<StreamParameters=" ) ) )
         {
-            AVPacket null_pkt = { 0 };
-            av_init_packet( &null_pkt );
-            null_pkt.data = NULL;
-            null_pkt.size = 0;
-            int decode_complete;
-            if( helper->decode( pkt_ctx, helper->picture, &decode_complete, &null_pkt ) >= 0 )
-            {
-                int frame_length = decode_complete ? helper->picture->nb_samples : 0;
-                if( stream_index == adhp->stream_index )
-                {
-                    audio_duration += frame_length;
-                    if( audio_duration > INT32_MAX )
-                        break;
-                    uint32_t audio_frame_number = audio_sample_count - helper->delay_count + i;
-                    audio_info[audio_frame_number].length = frame_length;
-                    if( audio_frame_number > 1
-                     && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                        constant_frame_length = 0;
-                }
-                print_index( index, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=-1,PTS=%" PRId64 ",DTS=%" PRId64 ",EDI=-1\n"
-                             "Channels=0:0x0,Rate=0,Format=none,BPS=0,Length=%d\n",
-                             stream_index, AVMEDIA_TYPE_AUDIO, pkt_ctx->codec_id,
-                             format_ctx->streams[stream_index]->time_base.num,
-                             format_ctx->streams[stream_index]->time_base.den,
-                             AV_NOPTS_VALUE, AV_NOPTS_VALUE, frame_length );
-            }
+            fseek( index, line_pos, SEEK_SET );
+            break;
         }
+        int stream_index;
+        lwlibav_video_stream_parameters_t params = { 0 };
+        if( read_video_stream_parameters( line, &stream_index, &params ) < 0 )
+            return -1;
+        if( stream_index == params_stream_index )
+            stream_params = params;
     }
-    print_index( index, "</LibavReaderIndex>\n" );
-    /* Deallocate video frame info if no active video stream. */
-    if( vdhp->stream_index < 0 )
-        lw_freep( &video_info );
-    /* Deallocate audio frame info if no active audio stream. */
-    if( adhp->stream_index < 0 )
-        lw_freep( &audio_info );
-    else
+    if( indexed_status.size < 0 )
     {
-        /* Check the active stream is DV in AVI Type-1 or not. */
-        if( adhp->dv_in_avi == 1 && format_ctx->streams[ adhp->stream_index ]->nb_index_entries == 0 )
+        /* Indexing was aborted before the index file was completed.
+         * Resume indexing from the last checkpoint if any, otherwise re-create the index file. */
+        if( !resume || !is_appendable_format( format_name ) )
+            return -1;
+        resume->resume_point_pos   = resume_point_pos;
+        resume->active_video_index = active_video_index;
+        resume->active_audio_index = active_audio_index;
+        if( parse_index_checkpoint( index, index_file_path, lwhp->file_path, file_size, file_mtime, resume ) < 0 )
         {
-            /* DV in AVI Type-1 */
-            audio_sample_count = video_info ? MIN( video_sample_count, audio_sample_count ) : 0;
-            for( uint32_t i = 1; i <= audio_sample_count; i++ )
-            {
-                audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
-                audio_info[i].sample_number   = video_info[i].sample_number;
-                audio_info[i].pts             = video_info[i].pts;
-                audio_info[i].dts             = video_info[i].dts;
-                audio_info[i].file_offset     = video_info[i].file_offset;
-                audio_info[i].extradata_index = video_info[i].extradata_index;
-            }
+            cleanup_resume( resume );
+            return -1;
         }
-        else
+        return 1;
+    }
+    /* Re-create the index file if the indexed part of the input file has been changed. */
+    if( !is_input_file_unchanged( lwhp->file_path, file_size, file_mtime, &indexed_status ) )
+        return -1;
+    if( indexed_status.size != file_size )
+    {
+        /* The input file has grown since the index file was created.
+         * Extend the index file instead of re-creating it.
+         * If the index file cannot be written, use it as it is, where the grown part is just ignored. */
+        if( resume_index_pos < 0 || !is_appendable_format( format_name ) )
+            return -1;
+        if( resume )
         {
-            if( adhp->dv_in_avi == 1 && opt->force_video && opt->force_video_index == -1 )
+            resume->index_pos          = resume_index_pos;
+            resume->resume_point_pos   = resume_point_pos;
+            resume->active_video_index = active_video_index;
+            resume->active_audio_index = active_audio_index;
+            if( parse_index_for_resume( index, NULL, resume ) < 0 )
             {
-                /* Disable DV video stream. */
-                disable_video_stream( vdhp );
-                video_info = NULL;
+                cleanup_resume( resume );
+                return -1;
             }
-            adhp->dv_in_avi = 0;
+            return 1;
         }
     }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
-    {
-        AVStream *stream = format_ctx->streams[stream_index];
-        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-         || stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
-            print_index( index, "<StreamDuration=%d,%d>%" PRId64 "</StreamDuration>\n",
-                         stream_index, stream->codecpar->codec_type, stream->duration );
-    }
-    if( !strcmp( lwhp->format_name, "asf" ) )
+    lwhp->format_name = format_name;
+    adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
+    int video_present = (active_video_index >= 0);
+    int audio_present = (active_audio_index >= 0);
+    vdhp->stream_index = opt->force_video ? opt->force_video_index : active_video_index;
+    adhp->stream_index = opt->force_audio ? opt->force_audio_index : active_audio_index;
+    lwindex_parser_t parser;
+    if( init_index_parser( &parser, vdhp, adhp, aohp ) < 0 )
+        goto fail_parsing;
+    /* The pixel format of consecutive frames is the same in most cases.
+     * Cache the last name lookup to avoid searching the descriptor table per frame. */
+    char last_pix_fmt_name[64] = { 0 };
+    enum AVPixelFormat last_pix_fmt = AV_PIX_FMT_NONE;
+    char buf[1024];
+    while( fgets( buf, sizeof(buf), index ) )
     {
-        /* Pretty hackish workaround for the ASF demuxer
-         * The Simple Index Object does not always describe all keyframes in corresponding video stream.
-         * Since the Simple Index Object cannot indicate PTS offset derived from missing indexes of early keyframes,
-         * the Simple Index Object is unreliable on frame-accurate seek. So, this section makes up the indexes from
-         * the actual timestamps and file offsets without the Simple Index Object.
-         * Here, also construct the indexes for audio stream from the actual timestamps and file offsets if present. */
-        for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+        int stream_index;
+        int codec_type;
+        int codec_id;
+        int extradata_index;
+        AVRational time_base;
+        int64_t pos;
+        int64_t pts;
+        int64_t dts;
+        if( sscanf( buf, "Index=%d,Type=%d,", &stream_index, &codec_type ) == 2
+         && codec_type == AVMEDIA_TYPE_AUDIO && stream_index != adhp->stream_index )
         {
-            AVStream *stream = format_ctx->streams[stream_index];
-            AVIndexEntry *temp = NULL;
-            if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
-            {
-                unsigned int allocated_size = video_keyframe_count * sizeof(AVIndexEntry);
-                temp = (AVIndexEntry *)av_realloc( stream->index_entries, allocated_size );
-                if( temp )
-                {
-                    uint32_t i = 0;
-                    for( uint32_t j = 1; j <= video_sample_count && i < video_keyframe_count; j++ )
-                        if( (video_info[j].flags & LW_VFRAME_FLAG_KEY)
-                         && (video_info[j].pts != AV_NOPTS_VALUE
-                          || video_info[j].dts != AV_NOPTS_VALUE) )
-                        {
-                            temp[i].pos          = video_info[j].file_offset;
-                            temp[i].timestamp    = video_info[j].pts != AV_NOPTS_VALUE ? video_info[j].pts : video_info[j].dts;
-                            temp[i].flags        = AVINDEX_KEYFRAME;
-                            temp[i].size         = 0;
-                            temp[i].min_distance = 0;
-                            ++i;
-                        }
-                    stream->index_entries                = temp;
-                    stream->index_entries_allocated_size = allocated_size;
-                    stream->nb_index_entries             = i;
-                }
-            }
-            else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+            /* The records of the streams are interleaved in decoding order, so they cannot be skipped at once.
+             * Just skip the record of the audio stream which is not active without parsing the whole. */
+            if( !fgets( buf, sizeof(buf), index ) )
+                goto fail_parsing;
+            continue;
+        }
+        if( sscanf( buf, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" SCNd64 ",PTS=%" SCNd64 ",DTS=%" SCNd64 ",EDI=%d",
+                    &stream_index, &codec_type, &codec_id, &time_base.num, &time_base.den, &pos, &pts, &dts, &extradata_index ) != 9 )
+            break;
+        if( codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            if( !fgets( buf, sizeof(buf), index ) )
+                goto fail_parsing;
+            if( check_dv_in_avi( vdhp, adhp, &parser, opt, stream_index, (enum AVCodecID)codec_id ) < 0 )
+                goto fail_parsing;
+            if( stream_index == vdhp->stream_index )
             {
-                unsigned int allocated_size = audio_sample_count * sizeof(AVIndexEntry);
-                temp = (AVIndexEntry *)av_realloc( stream->index_entries, allocated_size );
-                if( temp )
+                lwindex_video_record_t record;
+                int key;
+                int pict_type;
+                int poc;
+                int repeat_pict;
+                int field_info;
+                int width;
+                int height;
+                int colorspace;
+                char pix_fmt[64];
+                if( sscanf( buf, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%[^,],ColorSpace=%d",
+                            &key, &pict_type, &poc, &repeat_pict, &field_info, &width, &height, pix_fmt, &colorspace ) != 9 )
+                    goto fail_parsing;
+                if( strcmp( pix_fmt, last_pix_fmt_name ) )
                 {
-                    uint32_t i = 0;
-                    for( uint32_t j = 1; j <= audio_sample_count && i < audio_sample_count; j++ )
-                    {
-                        if( audio_info[j].pts != AV_NOPTS_VALUE
-                         || audio_info[j].dts != AV_NOPTS_VALUE )
-                        {
-                            temp[i].pos          = audio_info[j].file_offset;
-                            temp[i].timestamp    = audio_info[j].pts != AV_NOPTS_VALUE ? audio_info[j].pts : audio_info[j].dts;
-                            temp[i].flags        = AVINDEX_KEYFRAME;
-                            temp[i].size         = 0;
-                            temp[i].min_distance = 0;
-                            ++i;
-                        }
-                    }
-                    stream->index_entries                = temp;
-                    stream->index_entries_allocated_size = allocated_size;
-                    stream->nb_index_entries             = i;
+                    strcpy( last_pix_fmt_name, pix_fmt );
+                    last_pix_fmt = av_get_pix_fmt( (const char *)pix_fmt );
                 }
+                record.pos             = pos;
+                record.pts             = pts;
+                record.dts             = dts;
+                record.extradata_index = extradata_index;
+                record.key             = key;
+                record.pict_type       = pict_type;
+                record.poc             = poc;
+                record.repeat_pict     = repeat_pict;
+                record.field_info      = field_info;
+                record.width           = width;
+                record.height          = height;
+                record.pix_fmt         = last_pix_fmt;
+                record.colorspace      = colorspace;
+                if( import_video_record( vdhp, &parser, (enum AVCodecID)codec_id, time_base, &record ) < 0 )
+                    goto fail_parsing;
             }
-            if( !temp )
+        }
+        else if( codec_type == AVMEDIA_TYPE_AUDIO )
+        {
+            if( !fgets( buf, sizeof(buf), index ) )
+                goto fail_parsing;
+            if( stream_index == adhp->stream_index )
             {
-                /* Anyway clear the index entries. */
-                av_freep( &stream->index_entries );
-                stream->index_entries_allocated_size = 0;
-                stream->nb_index_entries             = 0;
+                lwindex_audio_record_t record;
+                uint64_t layout;
+                int      channels;
+                int      sample_rate;
+                char     sample_fmt[64];
+                int      bits_per_sample;
+                int      frame_length;
+                if( sscanf( buf, "Channels=%d:0x%" SCNx64 ",Rate=%d,Format=%[^,],BPS=%d,Length=%d",
+                            &channels, &layout, &sample_rate, sample_fmt, &bits_per_sample, &frame_length ) != 6 )
+                    goto fail_parsing;
+                record.pos             = pos;
+                record.pts             = pts;
+                record.dts             = dts;
+                record.channel_layout  = layout;
+                record.extradata_index = extradata_index;
+                record.channels        = channels;
+                record.sample_rate     = sample_rate;
+                record.sample_fmt      = av_get_sample_fmt( (const char *)sample_fmt );
+                record.bits_per_sample = bits_per_sample;
+                record.frame_length    = frame_length;
+                if( import_audio_record( adhp, aohp, &parser, (enum AVCodecID)codec_id, time_base, &record ) < 0 )
+                    goto fail_parsing;
             }
         }
     }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    if( need_reindexing( vdhp, &parser, opt, video_present, audio_present ) )
+        goto fail_parsing;  /* Need to re-create the index file. */
+    if( strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
+        goto fail_parsing;
+    /* Parse stream durations. */
+    if( !fgets( buf, sizeof(buf), index ) )
+        goto fail_parsing;
+    while( !strncmp( buf, "<StreamDuration=", strlen( "<StreamDuration=" ) ) )
     {
-        AVStream *stream = format_ctx->streams[stream_index];
-        if( stream->codecpar->codec_type == AVMEDIA_TYPE_VIDEO )
+        int     stream_index;
+        int     codec_type;
+        int64_t stream_duration;
+        if( sscanf( buf, "<StreamDuration=%d,%d>%" SCNd64 "</StreamDuration>", &stream_index, &codec_type, &stream_duration ) != 3 )
+            goto fail_parsing;
+        if( codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index )
+            vdhp->stream_duration = stream_duration;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+    }
+    /* Parse AVIndexEntry. */
+    while( !strncmp( buf, "<StreamIndexEntries=", strlen( "<StreamIndexEntries=" ) ) )
+    {
+        int stream_index;
+        int codec_type;
+        int index_entries_count;
+        int section_size;
+        if( sscanf( buf, "<StreamIndexEntries=%d,%d,%d,Size=%d>", &stream_index, &codec_type, &index_entries_count, &section_size ) != 4 )
+            goto fail_parsing;
+        if( !(codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+         && !(codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
         {
-            print_index( index, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_VIDEO, stream->nb_index_entries );
-            if( vdhp->stream_index != stream_index )
-                for( int i = 0; i < stream->nb_index_entries; i++ )
-                    write_av_index_entry( index, &stream->index_entries[i] );
-            else if( stream->nb_index_entries > 0 )
+            /* Skip the section of the stream which is not active. */
+            if( fseek( index, section_size, SEEK_CUR ) )
+                goto fail_parsing;
+            index_entries_count = 0;
+        }
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+        if( index_entries_count > 0 )
+        {
+            if( codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index )
             {
-                vdhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
+                vdhp->index_entries_count = index_entries_count;
+                vdhp->index_entries = (AVIndexEntry *)av_malloc( vdhp->index_entries_count * sizeof(AVIndexEntry) );
                 if( !vdhp->index_entries )
-                    goto fail_index;
-                for( int i = 0; i < stream->nb_index_entries; i++ )
+                    goto fail_parsing;
+                for( int i = 0; i < vdhp->index_entries_count; i++ )
                 {
-                    AVIndexEntry *ie = &stream->index_entries[i];
-                    vdhp->index_entries[i] = *ie;
-                    write_av_index_entry( index, ie );
+                    AVIndexEntry ie;
+                    int size;
+                    int flags;
+                    if( sscanf( buf, "POS=%" SCNd64 ",TS=%" SCNd64 ",Flags=%x,Size=%d,Distance=%d",
+                                &ie.pos, &ie.timestamp, (unsigned int *)&flags, &size, &ie.min_distance ) != 5 )
+                        break;
+                    ie.size  = size;
+                    ie.flags = flags;
+                    vdhp->index_entries[i] = ie;
+                    if( !fgets( buf, sizeof(buf), index ) )
+                        goto fail_parsing;
                 }
-                vdhp->index_entries_count = stream->nb_index_entries;
             }
-            print_index( index, "</StreamIndexEntries>\n" );
-        }
-        else if( stream->codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
-        {
-            print_index( index, "<StreamIndexEntries=%d,%d,%d>\n", stream_index, AVMEDIA_TYPE_AUDIO, stream->nb_index_entries );
-            if( adhp->stream_index != stream_index )
-                for( int i = 0; i < stream->nb_index_entries; i++ )
-                    write_av_index_entry( index, &stream->index_entries[i] );
-            else if( stream->nb_index_entries > 0 )
+            else if( codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index )
             {
-                /* Audio stream in matroska container requires index_entries for seeking.
-                 * This avoids for re-reading the file to create index_entries since the file will be closed once. */
-                adhp->index_entries = (AVIndexEntry *)av_malloc( stream->index_entries_allocated_size );
+                adhp->index_entries_count = index_entries_count;
+                adhp->index_entries = (AVIndexEntry *)av_malloc( adhp->index_entries_count * sizeof(AVIndexEntry) );
                 if( !adhp->index_entries )
-                    goto fail_index;
-                for( int i = 0; i < stream->nb_index_entries; i++ )
+                    goto fail_parsing;
+                for( int i = 0; i < adhp->index_entries_count; i++ )
                 {
-                    AVIndexEntry *ie = &stream->index_entries[i];
-                    adhp->index_entries[i] = *ie;
-                    write_av_index_entry( index, ie );
+                    AVIndexEntry ie;
+                    int size;
+                    int flags;
+                    if( sscanf( buf, "POS=%" SCNd64 ",TS=%" SCNd64 ",Flags=%x,Size=%d,Distance=%d",
+                                &ie.pos, &ie.timestamp, (unsigned int *)&flags, &size, &ie.min_distance ) != 5 )
+                        break;
+                    ie.size  = size;
+                    ie.flags = flags;
+                    adhp->index_entries[i] = ie;
+                    if( !fgets( buf, sizeof(buf), index ) )
+                        goto fail_parsing;
                 }
-                adhp->index_entries_count = stream->nb_index_entries;
             }
-            print_index( index, "</StreamIndexEntries>\n" );
         }
+        if( strncmp( buf, "</StreamIndexEntries>", strlen( "</StreamIndexEntries>" ) ) )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
     }
-    for( unsigned int stream_index = 0; stream_index < format_ctx->nb_streams; stream_index++ )
+    /* Parse extradata. */
+    while( !strncmp( buf, "<ExtraDataList=", strlen( "<ExtraDataList=" ) ) )
     {
-        AVStream          *stream   = format_ctx->streams[stream_index];
-        AVCodecParameters *codecpar = stream->codecpar;
-        if( codecpar->codec_type == AVMEDIA_TYPE_VIDEO || codecpar->codec_type == AVMEDIA_TYPE_AUDIO )
+        int stream_index;
+        int codec_type;
+        int entry_count;
+        int section_size;
+        if( sscanf( buf, "<ExtraDataList=%d,%d,%d,Size=%d>", &stream_index, &codec_type, &entry_count, &section_size ) != 4 )
+            goto fail_parsing;
+        if( !(codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
+         && !(codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
         {
-            lwindex_helper_t *helper = get_index_helper( &indexer, stream );
-            if( !helper || !helper->codec_ctx )
-                continue;
-            lwlibav_extradata_handler_t *list = &helper->exh;
-            void (*write_av_extradata)( FILE *, lwlibav_extradata_t * ) = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-                                                                        ? write_video_extradata
-                                                                        : write_audio_extradata;
-            print_index( index, "<ExtraDataList=%d,%d,%d>\n", stream_index, codecpar->codec_type, list->entry_count );
-            if( (codecpar->codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
-             || (codecpar->codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
-            {
-                for( int i = 0; i < list->entry_count; i++ )
-                    write_av_extradata( index, &list->entries[i] );
-                lwlibav_extradata_handler_t *exhp = codecpar->codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
-                exhp->entry_count   = list->entry_count;
-                exhp->entries       = list->entries;
-                exhp->current_index = codecpar->codec_type == AVMEDIA_TYPE_VIDEO
-                                    ? video_info[1].extradata_index
-                                    : audio_info[1].extradata_index;
-                /* Avoid freeing entries. */
-                list->entry_count = 0;
-                list->entries     = NULL;
-            }
-            else
-                for( int i = 0; i < list->entry_count; i++ )
-                    write_av_extradata( index, &list->entries[i] );
-            print_index( index, "</ExtraDataList>\n" );
+            /* Skip the section of the stream which is not active. */
+            if( fseek( index, section_size, SEEK_CUR ) )
+                goto fail_parsing;
+            entry_count = 0;
+        }
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
+        if( entry_count > 0 )
+        {
+            lwlibav_extradata_handler_t *exhp = codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
+            if( read_extradata_entries( index, buf, sizeof(buf), codec_type, entry_count, exhp ) < 0 )
+                goto fail_parsing;
+            exhp->current_index = codec_type == AVMEDIA_TYPE_VIDEO
+                                ? get_video_frame_info( &parser.video_store, 1 )->extradata_index
+                                : get_audio_frame_info( &parser.audio_store, 1 )->extradata_index;
         }
+        if( strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) ) )
+            goto fail_parsing;
+        if( !fgets( buf, sizeof(buf), index ) )
+            goto fail_parsing;
     }
-    print_index( index, "</LibavReaderIndexFile>\n" );
-    if( vdhp->stream_index >= 0 )
+    if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
     {
-        vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
-        if( !vdhp->keyframe_list )
-            goto fail_index;
-        vdhp->frame_list      = video_info;
-        vdhp->frame_count     = video_sample_count;
-        vdhp->initial_pix_fmt = vdhp->ctx->pix_fmt;
-        if( decide_video_seek_method( lwhp, vdhp, video_sample_count ) )
-            goto fail_index;
-        /* Compute the stream duration. */
-        compute_stream_duration( lwhp, vdhp, format_ctx->streams[ vdhp->stream_index ]->duration );
-        /* Create the repeat control info. */
-        create_video_frame_order_list( vdhp, vohp, opt );
-        /* Exclude invisible frames from the output handler. */
-        create_video_visible_frame_list( vdhp, vohp, invisible_count );
+        if( setup_parsed_index( lwhp, vdhp, vohp, adhp, aohp, opt, &parser, active_video_index ) < 0 )
+            goto fail_parsing;
+        if( vdhp->stream_index == params_stream_index )
+            vdhp->stream_params = stream_params;
+        if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
+        {
+            /* Update the active stream indexes when specifying different stream indexes. */
+            fseek( index, active_index_pos, SEEK_SET );
+            fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", vdhp->stream_index );
+            fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
+        }
+        return 0;
     }
-    if( adhp->stream_index >= 0 )
+fail_parsing:
+    lw_freep( &vdhp->frame_list );
+    adhp->frame_list = NULL;
+    free_frame_store( &parser.video_store );
+    free_frame_store( &parser.audio_store );
+    if( parser.video_info )
+        free( parser.video_info );
+    if( parser.audio_info )
+        free( parser.audio_info );
+    return -1;
+}
+
+static const lwindex_binary_section_t *find_binary_index_section
+(
+    const lwindex_binary_header_t  *header,
+    const lwindex_binary_section_t *sections,
+    uint32_t                        type,
+    int                             stream_index,
+    int                             codec_type
+)
+{
+    for( uint32_t i = 0; i < header->section_count; i++ )
+        if( sections[i].type == type
+         && (stream_index < 0 || (sections[i].stream_index == stream_index && sections[i].codec_type == codec_type)) )
+            return &sections[i];
+    return NULL;
+}
+
+static const char *get_binary_index_string
+(
+    const uint8_t                  *data,
+    const lwindex_binary_header_t  *header,
+    const lwindex_binary_section_t *sections,
+    uint32_t                        type
+)
+{
+    const lwindex_binary_section_t *section = find_binary_index_section( header, sections, type, -1, 0 );
+    if( !section || section->size == 0 || data[ section->offset + section->size - 1 ] != '\0' )
+        return NULL;
+    return (const char *)(data + section->offset);
+}
+
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    int            error;
+} lwindex_packed_reader_t;
+
+static uint64_t get_packed_uint
+(
+    lwindex_packed_reader_t *reader
+)
+{
+    uint64_t value = 0;
+    for( int shift = 0; shift < 64 && reader->p < reader->end; shift += 7 )
     {
-        adhp->frame_list   = audio_info;
-        adhp->frame_count  = audio_sample_count;
-        adhp->frame_length = constant_frame_length ? adhp->frame_list[1].length : 0;
-        decide_audio_seek_method( lwhp, adhp, audio_sample_count );
-        if( opt->av_sync && vdhp->stream_index >= 0 )
-            lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, audio_sample_rate );
+        uint8_t byte = *reader->p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if( !(byte & 0x80) )
+            return value;
+    }
+    reader->error = 1;
+    return 0;
+}
+
+static int64_t get_packed_int
+(
+    lwindex_packed_reader_t *reader
+)
+{
+    uint64_t value = get_packed_uint( reader );
+    return (int64_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static int64_t get_packed_delta
+(
+    lwindex_packed_reader_t *reader,
+    int64_t                  base
+)
+{
+    return (int64_t)((uint64_t)base + (uint64_t)get_packed_int( reader ));
+}
+
+static int unpack_video_record
+(
+    lwindex_packed_reader_t *reader,
+    lwindex_video_record_t  *last,
+    lwindex_video_record_t  *record,
+    int                      first
+)
+{
+    if( reader->p >= reader->end )
+        return -1;
+    uint8_t flags = *reader->p++;
+    if( first && (flags & (LWINDEX_PACKED_EXTRADATA | LWINDEX_PACKED_RESOLUTION | LWINDEX_PACKED_PIX_FMT | LWINDEX_PACKED_COLORSPACE))
+              != (LWINDEX_PACKED_EXTRADATA | LWINDEX_PACKED_RESOLUTION | LWINDEX_PACKED_PIX_FMT | LWINDEX_PACKED_COLORSPACE) )
+        return -1;
+    last->key = !!(flags & LWINDEX_PACKED_KEY);
+    last->pos = get_packed_delta( reader, last->pos );
+    if( !(flags & LWINDEX_PACKED_PTS_NONE) )
+        last->pts = get_packed_delta( reader, last->pts );
+    if( !(flags & LWINDEX_PACKED_DTS_NONE) )
+        last->dts = get_packed_delta( reader, last->dts );
+    last->pict_type   = (int32_t)get_packed_int( reader );
+    last->poc         = (int32_t)get_packed_int( reader );
+    last->repeat_pict = (int32_t)get_packed_int( reader );
+    last->field_info  = (int32_t)get_packed_int( reader );
+    if( flags & LWINDEX_PACKED_EXTRADATA )
+        last->extradata_index = (int32_t)get_packed_int( reader );
+    if( flags & LWINDEX_PACKED_RESOLUTION )
+    {
+        last->width  = (int32_t)get_packed_int( reader );
+        last->height = (int32_t)get_packed_int( reader );
+    }
+    if( flags & LWINDEX_PACKED_PIX_FMT )
+        last->pix_fmt = (int32_t)get_packed_int( reader );
+    if( flags & LWINDEX_PACKED_COLORSPACE )
+        last->colorspace = (int32_t)get_packed_int( reader );
+    if( reader->error )
+        return -1;
+    *record = *last;
+    if( flags & LWINDEX_PACKED_PTS_NONE )
+        record->pts = AV_NOPTS_VALUE;
+    if( flags & LWINDEX_PACKED_DTS_NONE )
+        record->dts = AV_NOPTS_VALUE;
+    return 0;
+}
+
+static int unpack_audio_record
+(
+    lwindex_packed_reader_t *reader,
+    lwindex_audio_record_t  *last,
+    lwindex_audio_record_t  *record,
+    int                      first
+)
+{
+    if( reader->p >= reader->end )
+        return -1;
+    uint8_t flags = *reader->p++;
+    if( first && (flags & (LWINDEX_PACKED_EXTRADATA | LWINDEX_PACKED_CHANNELS | LWINDEX_PACKED_SAMPLE_RATE | LWINDEX_PACKED_SAMPLE_FMT | LWINDEX_PACKED_FRAME_LENGTH))
+              != (LWINDEX_PACKED_EXTRADATA | LWINDEX_PACKED_CHANNELS | LWINDEX_PACKED_SAMPLE_RATE | LWINDEX_PACKED_SAMPLE_FMT | LWINDEX_PACKED_FRAME_LENGTH) )
+        return -1;
+    last->pos = get_packed_delta( reader, last->pos );
+    if( !(flags & LWINDEX_PACKED_PTS_NONE) )
+        last->pts = get_packed_delta( reader, last->pts );
+    if( !(flags & LWINDEX_PACKED_DTS_NONE) )
+        last->dts = get_packed_delta( reader, last->dts );
+    if( flags & LWINDEX_PACKED_EXTRADATA )
+        last->extradata_index = (int32_t)get_packed_int( reader );
+    if( flags & LWINDEX_PACKED_CHANNELS )
+    {
+        last->channels       = (int32_t)get_packed_int( reader );
+        last->channel_layout = get_packed_uint( reader );
+    }
+    if( flags & LWINDEX_PACKED_SAMPLE_RATE )
+        last->sample_rate = (int32_t)get_packed_int( reader );
+    if( flags & LWINDEX_PACKED_SAMPLE_FMT )
+    {
+        last->sample_fmt      = (int32_t)get_packed_int( reader );
+        last->bits_per_sample = (int32_t)get_packed_int( reader );
+    }
+    if( flags & LWINDEX_PACKED_FRAME_LENGTH )
+        last->frame_length = (int32_t)get_packed_int( reader );
+    if( reader->error )
+        return -1;
+    *record = *last;
+    if( flags & LWINDEX_PACKED_PTS_NONE )
+        record->pts = AV_NOPTS_VALUE;
+    if( flags & LWINDEX_PACKED_DTS_NONE )
+        record->dts = AV_NOPTS_VALUE;
+    return 0;
+}
+
+static int import_binary_index_entries
+(
+    const uint8_t                  *data,
+    const lwindex_binary_section_t *section,
+    lwlibav_decode_handler_t       *dhp
+)
+{
+    if( !section || section->entry_count == 0 )
+        return 0;
+    if( section->entry_size != sizeof(lwindex_index_entry_record_t) || section->entry_count > INT_MAX )
+        return -1;
+    dhp->index_entries = (AVIndexEntry *)av_malloc( section->entry_count * sizeof(AVIndexEntry) );
+    if( !dhp->index_entries )
+        return -1;
+    dhp->index_entries_count = section->entry_count;
+    const lwindex_index_entry_record_t *record = (const lwindex_index_entry_record_t *)(data + section->offset);
+    for( int i = 0; i < dhp->index_entries_count; i++ )
+    {
+        AVIndexEntry *ie = &dhp->index_entries[i];
+        ie->pos          = record[i].pos;
+        ie->timestamp    = record[i].timestamp;
+        ie->flags        = record[i].flags;
+        ie->size         = record[i].size;
+        ie->min_distance = record[i].min_distance;
+    }
+    return 0;
+}
+
+static int import_binary_extradata
+(
+    const uint8_t                  *data,
+    const lwindex_binary_section_t *section,
+    lwlibav_extradata_handler_t    *exhp,
+    int                             current_index
+)
+{
+    if( !section || section->entry_count == 0 )
+        return 0;
+    if( section->entry_size != sizeof(lwindex_extradata_record_t) || section->entry_count > INT_MAX )
+        return -1;
+    if( !alloc_extradata_entries( exhp, section->entry_count ) )
+        return -1;
+    exhp->current_index = current_index;
+    const uint8_t *pos = data + section->offset;
+    const uint8_t *end = pos  + section->size;
+    for( int i = 0; i < exhp->entry_count; i++ )
+    {
+        if( (size_t)(end - pos) < sizeof(lwindex_extradata_record_t) )
+            return -1;
+        const lwindex_extradata_record_t *record = (const lwindex_extradata_record_t *)pos;
+        pos += sizeof(lwindex_extradata_record_t);
+        if( record->extradata_size < 0 || (size_t)(end - pos) < (size_t)record->extradata_size )
+            return -1;
+        lwlibav_extradata_t *entry = &exhp->entries[i];
+        entry->extradata_size  = record->extradata_size;
+        entry->codec_id        = (enum AVCodecID)record->codec_id;
+        entry->codec_tag       = record->codec_tag;
+        entry->width           = record->width;
+        entry->height          = record->height;
+        entry->pixel_format    = (enum AVPixelFormat)record->pixel_format;
+        entry->video_delay     = record->video_delay;
+        entry->channel_layout  = record->channel_layout;
+        entry->sample_format   = (enum AVSampleFormat)record->sample_format;
+        entry->sample_rate     = record->sample_rate;
+        entry->bits_per_sample = record->bits_per_sample;
+        entry->block_align     = record->block_align;
+        if( entry->extradata_size > 0 )
+        {
+            entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+            if( !entry->extradata )
+                return -1;
+            memcpy( entry->extradata, pos, entry->extradata_size );
+            memset( entry->extradata + entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
+        }
+        size_t padded_size = (entry->extradata_size + LWINDEX_BINARY_ALIGNMENT - 1) & ~(LWINDEX_BINARY_ALIGNMENT - 1);
+        pos += MIN( padded_size, (size_t)(end - pos) );
     }
-    cleanup_index_helpers( &indexer, format_ctx );
-    if( index )
-        fclose( index );
-    if( indicator->close )
-        indicator->close( php );
-    vdhp->format = NULL;
-    adhp->format = NULL;
-    return;
-fail_index:
-    cleanup_index_helpers( &indexer, format_ctx );
-    free( video_info );
-    free( audio_info );
-    if( index )
-        fclose( index );
-    if( indicator->close )
-        indicator->close( php );
-    vdhp->format = NULL;
-    adhp->format = NULL;
-    return;
+    return 0;
 }
 
-static int parse_index
+static int parse_binary_index
 (
     lwlibav_file_handler_t         *lwhp,
     lwlibav_video_decode_handler_t *vdhp,
@@ -2699,490 +6768,556 @@ static int parse_index
     FILE                           *index
 )
 {
-    /* Test to open the target file. */
-    char file_path[512] = { 0 };
-    if( fscanf( index, "<InputFilePath>%[^\n<]</InputFilePath>\n", file_path ) != 1 )
+    size_t size;
+    uint8_t *data = (uint8_t *)lw_map_file( index, &size );
+    if( !data )
         return -1;
-    FILE *target = lw_fopen( file_path, "rb" );
+    lwindex_parser_t parser;
+    memset( &parser, 0, sizeof(lwindex_parser_t) );
+    /* Check the header and the section table. */
+    const lwindex_binary_header_t *header = (const lwindex_binary_header_t *)data;
+    if( size < sizeof(lwindex_binary_header_t)
+     || memcmp( header->magic, LWINDEX_BINARY_MAGIC, LWINDEX_BINARY_MAGIC_SIZE )
+     || header->lwindex_version      != LWINDEX_VERSION
+     || header->index_file_version   != LWINDEX_INDEX_FILE_VERSION
+     || header->byte_order_mark      != LWINDEX_BINARY_BYTE_ORDER_MARK
+     || (header->avutil_version >> 16) != LIBAVUTIL_VERSION_MAJOR
+     || header->section_table_offset % LWINDEX_BINARY_ALIGNMENT
+     || header->section_table_offset > size
+     || header->section_count > (size - header->section_table_offset) / sizeof(lwindex_binary_section_t) )
+        goto fail_parsing;
+    const lwindex_binary_section_t *sections = (const lwindex_binary_section_t *)(data + header->section_table_offset);
+    for( uint32_t i = 0; i < header->section_count; i++ )
+        if( sections[i].offset % LWINDEX_BINARY_ALIGNMENT
+         || sections[i].offset > size
+         || sections[i].size   > size - sections[i].offset
+         || (sections[i].entry_size && sections[i].entry_count > sections[i].size / sections[i].entry_size) )
+            goto fail_parsing;
+    /* Test to open the target file. */
+    const char *file_path = get_binary_index_string( data, header, sections, LWINDEX_SECTION_INPUT_FILE_PATH );
+    if( !file_path )
+        goto fail_parsing;
+    FILE *target = lw_fopen( lwhp->file_path ? lwhp->file_path : file_path, "rb" );
     if( !target )
-        return -1;
+        goto fail_parsing;
+    int64_t file_size  = lw_get_file_size( target );
+    int64_t file_mtime = lw_get_file_mtime( target );
     fclose( target );
-    size_t file_path_length = strlen( file_path );
-    lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+    /* The binary index file is never extended, so re-create it if the input file has been changed at all. */
+    lwindex_file_status_t indexed_status = { header->input_file_size, header->input_file_mtime, header->input_file_fingerprint };
+    if( file_size != indexed_status.size
+     || !is_input_file_unchanged( lwhp->file_path ? lwhp->file_path : file_path, file_size, file_mtime, &indexed_status ) )
+        goto fail_parsing;
     if( !lwhp->file_path )
-        return -1;
-    memcpy( lwhp->file_path, file_path, file_path_length );
+    {
+        size_t file_path_length = strlen( file_path );
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            goto fail_parsing;
+        memcpy( lwhp->file_path, file_path, file_path_length );
+    }
     /* Parse the index file. */
     char format_name[256];
-    int active_video_index;
-    int active_audio_index;
-    if( fscanf( index, "<LibavReaderIndex=0x%x,%d,%[^>]>\n",
-                (unsigned int *)&lwhp->format_flags, &lwhp->raw_demuxer, format_name ) != 3 )
-        return -1;
-    int32_t active_index_pos = ftell( index );
-    if( fscanf( index, "<ActiveVideoStreamIndex>%d</ActiveVideoStreamIndex>\n", &active_video_index ) != 1
-     || fscanf( index, "<ActiveAudioStreamIndex>%d</ActiveAudioStreamIndex>\n", &active_audio_index ) != 1 )
-        return -1;
-    lwhp->format_name = format_name;
+    const char *name = get_binary_index_string( data, header, sections, LWINDEX_SECTION_FORMAT_NAME );
+    if( !name || strlen( name ) >= sizeof(format_name) )
+        goto fail_parsing;
+    strcpy( format_name, name );
+    lwhp->format_name  = format_name;
+    lwhp->format_flags = header->format_flags;
+    lwhp->raw_demuxer  = header->raw_demuxer;
+    int active_video_index = header->active_video_index;
+    int active_audio_index = header->active_audio_index;
     adhp->dv_in_avi = !strcmp( lwhp->format_name, "avi" ) ? -1 : 0;
     int video_present = (active_video_index >= 0);
     int audio_present = (active_audio_index >= 0);
     vdhp->stream_index = opt->force_video ? opt->force_video_index : active_video_index;
     adhp->stream_index = opt->force_audio ? opt->force_audio_index : active_audio_index;
-    uint32_t video_info_count = 1 << 16;
-    uint32_t audio_info_count = 1 << 16;
-    video_frame_info_t *video_info = NULL;
-    audio_frame_info_t *audio_info = NULL;
+    if( init_index_parser( &parser, vdhp, adhp, aohp ) < 0 )
+        goto fail_parsing;
+    /* Import the frame records of the active streams. The records of the other streams are never touched. */
+    for( uint32_t i = 0; i < header->section_count; i++ )
+    {
+        const lwindex_binary_section_t *section = &sections[i];
+        if( (section->type != LWINDEX_SECTION_FRAMES && section->type != LWINDEX_SECTION_PACKED_FRAMES)
+         || section->entry_count == 0 )
+            continue;
+        enum AVCodecID codec_id  = (enum AVCodecID)section->codec_id;
+        AVRational     time_base = { section->time_base_num, section->time_base_den };
+        int            packed    = (section->type == LWINDEX_SECTION_PACKED_FRAMES);
+        lwindex_packed_reader_t reader = { data + section->offset, data + section->offset + section->size, 0 };
+        if( section->codec_type == AVMEDIA_TYPE_VIDEO )
+        {
+            if( (!packed && section->entry_size != sizeof(lwindex_video_record_t))
+             || check_dv_in_avi( vdhp, adhp, &parser, opt, section->stream_index, codec_id ) < 0 )
+                goto fail_parsing;
+            if( section->stream_index != vdhp->stream_index )
+                continue;
+            const lwindex_video_record_t *record = (const lwindex_video_record_t *)(data + section->offset);
+            lwindex_video_record_t last     = { 0 };
+            lwindex_video_record_t unpacked = { 0 };
+            for( uint32_t j = 0; j < section->entry_count; j++ )
+                if( (packed && unpack_video_record( &reader, &last, &unpacked, j == 0 ) < 0)
+                 || import_video_record( vdhp, &parser, codec_id, time_base, packed ? &unpacked : &record[j] ) < 0 )
+                    goto fail_parsing;
+        }
+        else if( section->codec_type == AVMEDIA_TYPE_AUDIO && section->stream_index == adhp->stream_index )
+        {
+            if( !packed && section->entry_size != sizeof(lwindex_audio_record_t) )
+                goto fail_parsing;
+            const lwindex_audio_record_t *record = (const lwindex_audio_record_t *)(data + section->offset);
+            lwindex_audio_record_t last     = { 0 };
+            lwindex_audio_record_t unpacked = { 0 };
+            for( uint32_t j = 0; j < section->entry_count; j++ )
+                if( (packed && unpack_audio_record( &reader, &last, &unpacked, j == 0 ) < 0)
+                 || import_audio_record( adhp, aohp, &parser, codec_id, time_base, packed ? &unpacked : &record[j] ) < 0 )
+                    goto fail_parsing;
+        }
+    }
+    if( need_reindexing( vdhp, &parser, opt, video_present, audio_present ) )
+        goto fail_parsing;  /* Need to re-create the index file. */
+    /* Import the stream duration, AVIndexEntry and extradata of the active streams. */
     if( vdhp->stream_index >= 0 )
     {
-        video_info = (video_frame_info_t *)lw_malloc_zero( video_info_count * sizeof(video_frame_info_t) );
-        if( !video_info )
+        const lwindex_binary_section_t *frames = find_binary_index_section( header, sections, LWINDEX_SECTION_PACKED_FRAMES,
+                                                                           vdhp->stream_index, AVMEDIA_TYPE_VIDEO );
+        if( !frames )
+            frames = find_binary_index_section( header, sections, LWINDEX_SECTION_FRAMES,
+                                                vdhp->stream_index, AVMEDIA_TYPE_VIDEO );
+        if( frames )
+            vdhp->stream_duration = frames->stream_duration;
+        if( import_binary_index_entries( data, find_binary_index_section( header, sections, LWINDEX_SECTION_INDEX_ENTRIES,
+                                                                          vdhp->stream_index, AVMEDIA_TYPE_VIDEO ),
+                                         (lwlibav_decode_handler_t *)vdhp ) < 0
+         || import_binary_extradata( data, find_binary_index_section( header, sections, LWINDEX_SECTION_EXTRADATA,
+                                                                      vdhp->stream_index, AVMEDIA_TYPE_VIDEO ),
+                                     &vdhp->exh, get_video_frame_info( &parser.video_store, 1 )->extradata_index ) < 0 )
             goto fail_parsing;
     }
     if( adhp->stream_index >= 0 )
     {
-        audio_info = (audio_frame_info_t *)lw_malloc_zero( audio_info_count * sizeof(audio_frame_info_t) );
-        if( !audio_info )
+        if( import_binary_index_entries( data, find_binary_index_section( header, sections, LWINDEX_SECTION_INDEX_ENTRIES,
+                                                                          adhp->stream_index, AVMEDIA_TYPE_AUDIO ),
+                                         (lwlibav_decode_handler_t *)adhp ) < 0
+         || import_binary_extradata( data, find_binary_index_section( header, sections, LWINDEX_SECTION_EXTRADATA,
+                                                                      adhp->stream_index, AVMEDIA_TYPE_AUDIO ),
+                                     &adhp->exh, get_audio_frame_info( &parser.audio_store, 1 )->extradata_index ) < 0 )
             goto fail_parsing;
     }
-    vdhp->codec_id             = AV_CODEC_ID_NONE;
-    adhp->codec_id             = AV_CODEC_ID_NONE;
-    vdhp->initial_pix_fmt      = AV_PIX_FMT_NONE;
-    vdhp->initial_colorspace   = AVCOL_SPC_NB;
-    aohp->output_sample_format = AV_SAMPLE_FMT_NONE;
-    uint32_t video_sample_count    = 0;
-    uint32_t invisible_count       = 0;
-    int64_t  last_keyframe_pts     = AV_NOPTS_VALUE;
-    uint32_t audio_sample_count    = 0;
-    int      audio_sample_rate     = 0;
-    int      constant_frame_length = 1;
-    uint64_t audio_duration        = 0;
-    char buf[1024];
-    while( fgets( buf, sizeof(buf), index ) )
+    if( setup_parsed_index( lwhp, vdhp, vohp, adhp, aohp, opt, &parser, active_video_index ) < 0 )
+        goto fail_parsing;
+    lw_unmap_file( data, size );
+    if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
     {
-        int stream_index;
-        int codec_type;
-        int codec_id;
-        int extradata_index;
-        AVRational time_base;
-        int64_t pos;
-        int64_t pts;
-        int64_t dts;
-        if( sscanf( buf, "Index=%d,Type=%d,Codec=%d,TimeBase=%d/%d,POS=%" SCNd64 ",PTS=%" SCNd64 ",DTS=%" SCNd64 ",EDI=%d",
-                    &stream_index, &codec_type, &codec_id, &time_base.num, &time_base.den, &pos, &pts, &dts, &extradata_index ) != 9 )
-            break;
-        if( codec_type == AVMEDIA_TYPE_VIDEO )
-        {
-            if( !fgets( buf, sizeof(buf), index ) )
-                goto fail_parsing;
-            if( adhp->dv_in_avi == -1 && codec_id == AV_CODEC_ID_DVVIDEO && !opt->force_audio )
-            {
-                adhp->dv_in_avi = 1;
-                if( vdhp->stream_index == -1 )
-                {
-                    vdhp->stream_index = stream_index;
-                    video_info = (video_frame_info_t *)lw_malloc_zero( video_info_count * sizeof(video_frame_info_t) );
-                    if( !video_info )
-                        goto fail_parsing;
-                }
-            }
-            if( stream_index == vdhp->stream_index )
-            {
-                int pict_type;
-                int poc;
-                int repeat_pict;
-                int field_info;
-                int key;
-                int width;
-                int height;
-                int colorspace;
-                char pix_fmt[64];
-                if( sscanf( buf, "Key=%d,Pic=%d,POC=%d,Repeat=%d,Field=%d,Width=%d,Height=%d,Format=%[^,],ColorSpace=%d",
-                            &key, &pict_type, &poc, &repeat_pict, &field_info, &width, &height, pix_fmt, &colorspace ) != 9 )
-                    goto fail_parsing;
-                if( vdhp->codec_id == AV_CODEC_ID_NONE )
-                    vdhp->codec_id = (enum AVCodecID)codec_id;
-                if( (key | width | height) || pict_type == -1 || colorspace != AVCOL_SPC_NB )
-                {
-                    if( vdhp->initial_width == 0 || vdhp->initial_height == 0 )
-                    {
-                        vdhp->initial_width  = width;
-                        vdhp->initial_height = height;
-                        vdhp->max_width      = width;
-                        vdhp->max_height     = height;
-                    }
-                    else
-                    {
-                        if( vdhp->max_width  < width )
-                            vdhp->max_width  = width;
-                        if( vdhp->max_height < width )
-                            vdhp->max_height = height;
-                    }
-                    if( vdhp->initial_pix_fmt == AV_PIX_FMT_NONE )
-                        vdhp->initial_pix_fmt = av_get_pix_fmt( (const char *)pix_fmt );
-                    if( vdhp->initial_colorspace == AVCOL_SPC_NB )
-                        vdhp->initial_colorspace = (enum AVColorSpace)colorspace;
-                    if( vdhp->time_base.num == 0 || vdhp->time_base.den == 0 )
-                    {
-                        vdhp->time_base.num = time_base.num;
-                        vdhp->time_base.den = time_base.den;
-                    }
-                    ++video_sample_count;
-                    video_frame_info_t *info = &video_info[video_sample_count];
-                    info->pts             = pts;
-                    info->dts             = dts;
-                    info->file_offset     = pos;
-                    info->sample_number   = video_sample_count;
-                    info->extradata_index = extradata_index;
-                    info->pict_type       = pict_type;
-                    info->poc             = poc;
-                    info->repeat_pict     = repeat_pict;
-                    info->field_info      = (lw_field_info_t)field_info;
-                    if( pts != AV_NOPTS_VALUE && last_keyframe_pts != AV_NOPTS_VALUE && pts < last_keyframe_pts )
-                        info->flags |= LW_VFRAME_FLAG_LEADING;
-                    if( key )
-                    {
-                        info->flags |= LW_VFRAME_FLAG_KEY;
-                        last_keyframe_pts = pts;
-                    }
-                    if( repeat_pict == 0 && field_info == LW_FIELD_INFO_UNKNOWN
-                     && av_get_pix_fmt( (const char *)pix_fmt ) == AV_PIX_FMT_NONE
-                     && ((enum AVCodecID)codec_id == AV_CODEC_ID_H264 || (enum AVCodecID)codec_id == AV_CODEC_ID_HEVC)
-                     && (width == 0 || height == 0) )
-                        info->flags |= LW_VFRAME_FLAG_CORRUPT;
-                    if( ((enum AVCodecID)codec_id == AV_CODEC_ID_VP8 || (enum AVCodecID)codec_id == AV_CODEC_ID_VP9)
-                     && pts == AV_NOPTS_VALUE && dts == AV_NOPTS_VALUE && pos == -1 )
-                    {
-                        /* VPx invisible altref frame. */
-                        info->flags |= LW_VFRAME_FLAG_INVISIBLE;
-                        ++invisible_count;
-                    }
-                }
-                if( video_sample_count + 1 == video_info_count )
-                {
-                    video_info_count <<= 1;
-                    video_frame_info_t *temp = (video_frame_info_t *)realloc( video_info, video_info_count * sizeof(video_frame_info_t) );
-                    if( !temp )
-                        goto fail_parsing;
-                    video_info = temp;
-                }
-            }
-        }
-        else if( codec_type == AVMEDIA_TYPE_AUDIO )
+        /* Update the active stream indexes when specifying different stream indexes. */
+        int32_t active_index[2] = { vdhp->stream_index, adhp->stream_index };
+        fseek( index, offsetof( lwindex_binary_header_t, active_video_index ), SEEK_SET );
+        fwrite( active_index, sizeof(int32_t), 2, index );
+    }
+    return 0;
+fail_parsing:
+    lw_freep( &vdhp->frame_list );
+    adhp->frame_list = NULL;
+    free_frame_store( &parser.video_store );
+    free_frame_store( &parser.audio_store );
+    if( parser.video_info )
+        free( parser.video_info );
+    if( parser.audio_info )
+        free( parser.audio_info );
+    lw_unmap_file( data, size );
+    return -1;
+}
+
+static int load_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    lwlibav_audio_decode_handler_t *adhp,
+    lwlibav_audio_output_handler_t *aohp,
+    lwlibav_option_t               *opt,
+    const char                     *index_file_path,
+    lwindex_resume_t               *resume
+)
+{
+    FILE *index = lw_fopen( index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
+    if( !index )
+        return -1;
+    int ret = -1;
+    uint8_t magic[LWINDEX_BINARY_MAGIC_SIZE];
+    if( fread( magic, 1, LWINDEX_BINARY_MAGIC_SIZE, index ) == LWINDEX_BINARY_MAGIC_SIZE
+     && !memcmp( magic, LWINDEX_BINARY_MAGIC, LWINDEX_BINARY_MAGIC_SIZE ) )
+        ret = parse_binary_index( lwhp, vdhp, vohp, adhp, aohp, opt, index );
+    else
+    {
+        uint8_t lwindex_version[4] = { 0 };
+        int index_file_version = 0;
+        rewind( index );
+        if( 4 == fscanf( index, "<LSMASHWorksIndexVersion=%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8 ">\n",
+                         &lwindex_version[0], &lwindex_version[1], &lwindex_version[2], &lwindex_version[3] )
+         && ((lwindex_version[0] << 24) | (lwindex_version[1] << 16) | (lwindex_version[2] << 8) | lwindex_version[3]) == LWINDEX_VERSION
+         && 1 == fscanf( index, "<LibavReaderIndexFile=%d>\n", &index_file_version )
+         && index_file_version == LWINDEX_INDEX_FILE_VERSION )
+            ret = parse_index( lwhp, vdhp, vohp, adhp, aohp, opt, index, index_file_path, resume );
+    }
+    fclose( index );
+    return ret;
+}
+
+typedef struct
+{
+    char   *path;
+    int64_t size;
+    int64_t mtime;
+} lwindex_cache_entry_t;
+
+typedef struct
+{
+    lwindex_cache_entry_t *entries;
+    int                    count;
+    int                    capacity;
+    int64_t                total_size;
+} lwindex_cache_list_t;
+
+/* Return the path of the index file for the input file in the cache directory, or NULL on failure.
+ * The name of the index file is the hash of the size, the last modification time and the fingerprint
+ * of the input file, so the same file shares one index file even if it is opened from different paths. */
+static char *get_cache_index_file_path
+(
+    const char *cache_dir,
+    const char *file_path
+)
+{
+    lwindex_file_status_t status;
+    if( get_input_file_status( file_path, -1, &status ) < 0 )
+        return NULL;
+    uint64_t hash = update_fingerprint( UINT64_C(0xcbf29ce484222325), &status, sizeof(lwindex_file_status_t) );
+    char *index_file_path = (char *)lw_malloc_zero( strlen( cache_dir ) + 22 );
+    if( index_file_path )
+        sprintf( index_file_path, "%s/%016" PRIx64 ".lwi", cache_dir, hash );
+    return index_file_path;
+}
+
+static void add_cache_entry
+(
+    void       *arg,
+    const char *path,
+    int64_t     size,
+    int64_t     mtime
+)
+{
+    lwindex_cache_list_t *list = (lwindex_cache_list_t *)arg;
+    if( list->count == list->capacity )
+    {
+        int capacity = list->capacity ? list->capacity << 1 : 64;
+        lwindex_cache_entry_t *temp = (lwindex_cache_entry_t *)realloc( list->entries, capacity * sizeof(lwindex_cache_entry_t) );
+        if( !temp )
+            return;
+        list->entries  = temp;
+        list->capacity = capacity;
+    }
+    size_t path_length = strlen( path );
+    lwindex_cache_entry_t *entry = &list->entries[ list->count ];
+    entry->path = (char *)lw_malloc_zero( path_length + 1 );
+    if( !entry->path )
+        return;
+    memcpy( entry->path, path, path_length );
+    entry->size  = size;
+    entry->mtime = mtime;
+    list->total_size += size;
+    ++ list->count;
+}
+
+static int compare_cache_entry_mtime
+(
+    const lwindex_cache_entry_t *a,
+    const lwindex_cache_entry_t *b
+)
+{
+    return a->mtime > b->mtime ? 1 : a->mtime == b->mtime ? 0 : -1;
+}
+
+/* Mark the index file as the most recently used one, and then remove the least recently used index files
+ * in the cache directory until their total size gets within cache_size MiB. */
+static void update_index_cache
+(
+    const char *cache_dir,
+    const char *index_file_path,
+    int         cache_size
+)
+{
+    lw_touch_file( index_file_path );
+    if( cache_size <= 0 )
+        return;
+    lwindex_cache_list_t list = { 0 };
+    if( lw_enumerate_files( cache_dir, ".lwi", add_cache_entry, &list ) == 0 && list.total_size > ((int64_t)cache_size << 20) )
+    {
+        qsort( list.entries, list.count, sizeof(lwindex_cache_entry_t), (int(*)( const void *, const void * ))compare_cache_entry_mtime );
+        /* Compare the file names only since the directory separators may differ. */
+        const char *index_file_name = index_file_path + strlen( index_file_path ) - strlen( "0123456789abcdef.lwi" );
+        for( int i = 0; i < list.count && list.total_size > ((int64_t)cache_size << 20); i++ )
         {
-            if( !fgets( buf, sizeof(buf), index ) )
-                goto fail_parsing;
-            if( stream_index == adhp->stream_index )
-            {
-                uint64_t layout;
-                int      channels;
-                int      sample_rate;
-                char     sample_fmt[64];
-                int      bits_per_sample;
-                int      frame_length;
-                if( sscanf( buf, "Channels=%d:0x%" SCNx64 ",Rate=%d,Format=%[^,],BPS=%d,Length=%d",
-                            &channels, &layout, &sample_rate, sample_fmt, &bits_per_sample, &frame_length ) != 6 )
-                    goto fail_parsing;
-                if( adhp->codec_id == AV_CODEC_ID_NONE )
-                    adhp->codec_id = (enum AVCodecID)codec_id;
-                if( (channels | layout | sample_rate | bits_per_sample) && audio_duration <= INT32_MAX )
-                {
-                    if( audio_sample_rate == 0 )
-                        audio_sample_rate = sample_rate;
-                    if( adhp->time_base.num == 0 || adhp->time_base.den == 0 )
-                    {
-                        adhp->time_base.num = time_base.num;
-                        adhp->time_base.den = time_base.den;
-                    }
-                    if( layout == 0 )
-                        layout = av_get_default_channel_layout( channels );
-                    if( av_get_channel_layout_nb_channels( layout )
-                      > av_get_channel_layout_nb_channels( aohp->output_channel_layout ) )
-                        aohp->output_channel_layout = layout;
-                    aohp->output_sample_format   = select_better_sample_format( aohp->output_sample_format,
-                                                                                av_get_sample_fmt( (const char *)sample_fmt ) );
-                    aohp->output_sample_rate     = MAX( aohp->output_sample_rate, audio_sample_rate );
-                    aohp->output_bits_per_sample = MAX( aohp->output_bits_per_sample, bits_per_sample );
-                    ++audio_sample_count;
-                    audio_frame_info_t *info = &audio_info[audio_sample_count];
-                    info->pts             = pts;
-                    info->dts             = dts;
-                    info->file_offset     = pos;
-                    info->sample_number   = audio_sample_count;
-                    info->extradata_index = extradata_index;
-                    info->sample_rate     = sample_rate;
-                }
-                else
-                    for( uint32_t i = 1; i <= adhp->exh.delay_count; i++ )
-                    {
-                        uint32_t audio_frame_number = audio_sample_count - adhp->exh.delay_count + i;
-                        if( audio_frame_number > audio_sample_count )
-                            goto fail_parsing;
-                        audio_info[audio_frame_number].length = frame_length;
-                        if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                            constant_frame_length = 0;
-                        audio_duration += frame_length;
-                    }
-                if( audio_sample_count + 1 == audio_info_count )
-                {
-                    audio_info_count <<= 1;
-                    audio_frame_info_t *temp = (audio_frame_info_t *)realloc( audio_info, audio_info_count * sizeof(audio_frame_info_t) );
-                    if( !temp )
-                        goto fail_parsing;
-                    audio_info = temp;
-                }
-                if( frame_length == -1 )
-                    ++ adhp->exh.delay_count;
-                else if( audio_sample_count > adhp->exh.delay_count )
-                {
-                    uint32_t audio_frame_number = audio_sample_count - adhp->exh.delay_count;
-                    audio_info[audio_frame_number].length = frame_length;
-                    if( audio_frame_number > 1 && audio_info[audio_frame_number].length != audio_info[audio_frame_number - 1].length )
-                        constant_frame_length = 0;
-                    audio_duration += frame_length;
-                }
-            }
+            const char *path = list.entries[i].path;
+            size_t path_length = strlen( path );
+            if( (path_length < strlen( index_file_name ) || strcmp( path + path_length - strlen( index_file_name ), index_file_name ))
+             && lw_remove_file( path ) == 0 )
+                list.total_size -= list.entries[i].size;
         }
     }
-    if( video_present && opt->force_video && opt->force_video_index != -1
-     && (video_sample_count == 0 || vdhp->initial_pix_fmt == AV_PIX_FMT_NONE || vdhp->initial_width == 0 || vdhp->initial_height == 0) )
-        goto fail_parsing;  /* Need to re-create the index file. */
-    if( audio_present && opt->force_audio && opt->force_audio_index != -1 && (audio_sample_count == 0 || audio_duration == 0) )
-        goto fail_parsing;  /* Need to re-create the index file. */
-    if( strncmp( buf, "</LibavReaderIndex>", strlen( "</LibavReaderIndex>" ) ) )
-        goto fail_parsing;
-    /* Parse stream durations. */
-    if( !fgets( buf, sizeof(buf), index ) )
-        goto fail_parsing;
-    while( !strncmp( buf, "<StreamDuration=", strlen( "<StreamDuration=" ) ) )
+    for( int i = 0; i < list.count; i++ )
+        lw_free( list.entries[i].path );
+    lw_free( list.entries );
+}
+
+/* Return the index of the video stream to construct the frame list without parsing packets, or -1 if not found. */
+static int find_video_stream_of_header
+(
+    AVFormatContext  *format_ctx,
+    lwlibav_option_t *opt
+)
+{
+    int stream_index = opt->force_video
+                     ? opt->force_video_index
+                     : av_find_best_stream( format_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0 );
+    if( stream_index < 0 || (unsigned int)stream_index >= format_ctx->nb_streams
+     || format_ctx->streams[stream_index]->codecpar->codec_type != AVMEDIA_TYPE_VIDEO )
+        return -1;
+    return stream_index;
+}
+
+/* Set up the video decode handler from the stream header instead of parsing packets.
+ * The decoder is configured by the only extradata entry taken from the stream header.
+ * Return 0 on success, otherwise -1. */
+static int import_video_stream_header
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVFormatContext                *format_ctx,
+    int                             stream_index
+)
+{
+    AVStream            *stream   = format_ctx->streams[stream_index];
+    AVCodecParameters   *codecpar = stream->codecpar;
+    lwlibav_extradata_t *entry    = alloc_extradata_entries( &vdhp->exh, 1 );
+    if( !entry )
+        return -1;
+    vdhp->exh.entry_count = 1;
+    if( codecpar->extradata_size > 0 )
+    {
+        entry->extradata = (uint8_t *)av_mallocz( codecpar->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
+        if( !entry->extradata )
+            return -1;
+        memcpy( entry->extradata, codecpar->extradata, codecpar->extradata_size );
+        entry->extradata_size = codecpar->extradata_size;
+    }
+    entry->codec_id     = codecpar->codec_id;
+    entry->codec_tag    = codecpar->codec_tag;
+    entry->width        = codecpar->width;
+    entry->height       = codecpar->height;
+    entry->pixel_format = (enum AVPixelFormat)codecpar->format;
+    vdhp->exh.current_index  = 0;
+    vdhp->stream_index       = stream_index;
+    vdhp->codec_id           = codecpar->codec_id;
+    vdhp->time_base          = stream->time_base;
+    vdhp->max_width          = codecpar->width;
+    vdhp->max_height         = codecpar->height;
+    vdhp->initial_width      = codecpar->width;
+    vdhp->initial_height     = codecpar->height;
+    vdhp->initial_pix_fmt    = (enum AVPixelFormat)codecpar->format;
+    vdhp->initial_colorspace = codecpar->color_space;
+    return 0;
+}
+
+/* Set up the video decode handler with the frame list of the random access points only.
+ * The random access points are taken from the index of the container if present,
+ * otherwise from the keyframe packets demuxed without any parsing and decoding.
+ * Nothing is written into the index file since this is cheap enough to redo at every opening.
+ * Return 0 on success, otherwise -1. */
+static int create_sparse_index
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt
+)
+{
+    lwhp->format_name  = (char *)format_ctx->iformat->name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
+    int stream_index = find_video_stream_of_header( format_ctx, opt );
+    if( stream_index < 0 )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to find the video stream." );
+        return -1;
+    }
+    AVStream *stream = format_ctx->streams[stream_index];
+    lwindex_frame_store_t store;
+    if( init_frame_store( &store, sizeof(video_frame_info_t) ) < 0 )
+        return -1;
+    video_frame_info_t *info        = NULL;
+    uint32_t            frame_count = 0;
+    for( int i = 0; i < stream->nb_index_entries; i++ )
     {
-        int     stream_index;
-        int     codec_type;
-        int64_t stream_duration;
-        if( sscanf( buf, "<StreamDuration=%d,%d>%" SCNd64 "</StreamDuration>", &stream_index, &codec_type, &stream_duration ) != 3 )
-            goto fail_parsing;
-        if( codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index )
-            vdhp->stream_duration = stream_duration;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
+        AVIndexEntry *ie = &stream->index_entries[i];
+        if( !(ie->flags & AVINDEX_KEYFRAME) )
+            continue;
+        info = (video_frame_info_t *)reserve_frame_store_entry( &store, ++frame_count );
+        if( !info )
+            goto fail;
+        info->pts         = ie->timestamp;
+        info->dts         = ie->timestamp;
+        info->file_offset = ie->pos;
     }
-    /* Parse AVIndexEntry. */
-    while( !strncmp( buf, "<StreamIndexEntries=", strlen( "<StreamIndexEntries=" ) ) )
+    if( frame_count == 0 )
     {
-        int stream_index;
-        int codec_type;
-        int index_entries_count;
-        if( sscanf( buf, "<StreamIndexEntries=%d,%d,%d>", &stream_index, &codec_type, &index_entries_count ) != 3 )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
-        if( index_entries_count > 0 )
+        /* No index in the container, so pick up the keyframe packets of the stream. */
+        for( unsigned int i = 0; i < format_ctx->nb_streams; i++ )
+            if( (int)i != stream_index )
+                format_ctx->streams[i]->discard = AVDISCARD_ALL;
+        AVPacket pkt = { 0 };
+        av_init_packet( &pkt );
+        while( read_av_frame( format_ctx, &pkt ) >= 0 )
         {
-            if( codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index )
-            {
-                vdhp->index_entries_count = index_entries_count;
-                vdhp->index_entries = (AVIndexEntry *)av_malloc( vdhp->index_entries_count * sizeof(AVIndexEntry) );
-                if( !vdhp->index_entries )
-                    goto fail_parsing;
-                for( int i = 0; i < vdhp->index_entries_count; i++ )
-                {
-                    AVIndexEntry ie;
-                    int size;
-                    int flags;
-                    if( sscanf( buf, "POS=%" SCNd64 ",TS=%" SCNd64 ",Flags=%x,Size=%d,Distance=%d",
-                                &ie.pos, &ie.timestamp, (unsigned int *)&flags, &size, &ie.min_distance ) != 5 )
-                        break;
-                    ie.size  = size;
-                    ie.flags = flags;
-                    vdhp->index_entries[i] = ie;
-                    if( !fgets( buf, sizeof(buf), index ) )
-                        goto fail_parsing;
-                }
-            }
-            else if( codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index )
+            if( pkt.stream_index == stream_index && (pkt.flags & AV_PKT_FLAG_KEY) )
             {
-                adhp->index_entries_count = index_entries_count;
-                adhp->index_entries = (AVIndexEntry *)av_malloc( adhp->index_entries_count * sizeof(AVIndexEntry) );
-                if( !adhp->index_entries )
-                    goto fail_parsing;
-                for( int i = 0; i < adhp->index_entries_count; i++ )
+                info = (video_frame_info_t *)reserve_frame_store_entry( &store, ++frame_count );
+                if( !info )
                 {
-                    AVIndexEntry ie;
-                    int size;
-                    int flags;
-                    if( sscanf( buf, "POS=%" SCNd64 ",TS=%" SCNd64 ",Flags=%x,Size=%d,Distance=%d",
-                                &ie.pos, &ie.timestamp, (unsigned int *)&flags, &size, &ie.min_distance ) != 5 )
-                        break;
-                    ie.size  = size;
-                    ie.flags = flags;
-                    adhp->index_entries[i] = ie;
-                    if( !fgets( buf, sizeof(buf), index ) )
-                        goto fail_parsing;
+                    av_packet_unref( &pkt );
+                    goto fail;
                 }
+                info->pts         = pkt.pts;
+                info->dts         = pkt.dts;
+                info->file_offset = pkt.pos;
             }
-            else
-                for( int i = 0; i < index_entries_count; i++ )
-                    if( !fgets( buf, sizeof(buf), index ) )
-                        goto fail_parsing;
+            av_packet_unref( &pkt );
         }
-        if( strncmp( buf, "</StreamIndexEntries>", strlen( "</StreamIndexEntries>" ) ) )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
     }
-    /* Parse extradata. */
-    while( !strncmp( buf, "<ExtraDataList=", strlen( "<ExtraDataList=" ) ) )
+    if( frame_count == 0 )
     {
-        int stream_index;
-        int codec_type;
-        int entry_count;
-        if( sscanf( buf, "<ExtraDataList=%d,%d,%d>", &stream_index, &codec_type, &entry_count ) != 3 )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
-        if( entry_count > 0 )
-        {
-            if( (codec_type == AVMEDIA_TYPE_VIDEO && stream_index == vdhp->stream_index)
-             || (codec_type == AVMEDIA_TYPE_AUDIO && stream_index == adhp->stream_index) )
-            {
-                lwlibav_extradata_handler_t *exhp = codec_type == AVMEDIA_TYPE_VIDEO ? &vdhp->exh : &adhp->exh;
-                if( !alloc_extradata_entries( exhp, entry_count ) )
-                    goto fail_parsing;
-                exhp->current_index = codec_type == AVMEDIA_TYPE_VIDEO
-                                    ? video_info[1].extradata_index
-                                    : audio_info[1].extradata_index;
-                for( int i = 0; i < exhp->entry_count; i++ )
-                {
-                    lwlibav_extradata_t *entry = &exhp->entries[i];
-                    /* Get extradata size and others. */
-                    int codec_id;
-                    if( codec_type == AVMEDIA_TYPE_VIDEO )
-                    {
-                        char pix_fmt[64];
-                        if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Width=%d,Height=%d,Format=%[^,],BPS=%d",
-                                    &entry->extradata_size, &codec_id, &entry->codec_tag,
-                                    &entry->width, &entry->height,
-                                    pix_fmt, &entry->bits_per_sample ) != 7 )
-                            break;
-                        entry->pixel_format = av_get_pix_fmt( (const char *)pix_fmt );
-                    }
-                    else
-                    {
-                        char sample_fmt[64];
-                        if( sscanf( buf, "Size=%d,Codec=%d,4CC=0x%x,Layout=0x%" SCNx64 ",Rate=%d,Format=%[^,],BPS=%d,Align=%d",
-                                    &entry->extradata_size, &codec_id, &entry->codec_tag,
-                                    &entry->channel_layout, &entry->sample_rate,
-                                    sample_fmt, &entry->bits_per_sample, &entry->block_align ) != 8 )
-                            break;
-                        entry->sample_format = av_get_sample_fmt( (const char *)sample_fmt );
-                    }
-                    entry->codec_id = (enum AVCodecID)codec_id;
-                    /* Get extradata. */
-                    if( entry->extradata_size > 0 )
-                    {
-                        entry->extradata = (uint8_t *)av_malloc( entry->extradata_size + AV_INPUT_BUFFER_PADDING_SIZE );
-                        if( !entry->extradata )
-                            goto fail_parsing;
-                        if( fread( entry->extradata, 1, entry->extradata_size, index ) != entry->extradata_size )
-                        {
-                            av_free( entry->extradata );
-                            goto fail_parsing;
-                        }
-                        memset( entry->extradata + entry->extradata_size, 0, AV_INPUT_BUFFER_PADDING_SIZE );
-                    }
-                    if( !fgets( buf, sizeof(buf), index )   /* new line ('\n') */
-                     || !fgets( buf, sizeof(buf), index ) ) /* the first line of the next entry */
-                        goto fail_parsing;
-                }
-            }
-            else
-                for( int i = 0; i < entry_count; i++ )
-                {
-                    /* extradata size */
-                    int extradata_size;
-                    if( sscanf( buf, "Size=%d", &extradata_size ) != 1 )
-                        goto fail_parsing;
-                    /* extradata */
-                    for( int i = 0; i < extradata_size; i++ )
-                        if( fgetc( index ) == EOF )
-                            goto fail_parsing;
-                    if( !fgets( buf, sizeof(buf), index )   /* new line ('\n') */
-                     || !fgets( buf, sizeof(buf), index ) ) /* the first line of the next entry */
-                        goto fail_parsing;
-                }
-        }
-        if( strncmp( buf, "</ExtraDataList>", strlen( "</ExtraDataList>" ) ) )
-            goto fail_parsing;
-        if( !fgets( buf, sizeof(buf), index ) )
-            goto fail_parsing;
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to find any random accessible point of the video stream." );
+        goto fail;
     }
-    if( !strncmp( buf, "</LibavReaderIndexFile>", strlen( "</LibavReaderIndexFile>" ) ) )
+    info = (video_frame_info_t *)gather_frame_store( &store, frame_count );
+    if( !info )
+        return -1;
+    /* Decide how to seek each random accessible point. */
+    int seek_flags = lineup_seek_base_candidates( lwhp );
+    if( lwhp->format_flags & AVFMT_NO_BYTE_SEEK )
+        seek_flags &= ~SEEK_POS_BASED;
+    for( uint32_t i = 1; i <= frame_count; i++ )
     {
-        if( vdhp->stream_index >= 0 )
-        {
-            vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( (video_sample_count + 1) * sizeof(uint8_t) );
-            if( !vdhp->keyframe_list )
-                goto fail_parsing;
-            vdhp->frame_list  = video_info;
-            vdhp->frame_count = video_sample_count;
-            if( decide_video_seek_method( lwhp, vdhp, video_sample_count ) )
-                goto fail_parsing;
-            /* Compute the stream duration. */
-            compute_stream_duration( lwhp, vdhp, vdhp->stream_duration );
-            /* Create the repeat control info. */
-            create_video_frame_order_list( vdhp, vohp, opt );
-            /* Exclude invisible frames from the output handler. */
-            create_video_visible_frame_list( vdhp, vohp, invisible_count );
-        }
-        if( adhp->stream_index >= 0 )
-        {
-            if( adhp->dv_in_avi == 1 && adhp->index_entries_count == 0 )
-            {
-                /* DV in AVI Type-1 */
-                audio_sample_count = MIN( video_sample_count, audio_sample_count );
-                for( uint32_t i = 0; i <= audio_sample_count; i++ )
-                {
-                    audio_info[i].keyframe        = !!(video_info[i].flags & LW_VFRAME_FLAG_KEY);
-                    audio_info[i].sample_number   = video_info[i].sample_number;
-                    audio_info[i].pts             = video_info[i].pts;
-                    audio_info[i].dts             = video_info[i].dts;
-                    audio_info[i].file_offset     = video_info[i].file_offset;
-                    audio_info[i].extradata_index = video_info[i].extradata_index;
-                }
-            }
-            else
-            {
-                if( adhp->dv_in_avi == 1 && ((!opt->force_video && active_video_index == -1) || (opt->force_video && opt->force_video_index == -1)) )
-                {
-                    /* Disable DV video stream. */
-                    disable_video_stream( vdhp );
-                    video_info = NULL;
-                }
-                adhp->dv_in_avi = 0;
-            }
-            adhp->frame_list   = audio_info;
-            adhp->frame_count  = audio_sample_count;
-            adhp->frame_length = constant_frame_length ? audio_info[1].length : 0;
-            decide_audio_seek_method( lwhp, adhp, audio_sample_count );
-            if( opt->av_sync && vdhp->stream_index >= 0 )
-                lwhp->av_gap = calculate_av_gap( vdhp, vohp, adhp, audio_sample_rate );
-        }
-        if( vdhp->stream_index != active_video_index || adhp->stream_index != active_audio_index )
-        {
-            /* Update the active stream indexes when specifying different stream indexes. */
-            fseek( index, active_index_pos, SEEK_SET );
-            fprintf( index, "<ActiveVideoStreamIndex>%+011d</ActiveVideoStreamIndex>\n", vdhp->stream_index );
-            fprintf( index, "<ActiveAudioStreamIndex>%+011d</ActiveAudioStreamIndex>\n", adhp->stream_index );
-        }
-        return 0;
+        info[i].sample_number = i;
+        info[i].flags         = LW_VFRAME_FLAG_KEY;
+        info[i].repeat_pict   = 1;
+        if( info[i].file_offset == -1 )
+            seek_flags &= ~SEEK_POS_BASED;
+        if( info[i].pts == AV_NOPTS_VALUE )
+            seek_flags &= ~SEEK_PTS_BASED;
+        if( info[i].dts == AV_NOPTS_VALUE )
+            seek_flags &= ~SEEK_DTS_BASED;
     }
-fail_parsing:
-    vdhp->frame_list = NULL;
-    adhp->frame_list = NULL;
-    if( video_info )
-        free( video_info );
-    if( audio_info )
-        free( audio_info );
+    vdhp->lw_seek_flags = (seek_flags & SEEK_POS_BASED) ? SEEK_POS_BASED
+                        : (seek_flags & SEEK_PTS_BASED) ? SEEK_PTS_BASED
+                        : (seek_flags & SEEK_DTS_BASED) ? SEEK_DTS_BASED
+                        :                                 0;
+    if( vdhp->lw_seek_flags == 0 )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to find a way to seek random accessible points of the video stream." );
+        free( info );
+        return -1;
+    }
+    if( import_video_stream_header( vdhp, format_ctx, stream_index ) < 0 )
+    {
+        free( info );
+        return -1;
+    }
+    vdhp->frame_count = frame_count;
+    vdhp->sparse      = 1;
+    vdhp->min_ts      = (vdhp->lw_seek_flags & SEEK_PTS_BASED) ? info[1].pts
+                      : (vdhp->lw_seek_flags & SEEK_DTS_BASED) ? info[1].dts
+                      :                                          AV_NOPTS_VALUE;
+    vdhp->frame_list = info;
+    /* Every frame is output once as it is. */
+    vohp->repeat_control       = 0;
+    vohp->repeat_correction_ts = 0;
+    vohp->frame_order_count    = 0;
+    vohp->frame_order_list     = NULL;
+    vohp->vfr2cfr              = 0;
+    vohp->frame_count          = frame_count;
+    return 0;
+fail:
+    free_frame_store( &store );
+    return -1;
+}
+
+/* Set up the video decode handler with the frame list built from the sample table of the container
+ * such as the one of ISO Base Media file format instead of parsing every packet.
+ * This is applied only if the index entries of the stream cover every frame in decoding order
+ * and no picture reordering is present, since the index entries carry neither PTS nor POC.
+ * Return 0 on success, 1 if not applicable, otherwise -1. */
+static int create_index_from_container
+(
+    lwlibav_file_handler_t         *lwhp,
+    lwlibav_video_decode_handler_t *vdhp,
+    lwlibav_video_output_handler_t *vohp,
+    AVFormatContext                *format_ctx,
+    lwlibav_option_t               *opt
+)
+{
+    int stream_index = find_video_stream_of_header( format_ctx, opt );
+    if( stream_index < 0 )
+        return 1;
+    AVStream          *stream   = format_ctx->streams[stream_index];
+    AVCodecParameters *codecpar = stream->codecpar;
+    if( (!strstr( format_ctx->iformat->name, "mov" ) && !strstr( format_ctx->iformat->name, "matroska" ))
+     || stream->nb_index_entries == 0
+     || stream->nb_frames != stream->nb_index_entries
+     || codecpar->video_delay > 0
+     || !(stream->index_entries[0].flags & AVINDEX_KEYFRAME) )
+        return 1;
+    for( int i = 1; i < stream->nb_index_entries; i++ )
+        if( stream->index_entries[i].timestamp <= stream->index_entries[i - 1].timestamp )
+            return 1;
+    uint32_t frame_count = (uint32_t)stream->nb_index_entries;
+    video_frame_info_t *info = (video_frame_info_t *)lw_malloc_zero( ((size_t)frame_count + 2) * sizeof(video_frame_info_t) );
+    if( !info )
+        return -1;
+    for( uint32_t i = 1; i <= frame_count; i++ )
+    {
+        AVIndexEntry *ie = &stream->index_entries[i - 1];
+        info[i].pts           = ie->timestamp;
+        info[i].dts           = ie->timestamp;
+        info[i].file_offset   = ie->pos;
+        info[i].sample_number = i;
+        info[i].flags         = (ie->flags & AVINDEX_KEYFRAME) ? LW_VFRAME_FLAG_KEY : 0;
+        info[i].repeat_pict   = 1;
+    }
+    lwhp->format_name  = (char *)format_ctx->iformat->name;
+    lwhp->format_flags = format_ctx->iformat->flags;
+    lwhp->raw_demuxer  = !!format_ctx->iformat->raw_codec_id;
+    if( import_video_stream_header( vdhp, format_ctx, stream_index ) < 0 )
+        goto fail;
+    vdhp->keyframe_list = (uint8_t *)lw_malloc_zero( ((size_t)frame_count + 1) * sizeof(uint8_t) );
+    if( !vdhp->keyframe_list )
+        goto fail;
+    /* Keep the index entries for seeking as done by indexing. */
+    vdhp->index_entries = (AVIndexEntry *)av_malloc( stream->nb_index_entries * sizeof(AVIndexEntry) );
+    if( !vdhp->index_entries )
+        goto fail;
+    memcpy( vdhp->index_entries, stream->index_entries, stream->nb_index_entries * sizeof(AVIndexEntry) );
+    vdhp->index_entries_count = stream->nb_index_entries;
+    vdhp->frame_list          = info;
+    vdhp->frame_count         = frame_count;
+    info = NULL;
+    if( decide_video_seek_method( lwhp, vdhp, frame_count ) )
+        goto fail;
+    compute_stream_duration( lwhp, vdhp, stream->duration );
+    create_video_frame_order_list( vdhp, vohp, opt );
+    return 0;
+fail:
+    free( info );
+    disable_video_stream( vdhp );
+    free_extradata_entries( &vdhp->exh );
     return -1;
 }
 
@@ -3199,42 +7334,103 @@ int lwlibav_construct_index
     progress_handler_t             *php
 )
 {
-    /* Try to open the index file. */
     size_t file_path_length = strlen( opt->file_path );
-    char *index_file_path = (char *)lw_malloc_zero(file_path_length + 5);
-    if( !index_file_path )
-        return -1;
-    memcpy( index_file_path, opt->file_path, file_path_length );
-    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
-    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
-    if( has_lwi_ext )
-        index_file_path[file_path_length] = '\0';
-    else
+    if( opt->sparse_index )
     {
-        memcpy( index_file_path + file_path_length, ".lwi", strlen( ".lwi" ) );
-        index_file_path[file_path_length + 4] = '\0';
+        /* Construct the keyframe-only frame list without any index file. */
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            return -1;
+        memcpy( lwhp->file_path, opt->file_path, file_path_length );
+        av_register_all();
+        avcodec_register_all();
+        AVFormatContext *format_ctx = NULL;
+        vdhp->stream_index = -1;
+        adhp->stream_index = -1;
+        if( lavf_open_file( &format_ctx, lwhp->file_path, lhp ) < 0
+         || create_sparse_index( lwhp, vdhp, vohp, format_ctx, opt ) < 0 )
+        {
+            if( format_ctx )
+                lavf_close_file( &format_ctx );
+            lw_freep( &lwhp->file_path );
+            return -1;
+        }
+        lavf_close_file( &format_ctx );
+        lwhp->threads = opt->threads;
+        return 0;
     }
-    FILE *index = lw_fopen( index_file_path, (opt->force_video || opt->force_audio) ? "r+b" : "rb" );
-    free( index_file_path );
-    if( index )
+    if( opt->trust_container_index )
     {
-        uint8_t lwindex_version[4] = { 0 };
-        int index_file_version = 0;
-        if( 4 == fscanf( index, "<LSMASHWorksIndexVersion=%" SCNu8 ".%" SCNu8 ".%" SCNu8 ".%" SCNu8 ">\n",
-                         &lwindex_version[0], &lwindex_version[1], &lwindex_version[2], &lwindex_version[3] )
-         && ((lwindex_version[0] << 24) | (lwindex_version[1] << 16) | (lwindex_version[2] << 8) | lwindex_version[3]) == LWINDEX_VERSION
-         && 1 == fscanf( index, "<LibavReaderIndexFile=%d>\n", &index_file_version )
-         && index_file_version == LWINDEX_INDEX_FILE_VERSION
-         && parse_index( lwhp, vdhp, vohp, adhp, aohp, opt, index ) == 0 )
+        /* Construct the frame list from the index of the container without any index file if possible. */
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            return -1;
+        memcpy( lwhp->file_path, opt->file_path, file_path_length );
+        av_register_all();
+        avcodec_register_all();
+        AVFormatContext *format_ctx = NULL;
+        vdhp->stream_index = -1;
+        adhp->stream_index = -1;
+        int ret = lavf_open_file( &format_ctx, lwhp->file_path, lhp ) < 0
+                ? -1
+                : create_index_from_container( lwhp, vdhp, vohp, format_ctx, opt );
+        if( format_ctx )
+            lavf_close_file( &format_ctx );
+        if( ret == 0 )
         {
-            /* Opening and parsing the index file succeeded. */
-            fclose( index );
-            av_register_all();
-            avcodec_register_all();
             lwhp->threads = opt->threads;
             return 0;
         }
-        fclose( index );
+        lw_freep( &lwhp->file_path );
+        if( ret < 0 )
+            return -1;
+        /* Fall back to the index file since the index of the container is not enough. */
+        vdhp->stream_index = -1;
+    }
+    /* Try to open the index file. */
+    const char *ext = file_path_length >= 5 ? &opt->file_path[file_path_length - 4] : NULL;
+    int has_lwi_ext = ext && !strncmp( ext, ".lwi", strlen( ".lwi" ) );
+    const char *cache_dir = opt->cache_dir && opt->cache_dir[0] ? opt->cache_dir : getenv( "LWINDEX_CACHE_DIR" );
+    char *index_file_path = NULL;
+    if( cache_dir && cache_dir[0] && !has_lwi_ext && lw_make_directory( cache_dir ) == 0 )
+        index_file_path = get_cache_index_file_path( cache_dir, opt->file_path );
+    if( index_file_path )
+    {
+        /* The index file in the cache directory may be created from the same file at another path.
+         * Read the specified file instead of the one recorded in the index file. */
+        lwhp->file_path = (char *)lw_malloc_zero( file_path_length + 1 );
+        if( !lwhp->file_path )
+            goto fail;
+        memcpy( lwhp->file_path, opt->file_path, file_path_length );
+    }
+    else
+    {
+        cache_dir = NULL;
+        index_file_path = (char *)lw_malloc_zero( file_path_length + 5 );
+        if( !index_file_path )
+            return -1;
+        memcpy( index_file_path, opt->file_path, file_path_length );
+        if( has_lwi_ext )
+            index_file_path[file_path_length] = '\0';
+        else
+        {
+            memcpy( index_file_path + file_path_length, ".lwi", strlen( ".lwi" ) );
+            index_file_path[file_path_length + 4] = '\0';
+        }
+    }
+    lwindex_resume_t resume;
+    memset( &resume, 0, sizeof(lwindex_resume_t) );
+    int ret = load_index( lwhp, vdhp, vohp, adhp, aohp, opt, index_file_path, opt->no_create_index ? NULL : &resume );
+    if( ret == 0 )
+    {
+        /* Opening and parsing the index file succeeded. */
+        if( cache_dir )
+            update_index_cache( cache_dir, index_file_path, opt->cache_size );
+        free( index_file_path );
+        av_register_all();
+        avcodec_register_all();
+        lwhp->threads = opt->threads;
+        return 0;
     }
     /* Open file. */
     if( !lwhp->file_path )
@@ -3258,15 +7454,28 @@ int lwlibav_construct_index
     lwhp->threads      = opt->threads;
     vdhp->stream_index = -1;
     adhp->stream_index = -1;
-    /* Create the index file. */
-    create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, opt, indicator, php );
+    /* Create the index file, or extend it if the input file has grown. */
+    create_index( lwhp, vdhp, vohp, adhp, aohp, format_ctx, opt, indicator, php, lhp, index_file_path, ret == 1 ? &resume : NULL );
     /* Close file.
      * By opening file for video and audio separately, indecent work about frame reading can be avoidable. */
     lavf_close_file( &format_ctx );
     vdhp->ctx = NULL;
     adhp->ctx = NULL;
+    cleanup_resume( &resume );
+    if( resume.resumed )
+    {
+        /* Load the extended index file. */
+        lw_freep( &lwhp->file_path );
+        if( load_index( lwhp, vdhp, vohp, adhp, aohp, opt, index_file_path, NULL ) < 0 )
+            goto fail;
+        lwhp->threads = opt->threads;
+    }
+    if( cache_dir && !opt->no_create_index )
+        update_index_cache( cache_dir, index_file_path, opt->cache_size );
+    free( index_file_path );
     return 0;
 fail:
+    lw_free( index_file_path );
     if( lwhp->file_path )
         lw_freep( &lwhp->file_path );
     return -1;
@@ -27,7 +27,7 @@
 /* index file version
  * This version is bumped when its structure changed so that the lwindex invokes
  * reindexing opened file immediately. */
-#define LWINDEX_INDEX_FILE_VERSION 13
+#define LWINDEX_INDEX_FILE_VERSION 20
 
 typedef struct
 {
@@ -41,6 +41,15 @@ typedef struct
     int         force_audio_index;
     int         apply_repeat_flag;
     int         field_dominance;
+    int         binary_index;       /* 0: text index file, 1: binary index file,
+                                     * 2: binary index file of the fixed-size frame records written before packing, to compare */
+    const char *cache_dir;          /* directory to store index files, or NULL to store them next to the input files */
+    int         cache_size;         /* maximum total size of index files in cache_dir in MiB, 0: unlimited */
+    int         sparse_index;       /* 0: every frame, 1: only the keyframes of the video stream without any index file */
+    int         trust_container_index;  /* 0: always index, 1: build the frame list from the index of the container if enough */
+    int         pipeline_index;     /* 0: index on the calling thread, 1: demux, parse and write in a pipeline of threads */
+    int         ranged_index;       /* 0: index sequentially, 1: index byte ranges of an MPEG-TS/PS file in parallel without checkpoints */
+    int         checkpoint_interval;    /* interval of the checkpoints of indexing in MiB of demuxing, 0: 256 MiB */
     struct
     {
         int      active;
@@ -92,6 +92,7 @@ void lwlibav_audio_free_decode_handler
     av_free( adhp->index_entries );
     av_frame_free( &adhp->frame_buffer );
     avcodec_free_context( &adhp->ctx );
+    decoder_pool_destroy( adhp->decoder_pool );
     if( adhp->format )
         lavf_close_file( &adhp->format );
     lw_free( adhp );
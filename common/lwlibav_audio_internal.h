@@ -52,6 +52,7 @@ struct lwlibav_audio_decode_handler_tag
     uint32_t            frame_count;
     AVFrame            *frame_buffer;
     audio_frame_info_t *frame_list;
+    struct decoder_pool_tag *decoder_pool;
     /* */
     AVPacket            packet;         /* for getting and freeing */
     AVPacket            alter_packet;   /* for consumed by the decoder instead of 'packet'. */
@@ -39,6 +39,7 @@ extern "C"
 
 /* Close and open the new decoder to flush buffers in the decoder even if the decoder implements avcodec_flush_buffers().
  * It seems this brings about more stable composition when seeking.
+ * The new decoder is taken from the pool if opened in advance, and the old one is closed by the pool in the background.
  * Note that this function could reallocate AVCodecContext. */
 void lwlibav_flush_buffers
 (
@@ -49,7 +50,7 @@ void lwlibav_flush_buffers
     const AVCodec           *codec        = dhp->ctx->codec;
     void                    *app_specific = dhp->ctx->opaque;
     AVCodecContext *ctx = NULL;
-    if( open_decoder( &ctx, codecpar, codec, dhp->ctx->thread_count, dhp->ctx->refcounted_frames ) < 0 )
+    if( decoder_pool_open_decoder( dhp->decoder_pool, &ctx, codecpar, codec, dhp->ctx->thread_count, dhp->ctx->refcounted_frames ) < 0 )
     {
         avcodec_flush_buffers( dhp->ctx );
         dhp->error = 1;
@@ -60,7 +61,7 @@ void lwlibav_flush_buffers
     else
     {
         dhp->ctx->opaque = NULL;
-        avcodec_free_context( &dhp->ctx );
+        decoder_pool_close_decoder( dhp->decoder_pool, &dhp->ctx );
         dhp->ctx = ctx;
         dhp->ctx->opaque = app_specific;
     }
@@ -90,7 +91,7 @@ void lwlibav_update_configuration
     const int          refcounted_frames = dhp->ctx->refcounted_frames;
     /* Close the decoder here. */
     dhp->ctx->opaque = NULL;
-    avcodec_free_context( &dhp->ctx );
+    decoder_pool_close_decoder( dhp->decoder_pool, &dhp->ctx );
     /* Find an appropriate decoder. */
     const lwlibav_extradata_t *entry = &exhp->entries[extradata_index];
     const AVCodec *codec = find_decoder( entry->codec_id, dhp->preferred_decoder_names );
@@ -123,7 +124,7 @@ void lwlibav_update_configuration
     codecpar->codec_tag = entry->codec_tag;
     /* Open an appropriate decoder.
      * Here, we force single threaded decoding since some decoder doesn't do its proper initialization with multi-threaded decoding. */
-    if( open_decoder( &dhp->ctx, codecpar, codec, 1, refcounted_frames ) < 0 )
+    if( decoder_pool_open_decoder( dhp->decoder_pool, &dhp->ctx, codecpar, codec, 1, refcounted_frames ) < 0 )
     {
         strcpy( error_string, "Failed to open decoder.\n" );
         goto fail;
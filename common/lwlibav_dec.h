@@ -47,6 +47,7 @@ typedef struct
     int                 width;
     int                 height;
     enum AVPixelFormat  pixel_format;
+    int                 video_delay;        /* the decoder delay probed at indexing, -1 if not probed */
     /* Audio */
     uint64_t            channel_layout;
     enum AVSampleFormat sample_format;
@@ -84,6 +85,7 @@ typedef struct
     uint32_t                    frame_count;
     AVFrame                    *frame_buffer;
     void                       *frame_list;
+    struct decoder_pool_tag    *decoder_pool;
 } lwlibav_decode_handler_t;
 
 static inline int lavf_open_file
@@ -35,12 +35,13 @@ extern "C"
 }
 #endif  /* __cplusplus */
 
+#include "osdep.h"
 #include "utils.h"
 #include "video_output.h"
+#include "decode.h"
 #include "lwlibav_dec.h"
 #include "lwlibav_video.h"
 #include "lwlibav_video_internal.h"
-#include "decode.h"
 
 #define SEEK_MODE_NORMAL     0
 #define SEEK_MODE_UNSAFE     1
@@ -70,6 +71,82 @@ lwlibav_video_decode_handler_t *lwlibav_video_alloc_decode_handler
     return vdhp;
 }
 
+/* Deallocate the index lists unless they are borrowed. */
+static void free_index_lists
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    av_freep( &vdhp->index_entries );
+    if( vdhp->index_owner )
+    {
+        vdhp->exh.entries     = NULL;
+        vdhp->frame_list      = NULL;
+        vdhp->order_converter = NULL;
+        vdhp->keyframe_list   = NULL;
+        return;
+    }
+    lwlibav_extradata_handler_t *exhp = &vdhp->exh;
+    if( exhp->entries )
+    {
+        for( int i = 0; i < exhp->entry_count; i++ )
+            if( exhp->entries[i].extradata )
+                av_free( exhp->entries[i].extradata );
+        lw_freep( &exhp->entries );
+    }
+    lw_freep( &vdhp->frame_list );
+    lw_freep( &vdhp->order_converter );
+    lw_freep( &vdhp->keyframe_list );
+}
+
+lwlibav_video_decode_handler_t *lwlibav_video_duplicate_decode_handler
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    const char                     *file_path,
+    int                             threads
+)
+{
+    lwlibav_video_decode_handler_t *dup = lwlibav_video_alloc_decode_handler();
+    if( !dup )
+        return NULL;
+    AVFrame  *frame_buffer = dup->frame_buffer;
+    AVPacket  packet       = dup->packet;
+    *dup = *vdhp;
+    /* Anything opened, decoded or written by vdhp is not inherited. */
+    dup->format                = NULL;
+    dup->ctx                   = NULL;
+    dup->frame_buffer          = frame_buffer;
+    dup->decoder_pool          = NULL;
+    dup->packet                = packet;
+    dup->first_valid_frame     = NULL;
+    dup->last_req_frame        = NULL;
+    dup->last_dec_frame        = NULL;
+    dup->movable_frame_buffer  = NULL;
+    memset( &dup->frame_cache, 0, sizeof(lw_video_frame_cache_t) );
+    dup->frame_cache.budget    = vdhp->frame_cache.budget;
+    dup->index_owner           = vdhp->index_owner ? vdhp->index_owner : vdhp;
+    dup->read_ahead            = NULL;
+    lwlibav_video_set_decoder_pool( dup, !!vdhp->decoder_pool );
+    /* The AVIndexEntrys are handed over to the AVStream, so each handler needs its own. */
+    dup->index_entries       = NULL;
+    dup->index_entries_count = 0;
+    if( vdhp->index_entries && vdhp->index_entries_count > 0 )
+    {
+        size_t size = vdhp->index_entries_count * sizeof(AVIndexEntry);
+        dup->index_entries = (AVIndexEntry *)av_malloc( size );
+        if( !dup->index_entries )
+            goto fail;
+        memcpy( dup->index_entries, vdhp->index_entries, size );
+        dup->index_entries_count = vdhp->index_entries_count;
+    }
+    if( lwlibav_video_get_desired_track( file_path, dup, threads ) < 0 )
+        goto fail;
+    return dup;
+fail:
+    lwlibav_video_free_decode_handler( dup );
+    return NULL;
+}
+
 lwlibav_video_output_handler_t *lwlibav_video_alloc_output_handler
 (
     void
@@ -85,23 +162,16 @@ void lwlibav_video_free_decode_handler
 {
     if( !vdhp )
         return;
-    lwlibav_extradata_handler_t *exhp = &vdhp->exh;
-    if( exhp->entries )
-    {
-        for( int i = 0; i < exhp->entry_count; i++ )
-            if( exhp->entries[i].extradata )
-                av_free( exhp->entries[i].extradata );
-        lw_free( exhp->entries );
-    }
+    /* The worker of the read-ahead might be decoding. */
+    lw_video_read_ahead_destroy( vdhp->read_ahead );
+    free_index_lists( vdhp );
     av_packet_unref( &vdhp->packet );
-    lw_free( vdhp->frame_list );
-    lw_free( vdhp->order_converter );
-    lw_free( vdhp->keyframe_list );
-    av_free( vdhp->index_entries );
     av_frame_free( &vdhp->frame_buffer );
     av_frame_free( &vdhp->first_valid_frame );
     av_frame_free( &vdhp->movable_frame_buffer );
+    lw_video_frame_cache_cleanup( &vdhp->frame_cache );
     avcodec_free_context( &vdhp->ctx );
+    decoder_pool_destroy( vdhp->decoder_pool );
     if( vdhp->format )
         lavf_close_file( &vdhp->format );
     lw_free( vdhp );
@@ -161,6 +231,40 @@ void lwlibav_video_set_seek_mode
     vdhp->seek_mode = seek_mode;
 }
 
+void lwlibav_video_set_frame_cache_size
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    size_t                          frame_cache_size
+)
+{
+    vdhp->frame_cache.budget = frame_cache_size;
+}
+
+void lwlibav_video_set_read_ahead
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             read_ahead_depth
+)
+{
+    vdhp->read_ahead_depth = read_ahead_depth;
+}
+
+void lwlibav_video_set_decoder_pool
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             decoder_pool
+)
+{
+    if( decoder_pool && !vdhp->decoder_pool )
+        /* Without the pool, decoders are just opened and closed on demand. */
+        vdhp->decoder_pool = decoder_pool_create();
+    else if( !decoder_pool )
+    {
+        decoder_pool_destroy( vdhp->decoder_pool );
+        vdhp->decoder_pool = NULL;
+    }
+}
+
 void lwlibav_video_set_preferred_decoder_names
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -176,7 +280,10 @@ void lwlibav_video_set_log_handler
     lw_log_handler_t               *lh
 )
 {
-    vdhp->lh = *lh;
+    if( vdhp->read_ahead )
+        *lw_video_read_ahead_get_log_handler( vdhp->read_ahead ) = *lh;
+    else
+        vdhp->lh = *lh;
 }
 
 void lwlibav_video_set_get_buffer_func
@@ -211,7 +318,9 @@ lw_log_handler_t *lwlibav_video_get_log_handler
     lwlibav_video_decode_handler_t *vdhp
 )
 {
-    return vdhp ? &vdhp->lh : NULL;
+    if( !vdhp )
+        return NULL;
+    return vdhp->read_ahead ? lw_video_read_ahead_get_log_handler( vdhp->read_ahead ) : &vdhp->lh;
 }
 
 AVCodecContext *lwlibav_video_get_codec_context
@@ -258,6 +367,62 @@ void lwlibav_video_force_seek
     vdhp->last_frame_number = vdhp->frame_count + 1;
 }
 
+/* Open the input file for the video stream.
+ * avformat_find_stream_info() may decode several frames, which takes a long time for high resolution sources.
+ * If the parameters of the stream were recorded in the index file, use them instead as long as the demuxer
+ * has created the same stream from the file header. */
+static int open_video_file
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    const char                     *file_path
+)
+{
+    const lwlibav_video_stream_parameters_t *params = &vdhp->stream_params;
+    if( !params->present )
+        return lavf_open_file( &vdhp->format, file_path, &vdhp->lh );
+    if( avformat_open_input( &vdhp->format, file_path, NULL, NULL ) )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to avformat_open_input." );
+        return -1;
+    }
+    AVFormatContext *format_ctx = vdhp->format;
+    if( !(format_ctx->ctx_flags & AVFMTCTX_NOHEADER)
+     && vdhp->stream_index < (int)format_ctx->nb_streams
+     && format_ctx->streams[ vdhp->stream_index ]->id                    == params->id
+     && format_ctx->streams[ vdhp->stream_index ]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO
+     && format_ctx->streams[ vdhp->stream_index ]->codecpar->codec_id   == params->codec_id )
+    {
+        AVStream          *stream   = format_ctx->streams[ vdhp->stream_index ];
+        AVCodecParameters *codecpar = stream->codecpar;
+        codecpar->codec_tag             = params->codec_tag;
+        codecpar->width                 = params->width;
+        codecpar->height                = params->height;
+        codecpar->format                = params->pixel_format;
+        codecpar->sample_aspect_ratio   = params->sample_aspect_ratio;
+        codecpar->field_order           = params->field_order;
+        codecpar->color_range           = params->color_range;
+        codecpar->color_primaries       = params->color_primaries;
+        codecpar->color_trc             = params->color_trc;
+        codecpar->color_space           = params->color_space;
+        codecpar->chroma_location       = params->chroma_location;
+        codecpar->profile               = params->profile;
+        codecpar->level                 = params->level;
+        codecpar->video_delay           = params->video_delay;
+        codecpar->bits_per_coded_sample = params->bits_per_coded_sample;
+        codecpar->bits_per_raw_sample   = params->bits_per_raw_sample;
+        stream->sample_aspect_ratio     = params->stream_sample_aspect_ratio;
+        stream->avg_frame_rate          = params->avg_frame_rate;
+        stream->r_frame_rate            = params->r_frame_rate;
+        return 0;
+    }
+    if( avformat_find_stream_info( format_ctx, NULL ) < 0 )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_FATAL, "Failed to avformat_find_stream_info." );
+        return -1;
+    }
+    return 0;
+}
+
 int lwlibav_video_get_desired_track
 (
     const char                     *file_path,
@@ -268,14 +433,11 @@ int lwlibav_video_get_desired_track
     AVCodecContext *ctx = NULL;
     if( vdhp->stream_index < 0
      || vdhp->frame_count == 0
-     || lavf_open_file( &vdhp->format, file_path, &vdhp->lh ) < 0
+     || open_video_file( vdhp, file_path ) < 0
      || find_and_open_decoder( &ctx, vdhp->format->streams[ vdhp->stream_index ]->codecpar,
                                vdhp->preferred_decoder_names, threads, 1 ) < 0 )
     {
-        av_freep( &vdhp->index_entries );
-        lw_freep( &vdhp->frame_list );
-        lw_freep( &vdhp->order_converter );
-        lw_freep( &vdhp->keyframe_list );
+        free_index_lists( vdhp );
         if( vdhp->format )
             lavf_close_file( &vdhp->format );
         return -1;
@@ -575,6 +737,30 @@ static void correct_output_delay
     }
 }
 
+/* Keep the picture the decoder output on the way to the requested one.
+ * Pictures preceding the random accessible point in presentation order are not kept
+ * since they might refer to pictures which have not been decoded. */
+static void cache_passed_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVFrame                        *frame,
+    uint32_t                        picture_number,
+    uint32_t                        rap_number
+)
+{
+    uint32_t presentation_rap_number = vdhp->order_converter
+                                     ? vdhp->order_converter[rap_number].decoding_to_presentation
+                                     : rap_number;
+    if( vdhp->frame_cache.budget == 0
+     || picture_number < vdhp->first_valid_frame_number
+     || picture_number < presentation_rap_number
+     || picture_number > vdhp->frame_count
+     || is_half_frame( vdhp, picture_number )
+     || (vdhp->frame_list[picture_number].flags & LW_VFRAME_FLAG_LEADING) )
+        return;
+    lw_video_frame_cache_put( &vdhp->frame_cache, picture_number, frame, vdhp->frame_list[picture_number].pts );
+}
+
 static uint32_t seek_video
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -632,6 +818,8 @@ static uint32_t seek_video
                     vdhp->last_half_frame = is_half_frame( vdhp, picture_number );
                     return current + 1;
                 }
+                if( !error_ignorance )
+                    cache_passed_picture( vdhp, frame, picture_number, rap_number );
                 decoder_delay = exhp->delay_count;
             }
             else
@@ -790,6 +978,7 @@ static int get_frame
                     return 0;
                 else if( picture_number > requested_picture_number )
                     return -1;
+                cache_passed_picture( vdhp, frame, picture_number, rap_number );
             }
             else
                 vdhp->last_half_frame = is_half_frame( vdhp, estimated_picture_number );
@@ -900,6 +1089,77 @@ return_last_frame:
 #undef REQUESTED_FRAME_IS_ALREADY_ON_OUTPUT_FRAME_BUFFER
 }
 
+/* Answer whether pkt is the random accessible point, or is beyond it since the demuxer might have sought wrong position. */
+static int reach_sparse_frame
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    video_frame_info_t             *info,
+    AVPacket                       *pkt
+)
+{
+    if( vdhp->lw_seek_flags & SEEK_POS_BASED )
+        return pkt->pos != -1 && pkt->pos >= info->file_offset;
+    if( vdhp->lw_seek_flags & SEEK_PTS_BASED )
+        return pkt->pts != AV_NOPTS_VALUE && pkt->pts >= info->pts;
+    return pkt->dts != AV_NOPTS_VALUE && pkt->dts >= info->dts;
+}
+
+/* Get the picture of the random accessible point picture_number from the frame list consisting of only them.
+ * Decoding always starts from the requested picture, whose packet is marked to identify it at the output. */
+static int get_sparse_picture
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    AVFrame                        *frame,
+    uint32_t                        picture_number
+)
+{
+    lwlibav_flush_buffers( (lwlibav_decode_handler_t *)vdhp );
+    if( vdhp->error )
+        return -1;
+    int64_t rap_pos = get_random_accessible_point_position( vdhp, picture_number );
+    if( av_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
+        av_seek_frame( vdhp->format, vdhp->stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
+    video_frame_info_t *info      = &vdhp->frame_list[picture_number];
+    AVPacket           *pkt       = &vdhp->packet;
+    AVFrame            *mov_frame = vdhp->movable_frame_buffer;
+    uint32_t            fed       = 0;
+    uint32_t            limit     = 2 * get_decoder_delay( vdhp->ctx ) + 16;  /* arbitrary */
+    while( fed <= limit )
+    {
+        int ret = lwlibav_get_av_frame( vdhp->format, vdhp->stream_index, picture_number, pkt );
+        if( ret == 0 )
+        {
+            if( fed == 0 && !reach_sparse_frame( vdhp, info, pkt ) )
+                /* Skip the pictures preceding the requested one. */
+                continue;
+            /* Picture numbers are 1-origin, so 0 never matches the requested picture. */
+            pkt->pts = fed == 0 ? picture_number : 0;
+            pkt->dts = AV_NOPTS_VALUE;
+        }
+        else if( fed == 0 )
+            break;
+        ++fed;
+        int got_picture;
+        av_frame_unref( mov_frame );
+        if( decode_video_packet( vdhp->ctx, mov_frame, &got_picture, pkt ) < 0 && ret == 0 )
+            continue;
+        if( got_picture && get_output_order_id( mov_frame ) == picture_number )
+        {
+            av_frame_unref( frame );
+            av_frame_move_ref( frame, mov_frame );
+            vdhp->last_dec_frame          = frame;
+            vdhp->last_rap_number         = picture_number;
+            vdhp->last_fed_picture_number = picture_number;
+            return 0;
+        }
+        if( ret > 0 && !got_picture )
+            /* No more frames. */
+            break;
+    }
+    lw_log_show( &vdhp->lh, LW_LOG_ERROR, "Failed to decode the random accessible point %u.", picture_number );
+    return -1;
+}
+
 static inline uint32_t get_last_half_offset
 (
     lwlibav_video_decode_handler_t *vdhp
@@ -913,6 +1173,24 @@ static inline uint32_t get_last_half_offset
          :                     0;
 }
 
+/* Decide whether the requested picture after the last one is reached by decoding forward by the measured costs
+ * instead of the fixed threshold. The number of pictures decoded after seeking is derived from the closest RAP. */
+static int prefer_decoding_forward
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    uint32_t                        picture_number,
+    uint32_t                        last_frame_number
+)
+{
+    uint32_t rap_number;
+    find_random_accessible_point( vdhp, picture_number, 0, &rap_number );
+    if( rap_number == vdhp->last_rap_number )
+        /* Seeking doesn't skip any picture. */
+        return 1;
+    uint32_t seek_count = picture_number >= rap_number ? picture_number - rap_number + 1 : 1;
+    return seek_cost_model_prefer_forward( &vdhp->seek_cost, picture_number - last_frame_number, seek_count );
+}
+
 static int get_requested_picture
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -924,6 +1202,19 @@ static int get_requested_picture
     if( picture_number > vdhp->frame_count )
         picture_number = vdhp->frame_count;
     uint32_t extradata_index;
+    AVFrame *cached_frame = frame == vdhp->frame_buffer
+                          ? lw_video_frame_cache_get( &vdhp->frame_cache, picture_number )
+                          : NULL;
+    if( cached_frame )
+    {
+        /* The decoder state is left as it is. */
+        if( lw_video_frame_cache_output( &vdhp->frame_cache, frame, cached_frame ) < 0 )
+            goto video_fail;
+        extradata_index = vdhp->frame_list[picture_number].extradata_index;
+        goto return_cached_frame;
+    }
+    /* The decoder state might refer to the content of the frame buffer before the cached frame was output. */
+    lw_video_frame_cache_restore( &vdhp->frame_cache, vdhp->frame_buffer );
     uint32_t last_half_offset = get_last_half_offset( vdhp );
     if( picture_number == vdhp->last_frame_number
      || picture_number == vdhp->last_frame_number + last_half_offset )
@@ -934,6 +1225,15 @@ static int get_requested_picture
         extradata_index = vdhp->frame_list[picture_number].extradata_index;
         goto return_frame;
     }
+    if( vdhp->sparse )
+    {
+        /* Every picture is a random accessible point and decoded from itself. */
+        if( get_sparse_picture( vdhp, frame, picture_number ) < 0 )
+            goto video_fail;
+        vdhp->last_frame_number = picture_number;
+        extradata_index = vdhp->frame_list[picture_number].extradata_index;
+        goto return_frame;
+    }
     if( picture_number < vdhp->first_valid_frame_number || vdhp->frame_count == 1 )
     {
         /* Copy the first valid video frame data. */
@@ -951,19 +1251,29 @@ static int get_requested_picture
     uint32_t last_frame_number = vdhp->last_frame_number + last_half_offset;
     int      seek_mode         = vdhp->seek_mode;
     int64_t  rap_pos           = INT64_MIN;
+    int      adaptive_seek     = vdhp->forward_seek_threshold == 0;
+    uint32_t fed_count;         /* number of pictures expected to be decoded for the cost model */
+    if( adaptive_seek )
+        seek_cost_model_start( &vdhp->seek_cost );
     if( picture_number > last_frame_number
-     && picture_number <= last_frame_number + vdhp->forward_seek_threshold )
+     && (adaptive_seek ? prefer_decoding_forward( vdhp, picture_number, last_frame_number )
+                       : picture_number <= last_frame_number + vdhp->forward_seek_threshold) )
     {
         start_number = vdhp->last_fed_picture_number + 1;
         rap_number   = vdhp->last_rap_number;
+        fed_count    = picture_number - last_frame_number;
     }
     else
     {
         find_random_accessible_point( vdhp, picture_number, 0, &rap_number );
         if( rap_number == vdhp->last_rap_number && picture_number > last_frame_number )
+        {
             start_number = vdhp->last_fed_picture_number + 1;
+            fed_count    = picture_number - last_frame_number;
+        }
         else
         {
+            fed_count = picture_number >= rap_number ? picture_number - rap_number + 1 : 1;
             /* Require starting to decode from random accessible picture. */
             rap_pos = get_random_accessible_point_position( vdhp, rap_number );
             vdhp->last_rap_number = rap_number;
@@ -993,11 +1303,16 @@ static int get_requested_picture
             vdhp->last_rap_number = rap_number;
         }
         start_number = seek_video( vdhp, frame, picture_number, rap_number, rap_pos, seek_mode != SEEK_MODE_NORMAL );
+        /* Retries are not measured since they are not what the decision expects. */
+        fed_count = 0;
     }
+    if( adaptive_seek )
+        seek_cost_model_update( &vdhp->seek_cost, fed_count, rap_pos != INT64_MIN );
     vdhp->last_frame_number = picture_number;
     extradata_index = vdhp->frame_list[picture_number].extradata_index;
 return_frame:;
     vdhp->last_req_frame = frame;
+return_cached_frame:;
     /* Don't exceed the maximum presentation size specified for each sequence. */
     lwlibav_extradata_t *entry = &vdhp->exh.entries[extradata_index];
     if( vdhp->ctx->width > entry->width )
@@ -1006,6 +1321,8 @@ return_frame:;
         vdhp->ctx->height = entry->height;
     /* Set the actual PTS here. */
     frame->pts = vdhp->frame_list[picture_number].pts;
+    if( !cached_frame )
+        lw_video_frame_cache_put( &vdhp->frame_cache, picture_number, frame, frame->pts );
     return 0;
 video_fail:
     /* fatal error of decoding */
@@ -1299,6 +1616,34 @@ static void handle_decoder_pix_fmt
         codecpar->format = (int)pix_fmt;
 }
 
+static int read_ahead_decode
+(
+    void     *handler,
+    AVFrame  *frame,
+    uint32_t  frame_number
+)
+{
+    return get_requested_picture( (lwlibav_video_decode_handler_t *)handler, frame, frame_number );
+}
+
+/* The decoder outputs only to the frame buffer of the read-ahead from now on,
+ * so the decoded frame cache, which works on the frame buffer of the handler, is discarded. */
+static void start_read_ahead
+(
+    lwlibav_video_decode_handler_t *vdhp
+)
+{
+    lw_video_frame_cache_cleanup( &vdhp->frame_cache );
+    vdhp->frame_cache.budget = 0;
+    vdhp->read_ahead = lw_video_read_ahead_create( vdhp->read_ahead_depth, vdhp->frame_count,
+                                                   read_ahead_decode, vdhp, &vdhp->lh );
+    if( !vdhp->read_ahead )
+    {
+        lw_log_show( &vdhp->lh, LW_LOG_WARNING, "Failed to start the read-ahead. Frames are decoded on demand." );
+        vdhp->read_ahead_depth = 0;
+    }
+}
+
 static int get_video_frame
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -1308,7 +1653,11 @@ static int get_video_frame
 {
     if( vohp->repeat_control )
         return lwlibav_repeat_control( vdhp, vohp, frame_number );
-    if( frame_number == vdhp->last_frame_number )
+    if( vdhp->read_ahead_depth > 0 && !vdhp->read_ahead )
+        start_read_ahead( vdhp );
+    if( vdhp->read_ahead )
+        return lw_video_read_ahead_get_frame( vdhp->read_ahead, vdhp->frame_buffer, frame_number );
+    if( frame_number == vdhp->last_frame_number && !vdhp->frame_cache.stashed )
         return 1;
     return get_requested_picture( vdhp, vdhp->frame_buffer, frame_number );
 }
@@ -1331,7 +1680,7 @@ int lwlibav_video_get_frame
     }
     int ret;
     if( (ret = get_video_frame( vdhp, vohp, frame_number )) != 0
-     || (ret = update_scaler_configuration_if_needed( &vohp->scaler, &vdhp->lh, vdhp->frame_buffer )) < 0 )
+     || (ret = update_scaler_configuration_if_needed( &vohp->scaler, lwlibav_video_get_log_handler( vdhp ), vdhp->frame_buffer )) < 0 )
         return ret;
     return 0;
 }
@@ -1372,6 +1721,13 @@ int lwlibav_video_find_first_valid_frame
     vdhp->av_seek_flags = (vdhp->lw_seek_flags & SEEK_POS_BASED) ? AVSEEK_FLAG_BYTE
                         : vdhp->lw_seek_flags == 0               ? AVSEEK_FLAG_FRAME
                         : 0;
+    if( vdhp->sparse )
+    {
+        /* The first picture is a random accessible point, so it is decoded at the first request. */
+        vdhp->av_seek_flags |= AVSEEK_FLAG_BACKWARD;
+        vdhp->first_valid_frame_number = 1;
+        return 0;
+    }
     if( vdhp->frame_count != 1 )
     {
         vdhp->av_seek_flags |= AVSEEK_FLAG_BACKWARD;
@@ -1438,7 +1794,7 @@ enum lw_field_info lwlibav_video_get_field_info
 )
 {
     return frame_number <= vdhp->frame_count
-         ? vdhp->frame_list[frame_number].field_info
+         ? (lw_field_info_t)vdhp->frame_list[frame_number].field_info
          : LW_FIELD_INFO_UNKNOWN;
 }
 
@@ -1455,6 +1811,9 @@ void set_video_basic_settings
     codecpar->width                 = entry->width;
     codecpar->height                = entry->height;
     codecpar->bits_per_coded_sample = entry->bits_per_sample;
+    /* The decoder delay probed at indexing must not be underestimated by the new decoder. */
+    if( codecpar->video_delay < entry->video_delay )
+        codecpar->video_delay = entry->video_delay;
     handle_decoder_pix_fmt( codecpar, codec, entry->pixel_format );
 }
 
@@ -1466,16 +1825,23 @@ int try_decode_video_frame
     char                     *error_string
 )
 {
+    lwlibav_video_decode_handler_t *vdhp = (lwlibav_video_decode_handler_t *)dhp;
+    AVFormatContext *format_ctx   = vdhp->format;
+    int              stream_index = vdhp->stream_index;
+    AVCodecContext  *ctx          = vdhp->ctx;
+    /* The resolution, the pixel format and the decoder delay probed at indexing are recorded in the extradata entry.
+     * If all of them are recorded and the decoder has been opened with them, no frame has to be decoded here.
+     * Otherwise, e.g. for the entry taken from the parameters of the container, decode frames. */
+    const lwlibav_extradata_t *entry = &vdhp->exh.entries[ vdhp->exh.current_index ];
+    if( entry->video_delay >= 0
+     && ctx->width > 0 && ctx->height > 0 && ctx->pix_fmt != AV_PIX_FMT_NONE )
+        return 0;
     AVFrame *picture = av_frame_alloc();
     if( !picture )
     {
         strcpy( error_string, "Failed to alloc AVFrame to set up a decoder configuration.\n" );
         return -1;
     }
-    lwlibav_video_decode_handler_t *vdhp = (lwlibav_video_decode_handler_t *)dhp;
-    AVFormatContext *format_ctx   = vdhp->format;
-    int              stream_index = vdhp->stream_index;
-    AVCodecContext  *ctx          = vdhp->ctx;
     if( av_seek_frame( format_ctx, stream_index, rap_pos, vdhp->av_seek_flags ) < 0 )
         av_seek_frame( format_ctx, stream_index, rap_pos, vdhp->av_seek_flags | AVSEEK_FLAG_ANY );
     do
@@ -51,6 +51,16 @@ lwlibav_video_output_handler_t *lwlibav_video_alloc_output_handler
     void
 );
 
+/* Allocate a decode handler which decodes the same stream as vdhp independently.
+ * The index lists of vdhp are shared, and the input file is opened again.
+ * This must be called after lwlibav_video_get_desired_track() and before the AVIndexEntrys of vdhp are imported. */
+lwlibav_video_decode_handler_t *lwlibav_video_duplicate_decode_handler
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    const char                     *file_path,
+    int                             threads
+);
+
 void lwlibav_video_free_decode_handler
 (
     lwlibav_video_decode_handler_t *vdhp
@@ -74,6 +84,7 @@ void lwlibav_video_free_output_handler_ptr
 /*****************************************************************************
  * Setters
  *****************************************************************************/
+/* If forward_seek_threshold is 0, whether to seek or not is decided by the costs measured while decoding. */
 void lwlibav_video_set_forward_seek_threshold
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -86,6 +97,29 @@ void lwlibav_video_set_seek_mode
     int                             seek_mode
 );
 
+/* Set the byte budget of the decoded frame cache. 0 disables the cache. */
+void lwlibav_video_set_frame_cache_size
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    size_t                          frame_cache_size
+);
+
+/* Set the maximum number of frames decoded in advance by a worker thread under sequential access.
+ * 0 disables it. The decoded frame cache is not used if enabled. */
+void lwlibav_video_set_read_ahead
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             read_ahead_depth
+);
+
+/* Set to 1 to replace the decoder at every seek with the one opened in advance by a pool of decoders,
+ * which closes the old one in the background. 0 disables it, and then decoders are opened and closed in place. */
+void lwlibav_video_set_decoder_pool
+(
+    lwlibav_video_decode_handler_t *vdhp,
+    int                             decoder_pool
+);
+
 void lwlibav_video_set_preferred_decoder_names
 (
     lwlibav_video_decode_handler_t *vdhp,
@@ -33,11 +33,12 @@ typedef struct
     int64_t         file_offset;        /* offset from the beginning of file */
     uint32_t        sample_number;      /* unique value in decoding order */
     int             extradata_index;    /* index of extradata to decode this frame */
-    int             flags;              /* a combination of LW_VFRAME_FLAG_*s */
-    int             pict_type;          /* may be stored as enum AVPictureType */
     int             poc;                /* Picture Order Count */
-    int             repeat_pict;
-    lw_field_info_t field_info;
+    /* The following fields are narrowed to keep the frame list compact for long sources. */
+    uint8_t         flags;              /* a combination of LW_VFRAME_FLAG_*s */
+    uint8_t         pict_type;          /* may be stored as enum AVPictureType */
+    int8_t          repeat_pict;
+    uint8_t         field_info;         /* stored as lw_field_info_t */
 } video_frame_info_t;
 
 typedef struct
@@ -45,6 +46,34 @@ typedef struct
     uint32_t decoding_to_presentation;
 } order_converter_t;
 
+/* The parameters of the video stream set by avformat_find_stream_info() at indexing
+ * These are recorded in the index file so that the probe can be skipped when the input file is opened again. */
+typedef struct
+{
+    int                 present;
+    int                 id;
+    enum AVCodecID      codec_id;
+    unsigned int        codec_tag;
+    int                 width;
+    int                 height;
+    enum AVPixelFormat  pixel_format;
+    AVRational          sample_aspect_ratio;
+    enum AVFieldOrder   field_order;
+    enum AVColorRange   color_range;
+    enum AVColorPrimaries color_primaries;
+    enum AVColorTransferCharacteristic color_trc;
+    enum AVColorSpace   color_space;
+    enum AVChromaLocation chroma_location;
+    int                 profile;
+    int                 level;
+    int                 video_delay;
+    int                 bits_per_coded_sample;
+    int                 bits_per_raw_sample;
+    AVRational          stream_sample_aspect_ratio;
+    AVRational          avg_frame_rate;
+    AVRational          r_frame_rate;
+} lwlibav_video_stream_parameters_t;
+
 struct lwlibav_video_decode_handler_tag
 {
     /* common */
@@ -65,8 +94,11 @@ struct lwlibav_video_decode_handler_tag
     uint32_t            frame_count;
     AVFrame            *frame_buffer;
     video_frame_info_t *frame_list;         /* stored in presentation order */
+    struct decoder_pool_tag *decoder_pool;
     /* */
-    uint32_t            forward_seek_threshold;
+    int                 sparse;             /* Set to non-zero if the frame list consists of only random accessible points. */
+    uint32_t            forward_seek_threshold; /* 0 means that the decision is done by seek_cost */
+    seek_cost_model_t   seek_cost;
     int                 seek_mode;
     int                 max_width;
     int                 max_height;
@@ -97,4 +129,10 @@ struct lwlibav_video_decode_handler_tag
     uint32_t            last_ts_frame_number;
     AVRational          actual_time_base;
     int                 strict_cfr;
+    lwlibav_video_stream_parameters_t stream_params;
+    lw_video_frame_cache_t            frame_cache;  /* decoded frames keyed by presentation frame number */
+    const lwlibav_video_decode_handler_t *index_owner;  /* the handler lending the index lists to this handler if any
+                                                         * The lender must be freed after this handler. */
+    int                    read_ahead_depth;            /* the maximum number of frames read ahead, 0 if disabled */
+    lw_video_read_ahead_t *read_ahead;                  /* started at the first request if enabled */
 };
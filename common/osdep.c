@@ -22,13 +22,26 @@
 
 #ifdef _WIN32
 #define _CRT_SECURE_NO_WARNINGS
+#if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+#undef  _WIN32_WINNT
+#define _WIN32_WINNT 0x0600     /* CONDITION_VARIABLE */
+#endif
 
 #include "osdep.h"
 #include "utils.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <io.h>
+#include <process.h>
+#include <string.h>
+#include <direct.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
 
 #include <windows.h>
+#include <psapi.h>
 
 int lw_string_to_wchar( int cp, const char *from, wchar_t **to )
 {
@@ -64,4 +77,547 @@ FILE *lw_win32_fopen( const char *name, const char *mode )
     return fp;
 }
 
+void *lw_map_file( FILE *fp, size_t *size )
+{
+    HANDLE file = (HANDLE)_get_osfhandle( _fileno( fp ) );
+    LARGE_INTEGER file_size;
+    if( file == INVALID_HANDLE_VALUE || !GetFileSizeEx( file, &file_size )
+     || file_size.QuadPart <= 0 || (uint64_t)file_size.QuadPart > SIZE_MAX )
+        return NULL;
+    HANDLE mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( !mapping )
+        return NULL;
+    /* The view keeps the mapping object alive, so the handle can be closed here. */
+    void *data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( mapping );
+    if( !data )
+        return NULL;
+    *size = (size_t)file_size.QuadPart;
+    return data;
+}
+
+void lw_unmap_file( void *data, size_t size )
+{
+    if( data )
+        UnmapViewOfFile( data );
+}
+
+int64_t lw_get_file_size( FILE *fp )
+{
+    struct _stati64 st;
+    if( _fstati64( _fileno( fp ), &st ) < 0 )
+        return -1;
+    return st.st_size;
+}
+
+int lw_truncate_file( FILE *fp, int64_t size )
+{
+    if( fflush( fp ) )
+        return -1;
+    return _chsize_s( _fileno( fp ), size ) ? -1 : 0;
+}
+
+int lw_fseek( FILE *fp, int64_t offset, int whence )
+{
+    return _fseeki64( fp, offset, whence ) ? -1 : 0;
+}
+
+int64_t lw_ftell( FILE *fp )
+{
+    return _ftelli64( fp );
+}
+
+int64_t lw_get_file_mtime( FILE *fp )
+{
+    struct _stati64 st;
+    if( _fstati64( _fileno( fp ), &st ) < 0 )
+        return -1;
+    return st.st_mtime;
+}
+
+int lw_touch_file( const char *name )
+{
+    wchar_t *wname = 0;
+    if( !lw_string_to_wchar( CP_UTF8, name, &wname ) )
+        return -1;
+    int ret = _wutime( wname, NULL ) ? -1 : 0;
+    lw_freep( &wname );
+    return ret;
+}
+
+int lw_remove_file( const char *name )
+{
+    wchar_t *wname = 0;
+    if( !lw_string_to_wchar( CP_UTF8, name, &wname ) )
+        return -1;
+    int ret = _wremove( wname ) ? -1 : 0;
+    lw_freep( &wname );
+    return ret;
+}
+
+int lw_make_directory( const char *name )
+{
+    wchar_t *wname = 0;
+    if( !lw_string_to_wchar( CP_UTF8, name, &wname ) )
+        return -1;
+    DWORD attributes = GetFileAttributesW( wname );
+    int ret = (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+           || _wmkdir( wname ) == 0 ? 0 : -1;
+    lw_freep( &wname );
+    return ret;
+}
+
+int lw_enumerate_files
+(
+    const char *dir,
+    const char *ext,
+    void      (*func)( void *arg, const char *path, int64_t size, int64_t mtime ),
+    void       *arg
+)
+{
+    size_t dir_length = strlen( dir );
+    char *pattern = (char *)lw_malloc_zero( dir_length + strlen( ext ) + 3 );
+    if( !pattern )
+        return -1;
+    sprintf( pattern, "%s\\*%s", dir, ext );
+    wchar_t *wpattern = 0;
+    int nc = lw_string_to_wchar( CP_UTF8, pattern, &wpattern );
+    lw_free( pattern );
+    if( !nc )
+        return -1;
+    WIN32_FIND_DATAW data;
+    HANDLE find = FindFirstFileW( wpattern, &data );
+    lw_freep( &wpattern );
+    if( find == INVALID_HANDLE_VALUE )
+        return GetLastError() == ERROR_FILE_NOT_FOUND ? 0 : -1;
+    do
+    {
+        char *name = 0;
+        if( (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || !lw_string_from_wchar( CP_UTF8, data.cFileName, &name ) )
+            continue;
+        char *path = (char *)lw_malloc_zero( dir_length + strlen( name ) + 2 );
+        if( path )
+        {
+            sprintf( path, "%s\\%s", dir, name );
+            /* FILETIME is in 100 nanoseconds since 1601-01-01. */
+            uint64_t mtime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+            func( arg, path, ((int64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow,
+                  (int64_t)(mtime / 10000000) - INT64_C(11644473600) );
+            lw_free( path );
+        }
+        lw_free( name );
+    } while( FindNextFileW( find, &data ) );
+    FindClose( find );
+    return 0;
+}
+
+struct lw_thread_tag
+{
+    HANDLE handle;
+    void *(*func)( void * );
+    void  *arg;
+    void  *ret;
+};
+
+struct lw_mutex_tag
+{
+    CRITICAL_SECTION cs;
+};
+
+struct lw_cond_tag
+{
+    CONDITION_VARIABLE cv;
+};
+
+static unsigned __stdcall thread_start( void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)arg;
+    thread->ret = thread->func( thread->arg );
+    return 0;
+}
+
+lw_thread_t *lw_thread_create( void *(*func)( void * ), void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)lw_malloc_zero( sizeof(lw_thread_t) );
+    if( !thread )
+        return NULL;
+    thread->func   = func;
+    thread->arg    = arg;
+    thread->handle = (HANDLE)_beginthreadex( NULL, 0, thread_start, thread, 0, NULL );
+    if( !thread->handle )
+    {
+        lw_free( thread );
+        return NULL;
+    }
+    return thread;
+}
+
+void *lw_thread_join( lw_thread_t *thread )
+{
+    if( !thread )
+        return NULL;
+    WaitForSingleObject( thread->handle, INFINITE );
+    CloseHandle( thread->handle );
+    void *ret = thread->ret;
+    lw_free( thread );
+    return ret;
+}
+
+lw_mutex_t *lw_mutex_create( void )
+{
+    lw_mutex_t *mutex = (lw_mutex_t *)lw_malloc_zero( sizeof(lw_mutex_t) );
+    if( mutex )
+        InitializeCriticalSection( &mutex->cs );
+    return mutex;
+}
+
+void lw_mutex_destroy( lw_mutex_t *mutex )
+{
+    if( !mutex )
+        return;
+    DeleteCriticalSection( &mutex->cs );
+    lw_free( mutex );
+}
+
+void lw_mutex_lock( lw_mutex_t *mutex )
+{
+    EnterCriticalSection( &mutex->cs );
+}
+
+void lw_mutex_unlock( lw_mutex_t *mutex )
+{
+    LeaveCriticalSection( &mutex->cs );
+}
+
+lw_cond_t *lw_cond_create( void )
+{
+    lw_cond_t *cond = (lw_cond_t *)lw_malloc_zero( sizeof(lw_cond_t) );
+    if( cond )
+        InitializeConditionVariable( &cond->cv );
+    return cond;
+}
+
+void lw_cond_destroy( lw_cond_t *cond )
+{
+    lw_free( cond );
+}
+
+void lw_cond_wait( lw_cond_t *cond, lw_mutex_t *mutex )
+{
+    SleepConditionVariableCS( &cond->cv, &mutex->cs, INFINITE );
+}
+
+void lw_cond_signal( lw_cond_t *cond )
+{
+    WakeConditionVariable( &cond->cv );
+}
+
+void lw_cond_broadcast( lw_cond_t *cond )
+{
+    WakeAllConditionVariable( &cond->cv );
+}
+
+int lw_get_cpu_count( void )
+{
+    SYSTEM_INFO si;
+    GetSystemInfo( &si );
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+}
+
+int64_t lw_get_wall_clock( void )
+{
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if( !QueryPerformanceFrequency( &frequency ) || !QueryPerformanceCounter( &counter ) )
+        return -1;
+    return (int64_t)(counter.QuadPart / frequency.QuadPart) * 1000000
+         + (int64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+}
+
+int64_t lw_get_thread_cpu_time( void )
+{
+    FILETIME creation_time;
+    FILETIME exit_time;
+    FILETIME kernel_time;
+    FILETIME user_time;
+    if( !GetThreadTimes( GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time ) )
+        return -1;
+    /* in 100-nanosecond units */
+    uint64_t kernel = ((uint64_t)kernel_time.dwHighDateTime << 32) | kernel_time.dwLowDateTime;
+    uint64_t user   = ((uint64_t)user_time.dwHighDateTime   << 32) | user_time.dwLowDateTime;
+    return (int64_t)((kernel + user) / 10);
+}
+
+int64_t lw_get_peak_memory_usage( void )
+{
+    /* Look up the function since it is in psapi.dll instead of kernel32.dll before Windows 7. */
+    typedef BOOL (WINAPI *get_process_memory_info_func)( HANDLE, PROCESS_MEMORY_COUNTERS *, DWORD );
+    get_process_memory_info_func func = (get_process_memory_info_func)GetProcAddress( GetModuleHandleW( L"kernel32.dll" ),
+                                                                                      "K32GetProcessMemoryInfo" );
+    PROCESS_MEMORY_COUNTERS pmc;
+    if( !func || !func( GetCurrentProcess(), &pmc, sizeof(pmc) ) )
+        return -1;
+    return (int64_t)pmc.PeakWorkingSetSize;
+}
+
+#else
+#define _POSIX_C_SOURCE 200112L  /* fileno(), fseeko(), ftruncate(), mmap(), munmap(), clock_gettime() and pthreads */
+
+#include "osdep.h"
+#include "utils.h"
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+void *lw_map_file( FILE *fp, size_t *size )
+{
+    struct stat st;
+    int fd = fileno( fp );
+    if( fd < 0 || fstat( fd, &st ) < 0 || st.st_size <= 0 || (uint64_t)st.st_size > SIZE_MAX )
+        return NULL;
+    void *data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if( data == MAP_FAILED )
+        return NULL;
+    *size = (size_t)st.st_size;
+    return data;
+}
+
+void lw_unmap_file( void *data, size_t size )
+{
+    if( data )
+        munmap( data, size );
+}
+
+int64_t lw_get_file_size( FILE *fp )
+{
+    struct stat st;
+    int fd = fileno( fp );
+    if( fd < 0 || fstat( fd, &st ) < 0 )
+        return -1;
+    return st.st_size;
+}
+
+int lw_truncate_file( FILE *fp, int64_t size )
+{
+    if( fflush( fp ) )
+        return -1;
+    return ftruncate( fileno( fp ), (off_t)size );
+}
+
+int lw_fseek( FILE *fp, int64_t offset, int whence )
+{
+    return fseeko( fp, (off_t)offset, whence ) ? -1 : 0;
+}
+
+int64_t lw_ftell( FILE *fp )
+{
+    return (int64_t)ftello( fp );
+}
+
+int64_t lw_get_file_mtime( FILE *fp )
+{
+    struct stat st;
+    int fd = fileno( fp );
+    if( fd < 0 || fstat( fd, &st ) < 0 )
+        return -1;
+    return st.st_mtime;
+}
+
+int lw_touch_file( const char *name )
+{
+    return utime( name, NULL );
+}
+
+int lw_remove_file( const char *name )
+{
+    return remove( name ) ? -1 : 0;
+}
+
+int lw_make_directory( const char *name )
+{
+    return mkdir( name, 0777 ) == 0 || errno == EEXIST ? 0 : -1;
+}
+
+int lw_enumerate_files
+(
+    const char *dir,
+    const char *ext,
+    void      (*func)( void *arg, const char *path, int64_t size, int64_t mtime ),
+    void       *arg
+)
+{
+    DIR *dp = opendir( dir );
+    if( !dp )
+        return -1;
+    size_t dir_length = strlen( dir );
+    size_t ext_length = strlen( ext );
+    struct dirent *entry;
+    while( (entry = readdir( dp )) != NULL )
+    {
+        size_t name_length = strlen( entry->d_name );
+        if( name_length < ext_length || strcmp( entry->d_name + name_length - ext_length, ext ) )
+            continue;
+        char *path = (char *)lw_malloc_zero( dir_length + name_length + 2 );
+        if( !path )
+            continue;
+        sprintf( path, "%s/%s", dir, entry->d_name );
+        struct stat st;
+        if( stat( path, &st ) == 0 && S_ISREG( st.st_mode ) )
+            func( arg, path, st.st_size, st.st_mtime );
+        lw_free( path );
+    }
+    closedir( dp );
+    return 0;
+}
+
+struct lw_thread_tag
+{
+    pthread_t handle;
+};
+
+struct lw_mutex_tag
+{
+    pthread_mutex_t mutex;
+};
+
+struct lw_cond_tag
+{
+    pthread_cond_t cond;
+};
+
+lw_thread_t *lw_thread_create( void *(*func)( void * ), void *arg )
+{
+    lw_thread_t *thread = (lw_thread_t *)lw_malloc_zero( sizeof(lw_thread_t) );
+    if( !thread )
+        return NULL;
+    if( pthread_create( &thread->handle, NULL, func, arg ) )
+    {
+        lw_free( thread );
+        return NULL;
+    }
+    return thread;
+}
+
+void *lw_thread_join( lw_thread_t *thread )
+{
+    if( !thread )
+        return NULL;
+    void *ret = NULL;
+    pthread_join( thread->handle, &ret );
+    lw_free( thread );
+    return ret;
+}
+
+lw_mutex_t *lw_mutex_create( void )
+{
+    lw_mutex_t *mutex = (lw_mutex_t *)lw_malloc_zero( sizeof(lw_mutex_t) );
+    if( mutex && pthread_mutex_init( &mutex->mutex, NULL ) )
+        lw_freep( &mutex );
+    return mutex;
+}
+
+void lw_mutex_destroy( lw_mutex_t *mutex )
+{
+    if( !mutex )
+        return;
+    pthread_mutex_destroy( &mutex->mutex );
+    lw_free( mutex );
+}
+
+void lw_mutex_lock( lw_mutex_t *mutex )
+{
+    pthread_mutex_lock( &mutex->mutex );
+}
+
+void lw_mutex_unlock( lw_mutex_t *mutex )
+{
+    pthread_mutex_unlock( &mutex->mutex );
+}
+
+lw_cond_t *lw_cond_create( void )
+{
+    lw_cond_t *cond = (lw_cond_t *)lw_malloc_zero( sizeof(lw_cond_t) );
+    if( cond && pthread_cond_init( &cond->cond, NULL ) )
+        lw_freep( &cond );
+    return cond;
+}
+
+void lw_cond_destroy( lw_cond_t *cond )
+{
+    if( !cond )
+        return;
+    pthread_cond_destroy( &cond->cond );
+    lw_free( cond );
+}
+
+void lw_cond_wait( lw_cond_t *cond, lw_mutex_t *mutex )
+{
+    pthread_cond_wait( &cond->cond, &mutex->mutex );
+}
+
+void lw_cond_signal( lw_cond_t *cond )
+{
+    pthread_cond_signal( &cond->cond );
+}
+
+void lw_cond_broadcast( lw_cond_t *cond )
+{
+    pthread_cond_broadcast( &cond->cond );
+}
+
+int lw_get_cpu_count( void )
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf( _SC_NPROCESSORS_ONLN );
+    return count > 0 ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+int64_t lw_get_wall_clock( void )
+{
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    if( clock_gettime( CLOCK_MONOTONIC, &ts ) < 0 )
+#else
+    if( clock_gettime( CLOCK_REALTIME, &ts ) < 0 )
+#endif
+        return -1;
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t lw_get_thread_cpu_time( void )
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if( clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) < 0 )
+        return -1;
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+    return -1;
+#endif
+}
+
+int64_t lw_get_peak_memory_usage( void )
+{
+    struct rusage usage;
+    if( getrusage( RUSAGE_SELF, &usage ) < 0 )
+        return -1;
+#ifdef __APPLE__
+    return (int64_t)usage.ru_maxrss;            /* in bytes */
+#else
+    return (int64_t)usage.ru_maxrss * 1024;     /* in kilobytes */
+#endif
+}
+
 #endif
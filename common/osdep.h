@@ -37,4 +37,64 @@
    int lw_string_from_wchar( int cp, const wchar_t *from, char **to );
 #endif
 
+#include <stdio.h>
+/* Map the whole file opened as fp onto memory for read only access.
+ * Return the address of the mapped memory and set its size to *size on success.
+ * Otherwise return NULL. */
+void *lw_map_file( FILE *fp, size_t *size );
+void lw_unmap_file( void *data, size_t size );
+
+#include <stdint.h>
+/* Return the size of the file opened as fp, or -1 on failure. */
+int64_t lw_get_file_size( FILE *fp );
+/* Flush fp and cut off the file at size. Return 0 on success, otherwise -1. */
+int lw_truncate_file( FILE *fp, int64_t size );
+/* Same as fseek() except for 64-bit offset. Return 0 on success, otherwise -1. */
+int lw_fseek( FILE *fp, int64_t offset, int whence );
+/* Same as ftell() except for 64-bit offset. Return -1 on failure. */
+int64_t lw_ftell( FILE *fp );
+/* Return the last modification time in seconds of the file opened as fp, or -1 on failure. */
+int64_t lw_get_file_mtime( FILE *fp );
+/* Set the last access and modification time of the file to the current time. Return 0 on success, otherwise -1. */
+int lw_touch_file( const char *name );
+/* Return 0 on success, otherwise -1. */
+int lw_remove_file( const char *name );
+/* Create the directory unless it exists. Return 0 on success, otherwise -1. */
+int lw_make_directory( const char *name );
+/* Call func for each file in the directory dir whose name ends with ext.
+ * The path, the size and the last modification time in seconds of the file are passed to func.
+ * Return 0 on success, otherwise -1. */
+int lw_enumerate_files
+(
+    const char *dir,
+    const char *ext,
+    void      (*func)( void *arg, const char *path, int64_t size, int64_t mtime ),
+    void       *arg
+);
+
+/* Minimal threading primitives.
+ * Every create function returns NULL on failure. */
+typedef struct lw_thread_tag lw_thread_t;
+typedef struct lw_mutex_tag  lw_mutex_t;
+typedef struct lw_cond_tag   lw_cond_t;
+lw_thread_t *lw_thread_create( void *(*func)( void * ), void *arg );
+void *lw_thread_join( lw_thread_t *thread );
+lw_mutex_t *lw_mutex_create( void );
+void lw_mutex_destroy( lw_mutex_t *mutex );
+void lw_mutex_lock( lw_mutex_t *mutex );
+void lw_mutex_unlock( lw_mutex_t *mutex );
+lw_cond_t *lw_cond_create( void );
+void lw_cond_destroy( lw_cond_t *cond );
+void lw_cond_wait( lw_cond_t *cond, lw_mutex_t *mutex );
+void lw_cond_signal( lw_cond_t *cond );
+void lw_cond_broadcast( lw_cond_t *cond );
+/* Return the number of logical processors available. */
+int lw_get_cpu_count( void );
+/* Return the time in microseconds elapsed since an arbitrary point, or -1 on failure. */
+int64_t lw_get_wall_clock( void );
+/* Return the CPU time in microseconds consumed by the calling thread, or -1 if unavailable. */
+int64_t lw_get_thread_cpu_time( void );
+/* Return the peak resident memory in bytes of the process so far, or -1 if unavailable. */
+int64_t lw_get_peak_memory_usage( void );
+
 #endif
@@ -249,3 +249,128 @@ const char **lw_tokenize_string
         }
     return (const char **)tokens;
 }
+
+typedef struct
+{
+    uint64_t key;       /* sort key biased so that unsigned order matches signed order */
+    uint32_t index;     /* position of the record before sort */
+} lw_sort_pair_t;
+
+static inline int64_t get_record_key
+(
+    const uint8_t *records,
+    uint32_t       index,
+    size_t         size,
+    size_t         key_offset
+)
+{
+    int64_t key;
+    memcpy( &key, records + index * size + key_offset, sizeof(int64_t) );
+    return key;
+}
+
+/* Sort the pairs by insertion sort unless it moves more pairs than the limit.
+ * Return 0 if sorted, otherwise -1. The pairs stay in the same order for equal keys even if given up. */
+static int insertion_sort_pairs
+(
+    lw_sort_pair_t *pair,
+    uint32_t        count,
+    uint64_t        limit
+)
+{
+    uint64_t moves = 0;
+    for( uint32_t i = 1; i < count; i++ )
+    {
+        if( pair[i - 1].key <= pair[i].key )
+            continue;
+        lw_sort_pair_t p = pair[i];
+        uint32_t       j = i;
+        do
+        {
+            pair[j] = pair[j - 1];
+            --j;
+        } while( j > 0 && pair[j - 1].key > p.key );
+        pair[j] = p;
+        moves += i - j;
+        if( moves > limit )
+            return -1;
+    }
+    return 0;
+}
+
+/* Sort the records of size bytes by the int64_t key at key_offset of each record in ascending order.
+ * The (key, index) pairs are sorted, and then the records are gathered in the sorted order at once.
+ * The pairs displaced by a few positions, like timestamps reordered by B-frames, are sorted by insertion sort,
+ * otherwise by LSD radix sort in 8 bit digits, skipping the digits shared by all keys.
+ * Return 0 on success or if already sorted, otherwise -1 due to memory allocation failure. */
+int lw_sort_records
+(
+    void    *records,
+    uint32_t count,
+    size_t   size,
+    size_t   key_offset
+)
+{
+    uint8_t *base = (uint8_t *)records;
+    /* Timestamps in decoding order and sample numbers are usually sorted already. */
+    uint32_t i = 1;
+    while( i < count && get_record_key( base, i - 1, size, key_offset ) <= get_record_key( base, i, size, key_offset ) )
+        ++i;
+    if( i >= count )
+        return 0;
+    lw_sort_pair_t *pair = (lw_sort_pair_t *)malloc( 2 * (size_t)count * sizeof(lw_sort_pair_t) );
+    uint8_t        *temp = (uint8_t *)malloc( (size_t)count * size );
+    if( !pair || !temp )
+    {
+        free( pair );
+        free( temp );
+        return -1;
+    }
+    for( i = 0; i < count; i++ )
+    {
+        pair[i].key   = (uint64_t)get_record_key( base, i, size, key_offset ) ^ (UINT64_C(1) << 63);
+        pair[i].index = i;
+    }
+    lw_sort_pair_t *src = pair;
+    if( insertion_sort_pairs( pair, count, 4 * (uint64_t)count ) < 0 )
+    {
+        uint32_t (*histogram)[256] = (uint32_t (*)[256])lw_malloc_zero( 8 * 256 * sizeof(uint32_t) );
+        if( !histogram )
+        {
+            free( pair );
+            free( temp );
+            return -1;
+        }
+        for( i = 0; i < count; i++ )
+            for( int digit = 0; digit < 8; digit++ )
+                ++histogram[digit][(pair[i].key >> (digit * 8)) & 0xff];
+        lw_sort_pair_t *dst = pair + count;
+        for( int digit = 0; digit < 8; digit++ )
+        {
+            uint32_t *bucket = histogram[digit];
+            int shift = digit * 8;
+            if( bucket[(src[0].key >> shift) & 0xff] == count )
+                continue;   /* This digit is the same for all keys. */
+            uint32_t offset = 0;
+            for( int j = 0; j < 256; j++ )
+            {
+                uint32_t n = bucket[j];
+                bucket[j] = offset;
+                offset += n;
+            }
+            for( i = 0; i < count; i++ )
+                dst[ bucket[(src[i].key >> shift) & 0xff]++ ] = src[i];
+            lw_sort_pair_t *swap = src;
+            src = dst;
+            dst = swap;
+        }
+        free( histogram );
+    }
+    /* Here, src[i].index is the position of the record to be placed at i. */
+    for( i = 0; i < count; i++ )
+        memcpy( temp + (size_t)i * size, base + (size_t)src[i].index * size, size );
+    memcpy( base, temp, (size_t)count * size );
+    free( pair );
+    free( temp );
+    return 0;
+}
@@ -135,3 +135,13 @@ int lw_try_rational_framerate
     int64_t *framerate_den,
     uint64_t timebase
 );
+
+/* Sort the records of size bytes by the int64_t key at key_offset of each record in ascending order.
+ * Return 0 on success, otherwise -1 due to memory allocation failure. */
+int lw_sort_records
+(
+    void    *records,
+    uint32_t count,
+    size_t   size,
+    size_t   key_offset
+);
@@ -34,8 +34,408 @@ extern "C"
 #endif  /* __cplusplus */
 
 #include "utils.h"
+#include "osdep.h"
 #include "video_output.h"
 
+AVFrame *lw_video_frame_cache_get
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number
+)
+{
+    for( int i = 0; i < cache->count; i++ )
+        if( cache->entries[i].frame_number == frame_number )
+        {
+            cache->entries[i].last_use = ++cache->use_count;
+            return cache->entries[i].frame;
+        }
+    return NULL;
+}
+
+static void remove_cached_frame
+(
+    lw_video_frame_cache_t *cache,
+    int                     index
+)
+{
+    lw_video_frame_cache_entry_t *entry = &cache->entries[index];
+    cache->size -= entry->size;
+    av_frame_free( &entry->frame );
+    *entry = cache->entries[ --cache->count ];
+}
+
+void lw_video_frame_cache_put
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number,
+    const AVFrame          *frame,
+    int64_t                 pts
+)
+{
+    if( cache->budget == 0 || lw_video_frame_cache_get( cache, frame_number ) )
+        return;
+    AVFrame *clone = av_frame_clone( frame );
+    if( !clone )
+        return;
+    clone->pts = pts;
+    size_t size = 0;
+    for( int i = 0; i < AV_NUM_DATA_POINTERS && clone->buf[i]; i++ )
+        size += clone->buf[i]->size;
+    if( size > cache->budget )
+    {
+        av_frame_free( &clone );
+        return;
+    }
+    /* Discard the least recently used frames until the new frame fits within the budget. */
+    while( cache->count > 0 && cache->size + size > cache->budget )
+    {
+        int lru = 0;
+        for( int i = 1; i < cache->count; i++ )
+            if( cache->entries[i].last_use < cache->entries[lru].last_use )
+                lru = i;
+        remove_cached_frame( cache, lru );
+    }
+    if( cache->count == cache->capacity )
+    {
+        int capacity = cache->capacity ? 2 * cache->capacity : 16;
+        lw_video_frame_cache_entry_t *temp = (lw_video_frame_cache_entry_t *)realloc( cache->entries, capacity * sizeof(lw_video_frame_cache_entry_t) );
+        if( !temp )
+        {
+            av_frame_free( &clone );
+            return;
+        }
+        cache->entries  = temp;
+        cache->capacity = capacity;
+    }
+    lw_video_frame_cache_entry_t *entry = &cache->entries[ cache->count++ ];
+    entry->frame        = clone;
+    entry->frame_number = frame_number;
+    entry->size         = size;
+    entry->last_use     = ++cache->use_count;
+    cache->size += size;
+}
+
+int lw_video_frame_cache_output
+(
+    lw_video_frame_cache_t *cache,
+    AVFrame                *frame_buffer,
+    const AVFrame          *cached_frame
+)
+{
+    if( !cache->stashed )
+    {
+        if( !cache->stash && !(cache->stash = av_frame_alloc()) )
+            return -1;
+        av_frame_move_ref( cache->stash, frame_buffer );
+        cache->stashed = 1;
+    }
+    else
+        av_frame_unref( frame_buffer );
+    return av_frame_ref( frame_buffer, cached_frame );
+}
+
+void lw_video_frame_cache_restore
+(
+    lw_video_frame_cache_t *cache,
+    AVFrame                *frame_buffer
+)
+{
+    if( !cache->stashed )
+        return;
+    av_frame_unref( frame_buffer );
+    av_frame_move_ref( frame_buffer, cache->stash );
+    cache->stashed = 0;
+}
+
+void lw_video_frame_cache_cleanup
+(
+    lw_video_frame_cache_t *cache
+)
+{
+    while( cache->count > 0 )
+        remove_cached_frame( cache, cache->count - 1 );
+    lw_freep( &cache->entries );
+    av_frame_free( &cache->stash );
+    cache->capacity = 0;
+    cache->stashed  = 0;
+}
+
+struct lw_video_read_ahead_tag
+{
+    lw_video_read_ahead_decode_func *decode;
+    void                            *handler;
+    uint32_t                         frame_count;
+    int                              depth;
+    /* The frames read ahead are queued in a ring buffer in ascending order of frame numbers. */
+    AVFrame                        **queue;
+    int                              head;
+    int                              count;
+    uint32_t                         first_number;      /* the number of the frame at the head of the queue */
+    uint32_t                         next_number;       /* the number of the frame the worker decodes next */
+    uint32_t                         output_number;     /* the number of the frame output at the last request, 0 if none */
+    int                              active;            /* Set to non-zero while the worker is allowed to read ahead. */
+    int                              busy;              /* Set to non-zero while the worker is decoding. */
+    int                              destroy;
+    AVFrame                         *work;              /* the frame buffer to which the decoder outputs */
+    lw_thread_t                     *thread;
+    lw_mutex_t                      *mutex;             /* the lock of the above */
+    lw_cond_t                       *cond;
+    lw_mutex_t                      *decoder_lock;
+    /* Logging */
+    lw_log_handler_t                 user_lh;
+    lw_log_level                     deferred_level;
+    int                              deferred;
+    char                             deferred_message[1024];
+};
+
+/* Keep the most severe message until the end of the request. */
+static void read_ahead_defer_log
+(
+    lw_log_handler_t *lhp,
+    lw_log_level      level,
+    const char       *message
+)
+{
+    lw_video_read_ahead_t *ra = (lw_video_read_ahead_t *)lhp->priv;
+    lw_mutex_lock( ra->mutex );
+    if( !ra->deferred || level > ra->deferred_level )
+    {
+        ra->deferred       = 1;
+        ra->deferred_level = level;
+        strncpy( ra->deferred_message, message, sizeof(ra->deferred_message) - 1 );
+        ra->deferred_message[ sizeof(ra->deferred_message) - 1 ] = '\0';
+    }
+    lw_mutex_unlock( ra->mutex );
+}
+
+static void *read_ahead_worker
+(
+    void *arg
+)
+{
+    lw_video_read_ahead_t *ra = (lw_video_read_ahead_t *)arg;
+    lw_mutex_lock( ra->mutex );
+    while( !ra->destroy )
+    {
+        if( !ra->active || ra->count >= ra->depth || ra->next_number > ra->frame_count )
+        {
+            lw_cond_wait( ra->cond, ra->mutex );
+            continue;
+        }
+        uint32_t frame_number = ra->next_number;
+        ra->busy = 1;
+        lw_mutex_unlock( ra->mutex );
+        lw_mutex_lock( ra->decoder_lock );
+        int ret = ra->decode( ra->handler, ra->work, frame_number );
+        lw_mutex_lock( ra->mutex );
+        ra->busy = 0;
+        if( ret == 0 && ra->active && frame_number == ra->next_number )
+        {
+            AVFrame *frame = ra->queue[ (ra->head + ra->count) % ra->depth ];
+            av_frame_unref( frame );
+            if( av_frame_ref( frame, ra->work ) == 0 )
+            {
+                ++ ra->count;
+                ++ ra->next_number;
+            }
+            else
+                ra->active = 0;
+        }
+        else
+            /* Leave the failed frame to the caller, which decodes it by itself and gets the error. */
+            ra->active = 0;
+        lw_mutex_unlock( ra->decoder_lock );
+        lw_cond_broadcast( ra->cond );
+    }
+    lw_mutex_unlock( ra->mutex );
+    return NULL;
+}
+
+lw_video_read_ahead_t *lw_video_read_ahead_create
+(
+    int                              depth,
+    uint32_t                         frame_count,
+    lw_video_read_ahead_decode_func *decode,
+    void                            *handler,
+    lw_log_handler_t                *lhp
+)
+{
+    lw_video_read_ahead_t *ra = (lw_video_read_ahead_t *)lw_malloc_zero( sizeof(lw_video_read_ahead_t) );
+    if( !ra )
+        return NULL;
+    ra->decode      = decode;
+    ra->handler     = handler;
+    ra->frame_count = frame_count;
+    ra->depth       = depth;
+    ra->queue = (AVFrame **)lw_malloc_zero( depth * sizeof(AVFrame *) );
+    if( !ra->queue )
+        goto fail;
+    for( int i = 0; i < depth; i++ )
+        if( !(ra->queue[i] = av_frame_alloc()) )
+            goto fail;
+    ra->work         = av_frame_alloc();
+    ra->mutex        = lw_mutex_create();
+    ra->cond         = lw_cond_create();
+    ra->decoder_lock = lw_mutex_create();
+    if( !ra->work || !ra->mutex || !ra->cond || !ra->decoder_lock )
+        goto fail;
+    /* Every message goes through the read-ahead, which applies the level of the user. */
+    ra->user_lh   = *lhp;
+    lhp->level    = LW_LOG_INFO;
+    lhp->priv     = ra;
+    lhp->show_log = read_ahead_defer_log;
+    return ra;
+fail:
+    lw_video_read_ahead_destroy( ra );
+    return NULL;
+}
+
+void lw_video_read_ahead_destroy
+(
+    lw_video_read_ahead_t *ra
+)
+{
+    if( !ra )
+        return;
+    if( ra->thread )
+    {
+        lw_mutex_lock( ra->mutex );
+        ra->destroy = 1;
+        lw_cond_broadcast( ra->cond );
+        lw_mutex_unlock( ra->mutex );
+        lw_thread_join( ra->thread );
+    }
+    if( ra->queue )
+    {
+        for( int i = 0; i < ra->depth; i++ )
+            av_frame_free( &ra->queue[i] );
+        lw_free( ra->queue );
+    }
+    av_frame_free( &ra->work );
+    if( ra->decoder_lock )
+        lw_mutex_destroy( ra->decoder_lock );
+    if( ra->cond )
+        lw_cond_destroy( ra->cond );
+    if( ra->mutex )
+        lw_mutex_destroy( ra->mutex );
+    lw_free( ra );
+}
+
+lw_log_handler_t *lw_video_read_ahead_get_log_handler
+(
+    lw_video_read_ahead_t *ra
+)
+{
+    return &ra->user_lh;
+}
+
+static void pop_read_ahead_frame
+(
+    lw_video_read_ahead_t *ra
+)
+{
+    av_frame_unref( ra->queue[ ra->head ] );
+    ra->head = (ra->head + 1) % ra->depth;
+    -- ra->count;
+    ++ ra->first_number;
+}
+
+int lw_video_read_ahead_get_frame
+(
+    lw_video_read_ahead_t *ra,
+    AVFrame               *frame_buffer,
+    uint32_t               frame_number
+)
+{
+    int      ret;
+    uint32_t last_output_number;
+    lw_mutex_lock( ra->mutex );
+    last_output_number = ra->output_number;
+    if( frame_number == last_output_number )
+    {
+        ret = 1;
+        goto done;
+    }
+    if( ra->active && frame_number >= ra->first_number && frame_number <= ra->next_number )
+    {
+        /* The requested frame is read ahead or being read ahead. Skipped frames are just discarded. */
+        while( ra->count > 0 && ra->first_number < frame_number )
+            pop_read_ahead_frame( ra );
+        lw_cond_broadcast( ra->cond );
+        while( ra->count == 0 && ra->active && ra->next_number <= ra->frame_count )
+            lw_cond_wait( ra->cond, ra->mutex );
+        if( ra->count > 0 )
+        {
+            av_frame_unref( frame_buffer );
+            av_frame_move_ref( frame_buffer, ra->queue[ ra->head ] );
+            pop_read_ahead_frame( ra );
+            ra->output_number = frame_number;
+            lw_cond_broadcast( ra->cond );
+            ret = 0;
+            goto done;
+        }
+    }
+    /* Stop reading ahead and decode the requested frame here. */
+    ra->active = 0;
+    while( ra->busy )
+        lw_cond_wait( ra->cond, ra->mutex );
+    while( ra->count > 0 )
+        pop_read_ahead_frame( ra );
+    ra->output_number = 0;
+    lw_mutex_unlock( ra->mutex );
+    lw_mutex_lock( ra->decoder_lock );
+    ret = ra->decode( ra->handler, ra->work, frame_number );
+    if( ret == 0 )
+    {
+        av_frame_unref( frame_buffer );
+        ret = av_frame_ref( frame_buffer, ra->work ) < 0 ? -1 : 0;
+    }
+    lw_mutex_unlock( ra->decoder_lock );
+    lw_mutex_lock( ra->mutex );
+    if( ret < 0 )
+        goto done;
+    ra->output_number = frame_number;
+    if( frame_number == last_output_number + 1 && frame_number < ra->frame_count )
+    {
+        /* Sequential access is detected, so read the following frames ahead. */
+        ra->first_number = frame_number + 1;
+        ra->next_number  = frame_number + 1;
+        ra->active       = 1;
+        if( !ra->thread && !(ra->thread = lw_thread_create( read_ahead_worker, ra )) )
+            ra->active = 0;
+        lw_cond_broadcast( ra->cond );
+    }
+done:;
+    /* Show the message kept until here since the user might not return from showing it. */
+    lw_log_level level   = ra->deferred_level;
+    int          show    = ra->deferred;
+    char         message[sizeof(ra->deferred_message)];
+    if( show )
+        memcpy( message, ra->deferred_message, sizeof(message) );
+    ra->deferred = 0;
+    lw_mutex_unlock( ra->mutex );
+    lw_log_handler_t *lhp = &ra->user_lh;
+    if( show && lhp->priv && lhp->show_log && level >= lhp->level )
+        lhp->show_log( lhp, level, message );
+    return ret;
+}
+
+void lw_video_read_ahead_lock_decoder
+(
+    lw_video_read_ahead_t *ra
+)
+{
+    lw_mutex_lock( ra->decoder_lock );
+}
+
+void lw_video_read_ahead_unlock_decoder
+(
+    lw_video_read_ahead_t *ra
+)
+{
+    lw_mutex_unlock( ra->decoder_lock );
+}
+
 /* If YUV is treated as full range, return 1.
  * Otherwise, return 0. */
 int avoid_yuv_scale_conversion( enum AVPixelFormat *pixel_format )
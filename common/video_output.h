@@ -69,6 +69,134 @@ typedef struct
     void (*free_private_handler)( void *private_handler );
 } lw_video_output_handler_t;
 
+/* Decoded frame cache
+ * Decoded frames are kept with their frame numbers by reference until the total size of their buffers exceeds the budget.
+ * Then, the least recently used frames are discarded. */
+typedef struct
+{
+    AVFrame  *frame;
+    uint32_t  frame_number;
+    size_t    size;
+    uint64_t  last_use;
+} lw_video_frame_cache_entry_t;
+
+typedef struct
+{
+    size_t                        budget;   /* the maximum total size in bytes; 0 disables the cache */
+    size_t                        size;     /* the current total size in bytes */
+    int                           count;
+    int                           capacity;
+    uint64_t                      use_count;
+    lw_video_frame_cache_entry_t *entries;
+    /* The frame buffer filled with a cached frame lends its previous content to the stash,
+     * since the decoder handler might still expect that content. */
+    AVFrame                      *stash;
+    int                           stashed;
+} lw_video_frame_cache_t;
+
+/* Return the cached frame of the frame number, or NULL if not cached.
+ * The returned frame is still owned by the cache. */
+AVFrame *lw_video_frame_cache_get
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number
+);
+
+/* Add a reference to the frame with the presentation timestamp pts into the cache.
+ * Nothing is done if the cache is disabled or the frame number is already cached. */
+void lw_video_frame_cache_put
+(
+    lw_video_frame_cache_t *cache,
+    uint32_t                frame_number,
+    const AVFrame          *frame,
+    int64_t                 pts
+);
+
+/* Make the frame buffer refer to the cached frame.
+ * The previous content of the frame buffer is stashed unless another is already stashed.
+ * Return 0 on success, otherwise a negative value. */
+int lw_video_frame_cache_output
+(
+    lw_video_frame_cache_t *cache,
+    AVFrame                *frame_buffer,
+    const AVFrame          *cached_frame
+);
+
+/* Give the stashed content back to the frame buffer if any. */
+void lw_video_frame_cache_restore
+(
+    lw_video_frame_cache_t *cache,
+    AVFrame                *frame_buffer
+);
+
+void lw_video_frame_cache_cleanup
+(
+    lw_video_frame_cache_t *cache
+);
+
+/* Read-ahead of decoded frames for sequential access
+ * Once frames are requested in order, a worker thread decodes the following frames in advance and keeps up to
+ * the depth of them, so that decoding overlaps with the processing of the caller between requests.
+ * The worker and the caller never decode at the same time, and the decoder outputs only to the frame buffer
+ * owned by the read-ahead. The caller can take the decoder lock to access the decode handler safely.
+ * The log handler of the decode handler is taken over to forward messages to the caller at the end of requests
+ * since no message can be shown from the worker thread or while any lock is held. */
+typedef struct lw_video_read_ahead_tag lw_video_read_ahead_t;
+
+/* Decode the frame of frame_number into frame.
+ * Return 0 on success, otherwise a negative value. */
+typedef int lw_video_read_ahead_decode_func
+(
+    void     *handler,
+    AVFrame  *frame,
+    uint32_t  frame_number
+);
+
+/* lhp is the log handler used by handler, whose content is moved to the read-ahead.
+ * Return NULL on failure. */
+lw_video_read_ahead_t *lw_video_read_ahead_create
+(
+    int                              depth,
+    uint32_t                         frame_count,
+    lw_video_read_ahead_decode_func *decode,
+    void                            *handler,
+    lw_log_handler_t                *lhp
+);
+
+/* Stop the worker thread and then free the read-ahead. */
+void lw_video_read_ahead_destroy
+(
+    lw_video_read_ahead_t *ra
+);
+
+/* Return the log handler to which messages are forwarded. */
+lw_log_handler_t *lw_video_read_ahead_get_log_handler
+(
+    lw_video_read_ahead_t *ra
+);
+
+/* Make the frame buffer refer to the frame of frame_number, which is taken from the frames read ahead if available,
+ * otherwise decoded here.
+ * Return 0 on success.
+ * Return 1 if the frame buffer has been referring to the frame since the last call.
+ * Return a negative value otherwise. */
+int lw_video_read_ahead_get_frame
+(
+    lw_video_read_ahead_t *ra,
+    AVFrame               *frame_buffer,
+    uint32_t               frame_number
+);
+
+void lw_video_read_ahead_lock_decoder
+(
+    lw_video_read_ahead_t *ra
+);
+
+void lw_video_read_ahead_unlock_decoder
+(
+    lw_video_read_ahead_t *ra
+);
+
 int avoid_yuv_scale_conversion( enum AVPixelFormat *pixel_format );
 
 void setup_video_rendering